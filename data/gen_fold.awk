@@ -0,0 +1,68 @@
+# gen_fold.awk
+#
+# Generate the case folding and decomposition tables (src/fold_table.h)
+# used by fold.c from data/unicode_fold.txt.
+#
+# Usage: awk -f data/gen_fold.awk data/unicode_fold.txt > src/fold_table.h
+
+function hex(s,    i, n) {
+	n = 0
+	for (i = 1; i <= length(s); i++)
+		n = n * 16 + index("0123456789ABCDEF", toupper(substr(s, i, 1))) - 1
+	return n
+}
+
+BEGIN {
+	FS = "[.;]+"
+	print "/* fold_table.h */"
+	print ""
+	print "/* Generated by data/gen_fold.awk from data/unicode_fold.txt."
+	print " * Do not edit. */"
+	print ""
+	print "#ifndef FOLD_TABLE_H"
+	print "#define FOLD_TABLE_H"
+	print ""
+	folds = 0
+	decomps = 0
+}
+
+/^F;/ {
+	fold[folds++] = sprintf("\t{0x%s, 0x%s, %d, %d, %d},", $2, $3, $4, $5, $6)
+	for (cp = hex($2); cp <= hex($3) && cp < 2048; cp += $5)
+		short[cp] = cp + $4
+}
+
+/^D;/ {
+	split($3, cps, " ")
+	decomp[decomps++] = sprintf("\t{0x%s, 0x%s, 0x%s},", $2, cps[1],
+		(2 in cps) ? cps[2] : "0")
+}
+
+END {
+	print "static const struct fold_range fold_table[] = {"
+	for (i = 0; i < folds; i++)
+		print fold[i]
+	print "};"
+	print ""
+	printf "#define FOLD_TABLE_SIZE %d\n", folds
+	print ""
+	print "/* What the code points from U+0080 to U+07FF fold to */"
+	print "static const uint16_t fold_table_short[] = {"
+	for (cp = 128; cp < 2048; cp += 8) {
+		line = "\t"
+		for (i = cp; i < cp + 8; i++)
+			line = line sprintf("0x%04X,%s", (i in short) ? short[i] : i,
+				i < cp + 7 ? " " : "")
+		print line
+	}
+	print "};"
+	print ""
+	print "static const struct decomposition decomp_table[] = {"
+	for (i = 0; i < decomps; i++)
+		print decomp[i]
+	print "};"
+	print ""
+	printf "#define DECOMP_TABLE_SIZE %d\n", decomps
+	print ""
+	print "#endif /* FOLD_TABLE_H */"
+}
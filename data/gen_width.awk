@@ -0,0 +1,33 @@
+# gen_width.awk
+#
+# Generate the code point width table (src/width_table.h) used by utf8.c
+# from data/unicode_width.txt.
+#
+# Usage: awk -f data/gen_width.awk data/unicode_width.txt > src/width_table.h
+
+BEGIN {
+	FS = "[.;]+"
+	print "/* width_table.h */"
+	print ""
+	print "/* Generated by data/gen_width.awk from data/unicode_width.txt."
+	print " * Do not edit. */"
+	print ""
+	print "#ifndef WIDTH_TABLE_H"
+	print "#define WIDTH_TABLE_H"
+	print ""
+	print "static const struct width_range width_table[] = {"
+	n = 0
+}
+
+/^[0-9A-Fa-f]/ {
+	printf "\t{0x%s, 0x%s, %d},\n", $1, $2, $3
+	n++
+}
+
+END {
+	print "};"
+	print ""
+	printf "#define WIDTH_TABLE_SIZE %d\n", n
+	print ""
+	print "#endif /* WIDTH_TABLE_H */"
+}
@@ -0,0 +1,195 @@
+/* ansi.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+/* Colored input (--ansi).
+ *
+ * SGR sequences are removed from each candidate when it is loaded, so that
+ * matching, scoring, and measuring only ever see plain text. Where each
+ * sequence was is recorded as a span (offset into the plain text, and
+ * attribute), which is all the interface needs to restore the colors.
+ * Attributes are stored once: input colored by ls(1) or rg(1) uses only a
+ * handful of different sequences. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ansi.h"
+#include "choices.h" /* safe_realloc() */
+
+#define ESC 27
+#define INITIAL_SPANS_CAPACITY 256
+#define INITIAL_TABLE_SIZE 64 /* Must be a power of two */
+#define EMPTY_SLOT UINT32_MAX
+
+/* FNV-1a */
+static uint32_t
+hash_str(const char *s, const size_t len)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static void
+table_insert(ansi_t *ansi, const uint32_t attr)
+{
+	const char *s = ansi->attrs[attr];
+	const size_t mask = ansi->table_size - 1;
+	size_t i = hash_str(s, strlen(s)) & mask;
+
+	while (ansi->table[i] != EMPTY_SLOT)
+		i = (i + 1) & mask;
+
+	ansi->table[i] = attr;
+}
+
+static void
+table_grow(ansi_t *ansi)
+{
+	free(ansi->table);
+	ansi->table_size = ansi->table_size ? ansi->table_size * 2
+		: INITIAL_TABLE_SIZE;
+	ansi->table = safe_realloc(NULL, ansi->table_size * sizeof(uint32_t));
+	memset(ansi->table, 0xff, ansi->table_size * sizeof(uint32_t));
+
+	for (uint32_t a = 0; a < ansi->attrs_count; a++)
+		table_insert(ansi, a);
+}
+
+/* Return the index of the attribute SEQ (LEN bytes), adding it if new. */
+static uint32_t
+get_attr(ansi_t *ansi, const char *seq, const size_t len)
+{
+	if ((ansi->attrs_count + 1) * 2 > ansi->table_size)
+		table_grow(ansi);
+
+	const size_t mask = ansi->table_size - 1;
+	size_t i = hash_str(seq, len) & mask;
+
+	for (; ansi->table[i] != EMPTY_SLOT; i = (i + 1) & mask) {
+		const char *a = ansi->attrs[ansi->table[i]];
+		if (strncmp(a, seq, len) == 0 && a[len] == '\0')
+			return ansi->table[i];
+	}
+
+	const uint32_t attr = (uint32_t)ansi->attrs_count++;
+	ansi->attrs = safe_realloc(ansi->attrs,
+		ansi->attrs_count * sizeof(char *));
+	ansi->attrs[attr] = safe_realloc(NULL, len + 1);
+	memcpy(ansi->attrs[attr], seq, len);
+	ansi->attrs[attr][len] = '\0';
+
+	ansi->table[i] = attr;
+	return attr;
+}
+
+static void
+add_span(ansi_t *ansi, const size_t offset, const uint32_t attr)
+{
+	if (ansi->spans_count == ansi->spans_capacity) {
+		ansi->spans_capacity = ansi->spans_capacity
+			? ansi->spans_capacity * 2 : INITIAL_SPANS_CAPACITY;
+		ansi->spans = safe_realloc(ansi->spans,
+			ansi->spans_capacity * sizeof(struct ansi_span));
+	}
+
+	ansi->spans[ansi->spans_count].offset = (uint32_t)offset;
+	ansi->spans[ansi->spans_count].attr = attr;
+	ansi->spans_count++;
+}
+
+void
+ansi_init(ansi_t *ansi)
+{
+	memset(ansi, 0, sizeof(ansi_t));
+}
+
+void
+ansi_destroy(ansi_t *ansi)
+{
+	for (size_t i = 0; i < ansi->attrs_count; i++)
+		free(ansi->attrs[i]);
+	free(ansi->attrs);
+	free(ansi->spans);
+	free(ansi->table);
+	ansi_init(ansi);
+}
+
+/* Remove all CSI escape sequences from STR (in place), recording a span for
+ * each SGR sequence (the other ones are just dropped).
+ * Return the number of spans added. */
+size_t
+ansi_strip(ansi_t *ansi, char *str)
+{
+	char *p = strchr(str, ESC);
+	if (!p)
+		return 0;
+
+	const size_t count = ansi->spans_count;
+	char *dst = p;
+
+	while (*p) {
+		if (*p != ESC || p[1] != '[') {
+			*dst++ = *p++;
+			continue;
+		}
+
+		/* Parameter and intermediate bytes, then the final byte */
+		const char *seq = p;
+		p += 2;
+		while (*p >= 0x20 && *p <= 0x3f)
+			p++;
+		if (*p >= 0x40 && *p <= 0x7e)
+			p++;
+
+		if (p[-1] == 'm') {
+			const uint32_t attr = get_attr(ansi, seq, (size_t)(p - seq));
+			/* Consecutive sequences share the same offset: all of them are
+			 * kept, in order (e.g. a reset followed by a color). */
+			add_span(ansi, (size_t)(dst - str), attr);
+		}
+	}
+
+	*dst = '\0';
+	return ansi->spans_count - count;
+}
+
+/* Return 1 if ATTR resets all attributes, or 0 otherwise. */
+int
+ansi_is_reset(const ansi_t *ansi, const uint32_t attr)
+{
+	const char *a = ansi->attrs[attr];
+	return strcmp(a, "\x1b[m") == 0 || strcmp(a, "\x1b[0m") == 0;
+}
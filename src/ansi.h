@@ -0,0 +1,74 @@
+/* ansi.h */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#ifndef ANSI_H
+#define ANSI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* From OFFSET on (a byte offset into the plain text of a candidate), the
+ * text is printed using the SGR sequence number ATTR. */
+struct ansi_span {
+	uint32_t offset;
+	uint32_t attr;
+};
+
+typedef struct {
+	struct ansi_span *spans;
+	char **attrs; /* Distinct SGR sequences, indexed by struct ansi_span.attr */
+	uint32_t *table; /* Hash table mapping SGR sequences to ATTRS indices */
+	size_t spans_count;
+	size_t spans_capacity;
+	size_t attrs_count;
+	size_t table_size;
+} ansi_t;
+
+/* The colors of a single candidate */
+struct ansi_colors {
+	const ansi_t *ansi;
+	const struct ansi_span *spans;
+	size_t count;
+};
+
+void ansi_init(ansi_t *ansi);
+void ansi_destroy(ansi_t *ansi);
+size_t ansi_strip(ansi_t *ansi, char *str);
+int ansi_is_reset(const ansi_t *ansi, const uint32_t attr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ANSI_H */
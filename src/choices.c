@@ -34,10 +34,18 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/mman.h> /* munmap() */
 
+#include "config.h" /* ALGO_* */
 #include "options.h"
 #include "choices.h"
+#include "colors.h" /* KEY_ESC */
+#include "first_key.h"
+#include "score_cache.h"
 #include "match.h"
+#include "query.h"
+#include "search_index.h"
+#include "utf8.h"
 
 /* Initial size of buffer for storing input in memory */
 #define INITIAL_BUFFER_CAPACITY 4096
@@ -50,11 +58,30 @@ struct result_list {
 	size_t size;
 };
 
+struct worker;
+
+/* A fuzzy search of the strings of a job from START to END (excluded) */
+typedef void (*fuzzy_search_t)(struct worker *w, const size_t start,
+	const size_t end);
+
 struct search_job {
 	pthread_mutex_t lock;
-	choices_t *choices;
+	const choices_t *choices;
 	const char *search;
+	size_t len; /* Of SEARCH */
+	match_func_t match; /* Scorer of SEARCH (see match_for() and --algo) */
+	const query_t *query; /* Plan of SEARCH (--extended), or NULL: fuzzy */
+	const struct typo_needle *typos; /* SEARCH with typos (only), or NULL */
+	const char *const *keys; /* Keys to search (folded, if they need be) */
+	fuzzy_search_t fuzzy; /* Fuzzy search made for the job, or NULL */
+	const struct scored_result *subset; /* Strings to search, or NULL: all */
+	const size_t *candidates; /* Same, as given by the index (if no SUBSET) */
+	const struct score_rows *prev_rows; /* Rows to go on from, or NULL */
+	struct score_rows *rows; /* Rows to keep (--incremental), or NULL */
+	size_t total; /* Number of strings to search */
 	size_t processed;
+	size_t worker_count;
+	int case_sensitive;
 	struct worker *workers;
 };
 
@@ -73,13 +100,8 @@ cmpchoice(const void *idx1, const void *idx2)
 	const struct scored_result *b = idx2;
 
 	if (a->score == b->score) {
-		/* To ensure a stable sort, we must also sort by the string
-		 * pointers. We can do this since we know all the strings are
-		 * from a contiguous memory segment (buffer in choices_t). */
-		if (a->str < b->str)
-			return -1;
-		else
-			return 1;
+		/* To ensure a stable sort, we must also sort by input position. */
+		return a->index < b->index ? -1 : 1;
 	} else if (a->score < b->score) {
 		return 1;
 	} else {
@@ -87,7 +109,8 @@ cmpchoice(const void *idx1, const void *idx2)
 	}
 }
 
-static void *
+/* realloc(), aborting if out of memory. Every module allocates with it. */
+void *
 safe_realloc(void *buffer, const size_t size)
 {
 	buffer = realloc(buffer, size);
@@ -103,7 +126,7 @@ static void
 choices_reset_search(choices_t *c)
 {
 	free(c->results);
-	c->selection = c->available = 0;
+	c->selection = c->available = c->partial = 0;
 	c->results = NULL;
 }
 
@@ -111,19 +134,106 @@ static void
 choices_resize(choices_t *c, const size_t new_capacity)
 {
 	c->strings = safe_realloc(c->strings, new_capacity * sizeof(const char *));
+	c->widths = safe_realloc(c->widths, new_capacity * sizeof(uint32_t));
+	if (c->ansi) {
+		c->first_span = safe_realloc(c->first_span,
+			new_capacity * sizeof(uint32_t));
+	}
+	if (c->fields) {
+		c->keys = safe_realloc(c->keys, new_capacity * sizeof(const char *));
+		c->views = safe_realloc(c->views,
+			new_capacity * sizeof(const char *));
+	}
+	if (c->folded) {
+		c->folded = safe_realloc(c->folded,
+			new_capacity * sizeof(const char *));
+	}
+	if (c->decomposed) {
+		c->decomposed = safe_realloc(c->decomposed,
+			new_capacity * sizeof(const char *));
+	}
 	c->capacity = new_capacity;
 }
 
+/* The FOLD_* flags the strings of C are folded with for searches (not)
+ * ignoring case (see fold.c). */
+static int
+fold_flags(const choices_t *c, const int case_sensitive)
+{
+	return (case_sensitive ? 0 : FOLD_CASE) | (c->normalize ? FOLD_NFD : 0);
+}
+
+/* Make FOLDED (NULL: the same) the Ith entry of *SHADOWS, the keys of C
+ * folded some way. *SHADOWS is only allocated once a key differs. */
+static void
+set_shadow(choices_t *c, const char ***shadows, const size_t i,
+	const char *folded)
+{
+	if (!*shadows) {
+		if (!folded)
+			return;
+		*shadows = safe_realloc(NULL, c->capacity * sizeof(const char *));
+		for (size_t j = 0; j < i; j++)
+			(*shadows)[j] = choices_key(c, j);
+	}
+
+	(*shadows)[i] = folded ? folded : choices_key(c, i);
+}
+
+/* Fold the key of the Ith string of C once, and tell whether it may hold
+ * SGR sequences, so that searching never needs to. */
+static void
+scan_key(choices_t *c, const size_t i)
+{
+	const char *key = choices_key(c, i);
+	if (!c->sgr && strchr(key, KEY_ESC))
+		c->sgr = 1;
+	set_shadow(c, &c->folded, i, fold_add(c->fold, key, fold_flags(c, 0)));
+	if (c->normalize)
+		set_shadow(c, &c->decomposed, i, fold_add(c->fold, key, FOLD_NFD));
+}
+
 void
 choices_add(choices_t *c, char *choice)
 {
+	if (c->map) {
+		fprintf(stderr, "Error: Cannot add strings to a snapshot\n");
+		abort();
+	}
+
+	/* The strings array is about to change. */
+	if (c->index)
+		search_index_stop(c->index);
+	if (c->first_key)
+		first_key_clear(c->first_key);
+	if (c->scores)
+		score_cache_clear(c->scores);
+
 	/* Previous search is now invalid */
 	choices_reset_search(c);
 
 	if (c->size == c->capacity)
 		choices_resize(c, c->capacity * 2);
 
+	/* Keep the colors aside: everything else only deals with plain text. */
+	if (c->ansi) {
+		c->first_span[c->size] = (uint32_t)c->ansi->spans_count;
+		ansi_strip(c->ansi, choice);
+	}
+
+	/* Split it into fields once, so that searching never needs to. */
+	const char *view = choice;
+	if (c->fields) {
+		fields_add(c->fields, choice, &c->keys[c->size], &view);
+		c->views[c->size] = view;
+	}
+
+	/* Measure the string once, so that drawing it never needs to. */
+	const size_t width = utf8_width(view);
+	c->widths[c->size] = width > UINT32_MAX ? UINT32_MAX : (uint32_t)width;
+
 	c->strings[c->size++] = choice;
+	scan_key(c, c->size - 1);
 }
 
 void
@@ -178,10 +288,38 @@ void
 choices_init(choices_t *c, const options_t *options)
 {
 	c->strings = NULL;
+	c->widths = NULL;
+	c->first_span = NULL;
+	c->keys = NULL;
+	c->views = NULL;
+	c->folded = NULL;
+	c->decomposed = NULL;
+	c->fold = fold_new();
 	c->results = NULL;
+	c->fields = fields_new(options->field_delimiter, options->nth,
+		options->with_nth);
+
+	if (options->ansi) {
+		c->ansi = safe_realloc(NULL, sizeof(ansi_t));
+		ansi_init(c->ansi);
+	} else {
+		c->ansi = NULL;
+	}
 
 	c->buffer_size = 0;
 	c->buffer = NULL;
+	c->map = NULL;
+	c->map_size = 0;
+	c->index = options->search_index ? search_index_new() : NULL;
+	c->first_key = NULL;
+	c->scores = options->incremental
+		? score_cache_new(options->incremental * 1024 * 1024) : NULL;
+	c->algo = options->algo;
+	c->extended = options->extended;
+	c->exact = options->exact;
+	c->typos = options->typos;
+	c->normalize = options->normalize;
+	c->sgr = 0;
 
 	c->capacity = c->size = 0;
 	choices_resize(c, INITIAL_CHOICE_CAPACITY);
@@ -196,20 +334,179 @@ choices_init(choices_t *c, const options_t *options)
 	choices_reset_search(c);
 }
 
+/* Make the COUNT strings at ARENA (at the given OFFSETS), whose display
+ * widths are WIDTHS, the strings of C, which must be empty. They are
+ * not copied: all of them are part of MAP (MAP_SIZE bytes, mapped with
+ * mmap(2)), which C takes over. No string can be added afterwards.
+ * KEYS, if not NULL, holds the strings folded as C folds its keys, and
+ * C takes over its arrays: the strings are not folded again. */
+void
+choices_set_strings(choices_t *c, void *map, const size_t map_size,
+	const char *arena, const uint64_t *offsets, const uint32_t *widths,
+	const size_t count, const struct folded_keys *keys)
+{
+	choices_reset_search(c);
+	if (c->index)
+		search_index_clear(c->index);
+	if (c->first_key)
+		first_key_clear(c->first_key);
+	if (c->scores)
+		score_cache_clear(c->scores);
+	free(c->widths);
+
+	c->strings = safe_realloc(c->strings, (count + 1) * sizeof(const char *));
+	for (size_t i = 0; i < count; i++)
+		c->strings[i] = arena + offsets[i];
+
+	c->widths = (uint32_t *)widths;
+	c->capacity = c->size = count;
+	c->map = map;
+	c->map_size = map_size;
+
+	/* The fields are not part of the snapshot, and the widths are those
+	 * of the strings, not of their views: both are computed here. */
+	if (c->fields) {
+		fields_clear(c->fields);
+		c->keys = safe_realloc(c->keys, (count + 1) * sizeof(const char *));
+		c->views = safe_realloc(c->views, (count + 1) * sizeof(const char *));
+		c->widths = safe_realloc(NULL, (count + 1) * sizeof(uint32_t));
+		for (size_t i = 0; i < count; i++) {
+			fields_add(c->fields, c->strings[i], &c->keys[i], &c->views[i]);
+			const size_t width = utf8_width(c->views[i]);
+			c->widths[i] = width > UINT32_MAX ? UINT32_MAX : (uint32_t)width;
+		}
+	}
+
+	/* Neither are the folded keys, unless given. */
+	fold_clear(c->fold);
+	free(c->folded);
+	free(c->decomposed);
+	c->folded = c->decomposed = NULL;
+	c->sgr = 0;
+	if (keys) {
+		c->folded = keys->folded;
+		c->decomposed = keys->decomposed;
+		c->sgr = keys->sgr;
+	} else {
+		for (size_t i = 0; i < count; i++)
+			scan_key(c, i);
+	}
+}
+
+/* Index the strings added so far in the background (if --search-index
+ * is set), so that searches for long enough queries skip most strings.
+ * Strings added afterwards are only indexed by calling this again. */
+void
+choices_index(choices_t *c)
+{
+	if (c->index)
+		search_index_start(c->index, c->folded ? c->folded
+			: c->keys ? c->keys : c->strings, c->size);
+}
+
+/* Make the index saved at DATA (SIZE bytes, see search_index_save()) the
+ * index of C, if --search-index is set: choices_index() then has nothing
+ * left to do. The index must have been made from keys folded as those of
+ * C are. Return 0 on success, or -1 if it does not fit C. */
+int
+choices_set_index(choices_t *c, const void *data, const size_t size)
+{
+	if (!c->index)
+		return -1;
+
+	return search_index_load(c->index, c->folded ? c->folded
+		: c->keys ? c->keys : c->strings, c->size, data, size);
+}
+
+/* Compute the results of every single-character query in the background,
+ * searching as OPTIONS says, so that choices_search() answers the first
+ * keystroke at once. Strings added afterwards drop them. */
+void
+choices_precompute(choices_t *c, const options_t *options)
+{
+	if (!c->first_key)
+		c->first_key = first_key_new();
+	first_key_start(c->first_key, c, options->case_sens_mode,
+		options->sort);
+}
+
 void
 choices_destroy(choices_t *c)
 {
+	if (c->index) {
+		search_index_free(c->index);
+		c->index = NULL;
+	}
+	if (c->first_key) {
+		first_key_free(c->first_key);
+		c->first_key = NULL;
+	}
+	if (c->scores) {
+		score_cache_free(c->scores);
+		c->scores = NULL;
+	}
+
 	free(c->buffer);
 	c->buffer = NULL;
 	c->buffer_size = 0;
 
 	free(c->strings);
 	c->strings = NULL;
+	/* Snapshots hold the widths, unless measured again for the fields
+	 * (see choices_set_strings()). */
+	if (!c->map || c->fields)
+		free(c->widths);
+	if (c->map) {
+		munmap(c->map, c->map_size);
+		c->map = NULL;
+	}
+	c->widths = NULL;
+	free(c->first_span);
+	c->first_span = NULL;
+	free(c->keys);
+	c->keys = NULL;
+	free(c->views);
+	c->views = NULL;
+	free(c->folded);
+	c->folded = NULL;
+	free(c->decomposed);
+	c->decomposed = NULL;
+	fold_free(c->fold);
+	c->fold = NULL;
+	fields_free(c->fields);
+	c->fields = NULL;
 	c->capacity = c->size = 0;
 
 	free(c->results);
 	c->results = NULL;
 	c->available = c->selection = 0;
+
+	if (c->ansi) {
+		ansi_destroy(c->ansi);
+		free(c->ansi);
+		c->ansi = NULL;
+	}
+}
+
+/* Remove all strings (the memory is kept for reuse). The buffer is not
+ * used: this is meant for strings stored elsewhere (see filter.c). */
+void
+choices_clear(choices_t *c)
+{
+	choices_reset_search(c);
+	c->size = 0;
+	if (c->index)
+		search_index_clear(c->index);
+	if (c->first_key)
+		first_key_clear(c->first_key);
+	if (c->scores)
+		score_cache_clear(c->scores);
+	if (c->ansi)
+		c->ansi->spans_count = 0;
+	if (c->fields)
+		fields_clear(c->fields);
+	fold_clear(c->fold);
+	c->sgr = 0;
 }
 
 size_t
@@ -218,6 +515,134 @@ choices_available(const choices_t *c)
 	return c->available;
 }
 
+/* Return 1 if the strings of C are scored by match_greedy() (see
+ * --algo), or 0 if by match(). */
+int
+choices_greedy(const choices_t *c)
+{
+	return c->algo == ALGO_GREEDY
+		|| (c->algo == ALGO_AUTO && c->size > DEFAULT_ALGO_AUTO_THRESHOLD);
+}
+
+/* Compile SEARCH into a plan matching strings the way the searches of C
+ * do, or return NULL if these do not use the extended syntax. */
+query_t *
+choices_query(const choices_t *c, const char *search,
+	const int case_sensitive)
+{
+	if (!c->extended)
+		return NULL;
+
+	char *folded = fold_string(search, fold_flags(c, case_sensitive));
+	query_t *plan = query_compile(folded ? folded : search, case_sensitive,
+		choices_greedy(c), c->exact);
+	free(folded);
+	return plan;
+}
+
+/* Store in POSITIONS the positions of the characters of S matching SEARCH
+ * (both folded), the way the searches of C match it, and return the score
+ * of S. */
+static score_t
+folded_positions(const choices_t *c, const query_t *plan, const char *search,
+	const char *s, size_t *positions, const int case_sensitive)
+{
+	struct typo_needle typos;
+	score_t score = SCORE_MIN;
+	if (plan) {
+		score = query_positions(plan, s, positions);
+	} else if (c->exact) {
+		match_substring(search, strlen(search), s, MATCH_ANYWHERE,
+			case_sensitive, &score, positions);
+	} else if (c->typos > 0 && !has_match(search, s, case_sensitive)
+	&& typo_needle_init(&typos, search, c->typos, case_sensitive)) {
+		score = match_typos(&typos, s, positions, case_sensitive);
+	} else {
+		score = (choices_greedy(c) ? match_greedy_positions
+			: match_positions)(search, s, positions, case_sensitive);
+	}
+
+	return score;
+}
+
+/* Store in POSITIONS the positions of the characters of the key of the
+ * string of C at INDEX (see choices_key()) matching SEARCH, the way the
+ * searches of C match it (PLAN, as compiled by choices_query(), if not
+ * NULL, a substring with --exact, or fuzzily, maybe with typos), and
+ * return the score of the key. */
+score_t
+choices_positions(const choices_t *c, const query_t *plan,
+	const char *search, const size_t index, size_t *positions,
+	const int case_sensitive)
+{
+	/* Match the folded key, as searches do, then map back. */
+	const int flags = fold_flags(c, case_sensitive);
+	char *folded_search = plan ? NULL : fold_string(search, flags);
+	const char *key = choices_key(c, index);
+	const char *folded = choices_folded_key(c, index, case_sensitive);
+
+	const score_t score = folded_positions(c, plan,
+		folded_search ? folded_search : search, folded, positions,
+		case_sensitive);
+
+	if (folded != key)
+		fold_map_positions(key, flags, positions);
+	free(folded_search);
+	return score;
+}
+
+/* As choices_positions(), for STR, some text that is not a key of C (e.g.
+ * a key drawn without its colors): STR is folded first. */
+score_t
+choices_str_positions(const choices_t *c, const query_t *plan,
+	const char *search, const char *str, size_t *positions,
+	const int case_sensitive)
+{
+	const int flags = fold_flags(c, case_sensitive);
+	char *folded_search = plan ? NULL : fold_string(search, flags);
+	char *folded_str = fold_string(str, flags);
+
+	const score_t score = folded_positions(c, plan,
+		folded_search ? folded_search : search,
+		folded_str ? folded_str : str, positions, case_sensitive);
+
+	if (folded_str)
+		fold_map_positions(str, flags, positions);
+	free(folded_search);
+	free(folded_str);
+	return score;
+}
+
+/* Return the text searched for the string of C at INDEX in the input:
+ * the fields selected by --nth, or the string itself. */
+const char *
+choices_key(const choices_t *c, const size_t index)
+{
+	return c->keys ? c->keys[index] : c->strings[index];
+}
+
+/* Return the text searched for the string of C at INDEX by a search
+ * (not) ignoring case: its key (see choices_key()), folded as such
+ * searches fold it. */
+const char *
+choices_folded_key(const choices_t *c, const size_t index,
+	const int case_sensitive)
+{
+	const char **shadows = case_sensitive ? c->decomposed : c->folded;
+	return shadows ? shadows[index] : choices_key(c, index);
+}
+
+/* Map the POSITIONS of characters in the text searched for the string of
+ * C at INDEX (see choices_key()) to positions in that string, or in the
+ * text displayed for it if VIEW is set (see --with-nth). */
+void
+choices_map_positions(const choices_t *c, const size_t index, const int view,
+	size_t *positions)
+{
+	if (c->fields)
+		fields_map_positions(c->fields, index, view, positions);
+}
+
 #define BATCH_SIZE 512
 static void
 worker_get_next_batch(struct search_job *job, size_t *start, size_t *end)
@@ -227,8 +652,8 @@ worker_get_next_batch(struct search_job *job, size_t *start, size_t *end)
 	*start = job->processed;
 
 	job->processed += BATCH_SIZE;
-	if (job->processed > job->choices->size)
-		job->processed = job->choices->size;
+	if (job->processed > job->total)
+		job->processed = job->total;
 
 	*end = job->processed;
 
@@ -236,21 +661,22 @@ worker_get_next_batch(struct search_job *job, size_t *start, size_t *end)
 }
 #undef BATCH_SIZE
 
+/* Merge two partial results. Unsorted results (SORT is zero) are merged
+ * by input position, so that they remain in input order. */
 static struct result_list
-merge_result(struct result_list list1, struct result_list list2)
+merge_result(struct result_list list1, struct result_list list2,
+	const int sort)
 {
 	size_t result_index = 0, index1 = 0, index2 = 0;
 
 	struct result_list result;
 	result.size = list1.size + list2.size;
-	result.list = malloc(result.size * sizeof(struct scored_result));
-	if (!result.list) {
-		fprintf(stderr, "Error: Cannot allocate memory\n");
-		abort();
-	}
+	result.list = safe_realloc(NULL,
+		result.size * sizeof(struct scored_result));
 
 	while (index1 < list1.size && index2 < list2.size) {
-		if (cmpchoice(&list1.list[index1], &list2.list[index2]) < 0)
+		if (sort == 1 ? cmpchoice(&list1.list[index1], &list2.list[index2]) < 0
+		: list1.list[index1].index < list2.list[index2].index)
 			result.list[result_index++] = list1.list[index1++];
 		else
 			result.list[result_index++] = list2.list[index2++];
@@ -268,6 +694,69 @@ merge_result(struct result_list list1, struct result_list list2)
 	return result;
 }
 
+/* Fuzzy searches made for each variant of the matcher and of the scorer
+ * (see match.h): their loop neither calls through a pointer nor tests
+ * what the job sets once, such as the case sensitivity or whether keys
+ * may hold SGR sequences. */
+#define DEFINE_FUZZY_SEARCH(name, has_match_func, match_func) \
+	static void \
+	name(struct worker *w, const size_t start, const size_t end) \
+	{ \
+		const struct search_job *job = w->job; \
+		const char *search = job->search; \
+		const char *const *keys = job->keys; \
+		const char **strings = job->choices->strings; \
+		const struct scored_result *subset = job->subset; \
+		const size_t *candidates = job->candidates; \
+		struct result_list *result = &w->result; \
+		for (size_t i = start; i < end; i++) { \
+			const size_t index = subset ? subset[i].index \
+				: candidates ? candidates[i] : i; \
+			if (has_match_func(search, keys[index])) { \
+				result->list[result->size].str = strings[index]; \
+				result->list[result->size].index = index; \
+				result->list[result->size].score = match_func(search, \
+					keys[index]); \
+				result->size++; \
+			} \
+		} \
+	}
+
+#define DEFINE_FUZZY_SEARCHES(cs, sgr) \
+	DEFINE_FUZZY_SEARCH(fuzzy_##cs##sgr##_1, has_match_##cs##sgr, \
+		match_1_##cs) \
+	DEFINE_FUZZY_SEARCH(fuzzy_##cs##sgr##_2, has_match_##cs##sgr, \
+		match_2_##cs) \
+	DEFINE_FUZZY_SEARCH(fuzzy_##cs##sgr##_3, has_match_##cs##sgr, \
+		match_3_##cs) \
+	DEFINE_FUZZY_SEARCH(fuzzy_##cs##sgr##_n, has_match_##cs##sgr, \
+		match_##cs)
+
+DEFINE_FUZZY_SEARCHES(cs, )
+DEFINE_FUZZY_SEARCHES(ci, )
+DEFINE_FUZZY_SEARCHES(cs, _sgr)
+DEFINE_FUZZY_SEARCHES(ci, _sgr)
+
+#undef DEFINE_FUZZY_SEARCHES
+#undef DEFINE_FUZZY_SEARCH
+
+/* Return the fuzzy search for a query of LEN characters, (not) ignoring
+ * case, in keys that may hold SGR sequences (if SGR is set) or not. */
+static fuzzy_search_t
+fuzzy_search_for(const size_t len, const int case_sensitive, const int sgr)
+{
+	/* By case sensitivity, SGR, and length (1, 2, 3, or any other) */
+	static const fuzzy_search_t searches[2][2][4] = {
+		{{fuzzy_ci_1, fuzzy_ci_2, fuzzy_ci_3, fuzzy_ci_n},
+		{fuzzy_ci_sgr_1, fuzzy_ci_sgr_2, fuzzy_ci_sgr_3, fuzzy_ci_sgr_n}},
+		{{fuzzy_cs_1, fuzzy_cs_2, fuzzy_cs_3, fuzzy_cs_n},
+		{fuzzy_cs_sgr_1, fuzzy_cs_sgr_2, fuzzy_cs_sgr_3, fuzzy_cs_sgr_n}}
+	};
+
+	return searches[case_sensitive != 0][sgr != 0]
+		[len >= 1 && len <= 3 ? len - 1 : 3];
+}
+
 static void *
 choices_search_worker(void *data)
 {
@@ -284,10 +773,45 @@ choices_search_worker(void *data)
 		if (start == end)
 			break;
 
+		if (job->fuzzy) {
+			job->fuzzy(w, start, end);
+			continue;
+		}
+
 		for (size_t i = start; i < end; i++) {
-			if (has_match(job->search, c->strings[i])) {
-				result->list[result->size].str = c->strings[i];
-				result->list[result->size].score = match(job->search, c->strings[i]);
+			const size_t index = job->subset ? job->subset[i].index
+				: job->candidates ? job->candidates[i] : i;
+			const char *key = job->keys[index];
+			if (job->typos) {
+				if (has_match_typos(job->typos, key) > 0) {
+					result->list[result->size].str = c->strings[index];
+					result->list[result->size].index = index;
+					result->list[result->size].score = match_typos(job->typos,
+						key, NULL, job->case_sensitive);
+					result->size++;
+				}
+			} else if (job->query) {
+				if (query_match(job->query, key,
+				&result->list[result->size].score)) {
+					result->list[result->size].str = c->strings[index];
+					result->list[result->size].index = index;
+					result->size++;
+				}
+			} else if (c->exact) {
+				if (match_substring(job->search, job->len, key,
+				MATCH_ANYWHERE, job->case_sensitive,
+				&result->list[result->size].score, NULL)) {
+					result->list[result->size].str = c->strings[index];
+					result->list[result->size].index = index;
+					result->size++;
+				}
+			} else if (has_match(job->search, key, job->case_sensitive)) {
+				result->list[result->size].str = c->strings[index];
+				result->list[result->size].index = index;
+				result->list[result->size].score = job->rows || job->prev_rows
+					? score_rows_match(job->prev_rows, job->rows, w->worker_num,
+					job->search, key, index, job->case_sensitive)
+					: job->match(job->search, key, job->case_sensitive);
 				result->size++;
 			}
 		}
@@ -303,7 +827,7 @@ choices_search_worker(void *data)
 			break;
 
 		size_t next_worker = w->worker_num | (1 << step);
-		if (next_worker >= c->worker_count)
+		if (next_worker >= job->worker_count)
 			break;
 
 		if ((errno = pthread_join(job->workers[next_worker].thread_id, NULL))) {
@@ -311,44 +835,40 @@ choices_search_worker(void *data)
 			exit(EXIT_FAILURE);
 		}
 
-		w->result = merge_result(w->result, job->workers[next_worker].result);
+		w->result = merge_result(w->result, job->workers[next_worker].result,
+			w->sort);
 	}
 
 	return (char *)NULL;
 }
 
-void
-choices_search(choices_t *c, const char *search, const int sort)
+/* Run JOB on its workers, store its results in *RESULTS, and return
+ * their number. */
+static size_t
+run_job(struct search_job *job, const int sort,
+	struct scored_result **results)
 {
-	choices_reset_search(c);
-
-	struct search_job *job = calloc(1, sizeof(struct search_job));
-	if (!job) {
-		fprintf(stderr, "Error: Cannot allocate memory\n");
-		abort();
-	}
-
-	job->search = search;
-	job->choices = c;
-	if (pthread_mutex_init(&job->lock, NULL) != 0) {
-		fprintf(stderr, "Error: pthread_mutex_init failed\n");
-		abort();
-	}
-
-	job->workers = calloc(c->worker_count, sizeof(struct worker));
+	job->workers = calloc(job->worker_count, sizeof(struct worker));
 	if (!job->workers) {
 		fprintf(stderr, "Error: Cannot allocate memory\n");
 		abort();
 	}
 
 	struct worker *workers = job->workers;
-	for (int i = (int)c->worker_count - 1; i >= 0; i--) {
+	for (int i = (int)job->worker_count - 1; i >= 0; i--) {
 		workers[i].job = job;
 		workers[i].worker_num = (size_t)i;
 		workers[i].result.size = 0;
 		workers[i].sort = sort;
 		/* FIXME: This is overkill */
-		workers[i].result.list = malloc(c->size * sizeof(struct scored_result));
+		workers[i].result.list = malloc((job->total + 1)
+			* sizeof(struct scored_result));
+
+		/* A single worker runs on the calling thread. */
+		if (job->worker_count == 1) {
+			choices_search_worker(&workers[0]);
+			break;
+		}
 
 		/* These must be created last-to-first to avoid a race condition when
 		 * fanning in. */
@@ -359,31 +879,330 @@ choices_search(choices_t *c, const char *search, const int sort)
 		}
 	}
 
-	if (pthread_join(workers[0].thread_id, NULL)) {
+	if (job->worker_count > 1 && pthread_join(workers[0].thread_id, NULL)) {
 		perror("pthread_join");
 		exit(EXIT_FAILURE);
 	}
 
-	c->results = workers[0].result.list;
-	c->available = workers[0].result.size;
+	*results = workers[0].result.list;
+	const size_t count = workers[0].result.size;
 
 	free(workers);
+	job->workers = NULL;
+
+	return count;
+}
+
+/* Search the TOTAL strings of C in SUBSET (all of them if NULL) for
+ * SEARCH, using WORKERS threads. C is left untouched, except for SCORES
+ * (if not NULL), which get the rows of this search. Store the results in
+ * *RESULTS, and return their number. */
+static size_t
+run_search(const choices_t *c, const char *search, const int sort,
+	const int case_sensitive, const struct scored_result *subset,
+	size_t total, const size_t workers_num, score_cache_t *scores,
+	struct scored_result **results)
+{
+	/* Everything matches the empty query, with the same score: results
+	 * are in input order. */
+	if (!*search && !subset) {
+		*results = safe_realloc(NULL,
+			(total + 1) * sizeof(struct scored_result));
+		for (size_t i = 0; i < total; i++) {
+			(*results)[i].score = SCORE_MIN;
+			(*results)[i].str = c->strings[i];
+			(*results)[i].index = i;
+		}
+		if (scores)
+			score_cache_clear(scores);
+		return total;
+	}
+
+	/* Non-ASCII characters are matched folded (see fold.c). The index
+	 * holds the keys folded as when ignoring case: so are its lookups. */
+	char *folded = fold_string(search, fold_flags(c, case_sensitive));
+	if (folded)
+		search = folded;
+	char *lookup = case_sensitive
+		? fold_string(search, fold_flags(c, 0)) : NULL;
+
+	const int greedy = choices_greedy(c);
+	query_t *query = c->extended
+		? query_compile(search, case_sensitive, greedy, c->exact) : NULL;
+
+	/* Only fuzzy scores by match() go on from rows. */
+	if ((greedy || query || c->exact) && scores) {
+		score_cache_clear(scores);
+		scores = NULL;
+	}
+
+	/* Without a subset, only search the strings the index does not rule
+	 * out (which only knows about fuzzy queries: substrings match them
+	 * too). */
+	size_t *candidates = NULL;
+	if (!subset && !query && c->index) {
+		const size_t n = search_index_lookup(c->index,
+			lookup ? lookup : search, total, &candidates);
+		if (n != (size_t)-1)
+			total = n;
+	}
+	if (!subset && !query && !candidates && c->first_key) {
+		const size_t n = first_key_candidates(c->first_key,
+			lookup ? lookup : search, total, &candidates);
+		if (n != (size_t)-1)
+			total = n;
+	}
+
+	struct search_job *job = calloc(1, sizeof(struct search_job));
+	if (!job) {
+		fprintf(stderr, "Error: Cannot allocate memory\n");
+		abort();
+	}
+
+	job->search = search;
+	job->len = strlen(search);
+	job->match = greedy ? match_greedy : match_for(search);
+	job->query = query;
+	job->choices = c;
+	job->keys = case_sensitive ? c->decomposed : c->folded;
+	if (!job->keys)
+		job->keys = c->keys ? c->keys : c->strings;
+	job->subset = subset;
+	job->candidates = candidates;
+	job->total = total;
+	job->worker_count = workers_num > 0 ? workers_num : 1;
+	job->case_sensitive = case_sensitive;
+	if (scores) {
+		job->prev_rows = score_cache_prev(scores, search, case_sensitive);
+		job->rows = score_cache_rows(scores, c->size, job->worker_count);
+	} else if (!greedy && !query && !c->exact) {
+		job->fuzzy = fuzzy_search_for(job->len, case_sensitive, c->sgr);
+	}
+	if (pthread_mutex_init(&job->lock, NULL) != 0) {
+		fprintf(stderr, "Error: pthread_mutex_init failed\n");
+		abort();
+	}
+
+	size_t count = run_job(job, sort, results);
+
+	if (scores)
+		score_cache_set(scores, search, case_sensitive, job->rows);
+
+	/* Too few results: look for matches with typos too, after them. These
+	 * may be anywhere, not just in SUBSET or among the candidates. */
+	struct typo_needle typos;
+	if (count < DEFAULT_TYPOS_THRESHOLD && c->typos > 0 && !query
+	&& !c->exact && typo_needle_init(&typos, search, c->typos,
+	case_sensitive)) {
+		job->typos = &typos;
+		job->fuzzy = NULL;
+		job->subset = NULL;
+		job->candidates = NULL;
+		job->prev_rows = NULL;
+		job->rows = NULL;
+		job->total = c->size;
+		job->processed = 0;
+
+		struct scored_result *more;
+		const size_t n = run_job(job, sort, &more);
+		if (n > 0) {
+			*results = safe_realloc(*results,
+				(count + n + 1) * sizeof(struct scored_result));
+			memcpy(*results + count, more, n * sizeof(struct scored_result));
+			count += n;
+		}
+		free(more);
+	}
+
+	free(candidates);
+	query_free(query);
+	free(lookup);
+	free(folded);
 	pthread_mutex_destroy(&job->lock);
 	free(job);
+
+	return count;
+}
+
+/* Search C for SEARCH. If SEARCH is a single character whose results were
+ * computed beforehand (see choices_precompute()), only the best of them
+ * may be there: C->PARTIAL then holds the number of matches, and
+ * choices_complete() gets the rest. */
+void
+choices_search(choices_t *c, const char *search, const int sort,
+	const int case_sensitive)
+{
+	/* The last search was for SEARCH minus its last character: only its
+	 * results can match, and their scores go on from theirs. */
+	if (c->scores && c->results && c->partial == 0
+	&& score_cache_prev(c->scores, search, case_sensitive)) {
+		choices_narrow(c, search, sort, case_sensitive);
+		return;
+	}
+
+	choices_reset_search(c);
+
+	/* The results of single characters were scored fuzzily. */
+	size_t total;
+	if (c->first_key && c->exact == 0
+	&& first_key_results(c->first_key, search, sort, case_sensitive,
+		&c->results, &c->available, &total)) {
+		c->partial = total > c->available ? total : 0;
+		if (c->scores)
+			score_cache_clear(c->scores);
+		return;
+	}
+
+	/* Everything matches the empty query, in input order: no need to list
+	 * the results (see choices_get()). */
+	if (!*search) {
+		c->available = c->size;
+		if (c->scores)
+			score_cache_clear(c->scores);
+		return;
+	}
+
+	c->available = run_search(c, search, sort, case_sensitive, NULL, c->size,
+		c->worker_count, c->scores, &c->results);
+}
+
+/* If only the best results of SEARCH are there (see choices_search()),
+ * search again for all of them. */
+void
+choices_complete(choices_t *c, const char *search, const int sort,
+	const int case_sensitive)
+{
+	if (c->partial == 0)
+		return;
+
+	choices_reset_search(c);
+	c->available = run_search(c, search, sort, case_sensitive, NULL, c->size,
+		c->worker_count, c->scores, &c->results);
+}
+
+/* Like choices_search(), but only search the results of the previous
+ * search, which must be a search SEARCH narrows (i.e. whatever matches
+ * SEARCH also matched the previous query, e.g. "ab" after "a"). */
+void
+choices_narrow(choices_t *c, const char *search, const int sort,
+	const int case_sensitive)
+{
+	/* Partial results are not all of those to narrow. */
+	if (c->partial) {
+		choices_reset_search(c);
+		c->available = run_search(c, search, sort, case_sensitive, NULL,
+			c->size, c->worker_count, c->scores, &c->results);
+		return;
+	}
+
+	struct scored_result *subset = c->results;
+	const size_t total = c->available;
+
+	c->results = NULL;
+	choices_reset_search(c);
+	c->available = run_search(c, search, sort, case_sensitive, subset, total,
+		c->worker_count, c->scores, &c->results);
+	free(subset);
+}
+
+/* Search C for SEARCH using WORKERS threads (1: the calling thread only),
+ * leaving C untouched, so that several searches can run at once. Store
+ * the results (to be freed by the caller) in *RESULTS, and return their
+ * number. */
+size_t
+choices_search_r(const choices_t *c, const char *search, const int sort,
+	const int case_sensitive, const size_t workers,
+	struct scored_result **results)
+{
+	return run_search(c, search, sort, case_sensitive, NULL, c->size,
+		workers, NULL, results);
+}
+
+/* Like choices_search_r(), but only search the COUNT results in *RESULTS
+ * of a previous search SEARCH narrows (see choices_narrow()), which are
+ * replaced by the new ones. Return their number. */
+size_t
+choices_narrow_r(const choices_t *c, const char *search, const int sort,
+	const int case_sensitive, const size_t workers,
+	struct scored_result **results, const size_t count)
+{
+	struct scored_result *subset = *results;
+	const size_t n = run_search(c, search, sort, case_sensitive, subset, count,
+		workers, NULL, results);
+	free(subset);
+	return n;
+}
+
+/* Make the COUNT RESULTS (allocated with malloc(3)) the results of the
+ * current search, as if found by choices_search(). C takes ownership of
+ * them. */
+void
+choices_set_results(choices_t *c, struct scored_result *results,
+	const size_t count)
+{
+	choices_reset_search(c);
+	if (c->scores)
+		score_cache_clear(c->scores);
+	c->results = results;
+	c->available = count;
 }
 
 const char *
 choices_get(const choices_t *c, const size_t n)
 {
 	if (n < c->available)
-		return c->results[n].str;
+		return c->results ? c->results[n].str : c->strings[n];
 	return (char *)NULL;
 }
 
+/* Return the text displayed for the Nth result (see --with-nth). */
+const char *
+choices_getview(const choices_t *c, const size_t n)
+{
+	const char *str = choices_get(c, n);
+	return str && c->views ? c->views[choices_getindex(c, n)] : str;
+}
+
 score_t
 choices_getscore(const choices_t *c, const size_t n)
 {
-	return c->results[n].score;
+	return c->results ? c->results[n].score : SCORE_MIN;
+}
+
+/* Return the position of the Nth result in the input. */
+size_t
+choices_getindex(const choices_t *c, const size_t n)
+{
+	return c->results ? c->results[n].index : n;
+}
+
+/* Return the display width of the Nth result (SGR sequences excluded). */
+size_t
+choices_getwidth(const choices_t *c, const size_t n)
+{
+	return c->widths[choices_getindex(c, n)];
+}
+
+/* Store the colors of the Nth result (--ansi) in COLORS.
+ * Return the number of color spans, or 0 if there are none. */
+size_t
+choices_getcolors(const choices_t *c, const size_t n,
+	struct ansi_colors *colors)
+{
+	colors->ansi = c->ansi;
+	colors->spans = NULL;
+	colors->count = 0;
+
+	if (!c->ansi)
+		return 0;
+
+	const size_t i = choices_getindex(c, n);
+	const size_t end = i + 1 < c->size ? c->first_span[i + 1]
+		: c->ansi->spans_count;
+
+	colors->spans = c->ansi->spans + c->first_span[i];
+	colors->count = end - c->first_span[i];
+	return colors->count;
 }
 
 void
@@ -33,9 +33,15 @@
 #define CHOICES_H
 
 #include <stdio.h>
+#include <stdint.h> /* uint32_t */
 
+#include "ansi.h"
+#include "fields.h"
+#include "fold.h"
 #include "match.h" /* score_t */
 #include "options.h"
+#include "query.h"
+#include "search_index.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,29 +50,99 @@ extern "C" {
 struct scored_result {
 	score_t score;
 	const char *str;
+	size_t index; /* Index of STR in the strings array */
 };
 
 typedef struct {
 	char *buffer;
 	const char **strings;
-	struct scored_result *results;
+	uint32_t *widths; /* Display width of each string, computed on load */
+	uint32_t *first_span; /* First color span of each string (--ansi) */
+	const char **keys; /* Text searched for each string, or NULL: itself */
+	const char **views; /* Text displayed for each string, or NULL: itself */
+	fields_t *fields; /* Fields of the strings (--nth, --with-nth), or NULL */
+	const char **folded; /* Keys case-folded (see fold.c), or NULL: as is */
+	const char **decomposed; /* Keys decomposed (--normalize), or NULL */
+	fold_t *fold; /* Storage of FOLDED and DECOMPOSED */
+	ansi_t *ansi; /* Colors removed from the strings, or NULL */
+	void *map; /* Snapshot holding the strings (see snapshot.c), or NULL */
+	size_t map_size;
+	search_index_t *index; /* Inverted index (--search-index), or NULL */
+	struct first_key *first_key; /* Single-character queries, or NULL */
+	struct score_cache *scores; /* Rows of the last search, or NULL */
+	struct scored_result *results; /* NULL: all strings, in input order */
 	size_t buffer_size;
 	size_t capacity;
 	size_t size;
 	size_t available;
+	size_t partial; /* Matches, if RESULTS only holds the best ones, or 0 */
 	size_t selection;
 	size_t worker_count;
+	int algo; /* ALGO_* (see config.h) */
+	int extended; /* Queries use the extended syntax (see query.c) */
+	int exact; /* Queries are substrings, not fuzzy (see --exact) */
+	int typos; /* Most typos in fuzzy queries with few results (--typos) */
+	int normalize; /* Precomposed characters match decomposed ones */
+	int sgr; /* Some key holds an escape character (an SGR sequence?) */
 } choices_t;
 
+void *safe_realloc(void *buffer, const size_t size);
+
 void choices_add(choices_t *c, char *choice);
 void choices_init(choices_t *c, const options_t *options);
 void choices_fread(choices_t *c, FILE *file, const char input_delimiter,
 	const int max_choices);
+/* Keys folded beforehand (see choices_set_strings()) */
+struct folded_keys {
+	const char **folded; /* As FOLDED in choices_t */
+	const char **decomposed; /* As DECOMPOSED in choices_t */
+	int sgr; /* As SGR in choices_t */
+};
+
+void choices_set_strings(choices_t *c, void *map, const size_t map_size,
+	const char *arena, const uint64_t *offsets, const uint32_t *widths,
+	const size_t count, const struct folded_keys *keys);
+void choices_index(choices_t *c);
+int choices_set_index(choices_t *c, const void *data, const size_t size);
+void choices_precompute(choices_t *c, const options_t *options);
 void choices_destroy(choices_t *c);
+void choices_clear(choices_t *c);
 size_t choices_available(const choices_t *c);
-void choices_search(choices_t *c, const char *search, const int sort);
+int choices_greedy(const choices_t *c);
+query_t *choices_query(const choices_t *c, const char *search,
+	const int case_sensitive);
+score_t choices_positions(const choices_t *c, const query_t *plan,
+	const char *search, const size_t index, size_t *positions,
+	const int case_sensitive);
+score_t choices_str_positions(const choices_t *c, const query_t *plan,
+	const char *search, const char *str, size_t *positions,
+	const int case_sensitive);
+const char *choices_key(const choices_t *c, const size_t index);
+const char *choices_folded_key(const choices_t *c, const size_t index,
+	const int case_sensitive);
+void choices_map_positions(const choices_t *c, const size_t index,
+	const int view, size_t *positions);
+void choices_search(choices_t *c, const char *search, const int sort,
+	const int case_sensitive);
+void choices_complete(choices_t *c, const char *search, const int sort,
+	const int case_sensitive);
+void choices_narrow(choices_t *c, const char *search, const int sort,
+	const int case_sensitive);
+size_t choices_search_r(const choices_t *c, const char *search, const int sort,
+	const int case_sensitive, const size_t workers,
+	struct scored_result **results);
+size_t choices_narrow_r(const choices_t *c, const char *search, const int sort,
+	const int case_sensitive, const size_t workers,
+	struct scored_result **results, const size_t count);
+void choices_set_results(choices_t *c, struct scored_result *results,
+	const size_t count);
 const char *choices_get(const choices_t *c, const size_t n);
+const char *choices_getview(const choices_t *c, const size_t n);
 score_t choices_getscore(const choices_t *c, const size_t n);
+size_t choices_getindex(const choices_t *c, const size_t n);
+size_t choices_getwidth(const choices_t *c, const size_t n);
+size_t choices_getcolors(const choices_t *c, const size_t n,
+	struct ansi_colors *colors);
 void choices_prev(choices_t *c);
 void choices_next(choices_t *c);
 
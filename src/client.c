@@ -0,0 +1,431 @@
+/* client.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+
+/* Client mode (--connect): the input is searched by a daemon (see
+ * daemon.c), and only the matches received from it are kept locally.
+ *
+ * Strings are received along with their position in the corpus, which
+ * maps them to local copies: a string shown by several searches is only
+ * stored once, and selections (which refer to local copies) survive new
+ * searches. */
+
+#ifndef _DEFAULT_SOURCE
+/* realpath */
+# define _DEFAULT_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "client.h"
+#include "output.h"
+
+static void
+lost_connection(void)
+{
+	fputs("fnf: Lost connection to the daemon\n", stderr);
+	exit(EXIT_FAILURE);
+}
+
+static void
+unexpected_response(void)
+{
+	fputs("fnf: Unexpected response from the daemon\n", stderr);
+	exit(EXIT_FAILURE);
+}
+
+static void
+write_all(const int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		const ssize_t n = write(fd, buf, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			lost_connection();
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+}
+
+/* Skip the literal LIT at *P. Return 0 if found, or -1 otherwise. */
+static int
+skip(char **p, const char *lit)
+{
+	const size_t len = strlen(lit);
+	if (strncmp(*p, lit, len) != 0)
+		return -1;
+
+	*p += len;
+	return 0;
+}
+
+/* Encode the code point CP as UTF-8 at DST. Return the number of bytes. */
+static size_t
+encode_utf8(char *dst, const unsigned long cp)
+{
+	if (cp < 0x80) {
+		dst[0] = (char)cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		dst[0] = (char)(0xc0 | (cp >> 6));
+		dst[1] = (char)(0x80 | (cp & 0x3f));
+		return 2;
+	}
+	if (cp < 0x10000) {
+		dst[0] = (char)(0xe0 | (cp >> 12));
+		dst[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		dst[2] = (char)(0x80 | (cp & 0x3f));
+		return 3;
+	}
+	dst[0] = (char)(0xf0 | (cp >> 18));
+	dst[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+	dst[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+	dst[3] = (char)(0x80 | (cp & 0x3f));
+	return 4;
+}
+
+/* Parse the four hex digits at S into *CP.
+ * Return 0 on success, or -1 if they are not four hex digits. */
+static int
+parse_hex4(const char *s, unsigned long *cp)
+{
+	*cp = 0;
+	for (int i = 0; i < 4; i++) {
+		unsigned long digit;
+		if (s[i] >= '0' && s[i] <= '9')
+			digit = (unsigned long)(s[i] - '0');
+		else if (s[i] >= 'a' && s[i] <= 'f')
+			digit = (unsigned long)(s[i] - 'a' + 10);
+		else if (s[i] >= 'A' && s[i] <= 'F')
+			digit = (unsigned long)(s[i] - 'A' + 10);
+		else
+			return -1;
+		*cp = *cp << 4 | digit;
+	}
+
+	return 0;
+}
+
+/* Parse the \uXXXX escape at *SRC (past the backslash) into *CP, and
+ * move *SRC to its last character. Characters outside the BMP come as a
+ * pair of such escapes (UTF-16 surrogates). Return 0 on success, or -1 if
+ * malformed, or if it is a NUL, which C strings cannot hold. */
+static int
+parse_unicode_escape(char **src, unsigned long *cp)
+{
+	char *s = *src;
+	if (parse_hex4(s + 1, cp) == -1 || *cp == 0)
+		return -1;
+	s += 4;
+
+	if (*cp >= 0xdc00 && *cp <= 0xdfff) /* Low surrogate first */
+		return -1;
+
+	if (*cp >= 0xd800 && *cp <= 0xdbff) {
+		unsigned long low;
+		if (s[1] != '\\' || s[2] != 'u' || parse_hex4(s + 3, &low) == -1
+		|| low < 0xdc00 || low > 0xdfff)
+			return -1;
+		*cp = 0x10000 + ((*cp - 0xd800) << 10) + (low - 0xdc00);
+		s += 6;
+	}
+
+	*src = s;
+	return 0;
+}
+
+/* Unescape the JSON string at *P (starting with a quote) in place, and
+ * move *P past it. Return the string, or NULL if malformed. */
+static char *
+parse_string(char **p)
+{
+	if (**p != '"')
+		return NULL;
+
+	char *str = ++*p;
+	char *dst = str;
+	for (char *src = str; *src; src++) {
+		if (*src == '"') {
+			*dst = '\0';
+			*p = src + 1;
+			return str;
+		}
+
+		if (*src != '\\') {
+			*dst++ = *src;
+			continue;
+		}
+
+		switch (*++src) {
+		case 'b': *dst++ = '\b'; break;
+		case 'f': *dst++ = '\f'; break;
+		case 'n': *dst++ = '\n'; break;
+		case 'r': *dst++ = '\r'; break;
+		case 't': *dst++ = '\t'; break;
+		case 'u': {
+			unsigned long cp;
+			if (parse_unicode_escape(&src, &cp) == -1)
+				return NULL;
+			dst += encode_utf8(dst, cp);
+			break;
+		}
+		case '\0': return NULL;
+		default: *dst++ = *src; break; /* " \ / */
+		}
+	}
+
+	return NULL;
+}
+
+/* Parse the number at *P, and move *P past it. */
+static size_t
+parse_size(char **p)
+{
+	char *end;
+	const unsigned long long n = strtoull(*p, &end, 10);
+	if (end == *p)
+		unexpected_response();
+
+	*p = end;
+	return (size_t)n;
+}
+
+/* Exit if LINE is an error message. */
+static void
+check_error(char *line)
+{
+	char *p = line;
+	if (skip(&p, "{\"error\":") == -1)
+		return;
+
+	const char *msg = parse_string(&p);
+	fprintf(stderr, "fnf: %s\n", msg ? msg : line);
+	exit(EXIT_FAILURE);
+}
+
+/* Return the local index of the string TEXT, at position INDEX in the
+ * corpus, adding TEXT to C if new. */
+static size_t
+local_index(client_t *cl, choices_t *c, const char *text, const size_t index)
+{
+	if (index >= cl->locals_size) {
+		size_t size = cl->locals_size ? cl->locals_size : 1024;
+		while (size <= index)
+			size *= 2;
+		cl->locals = safe_realloc(cl->locals, size * sizeof(size_t));
+		memset(cl->locals + cl->locals_size, 0,
+			(size - cl->locals_size) * sizeof(size_t));
+		cl->locals_size = size;
+	}
+
+	/* The corpus may have been reloaded since: check the string. */
+	const size_t local = cl->locals[index];
+	if (local > 0 && strcmp(c->strings[local - 1], text) == 0)
+		return local - 1;
+
+	const size_t len = strlen(text) + 1;
+	char *copy = safe_realloc(NULL, len);
+	memcpy(copy, text, len);
+	choices_add(c, copy);
+
+	cl->locals[index] = c->size;
+	return c->size - 1;
+}
+
+/* Make the matches in the response LINE the results of the search in C. */
+static void
+parse_response(client_t *cl, choices_t *c, char *line)
+{
+	check_error(line);
+
+	char *p = line;
+	if (skip(&p, "{\"query\":") == -1 || !parse_string(&p)
+	|| skip(&p, ",\"total\":") == -1)
+		unexpected_response();
+	cl->total = parse_size(&p);
+
+	if (skip(&p, ",\"offset\":") == -1)
+		unexpected_response();
+	parse_size(&p);
+
+	if (skip(&p, ",\"results\":[") == -1)
+		unexpected_response();
+
+	struct scored_result *results = NULL;
+	size_t count = 0;
+	size_t cap = 0;
+
+	while (*p == '{' || *p == ',') {
+		if (*p == ',')
+			p++;
+
+		const char *text;
+		if (skip(&p, "{\"text\":") == -1 || !(text = parse_string(&p))
+		|| skip(&p, ",\"index\":") == -1)
+			unexpected_response();
+		const size_t index = parse_size(&p);
+
+		if (skip(&p, ",\"score\":") == -1)
+			unexpected_response();
+		/* Infinite scores are sent as out of range numbers. */
+		const score_t score = strtod(p, &p);
+
+		if (skip(&p, ",\"positions\":[") == -1 || !(p = strchr(p, ']'))
+		|| skip(&p, "]}") == -1)
+			unexpected_response();
+
+		if (count == cap) {
+			cap = cap ? cap * 2 : 64;
+			results = safe_realloc(results,
+				cap * sizeof(struct scored_result));
+		}
+
+		const size_t local = local_index(cl, c, text, index);
+		results[count].str = c->strings[local];
+		results[count].index = local;
+		results[count].score = score;
+		count++;
+	}
+
+	if (skip(&p, "]}") == -1)
+		unexpected_response();
+
+	choices_set_results(c, results, count);
+}
+
+/* Connect to the daemon at OPTIONS->CONNECT_SOCKET, and open the corpus
+ * OPTIONS->CORPUS. Exit on error. */
+void
+client_init(client_t *cl, const options_t *options)
+{
+	const char *socket_path = options->connect_socket;
+	memset(cl, 0, sizeof(client_t));
+
+	char *path = realpath(options->corpus, NULL);
+	if (!path) {
+		fprintf(stderr, "fnf: %s: %s\n", options->corpus, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "fnf: %s: Socket path too long\n", socket_path);
+		exit(EXIT_FAILURE);
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	cl->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (cl->fd == -1
+	|| connect(cl->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "fnf: %s: %s\n", socket_path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	cl->reader.fd = cl->fd;
+	write_all(cl->fd, path, strlen(path));
+	write_all(cl->fd, "\n", 1);
+	free(path);
+
+	char *line = reader_next_line(&cl->reader);
+	if (!line)
+		lost_connection();
+	check_error(line);
+
+	char *p = line;
+	if (skip(&p, "{\"size\":") == -1)
+		unexpected_response();
+	cl->size = parse_size(&p);
+}
+
+/* Close the connection, and free the strings received into C. */
+void
+client_destroy(client_t *cl, choices_t *c)
+{
+	for (size_t i = 0; i < c->size; i++)
+		free((char *)c->strings[i]);
+	c->size = 0;
+
+	close(cl->fd);
+	free(cl->reader.buf);
+	free(cl->locals);
+}
+
+/* Search for QUERY, making its LIMIT best matches (all if zero) the
+ * results of the search in C. */
+void
+client_search(client_t *cl, choices_t *c, const char *query,
+	const size_t limit)
+{
+	const size_t len = strlen(query);
+	char *request = safe_realloc(NULL, len + 32);
+
+	/* Tabs and newlines would end the query. */
+	for (size_t i = 0; i < len; i++)
+		request[i] = (query[i] == '\t' || query[i] == '\n') ? ' ' : query[i];
+	const int n = snprintf(request + len, 32, "\t%zu\n", limit);
+
+	write_all(cl->fd, request, len + (size_t)n);
+	free(request);
+
+	char *line = reader_next_line(&cl->reader);
+	if (!line)
+		lost_connection();
+	parse_response(cl, c, line);
+}
+
+/* Print the matches for OPTIONS->FILTER, as found by the daemon. */
+void
+client_filter(client_t *cl, choices_t *c, const options_t *options)
+{
+	static output_t out;
+	output_init(&out, STDOUT_FILENO, options->print_null ? '\0' : '\n');
+
+	client_search(cl, c, options->filter, options->limit);
+
+	const size_t available = choices_available(c);
+	for (size_t n = 0; n < available; n++) {
+		if (options->show_scores)
+			output_printf(&out, "%f\t", choices_getscore(c, n));
+		output_item(&out, choices_get(c, n));
+	}
+	output_flush(&out);
+}
@@ -0,0 +1,65 @@
+/* client.h */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "choices.h"
+#include "options.h"
+#include "server.h" /* reader_t */
+
+/* Matches fetched by each search of the interface */
+#define CLIENT_MAX_RESULTS 1000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	reader_t reader;
+	size_t *locals; /* Local index + 1 of each string in the corpus, or 0 */
+	size_t locals_size;
+	size_t size; /* Number of strings in the corpus */
+	size_t total; /* Number of matches of the last search */
+	int fd;
+} client_t;
+
+void client_init(client_t *cl, const options_t *options);
+void client_destroy(client_t *cl, choices_t *c);
+void client_search(client_t *cl, choices_t *c, const char *query,
+	const size_t limit);
+void client_filter(client_t *cl, choices_t *c, const options_t *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLIENT_H */
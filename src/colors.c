@@ -30,8 +30,11 @@
 #include <stdlib.h> /* getenv */
 #include <string.h> /* strlen */
 
+#include "ansi.h"
 #include "colors.h"
 #include "config.h" /* DEFAULT_COLORS */
+#include "match.h" /* MATCH_MAX_LEN */
+#include "utf8.h"
 
 char colors[COLOR_ITEMS_NUM][MAX_COLOR_LEN];
 
@@ -376,16 +379,152 @@ append_str(char *buf, const size_t buf_space, const char *str,
 	return str_len;
 }
 
+/* Length in bytes of the SGR sequence at S (zero if there is none). */
+static size_t
+sgr_len(const char *s)
+{
+	if (!IS_SGR_START(s))
+		return 0;
+
+	size_t i = 2;
+	while (s[i] && s[i] != 'm' && IS_SGR_CHAR(s[i]))
+		i++;
+
+	return s[i] == 'm' ? i + 1 : i;
+}
+
+struct row_layout {
+	size_t start; /* First byte of NAME to print */
+	size_t limit; /* Columns available for NAME (excluding ellipses) */
+	int lead_ellipsis;
+	int tail_ellipsis;
+};
+
+/* Fit NAME, whose display width is WIDTH, into COLS columns. If NAME is too
+ * wide, it is cut on the right, and, if the first highlighted character
+ * (at byte offset FIRST_MATCH) would fall off-screen, scrolled to the left
+ * as well, so that the match remains visible (the whole match, up to
+ * LAST_MATCH, if possible). ELLIPSIS_W is the width of the ellipsis marking
+ * the cuts. SGR sequences in NAME take no space. */
+static struct row_layout
+layout_row(const char *name, const size_t width, const size_t cols,
+	const size_t first_match, const size_t last_match, const size_t ellipsis_w)
+{
+	struct row_layout row = {0, cols, 0, 0};
+
+	if (width <= cols)
+		return row;
+
+	size_t before_first = 0; /* Width of NAME before the first match */
+	size_t through_first = 0; /* Width of NAME through the first match */
+	size_t through_last = 0; /* Width of NAME through the last match */
+
+	if (last_match != (size_t)-1) {
+		size_t total = 0;
+		for (size_t i = 0, len = 0; name[i] && i <= last_match; i += len) {
+			if ((len = sgr_len(name + i)) > 0)
+				continue;
+
+			const size_t cluster_start = total;
+			size_t w = 0;
+			len = utf8_cluster(name + i, &w);
+			total += w;
+
+			if (first_match >= i && first_match < i + len) {
+				before_first = cluster_start;
+				through_first = total;
+			}
+			if (last_match >= i && last_match < i + len)
+				through_last = total;
+		}
+	}
+
+	row.tail_ellipsis = 1;
+	row.limit = cols > ellipsis_w ? cols - ellipsis_w : 0;
+
+	if (through_last <= row.limit)
+		return row;
+
+	/* Scroll: drop characters from the left until the match (or at least
+	 * its first character) fits after the leading ellipsis. */
+	const size_t limit = row.limit > ellipsis_w ? row.limit - ellipsis_w : 0;
+	const size_t target = through_last - before_first <= limit
+		? through_last : through_first;
+	if (target <= row.limit) /* The first character is already visible */
+		return row;
+
+	row.lead_ellipsis = 1;
+	row.limit = limit;
+	const size_t excess = target > row.limit ? target - row.limit : 0;
+
+	size_t dropped = 0;
+	size_t len = 0;
+	while (dropped < excess && row.start < first_match) {
+		if ((len = sgr_len(name + row.start)) == 0) {
+			size_t w = 0;
+			len = utf8_cluster(name + row.start, &w);
+			dropped += w;
+		}
+		row.start += len;
+	}
+
+	/* The match may be close enough to the end to make the tail fit. */
+	if (width - dropped <= row.limit + ellipsis_w) {
+		row.tail_ellipsis = 0;
+		row.limit += ellipsis_w;
+	}
+
+	return row;
+}
+
+/* Append to BUF (of BUF_SPACE bytes) the colors of the spans FROM to TO
+ * (excluded) in ANSI, so that the attributes in effect right before the
+ * span TO are set again after a highlighted match. ORIG_COLOR (ORIG_LEN
+ * bytes), the base color, is set first.
+ * Return the number of bytes appended. */
+static size_t
+append_spans(char *buf, const size_t buf_space, const struct ansi_colors *ansi,
+	const size_t from, const size_t to, const char *orig_color,
+	const size_t orig_len)
+{
+	size_t l = append_str(buf, buf_space, RESET_ATTR, sizeof(RESET_ATTR) - 1);
+	l += append_str(buf + l, buf_space - l, orig_color, orig_len);
+
+	for (size_t i = from; i < to; i++) {
+		const char *attr = ansi->ansi->attrs[ansi->spans[i].attr];
+		l += append_str(buf + l, buf_space - l, attr, strlen(attr));
+	}
+
+	return l;
+}
+
+static const char *
+get_ellipsis(const tty_interface_t *state, size_t *width)
+{
+	if (state->options->unicode == 1) {
+		*width = 1;
+		return DEFAULT_ELLIPSIS_UNICODE;
+	}
+
+	*width = sizeof(DEFAULT_ELLIPSIS) - 1;
+	return DEFAULT_ELLIPSIS;
+}
+
 #define BUF_SIZE 8192
 /* Build a complete interface line and print it to the output device (STATE->TTY).
  * Prepend the pointer string POINTER->STR, and colorize the string NAME,
  * highlighting matching characters (according to POSITIONS) with the
  * appropriate color. The color of the original item, ORIGINAL_COLOR,
- * is preserved). */
+ * is preserved).
+ * Only the part of NAME fitting into COLS columns is printed: if the first
+ * match does not fit, NAME is scrolled horizontally to make it visible.
+ * If not NULL, ANSI holds the colors removed from NAME when loading it
+ * (--ansi): they are put back in place (and restored after each match). */
 void
 colorize_match(const tty_interface_t *state, const size_t *positions,
 	const char *name, const char *original_color, const pointer_t *pointer,
-	const int selected)
+	const int selected, const size_t cols, const size_t width,
+	const struct ansi_colors *ansi)
 {
 	const int no_color = state->options->no_color;
 	const char *highlight =
@@ -408,14 +547,27 @@ colorize_match(const tty_interface_t *state, const size_t *positions,
 		sel_color_len = strlen(sel_color);
 	}
 
+	size_t ellipsis_w = 0;
+	const char *ellipsis = get_ellipsis(state, &ellipsis_w);
+	const size_t ellipsis_len = strlen(ellipsis);
+	size_t last = 0;
+	while (last + 1 < MATCH_MAX_LEN && positions[last + 1] != (size_t)-1)
+		last++;
+
+	const struct row_layout row = layout_row(name, width, cols,
+		positions[0], positions[last], ellipsis_w);
+
 	size_t l = 0; /* Current buffer length */
 	size_t p = 0; /* Position in match */
+	size_t col = 0; /* Columns taken so far (excluding ellipses) */
 	int in_match = 0; /* Track whether we are currently in a match */
+	size_t span = 0; /* Next color span to apply (--ansi) */
+	size_t span_base = 0; /* Spans to apply again after a match */
 
 	static char buf[BUF_SIZE];
 	l += append_str(buf, sizeof(buf), pointer->str, pointer->len);
 
-	if (positions[p] != 0) {
+	if (positions[p] != row.start) {
 		/* If the first character is not a match, set the original color */
 		l += append_str(buf + l, sizeof(buf) - l, orig_color, oc_len);
 	} else if (selected == 1) {
@@ -424,32 +576,67 @@ colorize_match(const tty_interface_t *state, const size_t *positions,
 		l += append_str(buf + l, sizeof(buf) - l, sel_color, sel_color_len);
 	}
 
-	for (size_t i = 0; name[i]; i++) {
-		const int is_match = (positions[p] == i);
+	if (row.lead_ellipsis == 1)
+		l += append_str(buf + l, sizeof(buf) - l, ellipsis, ellipsis_len);
+
+	size_t char_len = 0;
+	for (size_t i = row.start; name[i]; i += char_len) {
+		size_t w = 0;
+		char_len = utf8_cluster(name + i, &w);
+		if (col + w > row.limit)
+			break;
+		col += w;
+
+		/* Colors starting here. Inside a match they are only printed
+		 * once the match is over. */
+		for (; ansi && span < ansi->count && ansi->spans[span].offset <= i;
+		span++) {
+			const uint32_t attr = ansi->spans[span].attr;
+			if (ansi_is_reset(ansi->ansi, attr))
+				span_base = span + 1;
+			if (!in_match) {
+				l += append_str(buf + l, sizeof(buf) - l, ansi->ansi->attrs[attr],
+					strlen(ansi->ansi->attrs[attr]));
+				if (span_base == span + 1) /* Reset: back to the base color */
+					l += append_str(buf + l, sizeof(buf) - l, orig_color, oc_len);
+			}
+		}
+
+		/* A grapheme cluster is highlighted as a whole. */
+		const int is_match = (positions[p] >= i && positions[p] < i + char_len);
 
 		if (is_match) {
 			if (!in_match) {
 				l += append_str(buf + l, sizeof(buf) - l, highlight, hl_len);
 				in_match = 1; /* Transition from non-match to match */
 			}
-			p++; /* Move to the next position */
+			while (positions[p] < i + char_len)
+				p++; /* Move to the next position */
 		} else {
 			if (in_match) {
-				l += append_str(buf + l, sizeof(buf) - l, orig_color, oc_len);
+				l += ansi ? append_spans(buf + l, sizeof(buf) - l, ansi,
+						span_base, span, orig_color, oc_len)
+					: append_str(buf + l, sizeof(buf) - l, orig_color, oc_len);
 				in_match = 0; /* Transition from match to non-match */
 			}
 		}
 
-		/* Make sure there is enough space in the buffer to write a complete
-		 * UTF-8 character (max 4 bytes + NUL terminator). */
-		if (l >= sizeof(buf) - 5)
+		/* Make sure there is enough space in the buffer to write the
+		 * whole cluster (plus NUL terminator). */
+		if (l + char_len >= sizeof(buf) - 1)
 			break;
 
 		/* Append the current character to the buffer */
 		buf[l++] = (name[i] == '\n') ? ' ' : name[i];
 		/* If a multi-byte character, append the remaining bytes */
-		while (IS_UTF8_CONT_BYTE(name[i + 1]))
-			buf[l++] = name[++i];
+		for (size_t j = 1; j < char_len; j++)
+			buf[l++] = name[i + j];
+	}
+
+	if (row.tail_ellipsis == 1) {
+		if (in_match)
+			l += append_str(buf + l, sizeof(buf) - l, orig_color, oc_len);
+		l += append_str(buf + l, sizeof(buf) - l, ellipsis, ellipsis_len);
 	}
 
 	l += append_str(buf + l, sizeof(buf) - l,
@@ -461,13 +648,50 @@ colorize_match(const tty_interface_t *state, const size_t *positions,
 	state->tty->fgcolor = TERM_FG_COLOR_RESET;
 	tty_fputs(state->tty, buf);
 }
-#undef BUF_SIZE
 
-/* Same as colorize_match, but for non-matching items. */
+/* Same as colorize_match, but for non-matching items.
+ * NAME may contain SGR sequences: they are printed, but take no space. */
 void
-colorize_no_match(tty_t *tty, const char *sel_color, const char *name,
-	const pointer_t *pointer)
+colorize_no_match(const tty_interface_t *state, const char *sel_color,
+	const char *name, const pointer_t *pointer, const size_t cols,
+	const size_t width)
 {
-	tty_printf(tty, "%s%s%s%s", pointer->str, sel_color, name,
-		RESET_ATTR CLEAR_LINE);
+	if (width <= cols) {
+		tty_printf(state->tty, "%s%s%s%s", pointer->str, sel_color, name,
+			RESET_ATTR CLEAR_LINE);
+		return;
+	}
+
+	size_t ellipsis_w = 0;
+	const char *ellipsis = get_ellipsis(state, &ellipsis_w);
+	const struct row_layout row =
+		layout_row(name, width, cols, (size_t)-1, (size_t)-1, ellipsis_w);
+
+	static char buf[BUF_SIZE];
+	size_t l = 0;
+	size_t col = 0;
+	size_t len = 0;
+
+	for (size_t i = 0; name[i] && l + 1 < sizeof(buf); i += len) {
+		if ((len = sgr_len(name + i)) == 0) {
+			size_t w = 0;
+			len = utf8_cluster(name + i, &w);
+			if (col + w > row.limit)
+				break;
+			col += w;
+		}
+
+		if (l + len >= sizeof(buf) - 1)
+			break;
+
+		memcpy(buf + l, name + i, len);
+		if (name[i] == '\n')
+			buf[l] = ' ';
+		l += len;
+	}
+	buf[l] = '\0';
+
+	tty_printf(state->tty, "%s%s%s%s%s", pointer->str, sel_color, buf,
+		row.tail_ellipsis == 1 ? ellipsis : "", RESET_ATTR CLEAR_LINE);
 }
+#undef BUF_SIZE
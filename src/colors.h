@@ -63,6 +63,7 @@
 #define IS_UTF8_CONT_BYTE(c) (((c) & 0xc0) == 0x80)
 #define IS_UTF8_CHAR(c)      (IS_UTF8_LEAD_BYTE((c)) || IS_UTF8_CONT_BYTE((c)))
 
+#include "ansi.h"
 #include "tty_interface.h"
 
 #ifdef __cplusplus
@@ -74,9 +75,11 @@ extern char colors[COLOR_ITEMS_NUM][MAX_COLOR_LEN];
 char *decolor_name(const char *name, char *color);
 void colorize_match(const tty_interface_t *state, const size_t *positions,
 	const char *name, const char *orig_color, const pointer_t *pointer,
-	const int selected);
-void colorize_no_match(tty_t *tty, const char *sel_color, const char *name,
-	const pointer_t *pointer);
+	const int selected, const size_t cols, const size_t width,
+	const struct ansi_colors *ansi);
+void colorize_no_match(const tty_interface_t *state, const char *sel_color,
+	const char *name, const pointer_t *pointer, const size_t cols,
+	const size_t width);
 void set_colors(tty_interface_t *state);
 
 #ifdef __cplusplus
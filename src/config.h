@@ -40,11 +40,19 @@
 #define SCORE_MATCH_DOT 0.6
 #define SCORE_MATCH_SLASH 0.9
 #define SCORE_MATCH_WORD 0.8
+#define SCORE_TYPO -1.0
 
 #define CASE_INSENSITIVE 0
 #define CASE_SENSITIVE   1
 #define CASE_SMART       2
 
+#define ALGO_OPTIMAL 0
+#define ALGO_GREEDY  1
+#define ALGO_AUTO    2 /* Greedy above DEFAULT_ALGO_AUTO_THRESHOLD strings */
+
+#define DEFAULT_ALGO ALGO_OPTIMAL
+#define DEFAULT_ALGO_AUTO_THRESHOLD 10000000
+#define DEFAULT_ANSI 0
 #define DEFAULT_AUTO_LINES 0
 #define DEFAULT_CASE_SENSITIVITY_MODE CASE_SMART
 #define DEFAULT_CLEAR 1
@@ -58,15 +66,24 @@
 	"pointer:1:1,prompt:6:1,query:-1,score:7:2,sel-bg:0,sel-fg:7:1,separator:7:2"
 #define DEFAULT_CYCLE 0
 #define DEFAULT_DELIMITER '\n'
+#define DEFAULT_ELLIPSIS ".."
+#define DEFAULT_ELLIPSIS_UNICODE "…"
+#define DEFAULT_EXACT 0
+#define DEFAULT_EXTENDED 0
 #define DEFAULT_FILTER NULL
+#define DEFAULT_INCREMENTAL 0 /* 0: disabled */
+#define DEFAULT_INCREMENTAL_LIMIT 64 /* MiB, if no limit is given */
 #define DEFAULT_INIT_SEARCH NULL
 #define DEFAULT_LEFT_ABORTS 0
+#define DEFAULT_LIMIT 0 /* 0: unlimited */
 #define DEFAULT_MARKER "*"
 #define DEFAULT_MARKER_UNICODE "✔"
 #define DEFAULT_MAX_ITEMS -1 /* Unlimited */
+#define DEFAULT_MEMORY_LIMIT 0 /* 0: unlimited */
 #define DEFAULT_MULTI 0
 #define DEFAULT_NO_BOLD 0
 #define DEFAULT_NO_COLOR 0
+#define DEFAULT_NORMALIZE 0
 #define DEFAULT_NUM_LINES 10
 #define DEFAULT_PAD 0
 #define DEFAULT_POINTER ">"
@@ -77,12 +94,17 @@
 #define DEFAULT_RIGHT_ACCEPTS 0
 #define DEFAULT_SCORES 0
 #define DEFAULT_SCROLLOFF -1 /* auto */
+#define DEFAULT_SEARCH_INDEX 0
 #define DEFAULT_SEPARATOR "-"
 #define DEFAULT_SEPARATOR_UNICODE "─"
 #define DEFAULT_SORT 1
+#define DEFAULT_SERVER_FD -1 /* Disabled */
 #define DEFAULT_SHOW_INFO 0
 #define DEFAULT_TAB_ACCEPTS 0
+#define DEFAULT_THROTTLE 0
 #define DEFAULT_TTY "/dev/tty"
+#define DEFAULT_TYPOS 0
+#define DEFAULT_TYPOS_THRESHOLD 10 /* --typos: fewer results, look for typos */
 #define DEFAULT_UNICODE 1
 #define DEFAULT_WORKERS 0 /* 0: Number of CPUs */
 
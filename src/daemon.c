@@ -0,0 +1,464 @@
+/* daemon.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+
+/* Daemon mode (--daemon).
+ *
+ * The daemon listens on a Unix domain socket, and loads files (corpora)
+ * the first time a client asks for them, keeping them in memory, along
+ * with the data computed on load, for later clients: each client only
+ * pays for its searches.
+ *
+ * Corpora are files of strings, as fnf reads on its standard input, or
+ * snapshots written with --index-out.
+ *
+ * A connection starts with a line holding the absolute path of a corpus,
+ * answered with {"size":N} (N being the number of strings in it), or
+ * with {"error":MESSAGE}. It then goes on as in --server mode (see
+ * server.c): one request per line, one line of JSON per response.
+ *
+ * Before each request, the file is checked for changes (identity, size,
+ * and modification time), and reloaded if needed. A version of a corpus
+ * in use is only freed once no client uses it anymore. With
+ * --memory-limit, the least recently used corpora no client is using are
+ * unloaded to make room for new ones.
+ *
+ * Each client is served by its own thread. Searches leave the corpus
+ * untouched (other clients may be searching it at the same time), but
+ * still use as many worker threads as --workers allows. */
+
+#ifndef _DEFAULT_SOURCE
+/* sigaction */
+# define _DEFAULT_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "daemon.h"
+#include "output.h"
+#include "server.h"
+#include "snapshot.h"
+
+struct corpus {
+	struct corpus *next;
+	char *path;
+	choices_t choices;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	size_t memory; /* Bytes taken by the strings and their data */
+	size_t users; /* Clients using this version */
+	unsigned long last_used;
+	int stale; /* Replaced by a newer version, or unloaded */
+};
+
+struct daemon {
+	pthread_mutex_t lock;
+	const options_t *options;
+	struct corpus *corpora; /* Current versions */
+	size_t memory; /* Taken by all corpora in the list */
+	size_t memory_limit; /* Zero: unlimited */
+	unsigned long clock; /* Incremented whenever a corpus is used */
+};
+
+struct client {
+	struct daemon *d;
+	int fd;
+};
+
+/* Path of the socket, to be removed on exit */
+static const char *socket_path = NULL;
+
+static int
+is_unchanged(const struct corpus *cp, const struct stat *st)
+{
+	return cp->dev == st->st_dev && cp->ino == st->st_ino
+		&& cp->size == st->st_size && cp->mtime == st->st_mtime;
+}
+
+static void
+corpus_free(struct corpus *cp)
+{
+	choices_destroy(&cp->choices);
+	free(cp->path);
+	free(cp);
+}
+
+/* Load the file PATH. Return NULL on error, setting *ERROR. */
+static struct corpus *
+corpus_load(const options_t *options, const char *path, const char **error)
+{
+	struct stat st;
+	FILE *fp = fopen(path, "r");
+	if (!fp || fstat(fileno(fp), &st) == -1 || !S_ISREG(st.st_mode)) {
+		*error = "Cannot read the corpus";
+		if (fp)
+			fclose(fp);
+		return NULL;
+	}
+
+	struct corpus *cp = safe_realloc(NULL, sizeof(struct corpus));
+	memset(cp, 0, sizeof(struct corpus));
+	cp->path = safe_realloc(NULL, strlen(path) + 1);
+	strcpy(cp->path, path);
+	cp->dev = st.st_dev;
+	cp->ino = st.st_ino;
+	cp->size = st.st_size;
+	cp->mtime = st.st_mtime;
+
+	choices_init(&cp->choices, options);
+	if (snapshot_check(fp) == 1) {
+		fclose(fp);
+		/* Snapshots are mapped: their pages are shared with other users. */
+		if (snapshot_load(&cp->choices, path, error) == -1) {
+			corpus_free(cp);
+			return NULL;
+		}
+	} else {
+		choices_fread(&cp->choices, fp, options->input_delimiter,
+			options->max_items);
+		fclose(fp);
+	}
+	choices_index(&cp->choices);
+
+	const choices_t *c = &cp->choices;
+	cp->memory = c->buffer_size + c->map_size + c->capacity * (sizeof(char *)
+		+ sizeof(uint32_t) * (c->ansi ? 2 : 1));
+	if (c->ansi) {
+		cp->memory += c->ansi->spans_capacity * sizeof(struct ansi_span)
+			+ c->ansi->table_size * sizeof(uint32_t);
+	}
+
+	return cp;
+}
+
+/* Remove CP from the list of corpora, freeing it if unused.
+ * Must be called with D->LOCK held. */
+static void
+corpus_unload(struct daemon *d, struct corpus *cp)
+{
+	for (struct corpus **p = &d->corpora; *p; p = &(*p)->next) {
+		if (*p == cp) {
+			*p = cp->next;
+			break;
+		}
+	}
+
+	d->memory -= cp->memory;
+	cp->stale = 1;
+	if (cp->users == 0)
+		corpus_free(cp);
+}
+
+/* Unload the least recently used corpora nobody is using, until the
+ * memory limit is met. Must be called with D->LOCK held. */
+static void
+enforce_memory_limit(struct daemon *d)
+{
+	while (d->memory_limit > 0 && d->memory > d->memory_limit) {
+		struct corpus *lru = NULL;
+		for (struct corpus *cp = d->corpora; cp; cp = cp->next) {
+			if (cp->users == 0 && (!lru || cp->last_used < lru->last_used))
+				lru = cp;
+		}
+
+		if (!lru)
+			return;
+		corpus_unload(d, lru);
+	}
+}
+
+/* Return the current version of the corpus PATH, or NULL on error (setting
+ * *ERROR). It must be handed back with corpus_release(). */
+static struct corpus *
+corpus_acquire(struct daemon *d, const char *path, const char **error)
+{
+	struct stat st;
+	if (stat(path, &st) == -1) {
+		*error = "Cannot access the corpus";
+		return NULL;
+	}
+
+	struct corpus *cp;
+	pthread_mutex_lock(&d->lock);
+	for (cp = d->corpora; cp; cp = cp->next) {
+		if (strcmp(cp->path, path) != 0)
+			continue;
+
+		if (is_unchanged(cp, &st)) {
+			cp->users++;
+			cp->last_used = ++d->clock;
+			pthread_mutex_unlock(&d->lock);
+			return cp;
+		}
+
+		corpus_unload(d, cp);
+		break;
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	/* Load without the lock, so that other clients are still served. */
+	struct corpus *new = corpus_load(d->options, path, error);
+	if (!new)
+		return NULL;
+
+	pthread_mutex_lock(&d->lock);
+
+	/* Another client may have loaded it in the meantime. */
+	for (cp = d->corpora; cp; cp = cp->next) {
+		if (strcmp(cp->path, path) == 0 && cp->dev == new->dev
+		&& cp->ino == new->ino && cp->size == new->size
+		&& cp->mtime == new->mtime) {
+			cp->users++;
+			cp->last_used = ++d->clock;
+			pthread_mutex_unlock(&d->lock);
+			corpus_free(new);
+			return cp;
+		}
+	}
+
+	if (d->memory_limit > 0 && new->memory > d->memory_limit) {
+		pthread_mutex_unlock(&d->lock);
+		corpus_free(new);
+		*error = "The corpus exceeds the memory limit";
+		return NULL;
+	}
+
+	/* An older version still listed is out of date. */
+	for (cp = d->corpora; cp; cp = cp->next) {
+		if (strcmp(cp->path, path) == 0) {
+			corpus_unload(d, cp);
+			break;
+		}
+	}
+
+	new->users = 1;
+	new->last_used = ++d->clock;
+	new->next = d->corpora;
+	d->corpora = new;
+	d->memory += new->memory;
+	enforce_memory_limit(d);
+
+	pthread_mutex_unlock(&d->lock);
+	return new;
+}
+
+static void
+corpus_release(struct daemon *d, struct corpus *cp)
+{
+	pthread_mutex_lock(&d->lock);
+	cp->users--;
+	if (cp->users == 0) {
+		if (cp->stale == 1)
+			corpus_free(cp);
+		else
+			enforce_memory_limit(d);
+	}
+	pthread_mutex_unlock(&d->lock);
+}
+
+/* Return the current version of CP, reloading it if the file changed.
+ * S is reset if the version changes. If the file cannot be read anymore,
+ * CP is kept. */
+static struct corpus *
+corpus_refresh(struct daemon *d, struct corpus *cp, session_t *s)
+{
+	struct stat st;
+	if (stat(cp->path, &st) == -1 || is_unchanged(cp, &st))
+		return cp;
+
+	const char *error = NULL;
+	struct corpus *new = corpus_acquire(d, cp->path, &error);
+	if (!new)
+		return cp;
+
+	corpus_release(d, cp);
+	session_reset(s, &new->choices);
+	return new;
+}
+
+static void *
+client_thread(void *data)
+{
+	struct client *cl = data;
+	struct daemon *d = cl->d;
+	reader_t r = {NULL, 0, 0, 0, cl->fd, 0};
+	output_t *out = safe_realloc(NULL, sizeof(output_t));
+	output_init(out, cl->fd, '\n');
+
+	const char *error = "Expected the absolute path of a corpus";
+	struct corpus *cp = NULL;
+	char *line = reader_next_line(&r);
+	if (line && *line == '/')
+		cp = corpus_acquire(d, line, &error);
+
+	if (!cp) {
+		output_printf(out, "{\"error\":\"%s\"}\n", error);
+		output_flush(out);
+	} else {
+		session_t s;
+		session_init(&s, &cp->choices, 1);
+		output_printf(out, "{\"size\":%zu}\n", cp->choices.size);
+
+		if (output_flush(out) == 0) {
+			while ((line = reader_next_line(&r))) {
+				cp = corpus_refresh(d, cp, &s);
+				if (session_request(&s, d->options, line, out) == -1)
+					break;
+			}
+		}
+
+		session_destroy(&s);
+		corpus_release(d, cp);
+	}
+
+	close(cl->fd);
+	free(r.buf);
+	free(out);
+	free(cl);
+	return NULL;
+}
+
+static void
+remove_socket(int sig)
+{
+	unlink(socket_path);
+	_exit(128 + sig);
+}
+
+/* Return a socket listening at PATH. Exit on error. */
+static int
+listen_socket(const char *path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "fnf: %s: Socket path too long\n", path);
+		exit(EXIT_FAILURE);
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		perror("socket");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Replace a socket left behind, unless a daemon still listens there. */
+	struct stat st;
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)
+		|| connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+			fprintf(stderr, "fnf: %s: Address in use\n", path);
+			exit(EXIT_FAILURE);
+		}
+		unlink(path);
+		close(fd);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	}
+
+	/* Only the user can connect: clients can read whatever we can. */
+	const mode_t mask = umask(077);
+	if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+	|| listen(fd, SOMAXCONN) == -1) {
+		fprintf(stderr, "fnf: %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	umask(mask);
+
+	return fd;
+}
+
+/* Serve clients connecting to the socket OPTIONS->DAEMON_SOCKET. */
+void
+daemon_run(const options_t *options)
+{
+	static struct daemon d;
+	d.options = options;
+	d.memory_limit = options->memory_limit * 1024 * 1024;
+	if (pthread_mutex_init(&d.lock, NULL) != 0) {
+		fprintf(stderr, "Error: pthread_mutex_init failed\n");
+		abort();
+	}
+
+	const int fd = listen_socket(options->daemon_socket);
+	socket_path = options->daemon_socket;
+
+	/* Clients going away must not take the daemon with them. */
+	signal(SIGPIPE, SIG_IGN);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = remove_socket;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	for (;;) {
+		const int client_fd = accept(fd, NULL, NULL);
+		if (client_fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("accept");
+			break;
+		}
+
+		struct client *cl = safe_realloc(NULL, sizeof(struct client));
+		cl->d = &d;
+		cl->fd = client_fd;
+
+		pthread_t thread;
+		if ((errno = pthread_create(&thread, &attr, client_thread, cl))) {
+			perror("pthread_create");
+			close(client_fd);
+			free(cl);
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+	unlink(socket_path);
+	close(fd);
+}
@@ -0,0 +1,450 @@
+/* fields.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+
+/* Field-aware matching (--delimiter, --nth, --with-nth).
+ *
+ * Each candidate is split into fields once, when it is loaded: the byte
+ * ranges of the fields of all candidates go into a single table, along
+ * with the text to match (the fields selected by --nth) and the text to
+ * display (those selected by --with-nth). Selected fields are joined by
+ * the delimiter; a selection running to the end of the candidate is not
+ * copied, but pointed at. Nothing is split again while searching or
+ * drawing: the positions of matched characters are mapped back to the
+ * candidate, or to the displayed text, through the table. */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "fields.h"
+#include "match.h" /* MATCH_MAX_LEN */
+
+#define MAX_RANGES 32
+#define BLOCK_SIZE (64 * 1024)
+#define INITIAL_TABLE_CAPACITY 1024
+
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t')
+
+/* Fields FIRST to LAST, numbered from 1, or from the last one (-1) if
+ * negative. Zero is an open end (e.g. "2.." or "..-2"). */
+struct field_range {
+	int first;
+	int last;
+};
+
+/* Byte range of a field in its candidate, delimiter excluded */
+struct field {
+	uint32_t start;
+	uint32_t end;
+};
+
+/* Storage for the selected fields of candidates, when copied */
+struct block {
+	struct block *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+struct fields {
+	const char *separator; /* Delimiter, also joining selected fields */
+	size_t separator_len;
+	int blanks; /* Fields are separated by runs of blanks (no --delimiter) */
+	struct field_range nth[MAX_RANGES];
+	struct field_range with_nth[MAX_RANGES];
+	size_t nth_count;
+	size_t with_nth_count;
+	struct field *table;
+	size_t table_size;
+	size_t table_capacity;
+	size_t *first; /* First field of each candidate, then TABLE_SIZE */
+	size_t count; /* Number of candidates */
+	size_t capacity;
+	struct block *blocks;
+};
+
+/* Parse the field number at *S (if any) into *N, and move *S past it.
+ * Return 1 if there was one, 0 if not, or -1 if it is not valid. */
+static int
+parse_index(const char **s, int *n)
+{
+	*n = 0;
+	if (**s != '-' && (**s < '0' || **s > '9'))
+		return 0;
+
+	char *end;
+	errno = 0;
+	const long value = strtol(*s, &end, 10);
+	if (end == *s || errno != 0 || value == 0
+	|| value > INT_MAX || value < -INT_MAX)
+		return -1;
+
+	*n = (int)value;
+	*s = end;
+	return 1;
+}
+
+/* Parse the comma-separated field ranges in SPEC (e.g. "1,3..5,-1") into
+ * RANGES (if not NULL). Return their number, or 0 if SPEC is not valid. */
+static size_t
+parse_ranges(const char *spec, struct field_range *ranges)
+{
+	const char *s = spec;
+	size_t count = 0;
+
+	for (;;) {
+		struct field_range r;
+		const int has_first = parse_index(&s, &r.first);
+		if (has_first == -1 || count == MAX_RANGES)
+			return 0;
+
+		if (s[0] == '.' && s[1] == '.') {
+			s += 2;
+			if (parse_index(&s, &r.last) == -1)
+				return 0;
+		} else if (has_first == 1) {
+			r.last = r.first;
+		} else {
+			return 0;
+		}
+
+		if (ranges)
+			ranges[count] = r;
+		count++;
+
+		if (*s == '\0')
+			return count;
+		if (*s++ != ',')
+			return 0;
+	}
+}
+
+/* Return 1 if SPEC is a valid list of field ranges (see --nth), or 0. */
+int
+fields_valid(const char *spec)
+{
+	return parse_ranges(spec, NULL) > 0;
+}
+
+/* Create a table of fields separated by DELIMITER (runs of blanks if
+ * NULL), selecting the text to match with NTH and the text to display
+ * with WITH_NTH (see --nth). Return NULL if neither is set: candidates are
+ * then matched and displayed as they are. */
+fields_t *
+fields_new(const char *delimiter, const char *nth, const char *with_nth)
+{
+	if (!nth && !with_nth)
+		return NULL;
+
+	fields_t *f = safe_realloc(NULL, sizeof(fields_t));
+	f->blanks = delimiter == NULL;
+	f->separator = delimiter ? delimiter : " ";
+	f->separator_len = strlen(f->separator);
+	f->nth_count = nth ? parse_ranges(nth, f->nth) : 0;
+	f->with_nth_count = with_nth ? parse_ranges(with_nth, f->with_nth) : 0;
+
+	f->table_capacity = INITIAL_TABLE_CAPACITY;
+	f->table = safe_realloc(NULL, f->table_capacity * sizeof(struct field));
+	f->capacity = INITIAL_TABLE_CAPACITY;
+	f->first = safe_realloc(NULL, (f->capacity + 1) * sizeof(size_t));
+	f->blocks = NULL;
+	fields_clear(f);
+
+	return f;
+}
+
+static void
+free_blocks(fields_t *f)
+{
+	while (f->blocks) {
+		struct block *next = f->blocks->next;
+		free(f->blocks);
+		f->blocks = next;
+	}
+}
+
+void
+fields_free(fields_t *f)
+{
+	if (!f)
+		return;
+
+	free_blocks(f);
+	free(f->table);
+	free(f->first);
+	free(f);
+}
+
+/* Remove all candidates (the memory of the table is kept for reuse). */
+void
+fields_clear(fields_t *f)
+{
+	free_blocks(f);
+	f->table_size = 0;
+	f->count = 0;
+	f->first[0] = 0;
+}
+
+static void
+push_field(fields_t *f, const size_t start, const size_t end)
+{
+	if (f->table_size == f->table_capacity) {
+		f->table_capacity *= 2;
+		f->table = safe_realloc(f->table,
+			f->table_capacity * sizeof(struct field));
+	}
+
+	f->table[f->table_size].start = (uint32_t)start;
+	f->table[f->table_size].end = (uint32_t)end;
+	f->table_size++;
+}
+
+/* Append the fields of LINE (LEN bytes) to the table. */
+static void
+split(fields_t *f, const char *line, const size_t len)
+{
+	if (f->blanks) {
+		for (size_t j = 0; j < len;) {
+			while (j < len && IS_BLANK(line[j]))
+				j++;
+			const size_t start = j;
+			while (j < len && !IS_BLANK(line[j]))
+				j++;
+			if (j > start)
+				push_field(f, start, j);
+		}
+		return;
+	}
+
+	for (const char *p = line;;) {
+		const char *delim = strstr(p, f->separator);
+		push_field(f, (size_t)(p - line),
+			delim ? (size_t)(delim - line) : len);
+		if (!delim)
+			break;
+		p = delim + f->separator_len;
+	}
+}
+
+/* Return field number N (see struct field_range) of COUNT fields, as
+ * an index from 1, OPEN if N is zero. */
+static long
+resolve(const int n, const size_t count, const long open)
+{
+	if (n == 0)
+		return open;
+	return n < 0 ? (long)count + n + 1 : n;
+}
+
+/* Store in SEGS the byte ranges of the Ith candidate selected by the
+ * COUNT RANGES (the fields of a range make a single one). Return their
+ * number. */
+static size_t
+select_fields(const fields_t *f, const size_t i,
+	const struct field_range *ranges, const size_t count,
+	struct field *segs)
+{
+	const struct field *fields = f->table + f->first[i];
+	const size_t n = f->first[i + 1] - f->first[i];
+	size_t k = 0;
+
+	for (size_t r = 0; r < count; r++) {
+		long first = resolve(ranges[r].first, n, 1);
+		long last = resolve(ranges[r].last, n, (long)n);
+		if (first < 1)
+			first = 1;
+		if (last > (long)n)
+			last = (long)n;
+		if (first > last)
+			continue;
+
+		segs[k].start = fields[first - 1].start;
+		segs[k].end = fields[last - 1].end;
+		k++;
+	}
+
+	return k;
+}
+
+/* Return room for a string of LEN bytes, NUL terminated, which lasts until
+ * fields_clear(). */
+static char *
+store(fields_t *f, const size_t len)
+{
+	struct block *b = f->blocks;
+
+	if (!b || b->size - b->used < len + 1) {
+		const size_t size = len + 1 > BLOCK_SIZE ? len + 1 : BLOCK_SIZE;
+		b = safe_realloc(NULL, sizeof(struct block) + size);
+		b->next = f->blocks;
+		b->size = size;
+		b->used = 0;
+		f->blocks = b;
+	}
+
+	char *p = b->data + b->used;
+	b->used += len + 1;
+	p[len] = '\0';
+
+	return p;
+}
+
+/* Return the COUNT byte ranges SEGS of LINE (LEN bytes long), joined by
+ * the separator. */
+static const char *
+join(fields_t *f, const char *line, const size_t len,
+	const struct field *segs, const size_t count)
+{
+	if (count == 0)
+		return line + len;
+	if (count == 1 && segs[0].end == len)
+		return line + segs[0].start;
+
+	size_t total = (count - 1) * f->separator_len;
+	for (size_t k = 0; k < count; k++)
+		total += segs[k].end - segs[k].start;
+
+	char *text = store(f, total);
+	char *p = text;
+	for (size_t k = 0; k < count; k++) {
+		if (k > 0) {
+			memcpy(p, f->separator, f->separator_len);
+			p += f->separator_len;
+		}
+		memcpy(p, line + segs[k].start, segs[k].end - segs[k].start);
+		p += segs[k].end - segs[k].start;
+	}
+
+	return text;
+}
+
+/* Split LINE, the next candidate, into fields, and store in *KEY the text
+ * to match, and in *VIEW the text to display (LINE itself if there is no
+ * selection). Both last as long as LINE, or until fields_clear(). */
+void
+fields_add(fields_t *f, const char *line, const char **key,
+	const char **view)
+{
+	const size_t len = strlen(line);
+
+	if (f->count == f->capacity) {
+		f->capacity *= 2;
+		f->first = safe_realloc(f->first,
+			(f->capacity + 1) * sizeof(size_t));
+	}
+
+	split(f, line, len);
+	f->first[++f->count] = f->table_size;
+
+	struct field segs[MAX_RANGES];
+	*key = f->nth_count == 0 ? line : join(f, line, len, segs,
+		select_fields(f, f->count - 1, f->nth, f->nth_count, segs));
+	*view = f->with_nth_count == 0 ? line : join(f, line, len, segs,
+		select_fields(f, f->count - 1, f->with_nth, f->with_nth_count, segs));
+}
+
+/* Return the position in the candidate of the byte at P in the text of
+ * the COUNT SEGS joined (see join()), or -1 if it is a separator. */
+static size_t
+to_line(const fields_t *f, const struct field *segs, const size_t count,
+	const size_t p)
+{
+	size_t offset = 0;
+
+	for (size_t k = 0; k < count; k++) {
+		const size_t len = segs[k].end - segs[k].start;
+		if (p < offset + len)
+			return segs[k].start + (p - offset);
+		offset += len + f->separator_len;
+		if (p < offset)
+			break;
+	}
+
+	return (size_t)-1;
+}
+
+/* The other way around: return the position of the byte at P in the
+ * candidate in the text of the COUNT SEGS joined, or -1 if not there. */
+static size_t
+from_line(const fields_t *f, const struct field *segs, const size_t count,
+	const size_t p)
+{
+	size_t offset = 0;
+
+	for (size_t k = 0; k < count; k++) {
+		if (p >= segs[k].start && p < segs[k].end)
+			return offset + (p - segs[k].start);
+		offset += segs[k].end - segs[k].start + f->separator_len;
+	}
+
+	return (size_t)-1;
+}
+
+/* Map the POSITIONS (as stored by match_positions()) of characters in the
+ * text to match of the Ith candidate to positions in the candidate, or in
+ * its text to display if VIEW is set. Positions not displayed are
+ * dropped. */
+void
+fields_map_positions(const fields_t *f, const size_t i, const int view,
+	size_t *positions)
+{
+	struct field keys[MAX_RANGES];
+	struct field views[MAX_RANGES];
+	const size_t key_count = f->nth_count == 0 ? 0
+		: select_fields(f, i, f->nth, f->nth_count, keys);
+	const size_t view_count = view == 0 || f->with_nth_count == 0 ? 0
+		: select_fields(f, i, f->with_nth, f->with_nth_count, views);
+	const int to_view = view && f->with_nth_count > 0;
+
+	size_t count = 0;
+	for (size_t k = 0; k < MATCH_MAX_LEN && positions[k] != (size_t)-1; k++) {
+		size_t p = positions[k];
+		if (f->nth_count > 0)
+			p = to_line(f, keys, key_count, p);
+		if (to_view && p != (size_t)-1)
+			p = from_line(f, views, view_count, p);
+		if (p == (size_t)-1)
+			continue;
+
+		/* Fields may be displayed in another order: keep them sorted. */
+		size_t j = count++;
+		for (; j > 0 && positions[j - 1] > p; j--)
+			positions[j] = positions[j - 1];
+		positions[j] = p;
+	}
+
+	if (count < MATCH_MAX_LEN)
+		positions[count] = (size_t)-1;
+}
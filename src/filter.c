@@ -0,0 +1,526 @@
+/* filter.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+/* Non-interactive mode (--show-matches).
+ *
+ * By default, the whole input is loaded, searched, and sorted before
+ * printing anything. Two cases do not need the whole input in memory:
+ *
+ * --no-sort: the input is read in chunks, as it comes. Each chunk is
+ *   searched (in parallel) as soon as it holds complete lines, and its
+ *   matches are printed in input order before reading the next one.
+ * --limit=N: chunks are searched the same way, but only the N best
+ *   matches so far are kept (in a heap), and printed once input ends.
+ *
+ * With --queries-file, the input is loaded once for many queries, which
+ * run in parallel (one per worker thread at a time). */
+
+#ifndef _DEFAULT_SOURCE
+/* clock_gettime */
+# define _DEFAULT_SOURCE
+#endif
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "config.h" /* CASE_* */
+#include "filter.h"
+#include "output.h"
+
+#define CHUNK_SIZE (1 << 20)
+
+struct query {
+	const char *str;
+	struct scored_result *results;
+	size_t count;
+	double ms; /* Time taken by the search */
+	int case_sensitive;
+};
+
+struct batch {
+	pthread_mutex_t lock;
+	const choices_t *choices;
+	struct query *queries;
+	size_t count;
+	size_t next; /* Next query to run */
+	int sort;
+};
+
+struct reader {
+	char *buf;
+	size_t len;
+	size_t cap;
+	int eof;
+};
+
+struct top_item {
+	score_t score;
+	size_t seq; /* Input position, to break ties */
+	char *str;
+};
+
+/* Min-heap of the best matches: the worst of them is at the root. */
+struct top_k {
+	struct top_item *items;
+	size_t size;
+	size_t alloc; /* Allocated items */
+	size_t cap; /* Most items kept (--limit) */
+};
+
+/* Return 1 if searches are case-sensitive, or 0 otherwise. Smart case is
+ * for interactive use: -e has always respected case, unless told to
+ * ignore it with --case=ignore. */
+static int
+filter_case_sensitive(const options_t *options)
+{
+	return options->case_sens_mode != CASE_INSENSITIVE;
+}
+
+static char *
+xstrdup(const char *str)
+{
+	const size_t len = strlen(str) + 1;
+	char *p = safe_realloc(NULL, len);
+	memcpy(p, str, len);
+	return p;
+}
+
+/* Return 1 if A ranks below B, or 0 otherwise. */
+static int
+ranks_below(const struct top_item *a, const struct top_item *b)
+{
+	if (a->score != b->score)
+		return a->score < b->score;
+	return a->seq > b->seq;
+}
+
+static int
+cmp_rank(const void *a, const void *b)
+{
+	return ranks_below(a, b) ? 1 : -1;
+}
+
+static void
+top_sift_down(struct top_k *top, size_t i)
+{
+	struct top_item *items = top->items;
+
+	for (;;) {
+		const size_t left = 2 * i + 1;
+		const size_t right = left + 1;
+		size_t worst = i;
+
+		if (left < top->size && ranks_below(&items[left], &items[worst]))
+			worst = left;
+		if (right < top->size && ranks_below(&items[right], &items[worst]))
+			worst = right;
+		if (worst == i)
+			return;
+
+		const struct top_item tmp = items[i];
+		items[i] = items[worst];
+		items[worst] = tmp;
+		i = worst;
+	}
+}
+
+/* Add the match STR to TOP, if it is among the best ones so far.
+ * STR is copied only if kept. */
+static void
+top_push(struct top_k *top, const char *str, const score_t score,
+	const size_t seq)
+{
+	const struct top_item item = {score, seq, NULL};
+
+	if (top->size == top->cap) {
+		if (!ranks_below(&top->items[0], &item))
+			return;
+
+		free(top->items[0].str);
+		top->items[0] = item;
+		top->items[0].str = xstrdup(str);
+		top_sift_down(top, 0);
+		return;
+	}
+
+	/* The limit may be far above the number of matches. */
+	if (top->size == top->alloc) {
+		top->alloc = top->alloc ? top->alloc * 2 : 1024;
+		if (top->alloc > top->cap)
+			top->alloc = top->cap;
+		top->items = safe_realloc(top->items,
+			top->alloc * sizeof(struct top_item));
+	}
+
+	size_t i = top->size++;
+	top->items[i] = item;
+	top->items[i].str = xstrdup(str);
+
+	/* Sift up */
+	while (i > 0 && ranks_below(&top->items[i], &top->items[(i - 1) / 2])) {
+		const struct top_item tmp = top->items[i];
+		top->items[i] = top->items[(i - 1) / 2];
+		top->items[(i - 1) / 2] = tmp;
+		i = (i - 1) / 2;
+	}
+}
+
+/* Return 1 if more input can be read right away, or 0 otherwise. */
+static int
+input_ready(void)
+{
+	struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+	return poll(&pfd, 1, 0) == 1;
+}
+
+/* Read more input into R, growing the buffer if full. Reading goes on
+ * while input is immediately available, up to a whole chunk, so that
+ * large inputs are searched in large chunks, while a slow producer (e.g.
+ * tail -f) gets its lines searched as soon as they arrive. */
+static void
+read_input(struct reader *r)
+{
+	if (r->len + 1 >= r->cap) { /* Keep room for a terminating NUL */
+		r->cap = r->cap ? r->cap * 2 : CHUNK_SIZE;
+		r->buf = safe_realloc(r->buf, r->cap);
+	}
+
+	const size_t start = r->len;
+
+	do {
+		ssize_t n;
+		while ((n = read(STDIN_FILENO, r->buf + r->len,
+		r->cap - r->len - 1)) == -1 && errno == EINTR);
+
+		if (n <= 0) {
+			if (n == -1)
+				perror("read");
+			r->eof = 1;
+			return;
+		}
+
+		r->len += (size_t)n;
+	} while (r->len - start < CHUNK_SIZE / 2 && r->len + 1 < r->cap
+	&& input_ready());
+}
+
+/* Return the length of the complete lines at the beginning of R (all of
+ * it at end of input), or zero if there are none. */
+static size_t
+complete_lines(const struct reader *r, const char delim)
+{
+	if (r->eof == 1)
+		return r->len;
+
+	size_t end = r->len;
+	while (end > 0 && r->buf[end - 1] != delim)
+		end--;
+
+	return end;
+}
+
+/* Print the matches of the search in C (input positions start at BASE),
+ * or add them to TOP if not NULL. Return the number of matches handled. */
+static size_t
+handle_matches(const choices_t *c, const options_t *options,
+	output_t *out, struct top_k *top, const size_t base, const size_t max)
+{
+	const size_t available = choices_available(c);
+	size_t n = 0;
+
+	for (; n < available && n < max; n++) {
+		if (top) {
+			top_push(top, choices_get(c, n), choices_getscore(c, n),
+				base + choices_getindex(c, n));
+			continue;
+		}
+
+		if (options->show_scores)
+			output_printf(out, "%f\t", choices_getscore(c, n));
+		output_item(out, choices_get(c, n));
+	}
+
+	return n;
+}
+
+/* Search the input chunk by chunk. Matches are printed as they are found,
+ * or, if TOP is not NULL, collected in TOP. */
+static void
+filter_chunks(choices_t *c, const options_t *options, output_t *out,
+	struct top_k *top)
+{
+	struct reader r = {NULL, 0, 0, 0};
+	const char delim = options->input_delimiter;
+	size_t max_items = options->max_items == -1
+		? (size_t)-1 : (size_t)options->max_items;
+	size_t max_matches = (top || options->limit == 0)
+		? (size_t)-1 : options->limit;
+	size_t base = 0; /* Input position of the first line in the chunk */
+
+	while (r.eof == 0 && max_items > 0 && max_matches > 0) {
+		read_input(&r);
+
+		const size_t end = complete_lines(&r, delim);
+		if (end == 0)
+			continue;
+
+		r.buf[r.len] = '\0'; /* Terminate the last line at end of input */
+		for (char *line = r.buf; line < r.buf + end && max_items > 0;) {
+			char *next = memchr(line, delim, (size_t)(r.buf + end - line));
+			if (next)
+				*next++ = '\0';
+			else
+				next = r.buf + end;
+
+			if (*line) { /* Skip empty lines */
+				choices_add(c, line);
+				max_items--;
+			}
+			line = next;
+		}
+
+		if (c->size > 0) {
+			choices_search(c, options->filter, 0,
+				filter_case_sensitive(options));
+			max_matches -= handle_matches(c, options, out, top, base,
+				max_matches);
+			/* Lines are about to be overwritten. */
+			output_flush(out);
+		}
+
+		base += c->size;
+		choices_clear(c);
+
+		memmove(r.buf, r.buf + end, r.len - end);
+		r.len -= end;
+	}
+
+	free(r.buf);
+}
+
+static double
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+static void *
+batch_worker(void *data)
+{
+	struct batch *b = data;
+
+	for (;;) {
+		pthread_mutex_lock(&b->lock);
+		struct query *q = b->next < b->count ? &b->queries[b->next++] : NULL;
+		pthread_mutex_unlock(&b->lock);
+
+		if (!q)
+			return NULL;
+
+		const double start = now_ms();
+		q->count = choices_search_r(b->choices, q->str, b->sort,
+			q->case_sensitive, 1, &q->results);
+		q->ms = now_ms() - start;
+	}
+}
+
+/* Run all queries in B, using WORKERS threads. */
+static void
+batch_run(struct batch *b, const size_t workers)
+{
+	pthread_t *threads = safe_realloc(NULL, workers * sizeof(pthread_t));
+	for (size_t i = 0; i < workers; i++) {
+		if ((errno = pthread_create(&threads[i], NULL, batch_worker, b))) {
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (size_t i = 0; i < workers; i++) {
+		if ((errno = pthread_join(threads[i], NULL))) {
+			perror("pthread_join");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	free(threads);
+}
+
+/* Read the queries in FILE (one per line, empty lines skipped) into
+ * *QUERIES. Return their number. BUF holds the file contents, and is to
+ * be freed by the caller. */
+static size_t
+read_queries(const char *file, char **buf, struct query **queries)
+{
+	FILE *fp = fopen(file, "r");
+	if (!fp) {
+		fprintf(stderr, "fnf: %s: %s\n", file, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	size_t len = 0;
+	size_t cap = 4096;
+	*buf = safe_realloc(NULL, cap);
+	while ((len += fread(*buf + len, 1, cap - len, fp)) == cap) {
+		cap *= 2;
+		*buf = safe_realloc(*buf, cap);
+	}
+	fclose(fp);
+	(*buf)[len] = '\0';
+
+	size_t count = 0;
+	*queries = NULL;
+	for (char *line = *buf; line && *line;) {
+		char *next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+
+		if (*line) {
+			*queries = safe_realloc(*queries,
+				(count + 1) * sizeof(struct query));
+			memset(&(*queries)[count], 0, sizeof(struct query));
+			(*queries)[count++].str = line;
+		}
+		line = next;
+	}
+
+	return count;
+}
+
+/* Print the matches in the input (read from STDIN) of each query in
+ * OPTIONS->QUERIES_FILE, grouped by query. */
+static void
+filter_queries(choices_t *c, const options_t *options, output_t *out)
+{
+	char *buf = NULL;
+	struct query *queries = NULL;
+	const size_t count = read_queries(options->queries_file, &buf, &queries);
+
+	/* Nothing to print (nor threads to start) */
+	if (count == 0) {
+		free(buf);
+		return;
+	}
+
+	if (!options->index_in)
+		choices_fread(c, stdin, options->input_delimiter, options->max_items);
+	choices_index(c);
+
+	for (size_t i = 0; i < count; i++)
+		queries[i].case_sensitive = filter_case_sensitive(options);
+
+	struct batch b;
+	b.choices = c;
+	b.queries = queries;
+	b.count = count;
+	b.next = 0;
+	b.sort = options->sort;
+	if (pthread_mutex_init(&b.lock, NULL) != 0) {
+		fprintf(stderr, "Error: pthread_mutex_init failed\n");
+		abort();
+	}
+
+	batch_run(&b, c->worker_count < count ? c->worker_count : count);
+	pthread_mutex_destroy(&b.lock);
+
+	const size_t limit = options->limit ? options->limit : (size_t)-1;
+	for (size_t i = 0; i < count; i++) {
+		const struct query *q = &queries[i];
+		output_printf(out, "# %s (%zu matches, %.3f ms)", q->str, q->count, q->ms);
+		output_copy(out, out->delim, 1);
+
+		for (size_t n = 0; n < q->count && n < limit; n++) {
+			if (options->show_scores)
+				output_printf(out, "%f\t", q->results[n].score);
+			output_item(out, q->results[n].str);
+		}
+		output_flush(out);
+		free(q->results);
+	}
+
+	free(queries);
+	free(buf);
+}
+
+/* Print the matches for OPTIONS->FILTER in the input (read from STDIN, or
+ * from a snapshot). */
+void
+filter_run(choices_t *c, const options_t *options)
+{
+	static output_t out;
+	output_init(&out, STDOUT_FILENO, options->print_null ? '\0' : '\n');
+
+	if (options->queries_file) {
+		filter_queries(c, options, &out);
+		return;
+	}
+
+	/* A snapshot is loaded already: searching it is all there is to do. */
+	if (options->index_in || (options->sort == 1 && options->limit == 0)) {
+		if (!options->index_in)
+			choices_fread(c, stdin, options->input_delimiter, options->max_items);
+		choices_search(c, options->filter, options->sort,
+			filter_case_sensitive(options));
+		handle_matches(c, options, &out, NULL, 0,
+			options->limit ? options->limit : (size_t)-1);
+		output_flush(&out);
+		return;
+	}
+
+	if (options->sort == 0) {
+		filter_chunks(c, options, &out, NULL);
+		return;
+	}
+
+	struct top_k top = {NULL, 0, 0, options->limit};
+
+	filter_chunks(c, options, &out, &top);
+
+	qsort(top.items, top.size, sizeof(struct top_item), cmp_rank);
+	for (size_t i = 0; i < top.size; i++) {
+		if (options->show_scores)
+			output_printf(&out, "%f\t", top.items[i].score);
+		output_item(&out, top.items[i].str);
+	}
+	output_flush(&out);
+
+	for (size_t i = 0; i < top.size; i++)
+		free(top.items[i].str);
+	free(top.items);
+}
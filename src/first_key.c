@@ -0,0 +1,373 @@
+/* first_key.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+/* Precomputed results for the first keystroke.
+ *
+ * Searching for a single character is the slowest search of all: most
+ * strings match, and all of them must be scored and sorted. Right after
+ * the input is loaded, a background thread runs these searches for every
+ * printable ASCII character, keeping only the best FIRST_KEY_RESULTS
+ * matches (and their number), so that the first keystroke is answered at
+ * once (see choices_search()). The rest of the matches are only looked
+ * for if needed (see choices_complete()).
+ *
+ * Before that, the thread builds a bitmap of the strings containing each
+ * printable ASCII character (regardless of case), which rules out
+ * strings lacking some character of a query without looking at them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "config.h" /* CASE_* */
+#include "first_key.h"
+
+#define CHARS 128 /* ASCII */
+#define IS_PRINTABLE(c) ((c) >= 0x20 && (c) < 0x7f)
+#define FOLD(c) (((c) >= 'A' && (c) <= 'Z') ? (c) | 32 : (c))
+
+#define WORD_BITS 64
+#define WORD(n) ((n) / WORD_BITS)
+#define BIT(n) ((uint64_t)1 << ((n) % WORD_BITS))
+
+/* Strings handled between two checks for a stop request */
+#define BATCH_SIZE 4096
+
+struct entry {
+	struct scored_result *results; /* The best matches */
+	size_t count;
+	size_t total; /* Number of matches */
+	int case_sensitive;
+	int ready;
+};
+
+struct first_key {
+	pthread_mutex_t lock; /* Protects everything below but THREAD/RUNNING */
+	pthread_t thread;
+	int running; /* Only used by the owner */
+	int stop;
+	const choices_t *choices; /* NULL if there is nothing to drop */
+	int case_mode; /* CASE_* (see config.h) */
+	int sort;
+	size_t size; /* Strings in the bitmaps (0: no bitmaps yet) */
+	uint64_t *bitmaps[CHARS]; /* By (lowercase) character */
+	struct entry entries[CHARS]; /* By character */
+};
+
+static int
+stop_requested(struct first_key *fk)
+{
+	pthread_mutex_lock(&fk->lock);
+	const int stop = fk->stop;
+	pthread_mutex_unlock(&fk->lock);
+	return stop;
+}
+
+static int
+build_bitmaps(struct first_key *fk)
+{
+	const choices_t *c = fk->choices;
+	const size_t words = WORD(c->size) + 1;
+
+	uint64_t *bitmaps[CHARS] = {NULL};
+	for (unsigned ch = 0; ch < CHARS; ch++) {
+		if (IS_PRINTABLE(ch) && FOLD(ch) == ch) {
+			bitmaps[ch] = safe_realloc(NULL,
+				words * sizeof(uint64_t));
+			memset(bitmaps[ch], 0, words * sizeof(uint64_t));
+		}
+	}
+
+	for (size_t i = 0; i < c->size; i++) {
+		if (i % BATCH_SIZE == 0 && stop_requested(fk)) {
+			for (unsigned ch = 0; ch < CHARS; ch++)
+				free(bitmaps[ch]);
+			return -1;
+		}
+
+		for (const unsigned char *s = (const unsigned char *)choices_folded_key(c, i, 0);
+		*s; s++) {
+			const unsigned ch = FOLD(*s);
+			if (IS_PRINTABLE(ch))
+				bitmaps[ch][WORD(i)] |= BIT(i);
+		}
+	}
+
+	pthread_mutex_lock(&fk->lock);
+	memcpy(fk->bitmaps, bitmaps, sizeof(bitmaps));
+	fk->size = c->size;
+	pthread_mutex_unlock(&fk->lock);
+
+	return 0;
+}
+
+static void
+search_char(struct first_key *fk, const char ch)
+{
+	const char query[2] = {ch, '\0'};
+	const int case_sensitive = fk->case_mode == CASE_SMART
+		? ch >= 'A' && ch <= 'Z' : fk->case_mode == CASE_SENSITIVE;
+
+	struct scored_result *results = NULL;
+	const size_t total = choices_search_r(fk->choices, query, fk->sort,
+		case_sensitive, 1, &results);
+	const size_t count = total < FIRST_KEY_RESULTS ? total : FIRST_KEY_RESULTS;
+
+	/* Only keep the best ones. */
+	struct scored_result *tmp = realloc(results,
+		(count + 1) * sizeof(struct scored_result));
+	if (tmp)
+		results = tmp;
+
+	pthread_mutex_lock(&fk->lock);
+	struct entry *e = &fk->entries[(unsigned char)ch];
+	e->results = results;
+	e->count = count;
+	e->total = total;
+	e->case_sensitive = case_sensitive;
+	e->ready = 1;
+	pthread_mutex_unlock(&fk->lock);
+}
+
+static void *
+first_key_worker(void *data)
+{
+	struct first_key *fk = data;
+
+	if (build_bitmaps(fk) == -1)
+		return (char *)NULL;
+
+	/* Letters are the most likely first keys, then digits. */
+	for (int pass = 0; pass < 3; pass++) {
+		for (int ch = 0x20; ch < 0x7f; ch++) {
+			const int alpha = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+			const int digit = ch >= '0' && ch <= '9';
+			if ((pass == 0 && !alpha) || (pass == 1 && !digit)
+			|| (pass == 2 && (alpha || digit)))
+				continue;
+
+			if (stop_requested(fk))
+				return (char *)NULL;
+			search_char(fk, (char)ch);
+		}
+	}
+
+	return (char *)NULL;
+}
+
+struct first_key *
+first_key_new(void)
+{
+	struct first_key *fk = safe_realloc(NULL, sizeof(struct first_key));
+	memset(fk, 0, sizeof(struct first_key));
+
+	if (pthread_mutex_init(&fk->lock, NULL) != 0) {
+		fprintf(stderr, "Error: pthread_mutex_init failed\n");
+		abort();
+	}
+
+	return fk;
+}
+
+void
+first_key_free(struct first_key *fk)
+{
+	first_key_clear(fk);
+	pthread_mutex_destroy(&fk->lock);
+	free(fk);
+}
+
+/* Start computing the results of the single-character queries in C (in
+ * the case sensitivity mode CASE_MODE, sorted if SORT is set) in the
+ * background. The strings of C must not change until first_key_clear()
+ * is called. */
+void
+first_key_start(struct first_key *fk, const choices_t *c,
+	const int case_mode, const int sort)
+{
+	first_key_clear(fk);
+	if (c->size == 0)
+		return;
+
+	fk->choices = c;
+	fk->case_mode = case_mode;
+	fk->sort = sort;
+	if ((errno = pthread_create(&fk->thread, NULL, &first_key_worker, fk))) {
+		perror("pthread_create");
+		exit(EXIT_FAILURE);
+	}
+	fk->running = 1;
+}
+
+/* Wait until all results are computed. */
+void
+first_key_wait(struct first_key *fk)
+{
+	if (!fk->running)
+		return;
+
+	if ((errno = pthread_join(fk->thread, NULL))) {
+		perror("pthread_join");
+		exit(EXIT_FAILURE);
+	}
+	fk->running = 0;
+}
+
+/* Stop computing, and drop whatever was computed. */
+void
+first_key_clear(struct first_key *fk)
+{
+	if (!fk->choices)
+		return;
+
+	if (fk->running) {
+		pthread_mutex_lock(&fk->lock);
+		fk->stop = 1;
+		pthread_mutex_unlock(&fk->lock);
+
+		if ((errno = pthread_join(fk->thread, NULL))) {
+			perror("pthread_join");
+			exit(EXIT_FAILURE);
+		}
+		fk->running = 0;
+	}
+
+	for (size_t i = 0; i < CHARS; i++) {
+		free(fk->bitmaps[i]);
+		free(fk->entries[i].results);
+	}
+	memset(fk->bitmaps, 0, sizeof(fk->bitmaps));
+	memset(fk->entries, 0, sizeof(fk->entries));
+	fk->size = 0;
+	fk->stop = 0;
+	fk->choices = NULL;
+}
+
+/* If the results of the single-character QUERY (searched for with SORT and
+ * CASE_SENSITIVE) are known, store a copy of the best of them (to be freed
+ * by the caller) in *RESULTS, their number in *COUNT and the number of
+ * matches in *TOTAL, and return 1. Otherwise, return 0. */
+int
+first_key_results(struct first_key *fk, const char *query, const int sort,
+	const int case_sensitive, struct scored_result **results, size_t *count,
+	size_t *total)
+{
+	const unsigned char ch = (unsigned char)*query;
+	if (!IS_PRINTABLE(ch) || query[1] || !fk->choices
+	|| sort != fk->sort)
+		return 0;
+
+	pthread_mutex_lock(&fk->lock);
+
+	const struct entry *e = &fk->entries[ch];
+	if (!e->ready || e->case_sensitive != case_sensitive) {
+		pthread_mutex_unlock(&fk->lock);
+		return 0;
+	}
+
+	*results = safe_realloc(NULL,
+		(e->count + 1) * sizeof(struct scored_result));
+	memcpy(*results, e->results, e->count * sizeof(struct scored_result));
+	*count = e->count;
+	*total = e->total;
+
+	pthread_mutex_unlock(&fk->lock);
+	return 1;
+}
+
+/* Store in *CANDIDATES (to be freed by the caller) the indexes, in
+ * increasing order, of the strings (out of TOTAL) containing every
+ * printable ASCII character of QUERY, and return their number. Return
+ * (size_t)-1 instead if the bitmaps are not built yet, or would not rule
+ * out enough strings: all strings are to be searched. */
+size_t
+first_key_candidates(struct first_key *fk, const char *query,
+	const size_t total, size_t **candidates)
+{
+	const uint64_t *maps[CHARS];
+	size_t n = 0;
+
+	pthread_mutex_lock(&fk->lock);
+
+	const size_t size = fk->size < total ? fk->size : total;
+	for (const unsigned char *q = (const unsigned char *)query;
+	*q && n < CHARS && size > 0; q++) {
+		const unsigned ch = FOLD(*q);
+		if (IS_PRINTABLE(ch))
+			maps[n++] = fk->bitmaps[ch];
+	}
+
+	if (n == 0) {
+		pthread_mutex_unlock(&fk->lock);
+		return (size_t)-1;
+	}
+
+	const size_t words = WORD(size - 1) + 1;
+	size_t found = 0;
+	for (size_t w = 0; w < words; w++) {
+		uint64_t v = maps[0][w];
+		for (size_t i = 1; i < n && v; i++)
+			v &= maps[i][w];
+		for (; v; v &= v - 1)
+			found++;
+	}
+
+	if (found > size / 2) {
+		pthread_mutex_unlock(&fk->lock);
+		return (size_t)-1;
+	}
+
+	size_t *cand = safe_realloc(NULL,
+		(found + total - size + 1) * sizeof(size_t));
+
+	size_t count = 0;
+	for (size_t w = 0; w < words; w++) {
+		uint64_t v = maps[0][w];
+		for (size_t i = 1; i < n && v; i++)
+			v &= maps[i][w];
+		for (size_t bit = 0; v; bit++, v >>= 1) {
+			if (v & 1)
+				cand[count++] = w * WORD_BITS + bit;
+		}
+	}
+
+	pthread_mutex_unlock(&fk->lock);
+
+	/* Strings not in the bitmaps */
+	for (size_t i = size; i < total; i++)
+		cand[count++] = i;
+
+	*candidates = cand;
+	return count;
+}
@@ -0,0 +1,59 @@
+/* first_key.h */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#ifndef FIRST_KEY_H
+#define FIRST_KEY_H
+
+#include "choices.h"
+
+/* Matches kept for each single-character query */
+#define FIRST_KEY_RESULTS 1000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct first_key *first_key_new(void);
+void first_key_free(struct first_key *fk);
+void first_key_start(struct first_key *fk, const choices_t *c,
+	const int case_mode, const int sort);
+void first_key_wait(struct first_key *fk);
+void first_key_clear(struct first_key *fk);
+int first_key_results(struct first_key *fk, const char *query, const int sort,
+	const int case_sensitive, struct scored_result **results, size_t *count,
+	size_t *total);
+size_t first_key_candidates(struct first_key *fk, const char *query,
+	const size_t total, size_t **candidates);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FIRST_KEY_H */
@@ -36,7 +36,12 @@
 
 #include "tty.h"
 #include "choices.h"
+#include "client.h"
+#include "daemon.h"
+#include "filter.h"
 #include "options.h"
+#include "server.h"
+#include "snapshot.h"
 #include "tty_interface.h"
 
 #include "config.h"
@@ -52,6 +57,35 @@ set_num_lines(options_t *options, const tty_t *tty, const size_t choices_size)
 		options->num_lines = choices_size;
 }
 
+/* Load the input from the snapshot given by --index-in, and/or write it to
+ * the one given by --index-out (and exit). */
+static void
+handle_snapshots(choices_t *choices, const options_t *options)
+{
+	const char *error = NULL;
+
+	if (options->index_in
+	&& snapshot_load(choices, options->index_in, &error) == -1) {
+		fprintf(stderr, "fnf: %s: %s\n", options->index_in, error);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!options->index_out)
+		return;
+
+	if (!options->index_in)
+		choices_fread(choices, stdin, options->input_delimiter,
+			options->max_items);
+	choices_index(choices); /* Saved along (if --search-index is set) */
+
+	const int ret = snapshot_write(choices, options->index_out, &error);
+	if (ret == -1)
+		fprintf(stderr, "fnf: %s: %s\n", options->index_out, error);
+
+	choices_destroy(choices);
+	exit(ret == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -61,25 +95,31 @@ main(int argc, char *argv[])
 	options_t options;
 	options_parse(&options, argc, argv);
 
-	if (options.case_sens_mode != CASE_SMART)
-		g_case_sensitive = (options.case_sens_mode == CASE_SENSITIVE);
-
 	choices_t choices;
 	choices_init(&choices, &options);
+	handle_snapshots(&choices, &options);
 
 	sel_t selection = {0};
 
-	if (options.filter) { /* --show-matches */
-		choices_fread(&choices, stdin, options.input_delimiter,
-			options.max_items);
-		choices_search(&choices, options.filter, options.sort);
-		for (size_t i = 0; i < choices_available(&choices); i++) {
-			if (options.show_scores)
-				printf("%f\t", choices_getscore(&choices, i));
-			printf("%s\n", choices_get(&choices, i));
-		}
+	client_t client;
+	client_t *remote = NULL; /* Searches run by a daemon */
+	if (options.connect_socket) {
+		client_init(&client, &options);
+		remote = &client;
+	}
+
+	if (options.server_fd != -1) { /* Co-process */
+		server_run(&choices, &options);
+	} else if (options.daemon_socket) { /* Daemon */
+		daemon_run(&options);
+	} else if (options.filter || options.queries_file) { /* Non-interactive */
+		if (remote)
+			client_filter(remote, &choices, &options);
+		else
+			filter_run(&choices, &options);
 	} else { /* Interactive */
-		if (isatty(STDIN_FILENO)) {
+		const int piped = !remote && !options.index_in;
+		if (piped && isatty(STDIN_FILENO)) {
 			fputs("fnf: Expected piped input (e.g. 'ls | fnf')\n", stderr);
 			choices_destroy(&choices);
 			exit(EXIT_FAILURE);
@@ -88,11 +128,14 @@ main(int argc, char *argv[])
 		tty_t tty;
 		tty_init(&tty, options.tty_filename);
 
-		if (!isatty(STDIN_FILENO))
+		if (piped && !isatty(STDIN_FILENO))
 			choices_fread(&choices, stdin, options.input_delimiter,
 				options.max_items);
+		choices_index(&choices);
+		if (!remote)
+			choices_precompute(&choices, &options);
 
-		set_num_lines(&options, &tty, choices.size);
+		set_num_lines(&options, &tty, remote ? remote->size : choices.size);
 
 		const size_t num_lines_adjustment = 1 + (size_t)options.show_info;
 
@@ -100,10 +143,13 @@ main(int argc, char *argv[])
 			options.num_lines = tty_getheight(&tty) - num_lines_adjustment;
 
 		tty_interface_t tty_interface;
-		tty_interface_init(&tty_interface, &tty, &choices, &options, &selection);
+		tty_interface_init(&tty_interface, &tty, &choices, &options, &selection,
+			remote);
 		ret = tty_interface_run(&tty_interface);
 	}
 
+	if (remote)
+		client_destroy(remote, &choices);
 	choices_destroy(&choices);
 
 	return ret;
@@ -0,0 +1,398 @@
+/* fold.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+/* Case folding and decomposition of non-ASCII characters, independent of
+ * the current locale.
+ *
+ * The matchers only fold the case of ASCII letters. Strings holding other
+ * characters are folded once, when loaded, into a shadow string that is
+ * searched instead (see choices_add()), the query being folded the same
+ * way: every code point is replaced by its simple case folding
+ * (FOLD_CASE), after its canonical decomposition if FOLD_NFD is set, so
+ * that precomposed and decomposed characters match alike. Combining marks
+ * are not reordered. ASCII is left as is, so that capitals still score as
+ * such.
+ *
+ * Folding may change the length of a character (e.g. KELVIN SIGN folds
+ * to 'K'): positions in a folded string are mapped back by folding it
+ * again. The tables come from data/unicode_fold.txt. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "fold.h"
+#include "match.h" /* MATCH_MAX_LEN */
+#include "utf8.h"
+
+/* Every STEPth code point from FIRST to LAST folds to itself plus DELTA. */
+struct fold_range {
+	uint32_t first;
+	uint32_t last;
+	int32_t delta;
+	uint8_t step;
+	uint8_t upper; /* Uppercase or titlecase letters */
+};
+
+/* CP decomposes to FIRST, followed by SECOND (if not 0). */
+struct decomposition {
+	uint32_t cp;
+	uint32_t first;
+	uint32_t second;
+};
+
+#include "fold_table.h"
+
+/* Hangul syllables decompose algorithmically (see the Unicode Standard,
+ * section 3.12). */
+#define HANGUL_S 0xac00
+#define HANGUL_L 0x1100
+#define HANGUL_V 0x1161
+#define HANGUL_T 0x11a7
+#define HANGUL_T_COUNT 28
+#define HANGUL_N_COUNT (21 * HANGUL_T_COUNT)
+#define HANGUL_COUNT (19 * HANGUL_N_COUNT)
+
+#define MAX_DECOMP 4 /* Code points a character decomposes to */
+#define MAX_GROWTH 3 /* Folded strings are at most this many times longer */
+#define BLOCK_SIZE (64 * 1024)
+
+/* Storage for folded strings */
+struct block {
+	struct block *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+struct fold {
+	struct block *blocks;
+};
+
+static const struct fold_range *
+find_fold(const uint32_t cp)
+{
+	size_t lo = 0;
+	size_t hi = FOLD_TABLE_SIZE;
+
+	while (lo < hi) {
+		const size_t mid = lo + ((hi - lo) >> 1);
+		if (cp > fold_table[mid].last)
+			lo = mid + 1;
+		else if (cp < fold_table[mid].first)
+			hi = mid;
+		else
+			return (cp - fold_table[mid].first) % fold_table[mid].step == 0
+				? &fold_table[mid] : NULL;
+	}
+
+	return NULL;
+}
+
+static uint32_t
+fold_cp(const uint32_t cp)
+{
+	if (cp < 0x80)
+		return cp;
+	if (cp < 0x800) /* Two bytes: most alphabets */
+		return fold_table_short[cp - 0x80];
+
+	const struct fold_range *r = find_fold(cp);
+	return r ? (uint32_t)((int32_t)cp + r->delta) : cp;
+}
+
+/* Store in OUT the canonical decomposition of CP, and return its length
+ * (at most MAX_DECOMP). */
+static size_t
+decompose(const uint32_t cp, uint32_t *out)
+{
+	if (cp >= HANGUL_S && cp < HANGUL_S + HANGUL_COUNT) {
+		const uint32_t s = cp - HANGUL_S;
+		out[0] = HANGUL_L + s / HANGUL_N_COUNT;
+		out[1] = HANGUL_V + (s % HANGUL_N_COUNT) / HANGUL_T_COUNT;
+		if (s % HANGUL_T_COUNT == 0)
+			return 2;
+		out[2] = HANGUL_T + s % HANGUL_T_COUNT;
+		return 3;
+	}
+
+	size_t lo = 0;
+	size_t hi = cp < decomp_table[0].cp ? 0 : DECOMP_TABLE_SIZE;
+
+	while (lo < hi) {
+		const size_t mid = lo + ((hi - lo) >> 1);
+		if (cp > decomp_table[mid].cp) {
+			lo = mid + 1;
+		} else if (cp < decomp_table[mid].cp) {
+			hi = mid;
+		} else {
+			const size_t n = decompose(decomp_table[mid].first, out);
+			return decomp_table[mid].second == 0 ? n
+				: n + decompose(decomp_table[mid].second, out + n);
+		}
+	}
+
+	out[0] = cp;
+	return 1;
+}
+
+/* Encode CP as UTF-8 into OUT (if not NULL), and return its length. */
+static size_t
+encode(const uint32_t cp, char *out)
+{
+	if (cp < 0x80) {
+		if (out)
+			out[0] = (char)cp;
+		return 1;
+	}
+
+	if (cp < 0x800) {
+		if (out) {
+			out[0] = (char)(0xc0 | (cp >> 6));
+			out[1] = (char)(0x80 | (cp & 0x3f));
+		}
+		return 2;
+	}
+
+	if (cp < 0x10000) {
+		if (out) {
+			out[0] = (char)(0xe0 | (cp >> 12));
+			out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+			out[2] = (char)(0x80 | (cp & 0x3f));
+		}
+		return 3;
+	}
+
+	if (out) {
+		out[0] = (char)(0xf0 | (cp >> 18));
+		out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+		out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		out[3] = (char)(0x80 | (cp & 0x3f));
+	}
+	return 4;
+}
+
+/* Fold the character at S into OUT (if not NULL), as FLAGS say. Store
+ * its length in *LEN, and return that of the result. Invalid bytes are
+ * kept as they are. */
+static size_t
+fold_char(const char *s, const int flags, size_t *len, char *out)
+{
+	if ((unsigned char)*s < 0x80) {
+		*len = 1;
+		if (out)
+			*out = *s;
+		return 1;
+	}
+
+	const unsigned char *u = (const unsigned char *)s;
+	if (!(flags & FOLD_NFD) && u[0] >= 0xc2 && u[0] <= 0xdf
+	&& (u[1] & 0xc0) == 0x80) { /* Two bytes, no decomposition */
+		const uint32_t c = ((uint32_t)(u[0] & 0x1f) << 6) | (u[1] & 0x3f);
+		*len = 2;
+		return encode((flags & FOLD_CASE) ? fold_table_short[c - 0x80] : c,
+			out);
+	}
+
+	uint32_t cp;
+	*len = utf8_decode(s, &cp);
+	if (cp == UTF8_INVALID && *len == 1) {
+		if (out)
+			*out = *s;
+		return 1;
+	}
+
+	uint32_t cps[MAX_DECOMP];
+	size_t n = 1;
+	cps[0] = cp;
+	if (flags & FOLD_NFD)
+		n = decompose(cp, cps);
+
+	size_t folded = 0;
+	for (size_t i = 0; i < n; i++) {
+		const uint32_t c = (flags & FOLD_CASE) ? fold_cp(cps[i]) : cps[i];
+		folded += encode(c, out ? out + folded : NULL);
+	}
+
+	return folded;
+}
+
+/* Fold S into OUT (MAX_GROWTH times as long as S, plus one byte), as
+ * FLAGS say, and return the length of the result. */
+static size_t
+fold_into(const char *s, const int flags, char *out)
+{
+	size_t folded = 0;
+	while (*s) {
+		size_t len;
+		folded += fold_char(s, flags, &len, out + folded);
+		s += len;
+	}
+
+	out[folded] = '\0';
+	return folded;
+}
+
+static int
+is_ascii(const char *s)
+{
+	while (*s) {
+		if ((unsigned char)*s++ >= 0x80)
+			return 0;
+	}
+
+	return 1;
+}
+
+fold_t *
+fold_new(void)
+{
+	fold_t *f = safe_realloc(NULL, sizeof(fold_t));
+	f->blocks = NULL;
+	return f;
+}
+
+/* Forget all strings folded by F. */
+void
+fold_clear(fold_t *f)
+{
+	while (f->blocks) {
+		struct block *next = f->blocks->next;
+		free(f->blocks);
+		f->blocks = next;
+	}
+}
+
+void
+fold_free(fold_t *f)
+{
+	if (!f)
+		return;
+
+	fold_clear(f);
+	free(f);
+}
+
+/* Return S folded as FLAGS say (FOLD_CASE, FOLD_NFD), kept by F until
+ * cleared, or NULL if that makes no difference. */
+const char *
+fold_add(fold_t *f, const char *s, const int flags)
+{
+	if (is_ascii(s))
+		return NULL;
+
+	const size_t max = strlen(s) * MAX_GROWTH + 1;
+	struct block *b = f->blocks;
+	if (!b || b->size - b->used < max) {
+		const size_t size = max > BLOCK_SIZE ? max : BLOCK_SIZE;
+		b = safe_realloc(NULL, sizeof(struct block) + size);
+		b->next = f->blocks;
+		b->size = size;
+		b->used = 0;
+		f->blocks = b;
+	}
+
+	char *p = b->data + b->used;
+	const size_t len = fold_into(s, flags, p);
+	if (strcmp(p, s) == 0)
+		return NULL;
+
+	b->used += len + 1;
+	return p;
+}
+
+/* Like fold_add(), but return a copy to be freed by the caller. */
+char *
+fold_string(const char *s, const int flags)
+{
+	if (is_ascii(s))
+		return NULL;
+
+	char *p = safe_realloc(NULL, strlen(s) * MAX_GROWTH + 1);
+	fold_into(s, flags, p);
+	if (strcmp(p, s) == 0) {
+		free(p);
+		return NULL;
+	}
+
+	return p;
+}
+
+/* Return 1 if S holds an uppercase or titlecase letter other than ASCII,
+ * or 0 otherwise. */
+int
+fold_has_upper(const char *s)
+{
+	while (*s) {
+		if ((unsigned char)*s < 0x80) {
+			s++;
+			continue;
+		}
+
+		uint32_t cp;
+		s += utf8_decode(s, &cp);
+		const struct fold_range *r = find_fold(cp);
+		if (r && r->upper)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Map the POSITIONS (as stored by match_positions()) of characters in S
+ * folded as FLAGS say to positions in S: all the bytes of the characters
+ * they were folded from. */
+void
+fold_map_positions(const char *s, const int flags, size_t *positions)
+{
+	size_t mapped[MATCH_MAX_LEN];
+	size_t count = 0;
+	size_t k = 0;
+	size_t folded = 0;
+
+	for (size_t i = 0; s[i] && k < MATCH_MAX_LEN
+	&& positions[k] != (size_t)-1;) {
+		size_t len;
+		folded += fold_char(s + i, flags, &len, NULL);
+		if (positions[k] < folded) {
+			for (size_t j = 0; j < len && count < MATCH_MAX_LEN; j++)
+				mapped[count++] = i + j;
+			while (k < MATCH_MAX_LEN && positions[k] != (size_t)-1
+			&& positions[k] < folded)
+				k++;
+		}
+		i += len;
+	}
+
+	memcpy(positions, mapped, count * sizeof(size_t));
+	if (count < MATCH_MAX_LEN)
+		positions[count] = (size_t)-1;
+}
@@ -93,16 +93,116 @@ clear(const tty_interface_t *state)
 static void
 action_select(tty_interface_t *state)
 {
-	const char *choice = choices_get(state->choices, state->choices->selection);
-	if (!choice)
+	const choices_t *choices = state->choices;
+	if (choices->selection >= choices_available(choices))
 		return;
 
-	if (is_selected(choice) == 1) {
-		deselect_entry(choice, state);
+	const size_t item = choices_getindex(choices, choices->selection);
+	toggle_entry(state->selection, item);
+	state->selection->anchor = item;
+}
+
+/* The query may have changed since the last search (keys typed in a row
+ * are handled before searching): actions on the whole result set need it
+ * up to date. */
+static void
+sync_search(tty_interface_t *state)
+{
+	if (strcmp(state->last_search, state->search) != 0)
+		update_search(state);
+}
+
+/* Mark all items in the current result set. */
+static void
+action_select_all(tty_interface_t *state)
+{
+	if (state->options->multi == 0) {
+		state->redraw = 0;
+		return;
+	}
+
+	sync_search(state);
+
+	const size_t available = choices_available(state->choices);
+	for (size_t i = 0; i < available; i++)
+		select_entry(state->selection, choices_getindex(state->choices, i));
+}
+
+/* Unmark all items, whether in the current result set or not. */
+static void
+action_deselect_all(tty_interface_t *state)
+{
+	if (state->options->multi == 0 || state->selection->selected == 0) {
+		state->redraw = 0;
+		return;
+	}
+
+	clear_selections(state->selection);
+}
+
+/* Invert the marks of all items in the current result set. */
+static void
+action_toggle_all(tty_interface_t *state)
+{
+	if (state->options->multi == 0) {
+		state->redraw = 0;
 		return;
 	}
 
-	save_selection(choice, state->selection);
+	sync_search(state);
+
+	const size_t available = choices_available(state->choices);
+	for (size_t i = 0; i < available; i++)
+		toggle_entry(state->selection, choices_getindex(state->choices, i));
+}
+
+/* Switch between exact (see --exact) and fuzzy matching, searching again
+ * for the current query. Remote searches (--connect) are always fuzzy. */
+static void
+action_toggle_exact(tty_interface_t *state)
+{
+	if (state->client) {
+		state->redraw = 0;
+		return;
+	}
+
+	state->choices->exact = !state->choices->exact;
+	update_search(state);
+}
+
+/* Invert the marks of the items between the last item (un)marked with TAB
+ * or Shift-TAB (excluded) and the current one (included). If the former is
+ * not in the current result set, only the current item is toggled. */
+static void
+action_toggle_range(tty_interface_t *state)
+{
+	if (state->options->multi == 0) {
+		state->redraw = 0;
+		return;
+	}
+
+	sync_search(state);
+
+	const choices_t *choices = state->choices;
+	const size_t available = choices_available(choices);
+	if (choices->selection >= available)
+		return;
+
+	const size_t current = choices->selection;
+	size_t anchor = current;
+	for (size_t i = 0; i < available; i++) {
+		if (choices_getindex(choices, i) == state->selection->anchor) {
+			anchor = i;
+			break;
+		}
+	}
+
+	const size_t first = anchor < current ? anchor + 1 : current;
+	const size_t last = anchor > current ? anchor - 1 : current;
+	for (size_t i = first; i <= last; i++)
+		toggle_entry(state->selection, choices_getindex(choices, i));
+
+	state->selection->anchor = choices_getindex(choices, current);
 }
 
 static void
@@ -127,7 +227,7 @@ action_emit(tty_interface_t *state)
 		return;
 	}
 
-	if (state->selection->size > 0)
+	if (state->selection->bitmap)
 		free_selections(state);
 
 	const char *selection =
@@ -480,6 +580,11 @@ static const keybinding_t keybindings[] = {
 	{"\x1b[6;5~", 6, action_last},        /* Ctrl-PgDn */
 	{"\x1b[6^", 4, action_last},          /* Ctrl-PgDn (rxvt) */
 	{"\x1b[8^", 4, action_last},          /* Ctrl-End (rxvt) */
+	{"\x1b" "a", 2, action_select_all},   /* Alt-a */
+	{"\x1b" "d", 2, action_deselect_all}, /* Alt-d */
+	{"\x1b" "t", 2, action_toggle_all},   /* Alt-t */
+	{"\x1b" "r", 2, action_toggle_range}, /* Alt-r */
+	{"\x1b" "e", 2, action_toggle_exact}, /* Alt-e */
 	{NULL, 0, NULL}
 };
 #undef KEY_CTRL
@@ -528,6 +633,8 @@ handle_input(tty_interface_t *state, const char *s,
 
 	/* If we have an unambiguous keybinding, run it.  */
 	if (found_keybinding != -1 && (!in_middle || handle_ambiguous_key)) {
+		/* Actions may need all the matches, not just the best ones. */
+		complete_search(state);
 		keybindings[found_keybinding].action(state);
 		*input = '\0';
 		return;
@@ -0,0 +1,226 @@
+/* libfnf.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "choices.h"
+#include "fold.h"
+#include "libfnf.h"
+#include "match.h"
+
+#if FNF_MAX_POSITIONS != MATCH_MAX_LEN
+# error "FNF_MAX_POSITIONS must be equal to MATCH_MAX_LEN"
+#endif
+
+#define BLOCK_SIZE (1 << 20)
+
+/* Candidates are copied into blocks, which never move (the choices only
+ * keep pointers to them). */
+struct block {
+	struct block *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+struct fnf_engine {
+	choices_t choices;
+	struct block *blocks; /* Most recent first */
+	char *query; /* Query of the last search */
+	int case_sensitive; /* Case sensitivity of the last search */
+};
+
+/* Return a copy of the LEN bytes at STR (NUL terminated). */
+static char *
+store_string(fnf_engine_t *engine, const char *str, const size_t len)
+{
+	struct block *b = engine->blocks;
+
+	if (!b || b->size - b->used < len + 1) {
+		const size_t size = len + 1 > BLOCK_SIZE ? len + 1 : BLOCK_SIZE;
+		b = safe_realloc(NULL, sizeof(struct block) + size);
+		b->next = engine->blocks;
+		b->size = size;
+		b->used = 0;
+		engine->blocks = b;
+	}
+
+	char *p = b->data + b->used;
+	memcpy(p, str, len);
+	p[len] = '\0';
+	b->used += len + 1;
+
+	return p;
+}
+
+/* Create a new engine, searching with WORKERS threads (zero: as many as
+ * CPUs). Return NULL on error. */
+fnf_engine_t *
+fnf_engine_new(const size_t workers)
+{
+	fnf_engine_t *engine = calloc(1, sizeof(fnf_engine_t));
+	if (!engine)
+		return NULL;
+
+	options_t options;
+	memset(&options, 0, sizeof(options_t));
+	options.workers = workers;
+	choices_init(&engine->choices, &options);
+
+	return engine;
+}
+
+void
+fnf_engine_free(fnf_engine_t *engine)
+{
+	if (!engine)
+		return;
+
+	choices_destroy(&engine->choices);
+
+	while (engine->blocks) {
+		struct block *next = engine->blocks->next;
+		free(engine->blocks);
+		engine->blocks = next;
+	}
+
+	free(engine->query);
+	free(engine);
+}
+
+/* Add COUNT strings (copied) to ENGINE. Empty strings are skipped. */
+void
+fnf_engine_add(fnf_engine_t *engine, const char *const *strings,
+	const size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (strings[i] && *strings[i])
+			choices_add(&engine->choices,
+				store_string(engine, strings[i], strlen(strings[i])));
+	}
+}
+
+/* Add the strings in BUF (LEN bytes), separated by DELIM, to ENGINE.
+ * Empty strings are skipped. Return the number of strings added. */
+size_t
+fnf_engine_add_buffer(fnf_engine_t *engine, const char *buf,
+	const size_t len, const char delim)
+{
+	const size_t size = engine->choices.size;
+	const char *end = buf + len;
+
+	for (const char *p = buf; p < end;) {
+		const char *next = memchr(p, delim, (size_t)(end - p));
+		const size_t n = next ? (size_t)(next - p) : (size_t)(end - p);
+
+		if (n > 0)
+			choices_add(&engine->choices, store_string(engine, p, n));
+
+		p += n + 1;
+	}
+
+	return engine->choices.size - size;
+}
+
+size_t
+fnf_engine_size(const fnf_engine_t *engine)
+{
+	return engine->choices.size;
+}
+
+/* Search ENGINE for QUERY, according to OPTS (NULL for defaults: smart
+ * case, sorted results). Return the number of results. */
+size_t
+fnf_engine_search(fnf_engine_t *engine, const char *query,
+	const struct fnf_search_opts *opts)
+{
+	const int case_mode = opts ? opts->case_mode : FNF_CASE_SMART;
+	const int sort = opts ? opts->sort : 1;
+
+	int case_sensitive = case_mode == FNF_CASE_RESPECT;
+	if (case_mode == FNF_CASE_SMART) {
+		for (const char *p = query; *p; p++) {
+			if (*p >= 'A' && *p <= 'Z') {
+				case_sensitive = 1;
+				break;
+			}
+		}
+		if (!case_sensitive)
+			case_sensitive = fold_has_upper(query);
+	}
+
+	const size_t len = strlen(query);
+	free(engine->query);
+	engine->query = safe_realloc(NULL, len + 1);
+	memcpy(engine->query, query, len + 1);
+	engine->case_sensitive = case_sensitive;
+
+	choices_search(&engine->choices, engine->query, sort, case_sensitive);
+	return choices_available(&engine->choices);
+}
+
+/* Return the Nth result of the last search (NULL if none), and store its
+ * score in SCORE (if not NULL). */
+const char *
+fnf_engine_result(const fnf_engine_t *engine, const size_t n, double *score)
+{
+	if (n >= choices_available(&engine->choices))
+		return NULL;
+
+	if (score)
+		*score = choices_getscore(&engine->choices, n);
+
+	return choices_get(&engine->choices, n);
+}
+
+/* Store in POSITIONS (an array of FNF_MAX_POSITIONS elements) the byte
+ * offsets of the characters matching the last query in the Nth result.
+ * Return the number of offsets stored. */
+size_t
+fnf_engine_positions(const fnf_engine_t *engine, const size_t n,
+	size_t *positions)
+{
+	const char *str = fnf_engine_result(engine, n, NULL);
+	if (!str || !*engine->query)
+		return 0;
+
+	memset(positions, -1, FNF_MAX_POSITIONS * sizeof(size_t));
+	choices_positions(&engine->choices, NULL, engine->query,
+		choices_getindex(&engine->choices, n), positions,
+		engine->case_sensitive);
+
+	size_t count = 0;
+	while (count < FNF_MAX_POSITIONS && positions[count] != (size_t)-1)
+		count++;
+
+	return count;
+}
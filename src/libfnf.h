@@ -0,0 +1,79 @@
+/* libfnf.h */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+/* The fnf search engine, as a library.
+ *
+ * An engine holds a list of candidates (copied when added) and the
+ * result of the last search on them. Engines share no state, so that
+ * different engines can be used at the same time from different threads.
+ * A single engine, however, must not be used by two threads at once. */
+
+#ifndef LIBFNF_H
+#define LIBFNF_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FNF_CASE_IGNORE  0
+#define FNF_CASE_RESPECT 1
+#define FNF_CASE_SMART   2 /* Respect case if the query has uppercase letters */
+
+/* Size of the array taken by fnf_engine_positions() */
+#define FNF_MAX_POSITIONS 1024
+
+typedef struct fnf_engine fnf_engine_t;
+
+struct fnf_search_opts {
+	int case_mode; /* One of FNF_CASE_* */
+	int sort; /* Sort results by score (otherwise, keep input order) */
+};
+
+fnf_engine_t *fnf_engine_new(const size_t workers);
+void fnf_engine_free(fnf_engine_t *engine);
+void fnf_engine_add(fnf_engine_t *engine, const char *const *strings,
+	const size_t count);
+size_t fnf_engine_add_buffer(fnf_engine_t *engine, const char *buf,
+	const size_t len, const char delim);
+size_t fnf_engine_size(const fnf_engine_t *engine);
+size_t fnf_engine_search(fnf_engine_t *engine, const char *query,
+	const struct fnf_search_opts *opts);
+const char *fnf_engine_result(const fnf_engine_t *engine, const size_t n,
+	double *score);
+size_t fnf_engine_positions(const fnf_engine_t *engine, const size_t n,
+	size_t *positions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBFNF_H */
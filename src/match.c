@@ -29,7 +29,6 @@
 * THE SOFTWARE.
 */
 
-#include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h> /* uint8_t */
@@ -37,15 +36,34 @@
 #include "match.h"
 #include "bonus.h"
 #include "colors.h"
-#include "tty_interface.h" /* g_case_sensitive */
 
-#define TOLOWER(c) (((c) >= 'A' && (c) <= 'Z') ? (c) | 32 : tolower(c))
-#define TOUPPER(c) (((c) >= 'a' && (c) <= 'z') ? (c) & ~32 : toupper(c))
+/* Only ASCII letters are folded here: other characters are folded
+ * beforehand, whatever the locale (see fold.c). */
+#define TOLOWER(c) (((c) >= 'A' && (c) <= 'Z') ? (c) | 32 : (c))
+#define TOUPPER(c) (((c) >= 'a' && (c) <= 'z') ? (c) & ~32 : (c))
 
 #define SWAP(x, y, T) do { T SWAP = x; x = y; y = SWAP; } while (0)
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
-static uint8_t utf8_len_table[256] = {0};
+/* Length of UTF-8 sequences, by lead byte (0: not a lead byte) */
+static const uint8_t utf8_len_table[256] = {
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	4, 4, 4, 4, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0
+};
 
 struct match_t {
 	score_t match_bonus[MATCH_MAX_LEN];
@@ -55,13 +73,6 @@ struct match_t {
 	size_t haystack_len;
 };
 
-static char *
-strcasechr(const char *s, int c)
-{
-	const char accept[3] = {(char)TOLOWER(c), (char)TOUPPER(c), '\0'};
-	return strpbrk(s, accept);
-}
-
 static const char *
 skip_sgr_sequences(const char *str)
 {
@@ -78,31 +89,49 @@ skip_sgr_sequences(const char *str)
 	return s;
 }
 
-int
-has_match(const char *needle, const char *haystack)
+/* Return the first occurrence of the character C in S (of either case,
+ * unless CASE_SENSITIVE is set), or NULL if there is none. */
+static inline const char *
+find_char(const char *s, const char c, const int case_sensitive)
 {
-	/* Skip initial SGR sequence from haystack. */
-	if (*haystack == KEY_ESC) {
-		haystack = skip_sgr_sequences(haystack);
-		if (!*haystack)
-			return 0;
-	}
+	if (case_sensitive)
+		return strchr(s, c);
 
-	/* Set a pointer to the beginning of the last SGR sequence. */
-	const char *escape_key = haystack;
-	while (*escape_key) {
-		if (IS_SGR_START(escape_key))
-			break;
-		escape_key++;
-	}
+	const char lower = (char)TOLOWER(c);
+	const char upper = (char)TOUPPER(lower);
+	if (lower == upper)
+		return strchr(s, c);
 
-	char *(*strchr_func)(const char *, int);
-	strchr_func = g_case_sensitive == 0 ? strcasechr : strchr;
+	const char accept[3] = {lower, upper, '\0'};
+	return strpbrk(s, accept);
+}
+
+/* Return 1 if all characters in NEEDLE appear in HAYSTACK, in order
+ * (ignoring case, unless CASE_SENSITIVE is set), or 0 otherwise. Unless
+ * SGR is set, HAYSTACK is taken to hold no SGR sequences. Callers pass
+ * constants, so that each variant is compiled without the tests it does
+ * not need (see DEFINE_HAS_MATCH()). */
+static inline int
+has_match_in(const char *needle, const char *haystack,
+	const int case_sensitive, const int sgr)
+{
+	/* Skip the initial SGR sequence, and stop at the next one. */
+	const char *escape_key = NULL;
+	if (sgr) {
+		if (*haystack == KEY_ESC) {
+			haystack = skip_sgr_sequences(haystack);
+			if (!*haystack)
+				return 0;
+		}
+
+		escape_key = strchr(haystack, KEY_ESC);
+		while (escape_key && !IS_SGR_START(escape_key))
+			escape_key = strchr(escape_key + 1, KEY_ESC);
+	}
 
-	/* Inspect haystack up to the beginning of the last SGR sequence. */
 	while (*needle) {
-		const char nch = *needle++;
-		if (!(haystack = strchr_func(haystack, nch)) || haystack >= escape_key)
+		haystack = find_char(haystack, *needle++, case_sensitive);
+		if (!haystack || (sgr && escape_key && haystack >= escape_key))
 			return 0;
 
 		haystack++;
@@ -111,6 +140,31 @@ has_match(const char *needle, const char *haystack)
 	return 1;
 }
 
+/* Variants of has_match(), for case sensitive (cs) or insensitive (ci)
+ * searches, in strings that may hold SGR sequences (sgr) or not. */
+#define DEFINE_HAS_MATCH(name, case_sensitive, sgr) \
+	int \
+	name(const char *needle, const char *haystack) \
+	{ \
+		return has_match_in(needle, haystack, case_sensitive, sgr); \
+	}
+
+DEFINE_HAS_MATCH(has_match_cs, 1, 0)
+DEFINE_HAS_MATCH(has_match_ci, 0, 0)
+DEFINE_HAS_MATCH(has_match_cs_sgr, 1, 1)
+DEFINE_HAS_MATCH(has_match_ci_sgr, 0, 1)
+
+#undef DEFINE_HAS_MATCH
+
+/* Return 1 if all characters in NEEDLE appear in HAYSTACK, in order
+ * (ignoring case, unless CASE_SENSITIVE is set), or 0 otherwise. */
+int
+has_match(const char *needle, const char *haystack, const int case_sensitive)
+{
+	return case_sensitive ? has_match_cs_sgr(needle, haystack)
+		: has_match_ci_sgr(needle, haystack);
+}
+
 static void
 precompute_bonus(const char *haystack, score_t *match_bonus)
 {
@@ -124,49 +178,71 @@ precompute_bonus(const char *haystack, score_t *match_bonus)
 }
 
 static char
-tolower_dummy(char c)
+c_tolower(char c)
 {
-	return c;
+	return (char)TOLOWER(c);
 }
 
-static char
-c_tolower(char c)
+/* Skip leading and trailing SGR color sequences from *HAYSTACK, and
+ * return the length of what is left. */
+static size_t
+haystack_span(const char **haystack)
 {
-	return (char)tolower(c);
+	if (**haystack != KEY_ESC)
+		return strlen(*haystack);
+
+	*haystack = skip_sgr_sequences(*haystack);
+	const char *esc = strchr(*haystack, KEY_ESC);
+	return (esc && esc[1] == '[') ? (size_t)(esc - *haystack)
+		: strlen(*haystack);
 }
 
-static void
+static inline void
 setup_match_struct(struct match_t *match, const char *needle,
-	const char *haystack)
-{
-	/* Skip leading and trailing SGR color sequences from HAYSTACK. */
-	if (*haystack == KEY_ESC) {
-		haystack = skip_sgr_sequences(haystack);
-		const char *esc = strchr(haystack, KEY_ESC);
-		match->haystack_len = (esc && esc[1] == '[') ? (size_t)(esc - haystack)
-			: strlen(haystack);
-	} else {
-		match->haystack_len = strlen(haystack);
-	}
-
+	const char *haystack, const int case_sensitive)
+{
+	match->haystack_len = haystack_span(&haystack);
 	match->needle_len = strlen(needle);
 
 	if (match->haystack_len > MATCH_MAX_LEN
 	|| match->needle_len > match->haystack_len)
 		return;
 
-	char (*tolower_func)(char);
-	tolower_func = g_case_sensitive == 0 ? c_tolower : tolower_dummy;
-
-	for (size_t i = 0; i < match->needle_len; i++)
-		match->lower_needle[i] = tolower_func(needle[i]);
-
-	for (size_t i = 0; i < match->haystack_len; i++)
-		match->lower_haystack[i] = tolower_func(haystack[i]);
+	if (case_sensitive) {
+		memcpy(match->lower_needle, needle, match->needle_len);
+		memcpy(match->lower_haystack, haystack, match->haystack_len);
+	} else {
+		for (size_t i = 0; i < match->needle_len; i++)
+			match->lower_needle[i] = c_tolower(needle[i]);
+		for (size_t i = 0; i < match->haystack_len; i++)
+			match->lower_haystack[i] = c_tolower(haystack[i]);
+	}
 
 	precompute_bonus(haystack, match->match_bonus);
 }
 
+/* Penalties of gaps of each length, computed at compile time */
+#define GAPS_4(g, k) (k) * (g), ((k) + 1) * (g), ((k) + 2) * (g), \
+	((k) + 3) * (g)
+#define GAPS_16(g, k) GAPS_4(g, k), GAPS_4(g, (k) + 4), GAPS_4(g, (k) + 8), \
+	GAPS_4(g, (k) + 12)
+#define GAPS_64(g, k) GAPS_16(g, k), GAPS_16(g, (k) + 16), \
+	GAPS_16(g, (k) + 32), GAPS_16(g, (k) + 48)
+#define GAPS_256(g, k) GAPS_64(g, k), GAPS_64(g, (k) + 64), \
+	GAPS_64(g, (k) + 128), GAPS_64(g, (k) + 192)
+#define GAPS_1024(g) GAPS_256(g, 0.0), GAPS_256(g, 256.0), \
+	GAPS_256(g, 512.0), GAPS_256(g, 768.0)
+
+static const score_t gaps_inner[MATCH_MAX_LEN] = {GAPS_1024(SCORE_GAP_INNER)};
+static const score_t gaps_trailing[MATCH_MAX_LEN] = {
+	GAPS_1024(SCORE_GAP_TRAILING)};
+
+/* The score of a gap of LEN characters after a match scored BASE, given
+ * the penalties GAPS: M[][] (see match_row()) only takes these, so that
+ * every way of computing it (dense, sparse or incremental) gets the
+ * same bits. */
+#define GAP_SCORE(base, len, gaps) ((base) + (gaps)[len])
+
 static inline void
 match_row(const struct match_t *match, const size_t row, score_t *curr_D,
 	score_t *curr_M, const score_t *last_D, const score_t *last_M)
@@ -179,8 +255,11 @@ match_row(const struct match_t *match, const size_t row, score_t *curr_D,
 	const char *lower_haystack = match->lower_haystack;
 	const score_t *match_bonus = match->match_bonus;
 
-	score_t prev_score = SCORE_MIN;
-	const score_t gap_score = i == n - 1 ? SCORE_GAP_TRAILING : SCORE_GAP_INNER;
+	/* Best match so far in this row (M[][] is the gap after it), and the
+	 * length of that gap */
+	score_t base = SCORE_MIN;
+	int gap = 0;
+	const score_t *gaps = i == n - 1 ? gaps_trailing : gaps_inner;
 
 	for (size_t j = 0; j < m; j++) {
 		if (lower_needle[i] == lower_haystack[j]) {
@@ -194,27 +273,247 @@ match_row(const struct match_t *match, const size_t row, score_t *curr_D,
 					last_D[j - 1] + SCORE_MATCH_CONSECUTIVE);
 			}
 			curr_D[j] = score;
-			curr_M[j] = prev_score = MAX(score, prev_score + gap_score);
+			if (score > GAP_SCORE(base, gap, gaps)) {
+				base = score;
+				gap = 0;
+			}
 		} else {
 			curr_D[j] = SCORE_MIN;
-			curr_M[j] = prev_score = prev_score + gap_score;
 		}
+		curr_M[j] = GAP_SCORE(base, gap, gaps);
+		gap++;
 	}
 }
 
-score_t
-match(const char *needle, const char *haystack)
+/* Store in ROW the cells of D holding a score (M is computed from them). */
+static void
+save_row(const score_t *D, const size_t m, struct match_row *row)
 {
-	if (!*needle)
-		return SCORE_MIN;
+	row->count = 0;
+	for (size_t j = 0; j < m; j++) {
+		if (D[j] != SCORE_MIN) {
+			row->pos[row->count] = (uint16_t)j;
+			row->score[row->count++] = D[j];
+		}
+	}
+}
 
-	struct match_t match;
-	setup_match_struct(&match, needle, haystack);
+/* Run the whole DP for MATCH, and return the score. If LAST is not NULL,
+ * store the last row of D[][] in it. */
+static score_t
+match_dp(const struct match_t *match, struct match_row *last)
+{
+	const size_t n = match->needle_len;
+	const size_t m = match->haystack_len;
 
-	const size_t n = match.needle_len;
-	const size_t m = match.haystack_len;
+	/* D[][] Stores the best score for this position ending with a match.
+	 * M[][] Stores the best possible score at this position. */
+	score_t D[2][MATCH_MAX_LEN], M[2][MATCH_MAX_LEN];
 
-	if (m > MATCH_MAX_LEN || n > m) {
+	score_t *last_D = D[0];
+	score_t *last_M = M[0];
+	score_t *curr_D = D[1];
+	score_t *curr_M = M[1];
+
+	for (size_t i = 0; i < n; i++) {
+		match_row(match, i, curr_D, curr_M, last_D, last_M);
+
+		SWAP(curr_D, last_D, score_t *);
+		SWAP(curr_M, last_M, score_t *);
+	}
+
+	if (last)
+		save_row(last_D, m, last);
+
+	return last_M[m - 1];
+}
+
+/* The sparse DP.
+ *
+ * D[i][j] only holds a score where the Ith needle character is the Jth
+ * one of the haystack, and M[i][j] only depends on the last of these
+ * before J. So, given the positions of each needle character in the
+ * haystack, a row of D is computed from the previous one looking at
+ * these positions only, instead of at every column: a query made of
+ * rare characters (digits, uppercase letters, punctuation...) takes
+ * about as long as the haystack takes to be read once. */
+
+/* The sparse DP is used if the cells it looks at (the occurrences of
+ * the character of each row) are at most 1/SPARSE_RATIO of all of them.
+ * Denser than that, looking at every column is faster. */
+#define SPARSE_RATIO 2
+
+/* Positions of each needle character in the haystack */
+struct occurrences {
+	uint16_t pos[MATCH_MAX_LEN]; /* Grouped by character */
+	uint16_t start[MATCH_MAX_LEN]; /* Of the Ith needle character */
+	uint16_t count[MATCH_MAX_LEN];
+};
+
+static inline score_t
+bonus_at(const char *haystack, const size_t j)
+{
+	return COMPUTE_BONUS(j ? haystack[j - 1] : '/', haystack[j]);
+}
+
+/* Store in CURR the cells of row I of D[][] holding a score, given those
+ * of the previous row PREV (if I > 0) and the COUNT positions OCC of the
+ * Ith needle character in HAYSTACK. */
+static void
+sparse_row(const char *haystack, const size_t i, const uint16_t *occ,
+	const size_t count, const struct match_row *prev, struct match_row *curr)
+{
+	score_t base = SCORE_MIN; /* Best match of PREV up to J - 1 */
+	size_t pos = 0;
+	size_t k = 0;
+
+	curr->count = 0;
+	for (size_t o = 0; o < count; o++) {
+		const size_t j = occ[o];
+		score_t score;
+
+		if (!i) {
+			score = ((score_t)j * SCORE_GAP_LEADING) + bonus_at(haystack, j);
+		} else if (j) {
+			while (k < prev->count && prev->pos[k] < j) {
+				if (prev->score[k] > GAP_SCORE(base, prev->pos[k] - pos,
+				gaps_inner)) {
+					base = prev->score[k];
+					pos = prev->pos[k];
+				}
+				k++;
+			}
+			const score_t last_D = k && prev->pos[k - 1] == j - 1
+				? prev->score[k - 1] : SCORE_MIN;
+			score = MAX(
+				GAP_SCORE(base, j - 1 - pos, gaps_inner)
+					+ bonus_at(haystack, j),
+				last_D + SCORE_MATCH_CONSECUTIVE);
+		} else {
+			continue;
+		}
+
+		if (score != SCORE_MIN) {
+			curr->pos[curr->count] = (uint16_t)j;
+			curr->score[curr->count++] = score;
+		}
+	}
+}
+
+/* Return M[][] at the end of the last row ROW, in a haystack of M
+ * characters. */
+static score_t
+sparse_score(const struct match_row *row, const size_t m)
+{
+	score_t base = SCORE_MIN;
+	size_t pos = 0;
+
+	for (size_t k = 0; k < row->count; k++) {
+		if (row->score[k] > GAP_SCORE(base, row->pos[k] - pos,
+		gaps_trailing)) {
+			base = row->score[k];
+			pos = row->pos[k];
+		}
+	}
+
+	return GAP_SCORE(base, m - 1 - pos, gaps_trailing);
+}
+
+/* List in OCC the positions of the N characters of NEEDLE in the M first
+ * characters of HAYSTACK. Return 0 if they are too many for the sparse DP
+ * to pay off, or 1 otherwise. */
+static inline int
+find_occurrences(const char *needle, const size_t n, const char *haystack,
+	const size_t m, const int case_sensitive, struct occurrences *occ)
+{
+	/* Needle characters are numbered from 1, by first appearance. Each
+	 * haystack character gets the number of the needle character it
+	 * matches (if any), so that no case is folded in the haystack. */
+	uint16_t slot[256] = {0};
+	size_t slots = 0;
+	uint16_t needle_slot[MATCH_MAX_LEN];
+
+	for (size_t i = 0; i < n; i++) {
+		const char c = case_sensitive == 0 ? c_tolower(needle[i]) : needle[i];
+		if (!slot[(unsigned char)c]) {
+			slot[(unsigned char)c] = (uint16_t)++slots;
+			const char u = (char)TOUPPER(c);
+			if (case_sensitive == 0 && u != c && c_tolower(u) == c)
+				slot[(unsigned char)u] = slot[(unsigned char)c];
+		}
+		needle_slot[i] = slot[(unsigned char)c];
+	}
+
+	uint16_t count[257] = {0};
+	for (size_t j = 0; j < m; j++)
+		count[slot[(unsigned char)haystack[j]]]++;
+
+	size_t cells = 0;
+	for (size_t i = 0; i < n; i++)
+		cells += count[needle_slot[i]];
+	if (cells * SPARSE_RATIO > n * m)
+		return 0;
+
+	/* Group positions by character, in order. */
+	uint16_t start[257];
+	start[1] = 0;
+	for (size_t s = 1; s < slots; s++)
+		start[s + 1] = start[s] + count[s];
+	uint16_t fill[257];
+	memcpy(fill, start, sizeof(start));
+
+	for (size_t j = 0; j < m; j++) {
+		const uint16_t s = slot[(unsigned char)haystack[j]];
+		if (s)
+			occ->pos[fill[s]++] = (uint16_t)j;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		occ->start[i] = start[needle_slot[i]];
+		occ->count[i] = count[needle_slot[i]];
+	}
+
+	return 1;
+}
+
+/* Compute the score of NEEDLE (N characters) in HAYSTACK (M characters)
+ * with the sparse DP, if it pays off, and store it in *SCORE, as well as
+ * the last row of D[][] in LAST if not NULL. Return 1 if done, or 0
+ * otherwise. */
+static inline int
+match_sparse(const char *needle, const size_t n, const char *haystack,
+	const size_t m, const int case_sensitive, struct match_row *last,
+	score_t *score)
+{
+	struct occurrences occ;
+	if (!find_occurrences(needle, n, haystack, m, case_sensitive, &occ))
+		return 0;
+
+	struct match_row rows[2];
+	struct match_row *prev = &rows[0], *curr = &rows[1];
+
+	for (size_t i = 0; i < n; i++) {
+		sparse_row(haystack, i, occ.pos + occ.start[i], occ.count[i], prev,
+			curr);
+		SWAP(curr, prev, struct match_row *);
+	}
+
+	if (last) {
+		last->count = prev->count;
+		memcpy(last->pos, prev->pos, prev->count * sizeof(uint16_t));
+		memcpy(last->score, prev->score, prev->count * sizeof(score_t));
+	}
+
+	*score = sparse_score(prev, m);
+	return 1;
+}
+
+/* Return the special score of a needle of N characters in a haystack of
+ * M characters, or 0 if the DP is needed to get it. */
+static score_t
+special_score(const size_t n, const size_t m)
+{
+	if (n == 0 || m > MATCH_MAX_LEN || n > m) {
 		/* Unreasonably large candidate: return no score
 		 * If it is a valid match it will still be returned, it will
 		 * just be ranked below any reasonably sized candidates. */
@@ -226,40 +525,216 @@ match(const char *needle, const char *haystack)
 		return SCORE_MAX;
 	}
 
-	/* D[][] Stores the best score for this position ending with a match.
-	 * M[][] Stores the best possible score at this position. */
-	score_t D[2][MATCH_MAX_LEN], M[2][MATCH_MAX_LEN];
+	return 0;
+}
 
-	score_t *last_D = D[0];
-	score_t *last_M = M[0];
-	score_t *curr_D = D[1];
-	score_t *curr_M = M[1];
+/* Like match(), but also store in LAST (if not NULL) the last row of the
+ * DP, from which match_extend() can go on when NEEDLE grows by one
+ * character. LAST->COUNT is MATCH_NO_ROW if there is no such row (the
+ * score is a special one). Callers given CASE_SENSITIVE as a constant
+ * get a variant compiled for it (see DEFINE_MATCH()). */
+static inline score_t
+match_in(const char *needle, const char *haystack, const int case_sensitive,
+	struct match_row *last)
+{
+	if (last)
+		last->count = MATCH_NO_ROW;
+
+	const char *h = haystack;
+	const size_t n = strlen(needle);
+	const size_t m = haystack_span(&h);
+
+	const score_t special = special_score(n, m);
+	if (special != 0)
+		return special;
+
+	/* Few occurrences of the needle characters: skip the other columns. */
+	score_t score;
+	if (match_sparse(needle, n, h, m, case_sensitive, last, &score))
+		return score;
+
+	struct match_t match;
+	setup_match_struct(&match, needle, haystack, case_sensitive);
+
+	return match_dp(&match, last);
+}
+
+score_t
+match_keep(const char *needle, const char *haystack, const int case_sensitive,
+	struct match_row *last)
+{
+	return case_sensitive ? match_in(needle, haystack, 1, last)
+		: match_in(needle, haystack, 0, last);
+}
+
+score_t
+match(const char *needle, const char *haystack, const int case_sensitive)
+{
+	return match_keep(needle, haystack, case_sensitive, NULL);
+}
 
+/* Scorers of needles of one to three characters (see match_for()).
+ *
+ * Nearly every candidate matches a short query, so these are the most
+ * searched for. They run the sparse DP (see sparse_row()) for all rows
+ * at once, in a single pass over the haystack: all a row needs to know
+ * of the previous one is its best match so far, and its score at the
+ * previous column. Nothing is set up, and no row is stored. */
+
+/* A row of the DP, as the pass goes */
+struct short_row {
+	score_t base; /* Best match so far (M[][] is the gap after it) */
+	size_t pos; /* Where it is */
+	score_t last_D; /* D[][] at the previous column */
+};
+
+static inline score_t
+match_short(const char *needle, const size_t n, const char *haystack,
+	const int case_sensitive)
+{
+	const size_t m = haystack_span(&haystack);
+
+	const score_t special = special_score(n, m);
+	if (special != 0)
+		return special;
+
+	/* Needle characters, and their other case (or themselves) */
+	char lower[3], upper[3];
+	struct short_row rows[3];
 	for (size_t i = 0; i < n; i++) {
-		match_row(&match, i, curr_D, curr_M, last_D, last_M);
+		lower[i] = upper[i] = case_sensitive == 0
+			? c_tolower(needle[i]) : needle[i];
+		if (case_sensitive == 0) {
+			const char u = (char)TOUPPER(lower[i]);
+			if (c_tolower(u) == lower[i])
+				upper[i] = u;
+		}
+		rows[i].base = rows[i].last_D = SCORE_MIN;
+		rows[i].pos = 0;
+	}
 
-		SWAP(curr_D, last_D, score_t *);
-		SWAP(curr_M, last_M, score_t *);
+	for (size_t j = 0; j < m; j++) {
+		const char c = haystack[j];
+
+		/* Last row first: each one goes on from the previous one as it
+		 * was up to J - 1. */
+		for (size_t i = n; i-- > 0;) {
+			struct short_row *row = &rows[i];
+			score_t score = SCORE_MIN;
+
+			if (c == lower[i] || c == upper[i]) {
+				if (!i) {
+					score = ((score_t)j * SCORE_GAP_LEADING)
+						+ bonus_at(haystack, j);
+				} else if (j) {
+					const struct short_row *prev = &rows[i - 1];
+					score = MAX(
+						GAP_SCORE(prev->base, j - 1 - prev->pos, gaps_inner)
+							+ bonus_at(haystack, j),
+						prev->last_D + SCORE_MATCH_CONSECUTIVE);
+				}
+				if (score > GAP_SCORE(row->base, j - row->pos,
+				i == n - 1 ? gaps_trailing : gaps_inner)) {
+					row->base = score;
+					row->pos = j;
+				}
+			}
+			row->last_D = score;
+		}
 	}
 
-	return last_M[m - 1];
+	return GAP_SCORE(rows[n - 1].base, m - 1 - rows[n - 1].pos, gaps_trailing);
 }
 
-static void
-init_utf8_len_table(void)
+/* Variants of the scorers of match_for(), for case sensitive (cs) or
+ * insensitive (ci) searches. Scorers only test the first byte of a
+ * haystack for SGR sequences, which is not worth a variant. */
+#define DEFINE_MATCH(name, call) \
+	score_t \
+	name(const char *needle, const char *haystack) \
+	{ \
+		return call; \
+	}
+
+DEFINE_MATCH(match_1_cs, match_short(needle, 1, haystack, 1))
+DEFINE_MATCH(match_1_ci, match_short(needle, 1, haystack, 0))
+DEFINE_MATCH(match_2_cs, match_short(needle, 2, haystack, 1))
+DEFINE_MATCH(match_2_ci, match_short(needle, 2, haystack, 0))
+DEFINE_MATCH(match_3_cs, match_short(needle, 3, haystack, 1))
+DEFINE_MATCH(match_3_ci, match_short(needle, 3, haystack, 0))
+DEFINE_MATCH(match_cs, match_in(needle, haystack, 1, NULL))
+DEFINE_MATCH(match_ci, match_in(needle, haystack, 0, NULL))
+
+#undef DEFINE_MATCH
+
+static score_t
+match_1(const char *needle, const char *haystack, const int case_sensitive)
+{
+	return case_sensitive ? match_1_cs(needle, haystack)
+		: match_1_ci(needle, haystack);
+}
+
+static score_t
+match_2(const char *needle, const char *haystack, const int case_sensitive)
+{
+	return case_sensitive ? match_2_cs(needle, haystack)
+		: match_2_ci(needle, haystack);
+}
+
+static score_t
+match_3(const char *needle, const char *haystack, const int case_sensitive)
+{
+	return case_sensitive ? match_3_cs(needle, haystack)
+		: match_3_ci(needle, haystack);
+}
+
+/* Return the scorer of NEEDLE: one made for its length, if any, or
+ * match(). All of them give the same scores. */
+match_func_t
+match_for(const char *needle)
+{
+	switch (strlen(needle)) {
+	case 1: return match_1;
+	case 2: return match_2;
+	case 3: return match_3;
+	default: return match;
+	}
+}
+
+/* Return the score of NEEDLE in HAYSTACK, as match() would, given the last
+ * row PREV of the DP for NEEDLE without its last character (see
+ * match_keep()): only the row of the last character is computed. Store
+ * it in LAST. */
+score_t
+match_extend(const char *needle, const char *haystack,
+	const int case_sensitive, const struct match_row *prev,
+	struct match_row *last)
 {
-	for (size_t i = 0; i < 256; i++) {
-		if (i < 128)
-			utf8_len_table[i] = 1;
-		else if (i >= 192 && i <= 223)
-			utf8_len_table[i] = 2;
-		else if (i >= 224 && i <= 239)
-			utf8_len_table[i] = 3;
-		else if (i >= 240 && i <= 247)
-			utf8_len_table[i] = 4;
-		else
-			utf8_len_table[i] = 0;
+	if (!*needle || !needle[1] || prev->count == MATCH_NO_ROW)
+		return match_keep(needle, haystack, case_sensitive, last);
+
+	last->count = MATCH_NO_ROW;
+
+	const size_t n = strlen(needle);
+	const size_t m = haystack_span(&haystack);
+
+	const score_t special = special_score(n, m);
+	if (special != 0)
+		return special;
+
+	const char nch = case_sensitive ? needle[n - 1] : c_tolower(needle[n - 1]);
+
+	/* The row of the last character, computed sparsely (see
+	 * sparse_row()) */
+	uint16_t occ[MATCH_MAX_LEN];
+	size_t count = 0;
+	for (size_t j = 1; j < m; j++) {
+		if ((case_sensitive ? haystack[j] : c_tolower(haystack[j])) == nch)
+			occ[count++] = (uint16_t)j;
 	}
+
+	sparse_row(haystack, n - 1, occ, count, prev, last);
+	return sparse_score(last, m);
 }
 
 /* Return 1 if the first wide character in HAYSTACK matches the first wide
@@ -304,17 +779,14 @@ fill_full_match_positions(size_t *positions, const char *needle, const size_t n)
  * to the POSITIONS array.
  * All parameters are guaranteed to be non-null. */
 score_t
-match_positions(const char *needle, const char *haystack, size_t *positions)
+match_positions(const char *needle, const char *haystack, size_t *positions,
+	const int case_sensitive)
 {
-	/* When initialized, utf8_len_table[0] is 1 */
-	if (utf8_len_table[0] == 0)
-		init_utf8_len_table();
-
 	if (!*needle)
 		return SCORE_MIN;
 
 	struct match_t match;
-	setup_match_struct(&match, needle, haystack);
+	setup_match_struct(&match, needle, haystack, case_sensitive);
 
 	const size_t n = match.needle_len;
 	const size_t m = match.haystack_len;
@@ -401,3 +873,345 @@ match_positions(const char *needle, const char *haystack, size_t *positions)
 	free(D);
 	return result;
 }
+
+/* Return the score of the N needle characters matched at the positions
+ * POS of HAYSTACK (M characters long), as the DP scores that alignment. */
+static score_t
+score_alignment(const char *haystack, const size_t m, const uint16_t *pos,
+	const size_t n)
+{
+	score_t score = ((score_t)pos[0] * SCORE_GAP_LEADING)
+		+ bonus_at(haystack, pos[0]);
+	for (size_t i = 1; i < n; i++) {
+		const score_t bonus = bonus_at(haystack, pos[i]);
+		score = pos[i] == pos[i - 1] + 1
+			? score + MAX(bonus, SCORE_MATCH_CONSECUTIVE)
+			: GAP_SCORE(score, pos[i] - 1 - pos[i - 1], gaps_inner) + bonus;
+	}
+
+	return GAP_SCORE(score, m - 1 - pos[n - 1], gaps_trailing);
+}
+
+/* Store in POSITIONS the positions POS of the N bytes of NEEDLE: only the
+ * first byte of multi-byte characters is a position. */
+static void
+store_positions(const char *needle, const size_t n, const uint16_t *pos,
+	size_t *positions)
+{
+	for (size_t i = 0, p = 0; i < n; i++) {
+		if (utf8_len_table[(uint8_t)needle[i]] != 0)
+			positions[p++] = pos[i];
+	}
+}
+
+/* Like match_positions(), but only score one alignment of NEEDLE in
+ * HAYSTACK, found in linear time: the first characters matching NEEDLE
+ * from the left, moved right as far as they go without passing the end
+ * of that first match, which gives the shortest window ending there
+ * (fzf's "v1" algorithm). The score is never above the one of match(),
+ * and is usually the same. POSITIONS may be NULL. */
+score_t
+match_greedy_positions(const char *needle, const char *haystack,
+	size_t *positions, const int case_sensitive)
+{
+	const size_t m = haystack_span(&haystack);
+	const size_t n = strlen(needle);
+
+	const score_t special = special_score(n, m);
+	if (special == SCORE_MAX && positions)
+		fill_full_match_positions(positions, needle, n);
+	if (special != 0)
+		return special;
+
+	/* Needle characters, and their other case (or themselves) */
+	char lower[MATCH_MAX_LEN], upper[MATCH_MAX_LEN];
+	for (size_t i = 0; i < n; i++) {
+		lower[i] = upper[i] = case_sensitive == 0
+			? c_tolower(needle[i]) : needle[i];
+		if (case_sensitive == 0) {
+			const char u = (char)TOUPPER(lower[i]);
+			if (c_tolower(u) == lower[i])
+				upper[i] = u;
+		}
+	}
+
+	/* Forward: the end of the leftmost match */
+	size_t i = 0, end = 0;
+	for (size_t j = 0; j < m; j++) {
+		if ((haystack[j] == lower[i] || haystack[j] == upper[i]) && ++i == n) {
+			end = j;
+			break;
+		}
+	}
+	if (i < n)
+		return SCORE_MIN;
+
+	/* Backward: the rightmost start of a match ending at END */
+	uint16_t pos[MATCH_MAX_LEN];
+	i = n - 1;
+	for (size_t j = end + 1; j-- > 0;) {
+		if (haystack[j] == lower[i] || haystack[j] == upper[i]) {
+			pos[i] = (uint16_t)j;
+			if (i-- == 0)
+				break;
+		}
+	}
+
+	if (positions)
+		store_positions(needle, n, pos, positions);
+
+	return score_alignment(haystack, m, pos, n);
+}
+
+/* Like match(), but see match_greedy_positions(). */
+score_t
+match_greedy(const char *needle, const char *haystack, const int case_sensitive)
+{
+	return match_greedy_positions(needle, haystack, NULL, case_sensitive);
+}
+
+static int
+same_bytes(const char *a, const char *b, const size_t n,
+	const int case_sensitive)
+{
+	if (case_sensitive == 1)
+		return memcmp(a, b, n) == 0;
+
+	for (size_t i = 0; i < n; i++) {
+		if (c_tolower(a[i]) != c_tolower(b[i]))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Like score_alignment(), for N characters matched from position S on */
+static score_t
+score_run(const char *haystack, const size_t m, const size_t s,
+	const size_t n)
+{
+	score_t score = ((score_t)s * SCORE_GAP_LEADING) + bonus_at(haystack, s);
+	for (size_t j = s + 1; j < s + n; j++)
+		score += MAX(bonus_at(haystack, j), SCORE_MATCH_CONSECUTIVE);
+
+	return GAP_SCORE(score, m - s - n, gaps_trailing);
+}
+
+/* Word-at-a-time (SWAR) compare: the bytes of the 64-bit word X equal to
+ * the byte broadcast in B get their high bit set. Some bytes above those
+ * may get it too, so this only tells where the byte is not. */
+#define BYTES_ONES UINT64_C(0x0101010101010101)
+#define BYTES_HIGH UINT64_C(0x8080808080808080)
+#define BYTES_EQ(x, b) ((((x) ^ (b)) - BYTES_ONES) & ~((x) ^ (b)) & BYTES_HIGH)
+
+/* Return 1 if the N (> 0) bytes of NEEDLE are found in HAYSTACK where
+ * ANCHOR says (MATCH_ANYWHERE, MATCH_PREFIX, MATCH_SUFFIX, or MATCH_WHOLE:
+ * the whole of it), ignoring case unless CASE_SENSITIVE is set, or 0
+ * otherwise. If found and SCORE is not NULL, store in *SCORE the score of
+ * the best occurrence, as match() scores that alignment, and its
+ * positions in POSITIONS (if not NULL). */
+int
+match_substring(const char *needle, const size_t n, const char *haystack,
+	const int anchor, const int case_sensitive, score_t *score,
+	size_t *positions)
+{
+	const size_t m = haystack_span(&haystack);
+	if (n > m)
+		return 0;
+
+	/* Where occurrences may start */
+	const size_t first = (anchor & MATCH_SUFFIX) ? m - n : 0;
+	const size_t last = (anchor & MATCH_PREFIX) ? 0 : m - n;
+
+	/* The first and last bytes of NEEDLE, in both cases */
+	const unsigned char f_lo = (unsigned char)(case_sensitive == 0
+		? c_tolower(needle[0]) : needle[0]);
+	const unsigned char f_up = (unsigned char)(case_sensitive == 0
+		? TOUPPER(f_lo) : f_lo);
+	const unsigned char l_lo = (unsigned char)(case_sensitive == 0
+		? c_tolower(needle[n - 1]) : needle[n - 1]);
+	const unsigned char l_up = (unsigned char)(case_sensitive == 0
+		? TOUPPER(l_lo) : l_lo);
+
+	const score_t special = special_score(n, m);
+	score_t best = SCORE_MIN;
+	size_t start = 0;
+	int found = 0;
+
+	for (size_t s = first; s <= last; s++) {
+		/* Rule out eight starts at once: those whose first or last byte
+		 * is not that of NEEDLE. */
+		if ((s - first) % 8 == 0 && last - s >= 7) {
+			uint64_t head, tail;
+			memcpy(&head, haystack + s, sizeof(head));
+			memcpy(&tail, haystack + s + n - 1, sizeof(tail));
+			if (((BYTES_EQ(head, f_lo * BYTES_ONES)
+			| BYTES_EQ(head, f_up * BYTES_ONES))
+			& (BYTES_EQ(tail, l_lo * BYTES_ONES)
+			| BYTES_EQ(tail, l_up * BYTES_ONES))) == 0) {
+				s += 7;
+				continue;
+			}
+		}
+
+		const unsigned char f = (unsigned char)haystack[s];
+		const unsigned char l = (unsigned char)haystack[s + n - 1];
+		if ((f != f_lo && f != f_up) || (l != l_lo && l != l_up)
+		|| !same_bytes(haystack + s, needle, n, case_sensitive))
+			continue;
+
+		if (!score)
+			return 1;
+
+		if (special != 0) {
+			found = 1;
+			start = s;
+			break;
+		}
+
+		const score_t sc = score_run(haystack, m, s, n);
+		if (found == 0 || sc > best) {
+			best = sc;
+			start = s;
+		}
+		found = 1;
+	}
+
+	if (found == 0)
+		return 0;
+
+	*score = special != 0 ? special : best;
+	if (positions && special != SCORE_MIN) {
+		uint16_t pos[MATCH_MAX_LEN];
+		for (size_t i = 0; i < n; i++)
+			pos[i] = (uint16_t)(start + i);
+		store_positions(needle, n, pos, positions);
+	}
+
+	return 1;
+}
+
+/* Queries with typos
+ *
+ * A string matches a query with K typos if the query, left K of its
+ * characters out, is a subsequence of it: this covers a wrong, missing or
+ * extra character in the query, and two characters swapped. Matches are
+ * found bit-parallel (after Wu and Manber), a 64-bit word holding what
+ * prefixes of the query match so far. */
+
+/* Queries this much longer than their number of typos */
+#define TYPO_EVERY 4
+
+/* Return 1 if the characters of NEEDLE can be left out up to TYPOS (at
+ * most MATCH_TYPOS_MAX) times, one for every TYPO_EVERY of them (which
+ * makes none for NEEDLE shorter than that, or longer than 64 bytes), and
+ * if so, make T match NEEDLE (ignoring case unless CASE_SENSITIVE is set)
+ * with typos, or 0 otherwise. */
+int
+typo_needle_init(struct typo_needle *t, const char *needle, const int typos,
+	const int case_sensitive)
+{
+	const size_t n = strlen(needle);
+	int k = typos < MATCH_TYPOS_MAX ? typos : MATCH_TYPOS_MAX;
+	if ((size_t)k > n / TYPO_EVERY)
+		k = (int)(n / TYPO_EVERY);
+	if (k <= 0 || n > 64)
+		return 0;
+
+	memset(t->masks, 0, sizeof(t->masks));
+	for (size_t i = 0; i < n; i++) {
+		const unsigned char c = (unsigned char)needle[i];
+		t->masks[c] |= UINT64_C(1) << i;
+		if (case_sensitive == 0) {
+			t->masks[(unsigned char)c_tolower((char)c)] |= UINT64_C(1) << i;
+			t->masks[(unsigned char)TOUPPER(c)] |= UINT64_C(1) << i;
+		}
+	}
+
+	t->needle = needle;
+	t->n = n;
+	t->typos = k;
+	return 1;
+}
+
+/* Return the fewest characters (up to K) the N characters of a needle
+ * from the one at SHIFT on must leave out to be found in the M bytes of
+ * HAYSTACK, given the MASKS of the needle, or -1 if more. */
+static int
+typo_scan(const uint64_t *masks, const size_t shift, const size_t n,
+	const int k, const char *haystack, const size_t m)
+{
+	if (n == 0)
+		return 0;
+
+	/* Bit I of R[D]: the first I + 1 characters match, D left out. */
+	uint64_t r[MATCH_TYPOS_MAX + 1] = {0};
+	for (int d = 0; d <= k; d++)
+		r[d] = (UINT64_C(1) << d) - 1;
+
+	const uint64_t last = UINT64_C(1) << (n - 1);
+	for (size_t j = 0; j < m && !(r[0] & last); j++) {
+		const uint64_t b = masks[(unsigned char)haystack[j]] >> shift;
+		r[0] |= ((r[0] << 1) | 1) & b;
+		for (int d = 1; d <= k; d++)
+			r[d] |= (((r[d] << 1) | 1) & b) | (r[d - 1] << 1);
+	}
+
+	for (int d = 0; d <= k; d++) {
+		if (r[d] & last)
+			return d;
+	}
+
+	return -1;
+}
+
+/* Return how many characters the needle of T must leave out to be found
+ * in HAYSTACK (0: it is, see has_match()), or -1 if more than allowed. */
+int
+has_match_typos(const struct typo_needle *t, const char *haystack)
+{
+	const size_t m = haystack_span(&haystack);
+	return typo_scan(t->masks, 0, t->n, t->typos, haystack, m);
+}
+
+/* Like match_positions(), for the needle of T found in HAYSTACK with
+ * typos (see has_match_typos()): score the characters that are found, at
+ * a cost of SCORE_TYPO for each one left out. */
+score_t
+match_typos(const struct typo_needle *t, const char *haystack,
+	size_t *positions, const int case_sensitive)
+{
+	const char *h = haystack;
+	const size_t m = haystack_span(&h);
+	int typos = typo_scan(t->masks, 0, t->n, t->typos, h, m);
+	if (typos < 0)
+		return SCORE_MIN;
+
+	/* Keep the characters of the needle that can still be found, at their
+	 * first occurrence, with the typos left for the rest; leave the others
+	 * out. */
+	char found[65];
+	size_t count = 0;
+	size_t j = 0;
+	int left = typos;
+	for (size_t i = 0; i < t->n; i++) {
+		const uint64_t bit = UINT64_C(1) << i;
+		size_t p = j;
+		while (p < m && !(t->masks[(unsigned char)h[p]] & bit))
+			p++;
+
+		if (p < m && typo_scan(t->masks, i + 1, t->n - i - 1, left,
+		h + p + 1, m - p - 1) >= 0) {
+			found[count++] = t->needle[i];
+			j = p + 1;
+		} else {
+			left--;
+		}
+	}
+	found[count] = '\0';
+
+	const score_t score = positions
+		? match_positions(found, haystack, positions, case_sensitive)
+		: match(found, haystack, case_sensitive);
+	return score + (score_t)typos * SCORE_TYPO;
+}
@@ -33,6 +33,8 @@
 #define MATCH_H
 
 #include <math.h>
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint16_t, uint64_t */
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,10 +46,76 @@ typedef double score_t;
 
 #define MATCH_MAX_LEN 1024
 
-int has_match(const char *needle, const char *haystack);
+#define MATCH_NO_ROW ((size_t)-1)
+
+/* Where match_substring() looks for its needle */
+#define MATCH_ANYWHERE 0
+#define MATCH_PREFIX   1
+#define MATCH_SUFFIX   2
+#define MATCH_WHOLE    (MATCH_PREFIX | MATCH_SUFFIX)
+
+/* Most query characters match_typos() may leave out */
+#define MATCH_TYPOS_MAX 2
+
+/* The cells of a row of D[][] (see match.c) holding a score */
+struct match_row {
+	size_t count;
+	uint16_t pos[MATCH_MAX_LEN];
+	score_t score[MATCH_MAX_LEN];
+};
+
+/* A query to match with typos (see typo_needle_init()) */
+struct typo_needle {
+	uint64_t masks[256]; /* Bit I of MASKS[C]: NEEDLE[I] matches C */
+	const char *needle;
+	size_t n; /* Length of NEEDLE */
+	int typos; /* Most characters of NEEDLE left out */
+};
+
+typedef score_t (*match_func_t)(const char *needle, const char *haystack,
+	const int case_sensitive);
+
+int has_match(const char *needle, const char *haystack,
+	const int case_sensitive);
+
+/* Variants of has_match() and of the scorers of match_for(), compiled for
+ * a case sensitivity (cs or ci) and, for has_match(), for haystacks that
+ * may hold SGR sequences (sgr) or not. A search picks them once. */
+int has_match_cs(const char *needle, const char *haystack);
+int has_match_ci(const char *needle, const char *haystack);
+int has_match_cs_sgr(const char *needle, const char *haystack);
+int has_match_ci_sgr(const char *needle, const char *haystack);
+score_t match_1_cs(const char *needle, const char *haystack);
+score_t match_1_ci(const char *needle, const char *haystack);
+score_t match_2_cs(const char *needle, const char *haystack);
+score_t match_2_ci(const char *needle, const char *haystack);
+score_t match_3_cs(const char *needle, const char *haystack);
+score_t match_3_ci(const char *needle, const char *haystack);
+score_t match_cs(const char *needle, const char *haystack);
+score_t match_ci(const char *needle, const char *haystack);
+
 score_t match_positions(const char *needle, const char *haystack,
+	size_t *positions, const int case_sensitive);
+score_t match(const char *needle, const char *haystack,
+	const int case_sensitive);
+match_func_t match_for(const char *needle);
+score_t match_keep(const char *needle, const char *haystack,
+	const int case_sensitive, struct match_row *last);
+score_t match_extend(const char *needle, const char *haystack,
+	const int case_sensitive, const struct match_row *prev,
+	struct match_row *last);
+score_t match_greedy(const char *needle, const char *haystack,
+	const int case_sensitive);
+score_t match_greedy_positions(const char *needle, const char *haystack,
+	size_t *positions, const int case_sensitive);
+int match_substring(const char *needle, const size_t n, const char *haystack,
+	const int anchor, const int case_sensitive, score_t *score,
 	size_t *positions);
-score_t match(const char *needle, const char *haystack);
+int typo_needle_init(struct typo_needle *t, const char *needle,
+	const int typos, const int case_sensitive);
+int has_match_typos(const struct typo_needle *t, const char *haystack);
+score_t match_typos(const struct typo_needle *t, const char *haystack,
+	size_t *positions, const int case_sensitive);
 
 #ifdef __cplusplus
 }
@@ -29,14 +29,20 @@
 * THE SOFTWARE.
 */
 
+#include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <stdint.h> /* SIZE_MAX */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "options.h"
 #include "config.h"
+#include "fields.h"
+#include "fold.h"
+#include "match.h"
 
 #define OPT_POINTER       1
 #define OPT_MARKER        2
@@ -55,6 +61,26 @@
 #define OPT_NO_BOLD       15
 #define OPT_COLOR_SCHEME  16
 #define OPT_GHOST         17
+#define OPT_THROTTLE      18
+#define OPT_ANSI          19
+#define OPT_LIMIT         20
+#define OPT_QUERIES_FILE  21
+#define OPT_SERVER        22
+#define OPT_DAEMON        23
+#define OPT_MEMORY_LIMIT  24
+#define OPT_CONNECT       25
+#define OPT_CORPUS        26
+#define OPT_INDEX_OUT     27
+#define OPT_INDEX_IN      28
+#define OPT_SEARCH_INDEX  29
+#define OPT_INCREMENTAL   30
+#define OPT_ALGO          31
+#define OPT_EXACT         32
+#define OPT_DELIMITER     33
+#define OPT_NTH           34
+#define OPT_WITH_NTH      35
+#define OPT_TYPOS         36
+#define OPT_NORMALIZE     37
 
 static const char *usage_str =
     ""
@@ -75,22 +101,43 @@ static const char *usage_str =
     " -s, --show-scores         Show the scores of each match\n"
     " -t, --tty=TTY             Specify the file to use as TTY device (default: /dev/tty)\n"
     " -v, --version             Output version information and exit\n"
+    " -x, --extended            Enable the extended search syntax (consult the manpage)\n"
+    "     --algo=ALGO           Set the scoring algorithm [optimal|greedy|auto] (default: optimal)\n"
+    "     --ansi                Interpret ANSI color codes in the input\n"
     "     --case=MODE           Set case sensitivity mode [respect|ignore|smart] (default: smart)\n"
     "     --color=COLORSPEC     Set custom colors (consult the manpage)\n"
     "     --color-scheme=SCHEME Set the base color scheme [dark|light|16] (default: dark)\n"
+    "     --connect=SOCKET      Search the --corpus FILE through the daemon at SOCKET\n"
+    "     --corpus=FILE         File to search with --connect\n"
+    "     --daemon=SOCKET       Serve searches on files to clients connecting to SOCKET\n"
+    "     --delimiter=STR       Field delimiter for --nth and --with-nth (default: blanks)\n"
+    "     --exact               Match the query as a substring, not fuzzily (toggle: Alt-e)\n"
     "     --ghost=STR           Text to display when input is empty\n"
+    "     --incremental[=MIB]   Reuse the scores of the last search as the query grows (default: 64 MiB)\n"
+    "     --index-in=FILE       Load the input from the snapshot FILE\n"
+    "     --index-out=FILE      Write the input as a snapshot to FILE and exit\n"
     "     --marker=STR          Multi-select marker (default: \"✔\" or \"*\")\n"
+    "     --memory-limit=MIB    Unload unused files to keep the daemon under MIB MiB\n"
     "     --no-bold             Do not use bold colors\n"
     "     --no-clear            Do not clear the interface on exit\n"
     "     --no-color            Disable colors\n"
     "     --no-sort             Do not sort the result\n"
     "     --no-unicode          Disable Unicode decorations\n"
+    "     --normalize           Match precomposed and decomposed characters alike\n"
+    "     --nth=FIELDS          Only match the given fields, e.g. 1,3..5,-1 (consult the manpage)\n"
     "     --pointer=STR         Pointer to highlighted match (default: \"▌\" or \">\")\n"
     "     --separator[=STR]     Print horizontal line after info\n"
     "     --print-null          Print ouput delimited by ASCII NUL characters\n"
+    "     --queries-file=FILE   Print the matches of each query in FILE and exit\n"
     "     --right-accepts       Right arrow key accepts\n"
+    "     --search-index        Index the input in the background to speed up searches\n"
+    "     --server[=FD]         Answer search requests read from FD (default: stdin)\n"
     "     --tab-accepts         TAB accepts\n"
-    "     --left-aborts         Left arrow key aborts\n";
+    "     --throttle            Lower the redraw rate if the terminal cannot keep up\n"
+    "     --typos=NUM           Also match queries with up to NUM (0-2) typos if few results\n"
+    "     --left-aborts         Left arrow key aborts\n"
+    "     --with-nth=FIELDS     Only display the given fields (as --nth)\n"
+    "     --limit=NUM           Print only up to NUM matches (with -e)\n";
 
 static void
 usage(void)
@@ -116,61 +163,125 @@ static const struct option longopts[] = {
 	{"show-scores", no_argument, NULL, 's'},
 	{"tty", required_argument, NULL, 't'},
 	{"version", no_argument, NULL, 'v'},
+	{"extended", no_argument, NULL, 'x'},
+	{"algo", required_argument, NULL, OPT_ALGO},
+	{"ansi", no_argument, NULL, OPT_ANSI},
 	{"case", required_argument, NULL, OPT_CASE},
 	{"color", required_argument, NULL, OPT_COLOR},
 	{"color-scheme", required_argument, NULL, OPT_COLOR_SCHEME},
+	{"connect", required_argument, NULL, OPT_CONNECT},
+	{"corpus", required_argument, NULL, OPT_CORPUS},
+	{"daemon", required_argument, NULL, OPT_DAEMON},
+	{"delimiter", required_argument, NULL, OPT_DELIMITER},
+	{"exact", no_argument, NULL, OPT_EXACT},
 	{"ghost", required_argument, NULL, OPT_GHOST},
+	{"incremental", optional_argument, NULL, OPT_INCREMENTAL},
+	{"index-in", required_argument, NULL, OPT_INDEX_IN},
+	{"index-out", required_argument, NULL, OPT_INDEX_OUT},
 	{"left-aborts", no_argument, NULL, OPT_LEFT_ABORTS},
+	{"limit", required_argument, NULL, OPT_LIMIT},
 	{"marker", required_argument, NULL, OPT_MARKER},
+	{"memory-limit", required_argument, NULL, OPT_MEMORY_LIMIT},
 	{"no-bold", no_argument, NULL, OPT_NO_BOLD},
 	{"no-clear", no_argument, NULL, OPT_NO_CLEAR},
 	{"no-color", no_argument, NULL, OPT_NO_COLOR},
 	{"no-sort", no_argument, NULL, OPT_NO_SORT},
 	{"no-unicode", no_argument, NULL, OPT_NO_UNICODE},
+	{"normalize", no_argument, NULL, OPT_NORMALIZE},
+	{"nth", required_argument, NULL, OPT_NTH},
 	{"pointer", required_argument, NULL, OPT_POINTER},
 	{"print-null", no_argument, NULL, OPT_PRINT_NULL},
+	{"queries-file", required_argument, NULL, OPT_QUERIES_FILE},
 	{"right-accepts", no_argument, NULL, OPT_RIGHT_ACCEPTS},
 	{"scroll-off", required_argument, NULL, OPT_SCROLLOFF},
+	{"search-index", no_argument, NULL, OPT_SEARCH_INDEX},
 	{"separator", optional_argument, NULL, OPT_SEPARATOR},
+	{"server", optional_argument, NULL, OPT_SERVER},
 	{"tab-accepts", no_argument, NULL, OPT_TAB_ACCEPTS},
+	{"throttle", no_argument, NULL, OPT_THROTTLE},
+	{"typos", required_argument, NULL, OPT_TYPOS},
+	{"with-nth", required_argument, NULL, OPT_WITH_NTH},
 	{NULL, 0, NULL, 0}
 };
 
+static int
+has_uppercase(const char *s)
+{
+	for (const char *p = s; *p; p++) {
+		if (*p >= 'A' && *p <= 'Z')
+			return 1;
+	}
+
+	return fold_has_upper(s);
+}
+
+/* Return 1 if searching for QUERY must be case-sensitive (according to
+ * the case sensitivity mode), or 0 otherwise. */
+int
+options_case_sensitive(const options_t *options, const char *query)
+{
+	if (options->case_sens_mode == CASE_SMART)
+		return has_uppercase(query);
+
+	return options->case_sens_mode == CASE_SENSITIVE;
+}
+
 /* Set options to default values. */
 void
 options_init(options_t *options)
 {
+	options->algo            = DEFAULT_ALGO;
+	options->ansi            = DEFAULT_ANSI;
 	options->auto_lines      = DEFAULT_AUTO_LINES;
 	options->case_sens_mode  = DEFAULT_CASE_SENSITIVITY_MODE;
 	options->clear           = DEFAULT_CLEAR;
 	options->color           = NULL; /* Unset */
 	options->color_scheme    = NULL; /* Unset (defaults to dark) */
+	options->connect_socket  = NULL; /* Unset */
+	options->corpus          = NULL; /* Unset */
 	options->cycle           = DEFAULT_CYCLE;
+	options->exact           = DEFAULT_EXACT;
+	options->extended        = DEFAULT_EXTENDED;
+	options->daemon_socket   = NULL; /* Unset */
+	options->field_delimiter = NULL; /* Unset (runs of blanks) */
 	options->filter          = DEFAULT_FILTER;
 	options->ghost           = NULL; /* Unset */
+	options->incremental     = DEFAULT_INCREMENTAL;
+	options->index_in        = NULL; /* Unset */
+	options->index_out       = NULL; /* Unset */
 	options->init_search     = DEFAULT_INIT_SEARCH;
 	options->input_delimiter = DEFAULT_DELIMITER;
 	options->left_aborts     = DEFAULT_LEFT_ABORTS;
+	options->limit           = DEFAULT_LIMIT;
 	options->marker          = DEFAULT_MARKER;
 	options->max_items       = DEFAULT_MAX_ITEMS;
+	options->memory_limit    = DEFAULT_MEMORY_LIMIT;
 	options->multi           = DEFAULT_MULTI;
 	options->no_bold         = DEFAULT_NO_BOLD;
 	options->no_color        = DEFAULT_NO_COLOR;
+	options->normalize       = DEFAULT_NORMALIZE;
+	options->nth             = NULL; /* Unset */
 	options->num_lines       = (size_t)-1; /* Unset */
 	options->pad             = DEFAULT_PAD;
 	options->pointer         = DEFAULT_POINTER;
 	options->print_null      = DEFAULT_PRINT_NULL;
 	options->prompt          = DEFAULT_PROMPT;
+	options->queries_file    = NULL; /* Unset */
 	options->reverse         = DEFAULT_REVERSE;
 	options->right_accepts   = DEFAULT_RIGHT_ACCEPTS;
 	options->show_info       = DEFAULT_SHOW_INFO;
 	options->show_scores     = DEFAULT_SCORES;
 	options->scrolloff       = DEFAULT_SCROLLOFF;
+	options->search_index    = DEFAULT_SEARCH_INDEX;
 	options->separator       = NULL; /* Unset */
+	options->server_fd       = DEFAULT_SERVER_FD;
 	options->sort            = DEFAULT_SORT;
 	options->tab_accepts     = DEFAULT_TAB_ACCEPTS;
+	options->throttle        = DEFAULT_THROTTLE;
 	options->tty_filename    = DEFAULT_TTY;
+	options->typos           = DEFAULT_TYPOS;
 	options->unicode         = DEFAULT_UNICODE;
+	options->with_nth        = NULL; /* Unset */
 	options->workers         = DEFAULT_WORKERS;
 }
 
@@ -197,6 +308,92 @@ set_workers(options_t *options, const char *value)
 	}
 }
 
+static void
+set_field_delimiter(options_t *options, const char *value)
+{
+	if (!*value) {
+		fputs("fnf: --delimiter cannot be empty\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	options->field_delimiter = value;
+}
+
+/* Return VALUE, the field ranges given to --NAME, if valid. */
+static const char *
+check_fields(const char *name, const char *value)
+{
+	if (!fields_valid(value)) {
+		fprintf(stderr, "fnf: Invalid value for --%s: %s\n", name, value);
+		exit(EXIT_FAILURE);
+	}
+
+	return value;
+}
+
+static void
+set_typos(options_t *options, const char *value)
+{
+	if (*value < '0' || *value > '0' + MATCH_TYPOS_MAX || value[1]) {
+		fprintf(stderr, "fnf: --typos must be 0 to %d\n", MATCH_TYPOS_MAX);
+		exit(EXIT_FAILURE);
+	}
+
+	options->typos = *value - '0';
+}
+
+/* Return VALUE, the number given to --NAME, if it is a valid size:
+ * digits only, and no larger than SIZE_MAX. */
+static size_t
+check_size(const char *name, const char *value)
+{
+	char *end = NULL;
+	errno = 0;
+	const unsigned long long n = strtoull(value, &end, 10);
+	if (*value < '0' || *value > '9' || *end || errno == ERANGE
+	|| n > SIZE_MAX) {
+		fprintf(stderr, "fnf: Invalid value for --%s: %s\n", name, value);
+		exit(EXIT_FAILURE);
+	}
+
+	return (size_t)n;
+}
+
+static void
+set_limit(options_t *options, const char *value)
+{
+	options->limit = check_size("limit", value);
+}
+
+static void
+set_memory_limit(options_t *options, const char *value)
+{
+	options->memory_limit = check_size("memory-limit", value);
+}
+
+static void
+set_incremental(options_t *options, const char *value)
+{
+	if (!value) {
+		options->incremental = DEFAULT_INCREMENTAL_LIMIT;
+	} else if (sscanf(value, "%zu", &options->incremental) != 1) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void
+set_server_fd(options_t *options, const char *value)
+{
+	if (!value) {
+		options->server_fd = 0; /* STDIN */
+	} else if (sscanf(value, "%d", &options->server_fd) != 1
+	|| options->server_fd < 0) {
+		fprintf(stderr, "Invalid file descriptor for --server: %s\n", value);
+		exit(EXIT_FAILURE);
+	}
+}
+
 static void
 set_lines(options_t *options, const char *value)
 {
@@ -278,6 +475,22 @@ set_case_sensitivy_mode(options_t *options, const char *value)
 		options->case_sens_mode = CASE_SMART;
 }
 
+static void
+set_algo(options_t *options, const char *value)
+{
+	if (strcmp(value, "optimal") == 0) {
+		options->algo = ALGO_OPTIMAL;
+	} else if (strcmp(value, "greedy") == 0) {
+		options->algo = ALGO_GREEDY;
+	} else if (strcmp(value, "auto") == 0) {
+		options->algo = ALGO_AUTO;
+	} else {
+		fprintf(stderr, "Invalid value for --algo: %s\n", value);
+		fprintf(stderr, "Valid values: 'optimal', 'greedy', or 'auto'\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
 static void
 set_color_scheme(options_t *options, const char *value)
 {
@@ -304,7 +517,7 @@ options_parse(options_t *options, int argc, char *argv[])
 	int separator_set = 0;
 
 	int c;
-	while ((c = getopt_long(argc, argv, "0ce:hij:l:mM:p:P:q:rt:sv",
+	while ((c = getopt_long(argc, argv, "0ce:hij:l:mM:p:P:q:rt:svx",
 	longopts, NULL)) != -1) {
 		switch (c) {
 		case '0': options->input_delimiter = '\0'; break;
@@ -323,23 +536,44 @@ options_parse(options_t *options, int argc, char *argv[])
 		case 't': options->tty_filename = optarg; break;
 		case 's': options->show_scores = 1;	break;
 		case 'v': print_version(); break;
+		case 'x': options->extended = 1; break;
+		case OPT_ALGO: set_algo(options, optarg); break;
+		case OPT_ANSI: options->ansi = 1; break;
 		case OPT_CASE: set_case_sensitivy_mode(options, optarg); break;
 		case OPT_COLOR: options->color = optarg; break;
 		case OPT_COLOR_SCHEME: set_color_scheme(options, optarg); break;
+		case OPT_CONNECT: options->connect_socket = optarg; break;
+		case OPT_CORPUS: options->corpus = optarg; break;
+		case OPT_DAEMON: options->daemon_socket = optarg; break;
+		case OPT_DELIMITER: set_field_delimiter(options, optarg); break;
+		case OPT_EXACT: options->exact = 1; break;
 		case OPT_GHOST: options->ghost = optarg; break;
+		case OPT_INCREMENTAL: set_incremental(options, optarg); break;
+		case OPT_INDEX_IN: options->index_in = optarg; break;
+		case OPT_INDEX_OUT: options->index_out = optarg; break;
 		case OPT_LEFT_ABORTS: options->left_aborts = 1; break;
+		case OPT_LIMIT: set_limit(options, optarg); break;
 		case OPT_MARKER: marker_set = set_marker(options, optarg); break;
+		case OPT_MEMORY_LIMIT: set_memory_limit(options, optarg); break;
 		case OPT_NO_BOLD: options->no_bold = 1; break;
 		case OPT_NO_CLEAR: options->clear = 0; break;
 		case OPT_NO_COLOR: options->no_color = 1; break;
 		case OPT_NO_SORT: options->sort = 0; break;
 		case OPT_NO_UNICODE: options->unicode = 0; break;
+		case OPT_NORMALIZE: options->normalize = 1; break;
+		case OPT_NTH: options->nth = check_fields("nth", optarg); break;
 		case OPT_POINTER: pointer_set = set_pointer(options, optarg); break;
 		case OPT_PRINT_NULL: options->print_null = 1; break;
+		case OPT_QUERIES_FILE: options->queries_file = optarg; break;
 		case OPT_RIGHT_ACCEPTS: options->right_accepts = 1; break;
 		case OPT_SCROLLOFF: set_scrolloff(options, optarg); break;
+		case OPT_SEARCH_INDEX: options->search_index = 1; break;
+		case OPT_SERVER: set_server_fd(options, optarg); break;
 		case OPT_SEPARATOR: separator_set = set_separator(options, optarg); break;
 		case OPT_TAB_ACCEPTS: options->tab_accepts = 1; break;
+		case OPT_THROTTLE: options->throttle = 1; break;
+		case OPT_TYPOS: set_typos(options, optarg); break;
+		case OPT_WITH_NTH: options->with_nth = check_fields("with-nth", optarg); break;
 		default: usage(); exit(EXIT_SUCCESS);
 		}
 	}
@@ -349,6 +583,26 @@ options_parse(options_t *options, int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	if (!options->connect_socket != !options->corpus) {
+		fputs("fnf: --connect and --corpus go together\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	if (options->ansi && (options->index_in || options->index_out)) {
+		fputs("fnf: --ansi cannot be used with snapshots\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	if (options->ansi && options->with_nth) {
+		fputs("fnf: --ansi cannot be used with --with-nth\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	if (options->connect_socket && options->queries_file) {
+		fputs("fnf: --queries-file cannot be used with --connect\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
 	if (separator_set == 1 && !options->separator)
 		options->separator = options->unicode == 0 ? DEFAULT_SEPARATOR
 			: DEFAULT_SEPARATOR_UNICODE;
@@ -49,32 +49,54 @@ typedef struct {
 	const char *pointer;
 	const char *marker;
 	const char *separator;
+	const char *queries_file;
+	const char *daemon_socket;
+	const char *connect_socket;
+	const char *corpus;
+	const char *index_in;
+	const char *index_out;
+	const char *field_delimiter; /* NULL: runs of blanks */
+	const char *nth;
+	const char *with_nth;
+	size_t incremental; /* Memory limit in MiB (0: disabled) */
+	size_t limit;
+	size_t memory_limit; /* In MiB */
 	size_t num_lines;
 	size_t workers;
+	int algo;
+	int ansi;
 	int auto_lines;
 	int case_sens_mode;
 	int clear;
 	int cycle;
+	int exact;
+	int extended;
 	int left_aborts;
 	int max_items;
 	int multi;
 	int no_bold;
 	int no_color;
+	int normalize;
 	int pad;
 	int print_null;
 	int reverse;
 	int right_accepts;
 	int scrolloff;
+	int search_index;
+	int server_fd;
 	int show_scores;
 	int show_info;
 	int sort;
 	int tab_accepts;
+	int throttle;
+	int typos; /* Most typos in queries with few results (see --typos) */
 	int unicode;
 	char input_delimiter;
 } options_t;
 
 void options_init(options_t *options);
 void options_parse(options_t *options, int argc, char *argv[]);
+int options_case_sensitive(const options_t *options, const char *query);
 
 #ifdef __cplusplus
 }
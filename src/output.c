@@ -0,0 +1,170 @@
+/* output.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+/* Batched output of results and selections.
+ *
+ * Items are not copied: each one becomes an iovec pointing straight into
+ * the input buffer, followed by another one for the terminator, and the
+ * whole batch is handed to the kernel with a single writev(2) call.
+ * Only strings which do not outlive the call (decolored names, scores)
+ * are copied, into a scratch area flushed along with the batch.
+ *
+ * vmsplice(2) would save the last copy for pipes, but the pages it maps
+ * keep being read after the call returns, which rules it out for memory
+ * we free (the input buffer, on exit) or reuse (the scratch area). */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+
+/* Initialize OUT to write to the file descriptor FD, terminating items
+ * with DELIM. */
+void
+output_init(output_t *out, const int fd, const char delim)
+{
+	/* Whatever was printed before must come first. */
+	fflush(stdout);
+
+	out->iov_count = 0;
+	out->scratch_len = 0;
+	out->fd = fd;
+	out->error = 0;
+	out->delim[0] = delim;
+}
+
+static void
+add_iov(output_t *out, const void *data, const size_t len)
+{
+	if (out->iov_count == OUTPUT_IOV_MAX)
+		output_flush(out);
+
+	/* Contiguous data (e.g. consecutive scratch copies) share one iovec. */
+	struct iovec *last = out->iov_count > 0
+		? &out->iov[out->iov_count - 1] : NULL;
+	if (last && (const char *)last->iov_base + last->iov_len == data) {
+		last->iov_len += len;
+		return;
+	}
+
+	out->iov[out->iov_count].iov_base = (void *)data;
+	out->iov[out->iov_count].iov_len = len;
+	out->iov_count++;
+}
+
+/* Queue the item STR, which must remain valid until the next flush. */
+void
+output_item(output_t *out, const char *str)
+{
+	add_iov(out, str, strlen(str));
+	add_iov(out, out->delim, 1);
+}
+
+/* Queue the LEN bytes at STR, which must remain valid until the next
+ * flush (no terminator is added). */
+void
+output_ref(output_t *out, const char *str, const size_t len)
+{
+	if (len > 0)
+		add_iov(out, str, len);
+}
+
+/* Queue a copy of the LEN bytes at STR (no terminator is added). */
+void
+output_copy(output_t *out, const char *str, const size_t len)
+{
+	/* Flush first if needed: flushing resets the scratch area. */
+	if (out->scratch_len + len > sizeof(out->scratch)
+	|| out->iov_count == OUTPUT_IOV_MAX) {
+		output_flush(out);
+		if (len > sizeof(out->scratch)) { /* Too large: write it now */
+			add_iov(out, str, len);
+			output_flush(out);
+			return;
+		}
+	}
+
+	memcpy(out->scratch + out->scratch_len, str, len);
+	add_iov(out, out->scratch + out->scratch_len, len);
+	out->scratch_len += len;
+}
+
+/* Queue formatted output (no terminator is added). */
+void
+output_printf(output_t *out, const char *fmt, ...)
+{
+	char buf[256];
+	va_list args;
+
+	va_start(args, fmt);
+	const int len = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	if (len > 0)
+		output_copy(out, buf, (size_t)len < sizeof(buf)
+			? (size_t)len : sizeof(buf) - 1);
+}
+
+/* Write everything queued so far.
+ * Return 0 on success, or -1 on error (subsequent calls do nothing). */
+int
+output_flush(output_t *out)
+{
+	struct iovec *iov = out->iov;
+	size_t count = out->iov_count;
+
+	while (count > 0 && out->error == 0) {
+		const ssize_t ret = writev(out->fd, iov, (int)count);
+		if (ret == -1) {
+			if (errno != EINTR)
+				out->error = 1;
+			continue;
+		}
+
+		/* Skip what was written, and resume after a short write. */
+		size_t written = (size_t)ret;
+		while (count > 0 && written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	out->iov_count = 0;
+	out->scratch_len = 0;
+	return out->error ? -1 : 0;
+}
@@ -0,0 +1,65 @@
+/* output.h */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <sys/uio.h> /* struct iovec */
+
+#define OUTPUT_IOV_MAX 1024 /* Guaranteed by POSIX systems we care about */
+#define OUTPUT_SCRATCH_SIZE 65536
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	struct iovec iov[OUTPUT_IOV_MAX];
+	char scratch[OUTPUT_SCRATCH_SIZE]; /* Copies of transient strings */
+	size_t iov_count;
+	size_t scratch_len;
+	int fd;
+	int error;
+	char delim[1]; /* Item terminator */
+} output_t;
+
+void output_init(output_t *out, const int fd, const char delim);
+void output_item(output_t *out, const char *str);
+void output_ref(output_t *out, const char *str, const size_t len);
+void output_copy(output_t *out, const char *str, const size_t len);
+void output_printf(output_t *out, const char *fmt, ...);
+int  output_flush(output_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,386 @@
+/* query.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+/* Extended search syntax (see --extended).
+ *
+ * A query is made of terms separated by spaces ("\ " is a space), all of
+ * which must match:
+ *
+ *   foo     fuzzy match
+ *   'foo    exact match: foo is a substring
+ *   ^foo    the string starts with foo
+ *   foo$    the string ends with foo
+ *   ^foo$   the string is foo
+ *   !foo    foo is not a substring (also !^foo, !foo$, and !^foo$)
+ *
+ * In exact mode (see --exact), foo is a substring and 'foo a fuzzy match.
+ *
+ * Terms separated by "|" make a group, which matches if any of them does
+ * (e.g. "^src | ^test .c$").
+ *
+ * The query is compiled once per search into a plan: its groups, sorted
+ * so that the cheapest and most selective run first (negations, then
+ * anchored compares, substrings, and fuzzy matches), so that most strings
+ * are ruled out before any fuzzy scoring. Only strings passing all groups
+ * are scored: the score is the sum of those of the groups (negations add
+ * nothing), that of a group being the best score of its matching terms. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "query.h"
+
+/* Costs of the terms, cheapest first */
+#define COST_ANCHORED 0 /* Prefix, suffix, or whole string */
+#define COST_EXACT    1
+#define COST_FUZZY    2
+
+struct query_term {
+	const char *text;
+	size_t len;
+	match_func_t match; /* Scorer of fuzzy terms */
+	int fuzzy;
+	int anchor; /* MATCH_* (see match_substring()), unless fuzzy */
+	int negated;
+};
+
+struct query_group {
+	size_t first; /* Index of its first term */
+	size_t count;
+	size_t len; /* Total length of its terms */
+	int cost; /* That of its most expensive term */
+	int negated; /* All of its terms are negated */
+};
+
+struct query {
+	char *text; /* The terms, unescaped, one after the other */
+	struct query_term *terms;
+	struct query_group *groups;
+	size_t count; /* Number of groups */
+	int case_sensitive;
+	int greedy;
+};
+
+static int
+term_cost(const struct query_term *t)
+{
+	return t->fuzzy ? COST_FUZZY
+		: t->anchor == MATCH_ANYWHERE ? COST_EXACT : COST_ANCHORED;
+}
+
+static int
+cmpgroup(const void *a, const void *b)
+{
+	const struct query_group *g1 = a;
+	const struct query_group *g2 = b;
+
+	if (g1->negated != g2->negated)
+		return g1->negated ? -1 : 1;
+	if (g1->cost != g2->cost)
+		return g1->cost < g2->cost ? -1 : 1;
+	/* Longer terms rule out more strings. */
+	if (g1->len != g2->len)
+		return g1->len > g2->len ? -1 : 1;
+
+	return g1->first < g2->first ? -1 : 1;
+}
+
+/* Copy the next token of *SEARCH (up to an unescaped space) to DST,
+ * unescaped and NUL-terminated, and move *SEARCH past it. Return its
+ * length. */
+static size_t
+next_token(const char **search, char *dst)
+{
+	const char *s = *search;
+	size_t len = 0;
+
+	while (*s && *s != ' ') {
+		if (*s == '\\' && s[1] == ' ')
+			s++;
+		dst[len++] = *s++;
+	}
+	dst[len] = '\0';
+
+	*search = s;
+	return len;
+}
+
+/* Parse the token TEXT (LEN bytes) into T. Quoting makes a term fuzzy if
+ * EXACT_MODE is set (see --exact), or a substring otherwise. Return 0 if
+ * nothing is left of it once its syntax is removed (it then matches
+ * everything), or 1. */
+static int
+parse_term(char *text, size_t len, const int exact_mode,
+	struct query_term *t)
+{
+	t->negated = t->anchor = 0;
+	int exact = exact_mode;
+
+	if (*text == '!') {
+		t->negated = 1;
+		text++; len--;
+	}
+	if (*text == '\'') {
+		exact = !exact_mode;
+		text++; len--;
+	}
+	if (*text == '^') {
+		t->anchor |= MATCH_PREFIX;
+		text++; len--;
+	}
+	if (len > 0 && text[len - 1] == '$') {
+		t->anchor |= MATCH_SUFFIX;
+		text[--len] = '\0';
+	}
+
+	t->text = text;
+	t->len = len;
+	t->fuzzy = t->negated == 0 && exact == 0 && t->anchor == MATCH_ANYWHERE;
+	return len > 0;
+}
+
+/* Compile SEARCH into a plan, to match it ignoring case unless
+ * CASE_SENSITIVE is set, scoring fuzzy terms with match_greedy() if
+ * GREEDY is set (see --algo), or match() otherwise. Unmarked terms are
+ * substrings if EXACT is set, or fuzzy otherwise. Return NULL if SEARCH is
+ * a single unmarked term, to be matched as usual. */
+query_t *
+query_compile(const char *search, const int case_sensitive, const int greedy,
+	const int exact)
+{
+	const char *s = search;
+	const size_t len = strlen(s);
+
+	query_t *q = safe_realloc(NULL, sizeof(query_t));
+	q->text = safe_realloc(NULL, len + 1);
+	q->terms = safe_realloc(NULL,
+		(len / 2 + 1) * sizeof(struct query_term));
+	q->groups = safe_realloc(NULL,
+		(len / 2 + 1) * sizeof(struct query_group));
+	q->count = 0;
+	q->case_sensitive = case_sensitive;
+	q->greedy = greedy;
+
+	size_t terms = 0;
+	int join = 0; /* The last token was "|" */
+	char *dst = q->text;
+
+	while (*s) {
+		if (*s == ' ') {
+			s++;
+			continue;
+		}
+
+		const size_t n = next_token(&s, dst);
+		if (n == 1 && *dst == '|') {
+			join = q->count > 0;
+			continue;
+		}
+
+		struct query_term *t = &q->terms[terms];
+		if (parse_term(dst, n, exact, t) == 0) {
+			join = 0;
+			continue;
+		}
+		t->match = greedy ? match_greedy : match_for(t->text);
+		dst += n + 1;
+
+		struct query_group *g = &q->groups[q->count - (join ? 1 : 0)];
+		if (join == 0) {
+			g->first = terms;
+			g->count = g->len = 0;
+			g->cost = COST_ANCHORED;
+			g->negated = 1;
+			q->count++;
+		}
+		g->count++;
+		g->len += t->len;
+		if (term_cost(t) > g->cost)
+			g->cost = term_cost(t);
+		g->negated &= t->negated;
+
+		terms++;
+		join = 0;
+	}
+
+	/* A single unmarked term, as typed: nothing to compile. */
+	const struct query_term *t = q->terms;
+	if (q->count == 1 && q->groups[0].count == 1 && t->negated == 0
+	&& t->anchor == MATCH_ANYWHERE && t->fuzzy != exact
+	&& strcmp(t->text, search) == 0) {
+		query_free(q);
+		return NULL;
+	}
+
+	qsort(q->groups, q->count, sizeof(struct query_group), cmpgroup);
+	return q;
+}
+
+void
+query_free(query_t *q)
+{
+	if (!q)
+		return;
+
+	free(q->text);
+	free(q->terms);
+	free(q->groups);
+	free(q);
+}
+
+static int
+term_found(const query_t *q, const struct query_term *t, const char *str)
+{
+	return t->fuzzy ? has_match(t->text, str, q->case_sensitive)
+		: match_substring(t->text, t->len, str, t->anchor, q->case_sensitive,
+		NULL, NULL);
+}
+
+/* Return the score of the term T, which matches STR, storing the
+ * positions of its characters in POSITIONS (if not NULL). */
+static score_t
+term_score(const query_t *q, const struct query_term *t, const char *str,
+	size_t *positions)
+{
+	if (t->fuzzy && positions) {
+		return (q->greedy ? match_greedy_positions : match_positions)(
+			t->text, str, positions, q->case_sensitive);
+	}
+	if (t->fuzzy)
+		return t->match(t->text, str, q->case_sensitive);
+
+	score_t score = SCORE_MIN;
+	match_substring(t->text, t->len, str, t->anchor, q->case_sensitive,
+		&score, positions);
+	return score;
+}
+
+/* Return the score of STR, which passes all groups of Q, marking in
+ * MARKED (if not NULL) the positions of the characters matching them. */
+static score_t
+query_score(const query_t *q, const char *str, unsigned char *marked)
+{
+	size_t positions[MATCH_MAX_LEN];
+	score_t total = 0;
+	int scored = 0;
+
+	for (size_t i = 0; i < q->count; i++) {
+		const struct query_group *g = &q->groups[i];
+		score_t best = SCORE_MIN;
+		int found = 0;
+
+		for (size_t j = 0; j < g->count; j++) {
+			const struct query_term *t = &q->terms[g->first + j];
+			/* A single term is known to match. */
+			if (t->negated || ((g->count > 1 || marked)
+			&& !term_found(q, t, str)))
+				continue;
+
+			if (marked)
+				memset(positions, -1, sizeof(positions));
+			const score_t score = term_score(q, t, str,
+				marked ? positions : NULL);
+			for (size_t k = 0; marked && k < MATCH_MAX_LEN
+			&& positions[k] != (size_t)-1; k++)
+				marked[positions[k]] = 1;
+
+			if (found == 0 || score > best)
+				best = score;
+			found = 1;
+		}
+
+		if (found == 0)
+			continue;
+
+		/* Too long strings (SCORE_MIN) go last, as with match(). */
+		total = total == SCORE_MIN || best == SCORE_MIN
+			? SCORE_MIN : total + best;
+		scored = 1;
+	}
+
+	return scored ? total : SCORE_MIN;
+}
+
+/* Return 1 if STR matches Q, storing its score in *SCORE (if not NULL),
+ * or 0 otherwise. */
+int
+query_match(const query_t *q, const char *str, score_t *score)
+{
+	for (size_t i = 0; i < q->count; i++) {
+		const struct query_group *g = &q->groups[i];
+		size_t j = 0;
+		for (; j < g->count; j++) {
+			const struct query_term *t = &q->terms[g->first + j];
+			if (term_found(q, t, str) != t->negated)
+				break;
+		}
+		if (j == g->count)
+			return 0;
+	}
+
+	if (score)
+		*score = query_score(q, str, NULL);
+	return 1;
+}
+
+/* Like match_positions(), for STR, a match of Q: the positions are those
+ * of the characters matching any of its terms, in increasing order. */
+score_t
+query_positions(const query_t *q, const char *str, size_t *positions)
+{
+	unsigned char marked[MATCH_MAX_LEN] = {0};
+	const score_t score = query_score(q, str, marked);
+
+	size_t p = 0;
+	for (size_t j = 0; j < MATCH_MAX_LEN; j++) {
+		if (marked[j])
+			positions[p++] = j;
+	}
+	if (p < MATCH_MAX_LEN)
+		positions[p] = (size_t)-1;
+
+	return score;
+}
+
+/* Return 1 if whatever matches SEARCH also matches PREV, which SEARCH
+ * starts with, or 0 if that cannot be told: negations and alternatives
+ * match more as they grow, and so may a term PREV ended with "$" or "\"
+ * (e.g. "a$" and "a$b"). */
+int
+query_narrows(const char *prev, const char *search)
+{
+	if (strpbrk(search, "!|"))
+		return 0;
+
+	const size_t len = strlen(prev);
+	return len == 0 || (prev[len - 1] != '$' && prev[len - 1] != '\\');
+}
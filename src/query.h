@@ -0,0 +1,56 @@
+/* query.h */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stddef.h>
+
+#include "match.h" /* score_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct query query_t;
+
+query_t *query_compile(const char *search, const int case_sensitive,
+	const int greedy, const int exact);
+void query_free(query_t *q);
+int query_match(const query_t *q, const char *str, score_t *score);
+score_t query_positions(const query_t *q, const char *str,
+	size_t *positions);
+int query_narrows(const char *prev, const char *search);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUERY_H */
@@ -0,0 +1,253 @@
+/* score_cache.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+/* Scores kept between searches (see --incremental).
+ *
+ * Typing a character makes the query one character longer. Each match of
+ * the new query matched the previous one, and most of its DP (see
+ * match.c) is the same: only the row of the new character is new. So,
+ * for each match, the last row of the DP is kept (only the cells holding
+ * a score, see match_keep()), and the next search goes on from there (see
+ * match_extend()), computing one row instead of all of them.
+ *
+ * Rows are stored in one arena per worker, so that workers need no lock,
+ * and are found by string index. When the arenas are full (the memory
+ * limit is reached), rows are not kept: the next search computes the
+ * scores of those strings from scratch. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "score_cache.h"
+
+/* A reference to a row: its arena, and its offset in it (plus one). */
+#define REF(worker, offset) (((uint64_t)(worker) << 40) | ((offset) + 1))
+#define REF_WORKER(ref) ((size_t)((ref) >> 40))
+#define REF_OFFSET(ref) ((size_t)((ref) & (((uint64_t)1 << 40) - 1)) - 1)
+
+struct arena {
+	unsigned char *data;
+	size_t len;
+	size_t cap;
+};
+
+struct score_rows {
+	uint64_t *refs; /* By string index (0: no row) */
+	struct arena *arenas; /* By worker */
+	size_t workers;
+	size_t budget; /* Bytes each arena may take */
+};
+
+struct score_cache {
+	size_t limit; /* Bytes the rows of a search may take */
+	char *query; /* Query the rows were computed for */
+	size_t query_cap;
+	int case_sensitive;
+	struct score_rows *rows; /* Or NULL */
+};
+
+static void
+rows_free(struct score_rows *rows)
+{
+	if (!rows)
+		return;
+
+	for (size_t i = 0; i < rows->workers; i++)
+		free(rows->arenas[i].data);
+	free(rows->arenas);
+	free(rows->refs);
+	free(rows);
+}
+
+/* Make a cache whose rows may take up to LIMIT bytes per search. */
+score_cache_t *
+score_cache_new(const size_t limit)
+{
+	score_cache_t *sc = safe_realloc(NULL, sizeof(score_cache_t));
+	sc->limit = limit;
+	sc->query = NULL;
+	sc->query_cap = 0;
+	sc->case_sensitive = 0;
+	sc->rows = NULL;
+	return sc;
+}
+
+void
+score_cache_free(score_cache_t *sc)
+{
+	rows_free(sc->rows);
+	free(sc->query);
+	free(sc);
+}
+
+/* Drop the rows (e.g. because the strings changed). */
+void
+score_cache_clear(score_cache_t *sc)
+{
+	rows_free(sc->rows);
+	sc->rows = NULL;
+}
+
+/* Return the rows of the last search if SEARCH is its query plus one
+ * character (in the same case sensitivity mode), or NULL otherwise. */
+const struct score_rows *
+score_cache_prev(const score_cache_t *sc, const char *search,
+	const int case_sensitive)
+{
+	if (!sc->rows || case_sensitive != sc->case_sensitive)
+		return NULL;
+
+	const size_t len = strlen(sc->query);
+	if (len == 0 || strncmp(search, sc->query, len) != 0
+	|| !search[len] || search[len + 1])
+		return NULL;
+
+	return sc->rows;
+}
+
+/* Return empty rows for a search of STRINGS strings by WORKERS workers, or
+ * NULL if they cannot fit in the memory limit. */
+struct score_rows *
+score_cache_rows(const score_cache_t *sc, const size_t strings,
+	const size_t workers)
+{
+	const size_t refs_size = strings * sizeof(uint64_t);
+	if (refs_size >= sc->limit || workers == 0)
+		return NULL;
+
+	struct score_rows *rows = safe_realloc(NULL, sizeof(struct score_rows));
+	rows->refs = calloc(strings + 1, sizeof(uint64_t));
+	rows->arenas = calloc(workers, sizeof(struct arena));
+	if (!rows->refs || !rows->arenas) {
+		fprintf(stderr, "Error: Cannot allocate memory\n");
+		abort();
+	}
+	rows->workers = workers;
+	rows->budget = (sc->limit - refs_size) / workers;
+
+	return rows;
+}
+
+/* Keep ROWS, computed for SEARCH, in place of the previous ones. ROWS may
+ * be NULL: there are none. */
+void
+score_cache_set(score_cache_t *sc, const char *search,
+	const int case_sensitive, struct score_rows *rows)
+{
+	rows_free(sc->rows);
+	sc->rows = rows;
+	if (!rows)
+		return;
+
+	const size_t len = strlen(search);
+	if (len + 1 > sc->query_cap) {
+		sc->query_cap = len + 1;
+		sc->query = safe_realloc(sc->query, sc->query_cap);
+	}
+	memcpy(sc->query, search, len + 1);
+	sc->case_sensitive = case_sensitive;
+}
+
+static void
+get_row(const struct score_rows *rows, const uint64_t ref,
+	struct match_row *row)
+{
+	const unsigned char *p = rows->arenas[REF_WORKER(ref)].data + REF_OFFSET(ref);
+	uint16_t count;
+
+	memcpy(&count, p, sizeof(count));
+	p += sizeof(count);
+	memcpy(row->pos, p, count * sizeof(uint16_t));
+	p += count * sizeof(uint16_t);
+	memcpy(row->score, p, count * sizeof(score_t));
+	row->count = count;
+}
+
+static void
+put_row(struct score_rows *rows, const size_t worker, const size_t index,
+	const struct match_row *row)
+{
+	if (row->count == MATCH_NO_ROW)
+		return;
+
+	struct arena *a = &rows->arenas[worker];
+	const uint16_t count = (uint16_t)row->count;
+	const size_t size = sizeof(count)
+		+ row->count * (sizeof(uint16_t) + sizeof(score_t));
+
+	if (a->len + size > a->cap) {
+		size_t cap = a->cap ? a->cap * 2 : 4096;
+		while (cap < a->len + size)
+			cap *= 2;
+		if (cap > rows->budget)
+			cap = rows->budget;
+		if (a->len + size > cap) /* Full */
+			return;
+		a->data = safe_realloc(a->data, cap);
+		a->cap = cap;
+	}
+
+	unsigned char *p = a->data + a->len;
+	memcpy(p, &count, sizeof(count));
+	p += sizeof(count);
+	memcpy(p, row->pos, row->count * sizeof(uint16_t));
+	p += row->count * sizeof(uint16_t);
+	memcpy(p, row->score, row->count * sizeof(score_t));
+
+	rows->refs[index] = REF(worker, a->len);
+	a->len += size;
+}
+
+/* Return the score of the string STR (at INDEX) for SEARCH, as match()
+ * would, going on from its row in PREV (if any: see score_cache_prev()),
+ * and keep its last row in ROWS, as WORKER. */
+score_t
+score_rows_match(const struct score_rows *prev, struct score_rows *rows,
+	const size_t worker, const char *search, const char *str,
+	const size_t index, const int case_sensitive)
+{
+	struct match_row last_row, row;
+	score_t score;
+
+	if (prev && prev->refs[index]) {
+		get_row(prev, prev->refs[index], &last_row);
+		score = match_extend(search, str, case_sensitive, &last_row, &row);
+	} else {
+		score = match_keep(search, str, case_sensitive, &row);
+	}
+
+	if (rows)
+		put_row(rows, worker, index, &row);
+
+	return score;
+}
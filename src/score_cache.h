@@ -0,0 +1,62 @@
+/* score_cache.h */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#ifndef SCORE_CACHE_H
+#define SCORE_CACHE_H
+
+#include <stddef.h>
+
+#include "match.h" /* score_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct score_cache score_cache_t;
+struct score_rows;
+
+score_cache_t *score_cache_new(const size_t limit);
+void score_cache_free(score_cache_t *sc);
+void score_cache_clear(score_cache_t *sc);
+const struct score_rows *score_cache_prev(const score_cache_t *sc,
+	const char *search, const int case_sensitive);
+struct score_rows *score_cache_rows(const score_cache_t *sc,
+	const size_t strings, const size_t workers);
+void score_cache_set(score_cache_t *sc, const char *search,
+	const int case_sensitive, struct score_rows *rows);
+score_t score_rows_match(const struct score_rows *prev,
+	struct score_rows *rows, const size_t worker, const char *search,
+	const char *str, const size_t index, const int case_sensitive);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCORE_CACHE_H */
@@ -0,0 +1,494 @@
+/* search_index.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+/* An inverted index of the strings of a choices_t (see --search-index).
+ *
+ * A string can only match a query if, for every two characters of the
+ * query, the first one appears somewhere before the second one in the
+ * string. For every such ordered pair of (case-folded) characters, the
+ * index keeps the list of the blocks of BLOCK_SIZE strings containing it.
+ * Looking up a query intersects the lists of its rarest pairs, leaving
+ * only a fraction of the strings for has_match() to look at.
+ *
+ * Characters are folded into CLASSES classes (letters and digits have
+ * their own), so that there are few enough lists. Lists hold block
+ * numbers, delta-encoded as varints. Both coarse classes and blocks only
+ * ever add candidates: lookups never miss a match.
+ *
+ * The index is built by a background thread, in batches, so that
+ * searching does not wait for it: strings not indexed yet are always
+ * candidates. Strings added later are indexed when indexing is started
+ * again (see choices_index()).
+ *
+ * A complete index can be saved in a snapshot (see snapshot.c), and its
+ * lists used straight from the mapping when it is loaded. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "search_index.h"
+
+#define CLASSES 64
+#define PAIRS (CLASSES * CLASSES)
+#define BLOCK_SIZE 16 /* Strings per block */
+#define BATCH_SIZE 1024 /* Strings indexed at once by the background thread */
+
+#define MIN_QUERY_LEN 3
+#define MAX_QUERY_LEN 32 /* Characters of the query used for lookups */
+#define MAX_LISTS 3 /* Lists intersected by a lookup */
+
+struct posting {
+	unsigned char *data; /* Block numbers (delta-encoded varints) */
+	size_t len;
+	size_t cap; /* 0 if DATA is not ours (see search_index_load()) */
+	size_t count; /* Number of blocks */
+	size_t last; /* Last block */
+};
+
+struct search_index {
+	pthread_mutex_t lock; /* Protects everything below but THREAD/RUNNING */
+	pthread_t thread;
+	int running; /* Only used by the owner */
+	int stop;
+	const char *const *strings;
+	size_t count; /* Number of strings to index */
+	size_t size; /* Number of strings indexed */
+	struct posting lists[PAIRS];
+};
+
+/* Return the class of the character CH. Whatever has_match() takes as
+ * the same character (regardless of case) must be of the same class. */
+static unsigned
+char_class(const unsigned char ch)
+{
+	if (ch >= 'a' && ch <= 'z')
+		return ch - 'a';
+	if (ch >= 'A' && ch <= 'Z')
+		return ch - 'A';
+	if (ch >= '0' && ch <= '9')
+		return 26 + ch - '0';
+	if (ch >= 0x80)
+		return CLASSES - 1;
+	return 36 + ch % 27;
+}
+
+static void
+posting_add(struct posting *p, const size_t block)
+{
+	if (p->count > 0 && p->last == block)
+		return;
+
+	size_t delta = p->count > 0 ? block - p->last : block;
+	if (p->cap < p->len + 10) {
+		size_t cap = p->cap ? p->cap * 2 : 16;
+		while (cap < p->len + 10)
+			cap *= 2;
+
+		/* Lists loaded from a snapshot are copied before they grow. */
+		unsigned char *data = safe_realloc(p->cap ? p->data : NULL,
+			cap);
+		if (!p->cap && p->len > 0)
+			memcpy(data, p->data, p->len);
+		p->data = data;
+		p->cap = cap;
+	}
+
+	while (delta >= 0x80) {
+		p->data[p->len++] = (unsigned char)(delta | 0x80);
+		delta >>= 7;
+	}
+	p->data[p->len++] = (unsigned char)delta;
+
+	p->last = block;
+	p->count++;
+}
+
+/* Decode the block number at *POS in P, following PREV. */
+static size_t
+posting_next(const struct posting *p, size_t *pos, const size_t prev)
+{
+	size_t delta = 0;
+	for (unsigned shift = 0;; shift += 7) {
+		const unsigned char byte = p->data[(*pos)++];
+		delta |= (size_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			break;
+	}
+
+	return prev + delta;
+}
+
+/* Add the pairs of characters of STR to the lists, as part of BLOCK. */
+static void
+index_string(search_index_t *idx, const char *str, const size_t block)
+{
+	/* FOLLOWS[C]: classes appearing before some character of class C. */
+	uint64_t follows[CLASSES];
+	uint64_t seen = 0, used = 0;
+
+	for (const unsigned char *s = (const unsigned char *)str; *s; s++) {
+		const unsigned c = char_class(*s);
+		if (!(used & ((uint64_t)1 << c))) {
+			follows[c] = 0;
+			used |= (uint64_t)1 << c;
+		}
+		follows[c] |= seen;
+		seen |= (uint64_t)1 << c;
+	}
+
+	for (unsigned c = 0; c < CLASSES; c++) {
+		if (!(used & ((uint64_t)1 << c)))
+			continue;
+
+		uint64_t v = follows[c];
+		for (unsigned x = 0; v; x++, v >>= 1) {
+			if (v & 1)
+				posting_add(&idx->lists[x * CLASSES + c], block);
+		}
+	}
+}
+
+static void *
+index_worker(void *data)
+{
+	search_index_t *idx = data;
+
+	for (;;) {
+		pthread_mutex_lock(&idx->lock);
+		if (idx->stop || idx->size >= idx->count) {
+			pthread_mutex_unlock(&idx->lock);
+			break;
+		}
+
+		const size_t end = idx->count - idx->size > BATCH_SIZE
+			? idx->size + BATCH_SIZE : idx->count;
+		for (size_t i = idx->size; i < end; i++)
+			index_string(idx, idx->strings[i], i / BLOCK_SIZE);
+		idx->size = end;
+
+		pthread_mutex_unlock(&idx->lock);
+	}
+
+	return (char *)NULL;
+}
+
+search_index_t *
+search_index_new(void)
+{
+	search_index_t *idx = calloc(1, sizeof(search_index_t));
+	if (!idx) {
+		fprintf(stderr, "Error: Cannot allocate memory\n");
+		abort();
+	}
+
+	if (pthread_mutex_init(&idx->lock, NULL) != 0) {
+		fprintf(stderr, "Error: pthread_mutex_init failed\n");
+		abort();
+	}
+
+	return idx;
+}
+
+void
+search_index_free(search_index_t *idx)
+{
+	search_index_clear(idx);
+	pthread_mutex_destroy(&idx->lock);
+	free(idx);
+}
+
+/* Index, in the background, the COUNT STRINGS, of which those indexed
+ * already must be the first ones. STRINGS must not change until
+ * search_index_stop() is called. */
+void
+search_index_start(search_index_t *idx, const char *const *strings,
+	const size_t count)
+{
+	search_index_stop(idx);
+
+	idx->strings = strings;
+	idx->count = count;
+	idx->stop = 0;
+	if (idx->size >= count)
+		return;
+
+	if ((errno = pthread_create(&idx->thread, NULL, &index_worker, idx))) {
+		perror("pthread_create");
+		exit(EXIT_FAILURE);
+	}
+	idx->running = 1;
+}
+
+/* Stop indexing (what is indexed already is kept). */
+void
+search_index_stop(search_index_t *idx)
+{
+	if (!idx->running)
+		return;
+
+	pthread_mutex_lock(&idx->lock);
+	idx->stop = 1;
+	pthread_mutex_unlock(&idx->lock);
+
+	if ((errno = pthread_join(idx->thread, NULL))) {
+		perror("pthread_join");
+		exit(EXIT_FAILURE);
+	}
+	idx->running = 0;
+}
+
+/* Wait until indexing is over. */
+void
+search_index_wait(search_index_t *idx)
+{
+	if (!idx->running)
+		return;
+
+	if ((errno = pthread_join(idx->thread, NULL))) {
+		perror("pthread_join");
+		exit(EXIT_FAILURE);
+	}
+	idx->running = 0;
+}
+
+/* Stop indexing, and drop the index. */
+void
+search_index_clear(search_index_t *idx)
+{
+	search_index_stop(idx);
+
+	for (size_t i = 0; i < PAIRS; i++) {
+		if (idx->lists[i].cap)
+			free(idx->lists[i].data);
+	}
+	memset(idx->lists, 0, sizeof(idx->lists));
+	idx->size = idx->count = 0;
+}
+
+/* An index as saved (see search_index_save()): this header, a table of
+ * PAIRS lists, and the data of all lists. */
+struct saved_index {
+	uint64_t strings; /* Number of strings indexed */
+	uint32_t pairs; /* PAIRS */
+	uint32_t block_size; /* BLOCK_SIZE */
+};
+
+struct saved_list {
+	uint64_t offset; /* Of its data, after the table */
+	uint64_t len;
+	uint64_t count;
+	uint64_t last;
+};
+
+/* Save the index of COUNT strings by calling PUT (with ARG) on every part
+ * of it, in order. Return 0 on success, or -1 if the index does not cover
+ * exactly COUNT strings (nothing is saved). Indexing must be over (see
+ * search_index_wait()). */
+int
+search_index_save(search_index_t *idx, const size_t count,
+	void (*put)(void *arg, const void *data, const size_t len), void *arg)
+{
+	if (idx->size != count || idx->running)
+		return -1;
+
+	struct saved_index header;
+	memset(&header, 0, sizeof(header));
+	header.strings = count;
+	header.pairs = PAIRS;
+	header.block_size = BLOCK_SIZE;
+	put(arg, &header, sizeof(header));
+
+	uint64_t offset = 0;
+	for (size_t i = 0; i < PAIRS; i++) {
+		const struct saved_list list = {offset, idx->lists[i].len,
+			idx->lists[i].count, idx->lists[i].last};
+		put(arg, &list, sizeof(list));
+		offset += list.len;
+	}
+
+	for (size_t i = 0; i < PAIRS; i++) {
+		if (idx->lists[i].len > 0)
+			put(arg, idx->lists[i].data, idx->lists[i].len);
+	}
+
+	return 0;
+}
+
+/* Make the index saved at DATA (SIZE bytes, see search_index_save()) that
+ * of the COUNT STRINGS. Its lists are used from DATA, which must outlive
+ * the index. Return 0 on success, or -1 if it is not an index of as many
+ * strings, made the same way (the index is then left empty). */
+int
+search_index_load(search_index_t *idx, const char *const *strings,
+	const size_t count, const void *data, const size_t size)
+{
+	search_index_clear(idx);
+
+	const size_t table = sizeof(struct saved_index)
+		+ PAIRS * sizeof(struct saved_list);
+	if (size < table)
+		return -1;
+
+	const struct saved_index *header = data;
+	if (header->strings != count || header->pairs != PAIRS
+	|| header->block_size != BLOCK_SIZE)
+		return -1;
+
+	const struct saved_list *lists = (const struct saved_list *)
+		(const void *)(header + 1);
+	const unsigned char *bytes = (const unsigned char *)data + table;
+	for (size_t i = 0; i < PAIRS; i++) {
+		if (lists[i].offset > size - table
+		|| lists[i].len > size - table - lists[i].offset
+		|| lists[i].count > lists[i].len) {
+			memset(idx->lists, 0, sizeof(idx->lists));
+			return -1;
+		}
+
+		idx->lists[i].data = (unsigned char *)(uintptr_t)
+			(bytes + lists[i].offset);
+		idx->lists[i].len = (size_t)lists[i].len;
+		idx->lists[i].count = (size_t)lists[i].count;
+		idx->lists[i].last = (size_t)lists[i].last;
+	}
+
+	idx->strings = strings;
+	idx->size = idx->count = count;
+	return 0;
+}
+
+/* Return the list of the pair made of the classes A and B. */
+#define LIST(idx, a, b) (&(idx)->lists[(a) * CLASSES + (b)])
+
+/* Store in *CANDIDATES (to be freed by the caller) the indexes, in
+ * increasing order, of the strings (out of TOTAL) that may match QUERY,
+ * and return their number. Return (size_t)-1 instead if the index cannot
+ * tell much about QUERY: all strings are to be searched. */
+size_t
+search_index_lookup(search_index_t *idx, const char *query,
+	const size_t total, size_t **candidates)
+{
+	unsigned classes[MAX_QUERY_LEN];
+	size_t len = 0;
+
+	if (strlen(query) < MIN_QUERY_LEN)
+		return (size_t)-1;
+
+	/* Non-ASCII characters may have case variants of any class. */
+	for (const unsigned char *q = (const unsigned char *)query;
+	*q && len < MAX_QUERY_LEN; q++) {
+		if (*q < 0x80)
+			classes[len++] = char_class(*q);
+	}
+
+	if (len < 2)
+		return (size_t)-1;
+
+	pthread_mutex_lock(&idx->lock);
+
+	const size_t indexed = idx->size < total ? idx->size : total;
+	const size_t blocks = (indexed + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	/* Pick the rarest pairs (lists are shared by repeated pairs). */
+	const struct posting *lists[MAX_LISTS];
+	size_t n = 0;
+	for (size_t i = 0; i < len; i++) {
+		for (size_t j = i + 1; j < len; j++) {
+			const struct posting *p = LIST(idx, classes[i], classes[j]);
+
+			size_t k = 0;
+			while (k < n && lists[k] != p)
+				k++;
+			if (k < n || (n == MAX_LISTS && p->count >= lists[n - 1]->count))
+				continue;
+
+			/* Insert P, keeping LISTS sorted by size. */
+			k = n < MAX_LISTS ? n++ : n - 1;
+			for (; k > 0 && lists[k - 1]->count > p->count; k--)
+				lists[k] = lists[k - 1];
+			lists[k] = p;
+		}
+	}
+
+	/* Lists holding most blocks are not worth intersecting. */
+	if (indexed == 0 || lists[0]->count > blocks / 4) {
+		pthread_mutex_unlock(&idx->lock);
+		return (size_t)-1;
+	}
+
+	size_t *found = safe_realloc(NULL,
+		(lists[0]->count + 1) * sizeof(size_t));
+	size_t found_count = 0;
+	size_t pos = 0, block = 0;
+	for (size_t i = 0; i < lists[0]->count; i++)
+		found[found_count++] = block = posting_next(lists[0], &pos, block);
+
+	for (size_t k = 1; k < n && lists[k]->count <= blocks / 4; k++) {
+		size_t kept = 0, m = 0;
+		pos = 0;
+		block = 0;
+		for (size_t i = 0; i < lists[k]->count && m < found_count; i++) {
+			block = posting_next(lists[k], &pos, block);
+			while (m < found_count && found[m] < block)
+				m++;
+			if (m < found_count && found[m] == block)
+				found[kept++] = found[m++];
+		}
+		found_count = kept;
+	}
+
+	/* Strings of the blocks found, and strings not indexed yet. */
+	size_t *cand = safe_realloc(NULL,
+		(found_count * BLOCK_SIZE + total - indexed + 1) * sizeof(size_t));
+	size_t count = 0;
+	for (size_t i = 0; i < found_count; i++) {
+		const size_t start = found[i] * BLOCK_SIZE;
+		const size_t end = start + BLOCK_SIZE < indexed
+			? start + BLOCK_SIZE : indexed;
+		for (size_t s = start; s < end; s++)
+			cand[count++] = s;
+	}
+
+	pthread_mutex_unlock(&idx->lock);
+	free(found);
+
+	for (size_t s = indexed; s < total; s++)
+		cand[count++] = s;
+
+	*candidates = cand;
+	return count;
+}
+
+#undef LIST
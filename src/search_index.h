@@ -0,0 +1,60 @@
+/* search_index.h */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct search_index search_index_t;
+
+search_index_t *search_index_new(void);
+void search_index_free(search_index_t *idx);
+void search_index_start(search_index_t *idx, const char *const *strings,
+	const size_t count);
+void search_index_stop(search_index_t *idx);
+void search_index_wait(search_index_t *idx);
+void search_index_clear(search_index_t *idx);
+int search_index_save(search_index_t *idx, const size_t count,
+	void (*put)(void *arg, const void *data, const size_t len), void *arg);
+int search_index_load(search_index_t *idx, const char *const *strings,
+	const size_t count, const void *data, const size_t size);
+size_t search_index_lookup(search_index_t *idx, const char *query,
+	const size_t total, size_t **candidates);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEARCH_INDEX_H */
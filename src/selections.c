@@ -29,127 +29,130 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h> /* STDOUT_FILENO */
 
+#include "choices.h" /* safe_realloc() */
 #include "colors.h"
+#include "output.h"
 #include "selections.h"
 
-/* Struct to store selected/marked entries. */
-struct selections_t {
-	char *name;
-	size_t namelen;
-};
+/* Selections are stored as a bitmap, one bit per item (as indexed in the
+ * strings array of the choices struct, i.e. in input order), so that
+ * marking and testing an item take constant time. */
 
-static struct selections_t *selections = (struct selections_t *)NULL;
+#define WORD_BITS 64
+#define WORD(n) ((n) / WORD_BITS)
+#define BIT(n) ((uint64_t)1 << ((n) % WORD_BITS))
 
-/* Search for the string NAME in the selections array. If found, return 1,
- * otherwise zero. */
-int
-is_selected(const char *name)
+/* Make sure the bitmap is large enough to hold the item ITEM. */
+static void
+reserve_bitmap(sel_t *sel, const size_t item)
 {
-	if (!name || !*name || !selections)
-		return 0;
+	if (WORD(item) < sel->size)
+		return;
 
-	const size_t len = strlen(name);
+	size_t size = sel->size ? sel->size : 16;
+	while (size <= WORD(item))
+		size *= 2;
 
-	for (size_t i = 0; selections[i].name; i++) {
-		if (*selections[i].name == *name && selections[i].namelen == len
-		&& strcmp(selections[i].name, name) == 0)
-			return 1;
-	}
+	uint64_t *tmp = safe_realloc(sel->bitmap, size * sizeof(uint64_t));
 
-	return 0;
+	memset(tmp + sel->size, 0, (size - sel->size) * sizeof(uint64_t));
+	sel->bitmap = tmp;
+	sel->size = size;
 }
 
-/* Remote the entry NAME from the selections array by setting the first
- * byte of the corresponding array entry to NUL */
-void
-deselect_entry(const char *name, tty_interface_t *state)
+/* Return 1 if the item ITEM is selected, or zero otherwise. */
+int
+is_selected(const sel_t *sel, const size_t item)
 {
-	if (!name || !*name || state->selection->selected == 0)
-		return;
-
-	const size_t len = strlen(name);
-	for (size_t i = 0; selections[i].name; i++) {
-		if (*selections[i].name != *name || selections[i].namelen != len
-		|| strcmp(selections[i].name, name) != 0)
-			continue;
-
-		*selections[i].name = '\0';
-		state->selection->selected--;
-		break;
-	}
-
-	if (state->selection->selected == 0)
-		free_selections(state);
+	return WORD(item) < sel->size && (sel->bitmap[WORD(item)] & BIT(item));
 }
 
-/* Save the string NAME into the selections array. */
+/* Mark the item ITEM as selected. */
 void
-save_selection(const char *name, sel_t *selection)
+select_entry(sel_t *sel, const size_t item)
 {
-	struct selections_t *tmp = (struct selections_t *)realloc(
-		selections, (selection->size + 2) * sizeof(struct selections_t));
-	if (!tmp) {
-		for (size_t i = 0; selections[i].name; i++)
-			free(selections[i].name);
-		free(selections);
-		fprintf(stderr, "Error: Cannot allocate memory\n");
-		abort();
+	reserve_bitmap(sel, item);
+	if (!(sel->bitmap[WORD(item)] & BIT(item))) {
+		sel->bitmap[WORD(item)] |= BIT(item);
+		sel->selected++;
 	}
-	selections = tmp;
+}
 
-	const size_t len = strlen(name);
-	selections[selection->size].name = (char *)malloc((len + 1) * sizeof(char));
-	if (!selections[selection->size].name) {
-		fprintf(stderr, "Error: Cannot allocate memory\n");
-		abort();
+/* Unmark the item ITEM. */
+void
+deselect_entry(sel_t *sel, const size_t item)
+{
+	if (is_selected(sel, item)) {
+		sel->bitmap[WORD(item)] &= ~BIT(item);
+		sel->selected--;
 	}
+}
 
-	selection->selected++;
-
-	memcpy(selections[selection->size].name, name, len + 1);
-	selections[selection->size].namelen = len;
+/* Select the item ITEM if not selected, and deselect it otherwise. */
+void
+toggle_entry(sel_t *sel, const size_t item)
+{
+	if (is_selected(sel, item))
+		deselect_entry(sel, item);
+	else
+		select_entry(sel, item);
+}
 
-	selection->size++;
-	selections[selection->size].name = (char *)NULL;
-	selections[selection->size].namelen = 0;
+/* Unmark all items (the bitmap is kept for later use). */
+void
+clear_selections(sel_t *sel)
+{
+	if (sel->selected > 0)
+		memset(sel->bitmap, 0, sel->size * sizeof(uint64_t));
+	sel->selected = 0;
 }
 
-/* Print the list of selected/marked entries to STDOUT. */
+/* Print the list of selected/marked entries to STDOUT, in input order. */
 void
 print_selections(tty_interface_t *state)
 {
-	if (state->selection->selected == 0 || state->options->multi == 0)
+	const sel_t *sel = state->selection;
+	if (sel->selected == 0 || state->options->multi == 0)
 		return;
 
-	const char end_char = state->options->print_null ? '\0' : '\n';
+	static output_t out;
+	output_init(&out, STDOUT_FILENO, state->options->print_null ? '\0' : '\n');
+	const char **strings = state->choices->strings;
 
-	for (size_t i = 0; selections[i].name; i++) {
-		if (!*selections[i].name)
+	for (size_t w = 0; w < sel->size; w++) {
+		if (sel->bitmap[w] == 0)
 			continue;
 
-		const char *name = (*selections[i].name == KEY_ESC
-			|| strchr(selections[i].name, KEY_ESC))
-			? decolor_name(selections[i].name, NULL) : selections[i].name;
-
-		printf("%s%c", name, end_char);
+		for (size_t bit = 0; bit < WORD_BITS; bit++) {
+			if (!(sel->bitmap[w] & ((uint64_t)1 << bit)))
+				continue;
+
+			const char *name = strings[w * WORD_BITS + bit];
+			if (*name != KEY_ESC && !strchr(name, KEY_ESC)) {
+				output_item(&out, name);
+				continue;
+			}
+
+			/* decolor_name() reuses its buffer: keep a copy. */
+			const char *p = decolor_name(name, NULL);
+			output_copy(&out, p, strlen(p));
+			output_copy(&out, out.delim, 1);
+		}
 	}
 
+	output_flush(&out);
 }
 
-/* Free the selections array. */
+/* Free the selections bitmap. */
 void
 free_selections(tty_interface_t *state)
 {
-	if (state->options->multi == 0 || state->selection->size == 0
-	|| !selections)
-		return;
-
-	for (size_t i = 0; selections[i].name; i++)
-		free(selections[i].name);
-	free(selections);
-	selections = (struct selections_t *)NULL;
+	sel_t *sel = state->selection;
 
-	state->selection->size = 0;
-	state->selection->selected = 0;
+	free(sel->bitmap);
+	sel->bitmap = NULL;
+	sel->size = 0;
+	sel->selected = 0;
 }
@@ -36,11 +36,13 @@
 extern "C" {
 #endif
 
-void deselect_entry(const char *name, tty_interface_t *state);
+void clear_selections(sel_t *sel);
+void deselect_entry(sel_t *sel, const size_t item);
 void free_selections(tty_interface_t *state);
-int  is_selected(const char *name);
+int  is_selected(const sel_t *sel, const size_t item);
 void print_selections(tty_interface_t *state);
-void save_selection(const char *name, sel_t *selection);
+void select_entry(sel_t *sel, const size_t item);
+void toggle_entry(sel_t *sel, const size_t item);
 
 #ifdef __cplusplus
 }
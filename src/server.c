@@ -0,0 +1,472 @@
+/* server.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+
+/* Co-process mode (--server).
+ *
+ * The input is loaded once, and then searched as many times as requested,
+ * so that a client (e.g. an editor plugin) does not need to start fnf and
+ * pipe the whole list to it again on every keystroke.
+ *
+ * Requests are read from the file descriptor given to --server, or, by
+ * default, from standard input, right after the input, which then ends at
+ * the first empty line. Each request is a line:
+ *
+ *   QUERY[<TAB>LIMIT[<TAB>OFFSET]]
+ *
+ * and is answered with a single line of JSON on standard output, e.g.:
+ *
+ *   {"query":"ab","total":7,"offset":0,"results":[{"text":"xaxb",
+ *   "index":12,"score":0.890000,"positions":[1,3]},...]}
+ *
+ * TOTAL is the number of matches, of which RESULTS holds up to LIMIT (all
+ * if zero, the default unless --limit is set), starting at OFFSET (0 by
+ * default). INDEX is the position of the match in the input, and
+ * POSITIONS are the byte offsets of the matching characters in TEXT.
+ *
+ * The results of the last search are kept: a request for another page of
+ * them costs no search at all, and a query extending the last one (as
+ * when typing) only searches its matches. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "match.h"
+#include "server.h"
+
+#define READ_SIZE 65536
+
+struct request {
+	const char *query;
+	size_t limit;
+	size_t offset;
+};
+
+/* Read from FD into BUF (LEN bytes), retrying if interrupted. Return the
+ * number of bytes read, or zero at end of input (or on error). */
+static size_t
+read_fd(const int fd, char *buf, const size_t len)
+{
+	ssize_t n;
+	while ((n = read(fd, buf, len)) == -1 && errno == EINTR);
+
+	if (n == -1)
+		perror("read");
+
+	return n > 0 ? (size_t)n : 0;
+}
+
+/* Read more data into R, after discarding what was already used. */
+static void
+reader_fill(reader_t *r)
+{
+	if (r->start > 0) {
+		memmove(r->buf, r->buf + r->start, r->len - r->start);
+		r->len -= r->start;
+		r->start = 0;
+	}
+
+	if (r->cap - r->len < READ_SIZE) {
+		r->cap = r->len + READ_SIZE * 2;
+		r->buf = safe_realloc(r->buf, r->cap);
+	}
+
+	/* Keep room for a terminating NUL */
+	const size_t n = read_fd(r->fd, r->buf + r->len, r->cap - r->len - 1);
+	if (n == 0)
+		r->eof = 1;
+	r->len += n;
+}
+
+/* Return the next line in R (NUL terminated, and valid until the next
+ * call), or NULL at end of input. */
+char *
+reader_next_line(reader_t *r)
+{
+	for (;;) {
+		char *line = r->buf + r->start;
+		char *end = r->start < r->len
+			? memchr(line, '\n', r->len - r->start) : NULL;
+
+		if (end) {
+			*end = '\0';
+			r->start = (size_t)(end - r->buf) + 1;
+			return line;
+		}
+
+		if (r->eof == 1) {
+			if (r->start == r->len)
+				return NULL;
+			/* Last line, with no newline */
+			r->buf[r->len] = '\0';
+			r->start = r->len;
+			return line;
+		}
+
+		reader_fill(r);
+	}
+}
+
+/* Load the input, from STDIN (unless loaded from a snapshot), into C, and
+ * set up R to read requests.
+ * If requests come from STDIN as well, the input ends at the first empty
+ * line (what follows is left in R). Return the buffer holding the input,
+ * to be freed by the caller. */
+static char *
+load_input(choices_t *c, const options_t *options, reader_t *r)
+{
+	r->fd = options->server_fd;
+
+	if (options->index_in) /* Loaded already */
+		return NULL;
+
+	if (r->fd != STDIN_FILENO) {
+		choices_fread(c, stdin, options->input_delimiter, options->max_items);
+		return NULL;
+	}
+
+	const char delim = options->input_delimiter;
+	size_t len = 0;
+	size_t cap = READ_SIZE;
+	size_t end = (size_t)-1; /* End of the input */
+	char *buf = safe_realloc(NULL, cap);
+
+	for (size_t i = 0; end == (size_t)-1;) {
+		if (cap - len < READ_SIZE) {
+			cap *= 2;
+			buf = safe_realloc(buf, cap);
+		}
+
+		const size_t n = read_fd(STDIN_FILENO, buf + len, cap - len - 1);
+		if (n == 0) {
+			r->eof = 1;
+			end = len;
+			break;
+		}
+		len += n;
+
+		/* An empty line: a delimiter at the start, or after another one */
+		for (; i < len; i++) {
+			if (buf[i] == delim && (i == 0 || buf[i - 1] == delim)) {
+				end = i;
+				break;
+			}
+		}
+	}
+
+	/* Hand the rest over to the request reader. */
+	if (end < len) {
+		r->len = len - end - 1;
+		r->cap = r->len + READ_SIZE;
+		r->buf = safe_realloc(NULL, r->cap);
+		memcpy(r->buf, buf + end + 1, r->len);
+	}
+
+	buf[end] = '\0';
+	int count = 0;
+	for (char *line = buf; line < buf + end;) {
+		char *next = memchr(line, delim, (size_t)(buf + end - line));
+		if (next)
+			*next++ = '\0';
+		else
+			next = buf + end;
+
+		if (*line) { /* Skip empty lines */
+			if (options->max_items != -1 && ++count > options->max_items)
+				break;
+			choices_add(c, line);
+		}
+		line = next;
+	}
+
+	return buf;
+}
+
+/* Parse the number in STR (if not empty) into *VALUE.
+ * Return 0 on success, or -1 if STR is not a number (or too large). */
+static int
+parse_size(const char *str, size_t *value)
+{
+	if (!*str)
+		return 0;
+
+	size_t n = 0;
+	for (; *str; str++) {
+		if (*str < '0' || *str > '9')
+			return -1;
+		const size_t digit = (size_t)(*str - '0');
+		if (n > (SIZE_MAX - digit) / 10)
+			return -1;
+		n = n * 10 + digit;
+	}
+
+	*value = n;
+	return 0;
+}
+
+/* Parse the request in LINE (modified) into REQ.
+ * Return 0 on success, or -1 if malformed. */
+static int
+parse_request(char *line, const options_t *options, struct request *req)
+{
+	req->query = line;
+	req->limit = options->limit;
+	req->offset = 0;
+
+	char *limit = strchr(line, '\t');
+	if (!limit)
+		return 0;
+	*limit++ = '\0';
+
+	char *offset = strchr(limit, '\t');
+	if (offset)
+		*offset++ = '\0';
+
+	if (parse_size(limit, &req->limit) == -1
+	|| (offset && parse_size(offset, &req->offset) == -1))
+		return -1;
+
+	return 0;
+}
+
+/* Set up S to search C. If SHARED is 1, C is being searched by other
+ * sessions at the same time, and is thus left untouched. */
+void
+session_init(session_t *s, choices_t *c, const int shared)
+{
+	s->choices = c;
+	s->results = NULL;
+	s->count = 0;
+	s->query = NULL;
+	s->query_cap = 0;
+	s->plan = NULL;
+	s->case_sensitive = 0;
+	s->valid = 0;
+	s->shared = shared;
+}
+
+void
+session_destroy(session_t *s)
+{
+	if (s->shared == 1)
+		free(s->results);
+	free(s->query);
+	query_free(s->plan);
+	session_init(s, NULL, 0);
+}
+
+/* Forget the results of the last search (e.g. because the strings
+ * changed). */
+void
+session_reset(session_t *s, choices_t *c)
+{
+	const int shared = s->shared;
+	session_destroy(s);
+	session_init(s, c, shared);
+}
+
+/* Search for QUERY, reusing the results of the last search if possible. */
+static void
+session_search(session_t *s, const options_t *options, const char *query)
+{
+	const int case_sensitive = options_case_sensitive(options, query);
+	const size_t len = strlen(query);
+
+	if (s->valid == 1 && case_sensitive == s->case_sensitive
+	&& strcmp(query, s->query) == 0)
+		return;
+
+	/* Whatever matches QUERY matches any prefix of it as well, provided
+	 * the prefix was not searched in a stricter case mode (and, with the
+	 * extended syntax, that QUERY does not match more as it grows). */
+	const int narrow = s->valid == 1
+		&& (case_sensitive == 1 || s->case_sensitive == 0)
+		&& strncmp(query, s->query, strlen(s->query)) == 0
+		&& (options->extended == 0 || query_narrows(s->query, query));
+
+	if (s->shared == 0) {
+		if (narrow == 1)
+			choices_narrow(s->choices, query, options->sort, case_sensitive);
+		else
+			choices_search(s->choices, query, options->sort, case_sensitive);
+		s->results = s->choices->results;
+		s->count = choices_available(s->choices);
+	} else if (narrow == 1) {
+		s->count = choices_narrow_r(s->choices, query, options->sort,
+			case_sensitive, s->choices->worker_count, &s->results, s->count);
+	} else {
+		free(s->results);
+		s->count = choices_search_r(s->choices, query, options->sort,
+			case_sensitive, s->choices->worker_count, &s->results);
+	}
+
+	if (len + 1 > s->query_cap) {
+		s->query_cap = len + 1;
+		s->query = safe_realloc(s->query, s->query_cap);
+	}
+	memcpy(s->query, query, len + 1);
+	query_free(s->plan);
+	s->plan = choices_query(s->choices, query, case_sensitive);
+	s->case_sensitive = case_sensitive;
+	s->valid = 1;
+}
+
+/* Queue STR as a JSON string. STR must remain valid until the next
+ * flush. Bytes are copied as they are: invalid UTF-8 is not fixed. */
+static void
+output_json_string(output_t *out, const char *str)
+{
+	const char *run = str; /* Beginning of the bytes needing no escape */
+	const char *p = str;
+
+	output_copy(out, "\"", 1);
+	for (; *p; p++) {
+		const unsigned char ch = (unsigned char)*p;
+		if (ch >= 0x20 && ch != '"' && ch != '\\')
+			continue;
+
+		output_ref(out, run, (size_t)(p - run));
+		if (ch == '"' || ch == '\\') {
+			const char esc[2] = {'\\', (char)ch};
+			output_copy(out, esc, 2);
+		} else {
+			output_printf(out, "\\u%04x", ch);
+		}
+		run = p + 1;
+	}
+	output_ref(out, run, (size_t)(p - run));
+	output_copy(out, "\"", 1);
+}
+
+static void
+output_json_score(output_t *out, const score_t score)
+{
+	/* JSON has no infinity, but a number out of range reads as one. */
+	if (score == SCORE_MAX)
+		output_copy(out, "1e999", 5);
+	else if (score == SCORE_MIN)
+		output_copy(out, "-1e999", 6);
+	else
+		output_printf(out, "%f", score);
+}
+
+static void
+output_json_positions(output_t *out, const session_t *s, const size_t index)
+{
+	size_t positions[MATCH_MAX_LEN];
+
+	output_copy(out, "[", 1);
+	if (*s->query) {
+		memset(positions, -1, sizeof(positions));
+		choices_positions(s->choices, s->plan, s->query, index,
+			positions, s->case_sensitive);
+		choices_map_positions(s->choices, index, 0, positions);
+		for (size_t i = 0; i < MATCH_MAX_LEN && positions[i] != (size_t)-1; i++)
+			output_printf(out, i == 0 ? "%zu" : ",%zu", positions[i]);
+	}
+	output_copy(out, "]", 1);
+}
+
+/* Write the response to REQ, whose search results are in S. */
+static void
+respond(output_t *out, const session_t *s, const struct request *req)
+{
+	const size_t limit = req->limit == 0 ? (size_t)-1 : req->limit;
+
+	output_copy(out, "{\"query\":", 9);
+	output_json_string(out, s->query);
+	output_printf(out, ",\"total\":%zu,\"offset\":%zu,\"results\":[",
+		s->count, req->offset);
+
+	for (size_t n = req->offset; n < s->count && n - req->offset < limit; n++) {
+		/* No results listed: all strings match (empty query). */
+		const struct scored_result all = {SCORE_MIN,
+			s->results ? NULL : s->choices->strings[n], n};
+		const struct scored_result *r = s->results ? &s->results[n] : &all;
+
+		output_copy(out, n == req->offset ? "{\"text\":" : ",{\"text\":",
+			n == req->offset ? 8 : 9);
+		output_json_string(out, r->str);
+		output_printf(out, ",\"index\":%zu,\"score\":", r->index);
+		output_json_score(out, r->score);
+		output_copy(out, ",\"positions\":", 13);
+		output_json_positions(out, s, r->index);
+		output_copy(out, "}", 1);
+	}
+
+	output_copy(out, "]}\n", 3);
+}
+
+/* Answer the request in LINE (modified), writing the response to OUT.
+ * Return 0 on success, or -1 if the response could not be written. */
+int
+session_request(session_t *s, const options_t *options, char *line,
+	output_t *out)
+{
+	struct request req;
+
+	if (parse_request(line, options, &req) == -1) {
+		const char *error = "{\"error\":\"Invalid request\"}\n";
+		output_copy(out, error, strlen(error));
+	} else {
+		session_search(s, options, req.query);
+		respond(out, s, &req);
+	}
+
+	return output_flush(out);
+}
+
+/* Load the input, and answer search requests until they end. */
+void
+server_run(choices_t *c, const options_t *options)
+{
+	static output_t out;
+	reader_t r = {NULL, 0, 0, 0, 0, 0};
+	session_t s;
+
+	char *input = load_input(c, options, &r);
+	choices_index(c);
+	output_init(&out, STDOUT_FILENO, '\n');
+	session_init(&s, c, 0);
+
+	char *line;
+	while ((line = reader_next_line(&r))) {
+		if (session_request(&s, options, line, &out) == -1)
+			break;
+	}
+
+	session_destroy(&s);
+	free(r.buf);
+	free(input);
+}
@@ -0,0 +1,79 @@
+/* server.h */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "choices.h"
+#include "options.h"
+#include "output.h"
+#include "query.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reader of newline terminated requests */
+typedef struct {
+	char *buf;
+	size_t start; /* Beginning of unread data */
+	size_t len;
+	size_t cap;
+	int fd;
+	int eof;
+} reader_t;
+
+/* Search state of a client: the results of its last search */
+typedef struct {
+	choices_t *choices;
+	struct scored_result *results;
+	size_t count;
+	char *query; /* Query of the last search */
+	size_t query_cap;
+	query_t *plan; /* Plan of QUERY (--extended), or NULL */
+	int case_sensitive;
+	int valid; /* RESULTS hold the matches of QUERY */
+	int shared; /* CHOICES are searched by other sessions as well */
+} session_t;
+
+char *reader_next_line(reader_t *r);
+void session_init(session_t *s, choices_t *c, const int shared);
+void session_destroy(session_t *s);
+void session_reset(session_t *s, choices_t *c);
+int session_request(session_t *s, const options_t *options, char *line,
+	output_t *out);
+void server_run(choices_t *c, const options_t *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERVER_H */
@@ -0,0 +1,509 @@
+/* snapshot.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+
+/* Input snapshots (--index-out, --index-in).
+ *
+ * A snapshot holds the strings of the input along with what is computed
+ * when loading them, laid out so that it can be used straight from a
+ * read-only shared mapping: loading one costs a checksum pass and the
+ * array of string pointers, and its pages are shared by all processes
+ * using it.
+ *
+ * Layout (native byte order; every section starts at a multiple of 8):
+ *
+ *   header    see struct snapshot_header
+ *   arena     the strings, in input order, each terminated by a NUL
+ *   offsets   uint64_t per string: its offset in the arena
+ *   widths    uint32_t per string: its display width
+ *   index     the search index, if any (see search_index_save())
+ *   shadows   the strings that folding changes (see fold.c), folded
+ *   folded    uint64_t per string: the offset of its folded version in
+ *             shadows, or NO_SHADOW if it is the same (empty if none is)
+ *   decomposed  the same, for its decomposed version (--normalize)
+ *
+ * The index and the folded strings are only written when the strings
+ * are what is searched (no --nth or --with-nth), and only used by a
+ * process folding them the same way (see SNAPSHOT_NORMALIZED): nothing is
+ * then computed again when the snapshot is loaded.
+ *
+ * The checksum covers everything after the header. Snapshots are written
+ * to a temporary file first, and renamed, so that processes using the
+ * previous version of the file are not disturbed. */
+
+#ifndef _DEFAULT_SOURCE
+/* mkstemp */
+# define _DEFAULT_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "search_index.h"
+
+#define SNAPSHOT_VERSION 1
+#define BYTE_ORDER_MARK 0x01020304u
+
+/* Flags of a snapshot */
+#define SNAPSHOT_NORMALIZED 1 /* Keys were folded with --normalize */
+#define SNAPSHOT_FOLDED     2 /* Folded strings are there */
+#define SNAPSHOT_SGR        4 /* Some string holds an escape character */
+
+#define NO_SHADOW UINT64_MAX
+
+#define SECTION_ARENA   0
+#define SECTION_OFFSETS 1
+#define SECTION_WIDTHS  2
+#define SECTION_INDEX   3
+#define SECTION_SHADOWS 4
+#define SECTION_FOLDED  5
+#define SECTION_DECOMPOSED 6
+#define SECTIONS_NUM    7
+
+struct snapshot_header {
+	char magic[8]; /* SNAPSHOT_MAGIC */
+	uint32_t version;
+	uint32_t byte_order; /* BYTE_ORDER_MARK, as written */
+	uint64_t count; /* Number of strings */
+	uint64_t checksum;
+	uint64_t flags; /* SNAPSHOT_* */
+	struct {
+		uint64_t offset;
+		uint64_t size;
+	} sections[SECTIONS_NUM];
+};
+
+struct hasher {
+	uint64_t hash;
+	uint64_t tail; /* Bytes not hashed yet (less than a word) */
+	size_t tail_len;
+};
+
+struct writer {
+	FILE *fp;
+	struct hasher hasher;
+	uint64_t pos;
+};
+
+static void
+hasher_init(struct hasher *h)
+{
+	h->hash = 0xcbf29ce484222325u;
+	h->tail = 0;
+	h->tail_len = 0;
+}
+
+static inline uint64_t
+hash_word(const uint64_t hash, const uint64_t word)
+{
+	const uint64_t h = (hash ^ word) * 0x100000001b3u;
+	return h ^ (h >> 32);
+}
+
+/* Hash the LEN bytes at DATA. A word at a time: FNV-1a, one byte at a
+ * time, would make the checksum the slowest part of loading. */
+static void
+hasher_update(struct hasher *h, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while (h->tail_len > 0 && h->tail_len < 8 && len > 0) {
+		h->tail |= (uint64_t)*p++ << (8 * h->tail_len++);
+		len--;
+	}
+	if (h->tail_len == 8) {
+		h->hash = hash_word(h->hash, h->tail);
+		h->tail = 0;
+		h->tail_len = 0;
+	}
+
+	for (; len >= 8; p += 8, len -= 8) {
+		uint64_t word = 0;
+		for (size_t i = 0; i < 8; i++) /* Same result on any byte order */
+			word |= (uint64_t)p[i] << (8 * i);
+		h->hash = hash_word(h->hash, word);
+	}
+
+	while (len-- > 0)
+		h->tail |= (uint64_t)*p++ << (8 * h->tail_len++);
+}
+
+static uint64_t
+hasher_final(struct hasher *h)
+{
+	if (h->tail_len > 0)
+		h->hash = hash_word(h->hash, h->tail);
+	return hash_word(h->hash, h->tail_len);
+}
+
+static void
+put(struct writer *w, const void *data, const size_t len)
+{
+	fwrite(data, 1, len, w->fp);
+	hasher_update(&w->hasher, data, len);
+	w->pos += len;
+}
+
+/* put(), as search_index_save() calls it */
+static void
+put_index(void *w, const void *data, const size_t len)
+{
+	put(w, data, len);
+}
+
+/* Pad with zeros up to the next multiple of 8. */
+static void
+pad(struct writer *w)
+{
+	static const char zeros[8] = {0};
+	put(w, zeros, (8 - w->pos % 8) % 8);
+}
+
+/* Write the versions in SHADOWS (one of the arrays of folded keys of C,
+ * or NULL) of the strings of C that differ from them, and store in
+ * OFFSETS where they are from START (see the layout above). */
+static void
+put_shadows(struct writer *w, const choices_t *c, const char **shadows,
+	const uint64_t start, uint64_t *offsets)
+{
+	for (size_t i = 0; shadows && i < c->size; i++) {
+		if (shadows[i] == c->strings[i]) {
+			offsets[i] = NO_SHADOW;
+		} else {
+			offsets[i] = w->pos - start;
+			put(w, shadows[i], strlen(shadows[i]) + 1);
+		}
+	}
+}
+
+/* Write the folded strings of C: the shadows, folded and decomposed
+ * sections of HEADER. OFFSETS has room for two offsets per string. */
+static void
+write_shadows(struct writer *w, struct snapshot_header *header,
+	const choices_t *c, uint64_t *offsets)
+{
+	const int sections[2] = {SECTION_FOLDED, SECTION_DECOMPOSED};
+	const char **shadows[2] = {c->folded, c->decomposed};
+	uint64_t *where[2] = {offsets, offsets + c->size};
+
+	const uint64_t start = header->sections[SECTION_SHADOWS].offset = w->pos;
+	for (int k = 0; k < 2; k++)
+		put_shadows(w, c, shadows[k], start, where[k]);
+	header->sections[SECTION_SHADOWS].size = w->pos - start;
+	pad(w);
+
+	for (int k = 0; k < 2; k++) {
+		const size_t size = shadows[k] ? c->size * sizeof(uint64_t) : 0;
+		header->sections[sections[k]].offset = w->pos;
+		header->sections[sections[k]].size = size;
+		put(w, where[k], size);
+		pad(w);
+	}
+}
+
+/* Write the strings in C, and their data, as a snapshot to the file PATH.
+ * Return 0 on success, or -1 on error (setting *ERROR). */
+int
+snapshot_write(const choices_t *c, const char *path, const char **error)
+{
+	const size_t len = strlen(path);
+	char *tmp = malloc(len + 8);
+	/* Offsets of the strings, then of their folded versions */
+	uint64_t *offsets = malloc((2 * c->size + 1) * sizeof(uint64_t));
+	if (!tmp || !offsets) {
+		free(tmp);
+		free(offsets);
+		*error = strerror(ENOMEM);
+		return -1;
+	}
+
+	memcpy(tmp, path, len);
+	memcpy(tmp + len, ".XXXXXX", 8);
+	const int fd = mkstemp(tmp);
+
+	/* mkstemp(3) creates private files: use the usual permissions. */
+	const mode_t mask = umask(0);
+	umask(mask);
+	if (fd != -1)
+		fchmod(fd, 0666 & ~mask);
+	struct writer w = {fd == -1 ? NULL : fdopen(fd, "wb"), {0, 0, 0}, 0};
+	if (!w.fp) {
+		*error = strerror(errno);
+		if (fd != -1) {
+			close(fd);
+			unlink(tmp);
+		}
+		free(tmp);
+		free(offsets);
+		return -1;
+	}
+
+	struct snapshot_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.byte_order = BYTE_ORDER_MARK;
+	header.count = c->size;
+	header.flags = c->normalize ? SNAPSHOT_NORMALIZED : 0;
+
+	/* Placeholder: the header is only complete once all the rest is out. */
+	fwrite(&header, 1, sizeof(header), w.fp);
+	w.pos = sizeof(header);
+	hasher_init(&w.hasher);
+
+	header.sections[SECTION_ARENA].offset = w.pos;
+	for (size_t i = 0; i < c->size; i++) {
+		offsets[i] = w.pos - header.sections[SECTION_ARENA].offset;
+		put(&w, c->strings[i], strlen(c->strings[i]) + 1);
+	}
+	header.sections[SECTION_ARENA].size =
+		w.pos - header.sections[SECTION_ARENA].offset;
+	pad(&w);
+
+	header.sections[SECTION_OFFSETS].offset = w.pos;
+	header.sections[SECTION_OFFSETS].size = c->size * sizeof(uint64_t);
+	put(&w, offsets, c->size * sizeof(uint64_t));
+	pad(&w);
+
+	header.sections[SECTION_WIDTHS].offset = w.pos;
+	header.sections[SECTION_WIDTHS].size = c->size * sizeof(uint32_t);
+	put(&w, c->widths, c->size * sizeof(uint32_t));
+	pad(&w);
+
+	/* Keys that are not the strings cannot be told apart when loading. */
+	header.sections[SECTION_INDEX].offset = w.pos;
+	if (c->index && !c->fields) {
+		search_index_wait(c->index);
+		search_index_save(c->index, c->size, put_index, &w);
+	}
+	header.sections[SECTION_INDEX].size =
+		w.pos - header.sections[SECTION_INDEX].offset;
+	pad(&w);
+
+	if (!c->fields) {
+		header.flags |= SNAPSHOT_FOLDED | (c->sgr ? SNAPSHOT_SGR : 0);
+		write_shadows(&w, &header, c, offsets);
+	} else {
+		for (int n = SECTION_SHADOWS; n <= SECTION_DECOMPOSED; n++)
+			header.sections[n].offset = w.pos;
+	}
+
+	header.checksum = hasher_final(&w.hasher);
+	rewind(w.fp);
+	fwrite(&header, 1, sizeof(header), w.fp);
+
+	int ret = ferror(w.fp) ? -1 : 0;
+	if (fclose(w.fp) != 0 || ret == -1 || rename(tmp, path) == -1) {
+		*error = strerror(errno ? errno : EIO);
+		unlink(tmp);
+		ret = -1;
+	}
+
+	free(tmp);
+	free(offsets);
+	return ret;
+}
+
+/* Return 1 if the section N of HEADER fits in a file of SIZE bytes, and
+ * holds ELEMENTS elements of ELEMENT_SIZE bytes (unless ELEMENT_SIZE is
+ * 0), or 0 otherwise. */
+static int
+valid_section(const struct snapshot_header *header, const int n,
+	const size_t size, const size_t element_size, const uint64_t elements)
+{
+	const uint64_t offset = header->sections[n].offset;
+	const uint64_t len = header->sections[n].size;
+
+	if (offset % 8 != 0 || offset < sizeof(*header) || offset > size
+	|| len > size - offset)
+		return 0;
+
+	return element_size == 0 || len / element_size == elements;
+}
+
+/* Store in *SHADOWS (NULL if none differs) the versions of the COUNT
+ * strings at ARENA (at the given OFFSETS) that the section N of HEADER
+ * holds (see write_shadows()). Return 0 on success, or -1 if they are
+ * corrupted. */
+static int
+load_shadows(const struct snapshot_header *header, const char *data,
+	const int n, const char *arena, const uint64_t *offsets,
+	const size_t count, const char ***shadows)
+{
+	*shadows = NULL;
+	if (header->sections[n].size == 0)
+		return 0;
+	if (header->sections[n].size / sizeof(uint64_t) != count)
+		return -1;
+
+	const char *start = data + header->sections[SECTION_SHADOWS].offset;
+	const uint64_t size = header->sections[SECTION_SHADOWS].size;
+	const uint64_t *where = (const uint64_t *)(const void *)
+		(data + header->sections[n].offset);
+	if (size > 0 && start[size - 1] != '\0')
+		return -1;
+
+	const char **s = malloc((count + 1) * sizeof(const char *));
+	if (!s)
+		return -1;
+
+	for (size_t i = 0; i < count; i++) {
+		if (where[i] != NO_SHADOW && where[i] >= size) {
+			free(s);
+			return -1;
+		}
+		s[i] = where[i] == NO_SHADOW ? arena + offsets[i] : start + where[i];
+	}
+
+	*shadows = s;
+	return 0;
+}
+
+/* Load the snapshot in the file PATH into C, which must hold no strings.
+ * Return 0 on success, or -1 on error (setting *ERROR). */
+int
+snapshot_load(choices_t *c, const char *path, const char **error)
+{
+	const int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		*error = strerror(errno);
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+
+	const size_t size = (size_t)st.st_size;
+	if (size < sizeof(struct snapshot_header)) {
+		close(fd);
+		*error = "Not a snapshot";
+		return -1;
+	}
+
+	void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		*error = strerror(errno);
+		return -1;
+	}
+
+	const struct snapshot_header *header = map;
+	const char *data = map;
+	*error = NULL;
+
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+		*error = "Not a snapshot";
+	else if (header->version != SNAPSHOT_VERSION)
+		*error = "Unsupported snapshot version";
+	else if (header->byte_order != BYTE_ORDER_MARK)
+		*error = "Snapshot written on a machine with another byte order";
+	else if (header->count > (uint64_t)(size / sizeof(uint32_t))
+	|| !valid_section(header, SECTION_ARENA, size, 0, 0)
+	|| !valid_section(header, SECTION_OFFSETS, size, sizeof(uint64_t),
+		header->count)
+	|| !valid_section(header, SECTION_WIDTHS, size, sizeof(uint32_t),
+		header->count)
+	|| !valid_section(header, SECTION_INDEX, size, 0, 0)
+	|| !valid_section(header, SECTION_SHADOWS, size, 0, 0)
+	|| !valid_section(header, SECTION_FOLDED, size, 0, 0)
+	|| !valid_section(header, SECTION_DECOMPOSED, size, 0, 0))
+		*error = "Corrupted snapshot";
+
+	if (!*error) {
+		struct hasher h;
+		hasher_init(&h);
+		hasher_update(&h, data + sizeof(*header), size - sizeof(*header));
+		if (hasher_final(&h) != header->checksum)
+			*error = "Corrupted snapshot (checksum mismatch)";
+	}
+
+	const char *arena = data + header->sections[SECTION_ARENA].offset;
+	const uint64_t arena_size = header->sections[SECTION_ARENA].size;
+	const uint64_t *offsets = (const uint64_t *)(const void *)
+		(data + header->sections[SECTION_OFFSETS].offset);
+
+	/* Every string must end within the arena. */
+	if (!*error && header->count > 0 && arena[arena_size - 1] != '\0')
+		*error = "Corrupted snapshot";
+	for (uint64_t i = 0; !*error && i < header->count; i++) {
+		if (offsets[i] >= arena_size)
+			*error = "Corrupted snapshot";
+	}
+
+	/* Keys folded as C folds them are not folded again, and neither is the
+	 * index built again (see choices_index()). */
+	const int same_keys = !c->fields
+		&& !(header->flags & SNAPSHOT_NORMALIZED) == !c->normalize;
+	struct folded_keys keys = {NULL, NULL, 0};
+	if (!*error && same_keys && (header->flags & SNAPSHOT_FOLDED)) {
+		keys.sgr = (header->flags & SNAPSHOT_SGR) != 0;
+		if (load_shadows(header, data, SECTION_FOLDED, arena, offsets,
+		(size_t)header->count, &keys.folded) == -1
+		|| load_shadows(header, data, SECTION_DECOMPOSED, arena, offsets,
+		(size_t)header->count, &keys.decomposed) == -1)
+			*error = "Corrupted snapshot";
+	}
+
+	if (*error) {
+		free(keys.folded);
+		free(keys.decomposed);
+		munmap(map, size);
+		return -1;
+	}
+
+	choices_set_strings(c, map, size, arena, offsets,
+		(const uint32_t *)(const void *)
+		(data + header->sections[SECTION_WIDTHS].offset),
+		(size_t)header->count,
+		same_keys && (header->flags & SNAPSHOT_FOLDED) ? &keys : NULL);
+
+	if (header->sections[SECTION_INDEX].size > 0 && same_keys)
+		choices_set_index(c, data + header->sections[SECTION_INDEX].offset,
+			(size_t)header->sections[SECTION_INDEX].size);
+	return 0;
+}
+
+/* Return 1 if FILE starts like a snapshot, or 0 otherwise. */
+int
+snapshot_check(FILE *fp)
+{
+	char magic[8];
+	const size_t n = fread(magic, 1, sizeof(magic), fp);
+	rewind(fp);
+
+	return n == sizeof(magic) && memcmp(magic, SNAPSHOT_MAGIC, n) == 0;
+}
@@ -31,11 +31,12 @@
 
 #ifndef _DEFAULT_SOURCE
 /* fileno, select, pselect, sigemptyset, sigaddset, struct timespec,
- * and SIGWINCH */
+ * clock_gettime, and SIGWINCH */
 # define _DEFAULT_SOURCE
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -44,9 +45,151 @@
 #include <sys/select.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 
+#include "choices.h" /* safe_realloc() */
 #include "tty.h"
 
+struct out_buf {
+	char *data;
+	size_t len;
+	size_t cap;
+};
+
+/* Frames are composed into FRAME. Once flushed, a frame is written to the
+ * (non-blocking) output fd. If the terminal does not take it all at once,
+ * the remainder stays in INFLIGHT (starting at INFLIGHT_OFF). Frames flushed
+ * while INFLIGHT is still being written replace each other in QUEUED, so
+ * that only the newest one is written next. A frame is never cut short:
+ * each one starts and ends at the prompt line, so skipping whole frames
+ * keeps the screen consistent. */
+struct tty_out {
+	struct out_buf frame;
+	struct out_buf inflight;
+	struct out_buf queued;
+	size_t inflight_off;
+	size_t last_frame_len;
+	double inflight_start; /* ms */
+	double last_flush; /* ms */
+	double throughput; /* Bytes per second (0: unknown, assume fast) */
+	int inflight_blocked;
+	int fd_flags;
+};
+
+static double
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+static void
+out_buf_reserve(struct out_buf *b, const size_t len)
+{
+	if (b->len + len < b->cap)
+		return;
+
+	size_t cap = b->cap ? b->cap : TTY_FRAME_CAPACITY;
+	while (cap <= b->len + len)
+		cap *= 2;
+
+	b->data = safe_realloc(b->data, cap);
+	b->cap = cap;
+}
+
+static void
+out_buf_append(struct out_buf *b, const char *str, const size_t len)
+{
+	out_buf_reserve(b, len);
+	memcpy(b->data + b->len, str, len);
+	b->len += len;
+}
+
+static void
+out_buf_swap(struct out_buf *a, struct out_buf *b)
+{
+	const struct out_buf tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+/* Update the throughput estimate once the in-flight frame is completely
+ * written. Only frames that had to wait for the terminal tell us something
+ * about the speed of the link: otherwise they just landed in the kernel
+ * buffer, so we let the estimate recover towards "fast". */
+static void
+update_throughput(struct tty_out *out, const double now)
+{
+	if (out->inflight_blocked == 0) {
+		out->throughput *= 2;
+		if (out->throughput > 1e8)
+			out->throughput = 0;
+		return;
+	}
+
+	const double elapsed = now - out->inflight_start;
+	if (elapsed <= 0)
+		return;
+
+	const double sample = (double)out->inflight.len * 1000.0 / elapsed;
+	out->throughput = out->throughput > 0
+		? (out->throughput * 0.5) + (sample * 0.5) : sample;
+}
+
+/* Write as much of the in-flight frame (and then of the queued one) as
+ * the terminal accepts without blocking. */
+static void
+write_pending(const tty_t *tty)
+{
+	struct tty_out *out = tty->out;
+
+	while (out->inflight_off < out->inflight.len) {
+		const ssize_t n = write(tty->fdout, out->inflight.data
+			+ out->inflight_off, out->inflight.len - out->inflight_off);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				out->inflight_blocked = 1;
+				return;
+			}
+			perror("error writing to tty");
+			exit(EXIT_FAILURE);
+		}
+
+		out->inflight_off += (size_t)n;
+		if (out->inflight_off < out->inflight.len)
+			continue;
+
+		/* In-flight frame done: move on to the queued one, if any. */
+		const double now = now_ms();
+		update_throughput(out, now);
+		out->inflight.len = out->inflight_off = 0;
+
+		if (out->queued.len > 0) {
+			out_buf_swap(&out->inflight, &out->queued);
+			out->inflight_start = now;
+			out->inflight_blocked = 0;
+		}
+	}
+}
+
+/* Write all pending output, waiting for the terminal if needed. */
+static void
+write_all(const tty_t *tty)
+{
+	struct tty_out *out = tty->out;
+
+	/* Whatever was composed but not flushed goes last. */
+	if (out->frame.len > 0)
+		tty_flush(tty);
+
+	fcntl(tty->fdout, F_SETFL, out->fd_flags);
+	write_pending(tty);
+}
+
 void
 tty_reset(tty_t *tty)
 {
@@ -57,7 +200,15 @@ void
 tty_close(tty_t *tty)
 {
 	tty_reset(tty);
-	fclose(tty->fout);
+	write_all(tty);
+
+	free(tty->out->frame.data);
+	free(tty->out->inflight.data);
+	free(tty->out->queued.data);
+	free(tty->out);
+	tty->out = NULL;
+
+	close(tty->fdout);
 	close(tty->fdin);
 }
 
@@ -76,17 +227,29 @@ tty_init(tty_t *tty, const char *tty_filename)
 		exit(EXIT_FAILURE);
 	}
 
-	tty->fout = fopen(tty_filename, "w");
-	if (!tty->fout) {
+	tty->fdout = open(tty_filename, O_WRONLY);
+	if (tty->fdout < 0) {
 		perror("Failed to open tty");
 		exit(EXIT_FAILURE);
 	}
 
-	if (setvbuf(tty->fout, NULL, _IOFBF, 16384)) {
-		perror("setvbuf");
+	tty->out = calloc(1, sizeof(struct tty_out));
+	if (!tty->out) {
+		fprintf(stderr, "Error: Cannot allocate memory\n");
+		abort();
+	}
+
+	/* Never block on output: a slow terminal must not delay input
+	 * handling. See tty_flush(). */
+	tty->out->fd_flags = fcntl(tty->fdout, F_GETFL);
+	if (tty->out->fd_flags == -1
+	|| fcntl(tty->fdout, F_SETFL, tty->out->fd_flags | O_NONBLOCK) == -1) {
+		perror("fcntl");
 		exit(EXIT_FAILURE);
 	}
 
+	tty->throttle = 0;
+
 	if (tcgetattr(tty->fdin, &tty->original_termios)) {
 		perror("tcgetattr");
 		exit(EXIT_FAILURE);
@@ -114,7 +277,7 @@ void
 tty_getwinsz(tty_t *tty)
 {
 	struct winsize ws;
-	if (ioctl(fileno(tty->fout), TIOCGWINSZ, &ws) == -1) {
+	if (ioctl(tty->fdout, TIOCGWINSZ, &ws) == -1) {
 		tty->maxwidth = DEFAULT_TERMINAL_COLS;
 		tty->maxheight = DEFAULT_TERMINAL_LINES;
 	} else {
@@ -142,35 +305,60 @@ tty_getchar(tty_t *tty)
 int
 tty_input_ready(tty_t *tty, const long int timeout, const int return_on_signal)
 {
-	fd_set readfs;
-	FD_ZERO(&readfs);
-	FD_SET(tty->fdin, &readfs);
-
-	struct timespec ts = {timeout / 1000, (timeout % 1000) * 1000000};
-
 	sigset_t mask;
 	sigemptyset(&mask);
 	if (return_on_signal == 0)
 		sigaddset(&mask, SIGWINCH);
 
-	const int err = pselect(tty->fdin + 1, &readfs, NULL, NULL,
-		timeout < 0 ? NULL : &ts, return_on_signal == 1 ? NULL : &mask);
+	const double deadline = timeout < 0 ? 0 : now_ms() + (double)timeout;
+
+	for (;;) {
+		fd_set readfs, writefs;
+		FD_ZERO(&readfs);
+		FD_ZERO(&writefs);
+		FD_SET(tty->fdin, &readfs);
+
+		/* Keep writing pending output while waiting for input. */
+		const int pending = tty_output_pending(tty);
+		if (pending == 1)
+			FD_SET(tty->fdout, &writefs);
+
+		long int wait = timeout;
+		if (timeout > 0) {
+			const double left = deadline - now_ms();
+			wait = left > 0 ? (long int)left : 0;
+		}
+
+		struct timespec ts = {wait / 1000, (wait % 1000) * 1000000};
+		const int maxfd = tty->fdin > tty->fdout ? tty->fdin : tty->fdout;
+
+		const int err = pselect(maxfd + 1, &readfs, pending ? &writefs : NULL,
+			NULL, timeout < 0 ? NULL : &ts,
+			return_on_signal == 1 ? NULL : &mask);
+
+		if (err < 0) {
+			if (errno == EINTR)
+				return 0;
+
+			perror("select");
+			exit(EXIT_FAILURE);
+		}
+
+		if (FD_ISSET(tty->fdin, &readfs))
+			return 1;
 
-	if (err < 0) {
-		if (errno == EINTR)
+		if (err == 0) /* Timeout */
 			return 0;
 
-		perror("select");
-		exit(EXIT_FAILURE);
+		if (pending == 1 && FD_ISSET(tty->fdout, &writefs))
+			write_pending(tty);
 	}
-
-	return FD_ISSET(tty->fdin, &readfs);
 }
 
 static void
 tty_sgr(const tty_t *tty, const int code)
 {
-	fprintf(tty->fout, "\x1b[%dm", code);
+	tty_printf(tty, "\x1b[%dm", code);
 }
 
 void
@@ -204,67 +392,122 @@ tty_setnormal(tty_t *tty)
 void
 tty_setnowrap(const tty_t *tty)
 {
-	fputs("\x1b[?7l", tty->fout);
+	tty_fputs(tty, "\x1b[?7l");
 }
 
 void
 tty_setwrap(const tty_t *tty)
 {
-	fputs("\x1b[?7h", tty->fout);
+	tty_fputs(tty, "\x1b[?7h");
 }
 
 void
 tty_newline(const tty_t *tty)
 {
-	fputs("\x1b[K\n", tty->fout);
+	tty_fputs(tty, "\x1b[K\n");
 }
 
 void
 tty_clearline(const tty_t *tty)
 {
-	fputs("\x1b[K", tty->fout);
+	tty_fputs(tty, "\x1b[K");
 }
 
 void
 tty_setcol(const tty_t *tty, const int col)
 {
-	fprintf(tty->fout, "\x1b[%dG", col + 1);
+	tty_printf(tty, "\x1b[%dG", col + 1);
 }
 
 void
 tty_moveup(const tty_t *tty, const int i)
 {
-	fprintf(tty->fout, "\x1b[%dA", i);
+	tty_printf(tty, "\x1b[%dA", i);
 }
 
 void
 tty_fputs(const tty_t *tty, const char *str)
 {
-	fputs(str, tty->fout);
+	out_buf_append(&tty->out->frame, str, strlen(str));
 }
 
 void
 tty_putc(const tty_t *tty, const char c)
 {
-	fputc(c, tty->fout);
+	out_buf_append(&tty->out->frame, &c, 1);
 }
 
+/* Hand the frame composed so far over to the terminal. If a previous frame
+ * is still being written, the new one waits in the queue, replacing any
+ * older frame waiting there: there is no point in drawing a frame that is
+ * already outdated. */
 void
 tty_flush(const tty_t *tty)
 {
-	fflush(tty->fout);
+	struct tty_out *out = tty->out;
+	if (out->frame.len == 0)
+		return;
+
+	out->last_flush = now_ms();
+	out->last_frame_len = out->frame.len;
+
+	if (out->inflight.len == 0) {
+		out_buf_swap(&out->frame, &out->inflight);
+		out->inflight_start = out->last_flush;
+		out->inflight_blocked = 0;
+	} else {
+		out_buf_swap(&out->frame, &out->queued);
+	}
+
+	out->frame.len = 0;
+	write_pending(tty);
+}
+
+int
+tty_output_pending(const tty_t *tty)
+{
+	return tty->out->inflight_off < tty->out->inflight.len;
+}
+
+void
+tty_drain(const tty_t *tty)
+{
+	write_pending(tty);
+}
+
+/* The time the terminal needs to take a whole frame, according to the
+ * measured throughput, minus the time elapsed since the last frame. */
+long
+tty_frame_delay(const tty_t *tty)
+{
+	const struct tty_out *out = tty->out;
+	if (tty->throttle == 0 || out->throughput <= 0)
+		return 0;
+
+	double interval = (double)out->last_frame_len * 1000.0 / out->throughput;
+	if (interval > TTY_MAX_FRAME_DELAY)
+		interval = TTY_MAX_FRAME_DELAY;
+
+	const double left = interval - (now_ms() - out->last_flush);
+	return left > 0 ? (long)left + 1 : 0;
+}
+
+void
+tty_cancel_frame(const tty_t *tty)
+{
+	tty->out->frame.len = 0;
 }
 
 void
 tty_hide_cursor(const tty_t *tty)
 {
-	fputs("\x1b[?25l", tty->fout);
+	tty_fputs(tty, "\x1b[?25l");
 }
 
 void
 tty_unhide_cursor(const tty_t *tty)
 {
-	fputs("\x1b[?25h", tty->fout);
+	tty_fputs(tty, "\x1b[?25h");
 }
 
 size_t
@@ -278,9 +521,24 @@ tty_getheight(const tty_t *tty)
 void
 tty_printf(const tty_t *tty, const char *fmt, ...)
 {
+	struct out_buf *b = &tty->out->frame;
+	out_buf_reserve(b, 256);
+
 	va_list args;
 	va_start(args, fmt);
-	vfprintf(tty->fout, fmt, args);
+	const int n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, args);
 	va_end(args);
+
+	if (n < 0)
+		return;
+
+	if ((size_t)n >= b->cap - b->len) { /* Truncated: grow and retry */
+		out_buf_reserve(b, (size_t)n + 1);
+		va_start(args, fmt);
+		vsnprintf(b->data + b->len, b->cap - b->len, fmt, args);
+		va_end(args);
+	}
+
+	b->len += (size_t)n;
 }
 #pragma GCC diagnostic pop
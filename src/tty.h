@@ -37,17 +37,27 @@
 #define DEFAULT_TERMINAL_COLS  80
 #define DEFAULT_TERMINAL_LINES 25
 
+/* Initial capacity of each output frame buffer */
+#define TTY_FRAME_CAPACITY 16384
+/* Upper bound (in ms) for the delay between frames when throttling */
+#define TTY_MAX_FRAME_DELAY 500
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Output state (frame buffers and throughput measurements), see tty.c */
+struct tty_out;
+
 typedef struct {
 	struct termios original_termios;
-	FILE *fout;
+	struct tty_out *out;
 	size_t maxwidth;
 	size_t maxheight;
 	int fgcolor;
 	int fdin;
+	int fdout;
+	int throttle; /* Lower the redraw rate on slow terminals */
 } tty_t;
 
 void tty_reset(tty_t *tty);
@@ -83,6 +93,20 @@ void tty_printf(const tty_t *tty, const char *fmt, ...);
 void tty_putc(const tty_t *tty, const char c);
 void tty_flush(const tty_t *tty);
 
+/* Return 1 if part of a previous frame is still waiting to be written to
+ * the terminal, or 0 otherwise. */
+int tty_output_pending(const tty_t *tty);
+
+/* Write as much pending output as the terminal accepts without blocking. */
+void tty_drain(const tty_t *tty);
+
+/* Return the number of milliseconds to wait before drawing the next frame.
+ * Always 0, unless throttling is enabled and the terminal is slow. */
+long tty_frame_delay(const tty_t *tty);
+
+/* Discard the output composed since the last flush. */
+void tty_cancel_frame(const tty_t *tty);
+
 size_t tty_getheight(const tty_t *tty);
 
 #ifdef __cplusplus
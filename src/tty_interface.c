@@ -29,14 +29,9 @@
 * THE SOFTWARE.
 */
 
-#ifndef _XOPEN_SOURCE
-# define _XOPEN_SOURCE 700 /* wcwidth, wcswidth */
-#endif
-
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
-#include <wchar.h> /* wcwidth, wcswidth */
 
 #include "colors.h"
 #include "config.h"
@@ -44,8 +39,8 @@
 #include "match.h"
 #include "selections.h"
 #include "tty_interface.h"
+#include "utf8.h"
 
-int g_case_sensitive = -1;
 
 int
 is_boundary(const char c)
@@ -53,73 +48,18 @@ is_boundary(const char c)
 	return (~c & (1 << 7) || c & (1 << 6));
 }
 
-static int
-contains_utf8(const char *str)
-{
-	const unsigned char *s = (const unsigned char *)str;
-
-	while (*s) {
-		if (*s >= 0x80)
-			return 1;
-		s++;
-	}
-
-	return 0;
-}
-
-/* A strlen implementation able to handle wide chars.
- * Return the number of columns required to print the string STR (instead
- * of the number of bytes required to store STR). */
-static size_t
-wc_xstrlen(const char *restrict str)
-{
-	wchar_t wbuf[PATH_MAX];
-	const size_t len = mbstowcs(wbuf, str, (size_t)PATH_MAX);
-	if (len == (size_t)-1) /* Invalid multi-byte sequence found */
-		return 0;
-
-	const int width = wcswidth(wbuf, len);
-	if (width != -1)
-		return (size_t)width;
-
-	return 0; /* A non-printable wide char was found */
-}
-
 static size_t
 get_cursor_position(const size_t start, const tty_interface_t *state)
 {
 	if (!*state->search)
 		return start;
 
-	int cursor_position = (int)start;
-	const size_t cursor = state->cursor;
-	const char *search = state->search;
-
-	if (contains_utf8(search) == 0) {
-		for (size_t i = 0; i < cursor && search[i]; i++)
-			cursor_position += is_boundary(search[i]);
-		return (size_t)cursor_position;
-	}
-
-	static wchar_t wbuf[SEARCH_SIZE_MAX * sizeof(wchar_t)];
-	const size_t ret = mbstowcs(wbuf, search, SEARCH_SIZE_MAX);
-	if (ret == (size_t)-1)
-		return start;
-
-	size_t wbuf_index = 0;
-
-	for (size_t i = 0; i < cursor && search[i]; i++) {
-		if (!is_boundary(search[i]))
-			continue;
-
-		const int w = wcwidth(wbuf[wbuf_index++]);
-		if (w > 0)
-			cursor_position += w;
-	}
-
-	return (size_t)cursor_position;
+	return start + utf8_nwidth(state->search, state->cursor);
 }
 
+/* Columns taken by a score, as printed by print_score() */
+#define SCORE_WIDTH 8
+
 static void
 print_score(const tty_t *tty, const score_t score, const int pad)
 {
@@ -143,9 +83,11 @@ set_item_color(const int selected, const char *orig_color, const int no_color)
 	return selected == 0 ? "" : SELECTION_NOCOLOR;
 }
 
+/* Draw CHOICE, the text displayed for the string at INDEX in the input. */
 static void
-draw_match(tty_interface_t *state, const char *choice, const int selected,
-	const pointer_t *pointer)
+draw_match(tty_interface_t *state, const char *choice, const size_t index,
+	const size_t width, const int selected, const pointer_t *pointer,
+	const struct ansi_colors *ansi)
 {
 	tty_t *tty = state->tty;
 	const options_t *options = state->options;
@@ -162,22 +104,45 @@ draw_match(tty_interface_t *state, const char *choice, const int selected,
 
 	score_t score = SCORE_MIN;
 	static size_t positions[MATCH_MAX_LEN];
+	/* Fields (--nth) are searched, and drawn as displayed (--with-nth). */
+	const choices_t *choices = state->choices;
 	if (*search) {
 		memset(positions, -1, sizeof(positions));
-		score = match_positions(search, dchoice, &positions[0]);
+		/* Drawn without its colors: not the key that was searched */
+		if (!choices->keys && dchoice != choice)
+			score = choices_str_positions(choices, state->query,
+				search, dchoice, &positions[0],
+				state->case_sensitive);
+		else
+			score = choices_positions(choices, state->query,
+				search, index, &positions[0],
+				state->case_sensitive);
 	} else {
 		positions[0] = (size_t)-1;
 	}
+	if (*search)
+		choices_map_positions(choices, index, 1, positions);
 
 	if (options->show_scores == 1)
 		print_score(tty, score, options->pad);
 
 	const char *color = set_item_color(selected, orig_color, options->no_color);
 
-	if (positions[0] == (size_t)-1) /* No matching result (or no query). */
-		colorize_no_match(tty, color, !selected ? choice : dchoice, pointer);
-	else /* We have matches (and a query). */
-		colorize_match(state, positions, dchoice, color, pointer, selected);
+	/* Columns left for the item itself */
+	const size_t prefix = pointer->width + (options->show_scores == 1
+		? (size_t)options->pad + SCORE_WIDTH : 0);
+	const size_t cols = tty->maxwidth > prefix ? tty->maxwidth - prefix : 0;
+
+	/* The colors of the item (--ansi) give way to the selection color. */
+	if (color != orig_color)
+		ansi = NULL;
+
+	if (positions[0] == (size_t)-1 && !ansi) /* No matching result (or no query). */
+		colorize_no_match(state, color, !selected ? choice : dchoice, pointer,
+			cols, width);
+	else /* We have matches (and a query), or colors to put back. */
+		colorize_match(state, positions, dchoice, color, pointer, selected,
+			cols, width, ansi);
 }
 
 static pointer_t *
@@ -193,28 +158,35 @@ build_pointer(const int current, const int selected, const options_t *options)
 		const char *gutter_color =
 			*colors[GUTTER_COLOR] ? colors[GUTTER_COLOR] : "";
 
+		const size_t ptr_w = utf8_width(options->pointer);
+		const size_t marker_w = utf8_width(options->marker);
+
 		/* Current (hovered) and selected */
 		snprintf(pointer[PTR_CUR_SEL].str, MAX_POINTER_LEN, "%*s%s%s%s%s%s",
 			pad, "", colors[SEL_BG_COLOR], colors[POINTER_COLOR],
 			options->pointer, colors[MARKER_COLOR], options->marker);
 		pointer[PTR_CUR_SEL].len = strlen(pointer[PTR_CUR_SEL].str);
+		pointer[PTR_CUR_SEL].width = (size_t)pad + ptr_w + marker_w;
 
 		/* Current (hovered) and not selected */
 		snprintf(pointer[PTR_CUR_NOSEL].str, MAX_POINTER_LEN, "%*s%s%s%s ",
 			pad, "", colors[SEL_BG_COLOR], colors[POINTER_COLOR],
 			options->pointer);
 		pointer[PTR_CUR_NOSEL].len = strlen(pointer[PTR_CUR_NOSEL].str);
+		pointer[PTR_CUR_NOSEL].width = (size_t)pad + ptr_w + 1;
 
 		/* Not current (not hovered) and selected */
 		snprintf(pointer[PTR_NOCUR_SEL].str, MAX_POINTER_LEN, "%*s%s %s%s%s%s",
 			pad, "", gutter_color, *gutter_color ? RESET_ATTR : "",
 			colors[MARKER_COLOR], options->marker, RESET_ATTR);
 		pointer[PTR_NOCUR_SEL].len = strlen(pointer[PTR_NOCUR_SEL].str);
+		pointer[PTR_NOCUR_SEL].width = (size_t)pad + 1 + marker_w;
 
 		/* Not current (not hovered) and not selected */
 		snprintf(pointer[PTR_NOCUR_NOSEL].str, MAX_POINTER_LEN, "%*s%s %s ",
 			pad, "", gutter_color, *gutter_color ? RESET_ATTR : "");
 		pointer[PTR_NOCUR_NOSEL].len = strlen(pointer[PTR_NOCUR_NOSEL].str);
+		pointer[PTR_NOCUR_NOSEL].width = (size_t)pad + 2;
 	}
 
 	if (current == 1)
@@ -227,7 +199,7 @@ static void
 build_separator(const tty_interface_t *state, char *separator, const size_t size)
 {
 	const char *sep_str = state->options->separator;
-	const size_t len = wc_xstrlen(sep_str);
+	const size_t len = utf8_width(sep_str);
 	const size_t p = (size_t)state->options->pad;
 	const size_t w = state->tty->maxwidth;
 
@@ -259,11 +231,17 @@ print_info(const tty_interface_t *state, const choices_t *choices, const int pad
 	if (!*separator && state->options->separator)
 		build_separator(state, separator, sizeof(separator));
 
+	/* Only part of the matches of a remote search are here. */
+	const client_t *client = state->client;
 	static char buf[MAX_INFO_LINE_LEN + sizeof(separator)];
-	snprintf(buf, sizeof(buf), "%s\x1b[%dG%s%zu/%zu%s%s%s%s",
+	snprintf(buf, sizeof(buf), "%s\x1b[%dG%s%zu/%zu%s%s%s%s%s%s",
 		reverse == 0 ? "\n" : "", pad, colors[INFO_COLOR],
-		choices->available, choices->size, selected,
-		separator, RESET_ATTR CLEAR_LINE, reverse == 1 ? "\n" : "");
+		client ? client->total
+			: choices->partial ? choices->partial : choices->available,
+		client ? client->size : choices->size, selected,
+		!client && choices_greedy(choices) ? " [greedy]" : "",
+		!client && choices->exact ? " [exact]" : "", separator,
+		RESET_ATTR CLEAR_LINE, reverse == 1 ? "\n" : "");
 
 	tty_fputs(state->tty, buf);
 }
@@ -308,6 +286,14 @@ draw(tty_interface_t *state)
 	}
 
 	const tty_t *tty = state->tty;
+
+	/* The terminal is still busy with the previous frame: draw later. */
+	if (tty_frame_delay(tty) > 0) {
+		tty_cancel_frame(tty);
+		state->draw_pending = 1;
+		return;
+	}
+	state->draw_pending = 0;
 	const choices_t *choices = state->choices;
 	const options_t *options = state->options;
 	const size_t num_lines = options->num_lines;
@@ -338,13 +324,18 @@ draw(tty_interface_t *state)
 		if (options_reverse == 0)
 			tty_putc(tty, '\n');
 
-		const char *choice = choices_get(choices, i);
+		const char *choice = choices_getview(choices, i);
 		if (choice) {
-			const int selected = (sel_num > 0 && is_selected(choice));
+			const int selected = (sel_num > 0
+				&& is_selected(state->selection, choices_getindex(choices, i)));
 			const int current = (i == choices->selection);
 			const pointer_t *ptr = build_pointer(current, selected, options);
 
-			draw_match(state, choice, current, ptr);
+			struct ansi_colors ansi;
+			const int colored = choices_getcolors(choices, i, &ansi) > 0;
+
+			draw_match(state, choice, choices_getindex(choices, i),
+				choices_getwidth(choices, i), current, ptr, colored ? &ansi : NULL);
 		} else {
 			tty_fputs(tty, CLEAR_LINE);
 		}
@@ -362,7 +353,7 @@ draw(tty_interface_t *state)
 	/* Let's draw the prompt */
 	static size_t prompt_len = (size_t)-1;
 	if (prompt_len == (size_t)-1)
-		prompt_len = wc_xstrlen(options->prompt);
+		prompt_len = utf8_width(options->prompt);
 
 	const size_t cursor_position =
 		get_cursor_position(prompt_len + (size_t)options_pad + 1, state);
@@ -382,39 +373,72 @@ draw(tty_interface_t *state)
 	tty_flush(tty);
 }
 
-static int
-has_uppercase(const char *s)
+/* In reverse mode, every frame starts by moving the cursor up to the
+ * first line of the interface. */
+static void
+move_to_top(const tty_interface_t *state)
+{
+	/* Hide cursor and move it up. */
+	tty_printf(state->tty, "\x1b[?25l\x1b[%zuA\n", 1 +
+		state->options->num_lines + (size_t)state->options->show_info);
+}
+
+/* Time (in ms) to wait for input before drawing a deferred frame, or -1
+ * (wait indefinitely) if there is none. */
+static long
+draw_timeout(const tty_interface_t *state)
 {
-	while (*s) {
-		if (isupper(*s))
-			return 1;
-		s++;
-	}
+	/* Nothing to do right now: find the rest of the matches. */
+	if (state->choices->partial)
+		return 0;
+
+	if (state->draw_pending == 0)
+		return -1;
 
-	return 0;
+	const long delay = tty_frame_delay(state->tty);
+	return delay > 0 ? delay : 0;
 }
 
-static void
+void
 update_search(tty_interface_t *state)
 {
-	if (state->options->case_sens_mode == CASE_SMART)
-		g_case_sensitive = has_uppercase(state->search);
+	state->case_sensitive = options_case_sensitive(state->options, state->search);
+
+	query_free(state->query);
+	state->query = choices_query(state->choices, state->search,
+		state->case_sensitive);
 
-	choices_search(state->choices, state->search, state->options->sort);
+	if (state->client)
+		client_search(state->client, state->choices, state->search,
+			CLIENT_MAX_RESULTS);
+	else
+		choices_search(state->choices, state->search, state->options->sort,
+			state->case_sensitive);
 	strcpy(state->last_search, state->search);
 }
 
+/* If only the best matches of the last search are known (a precomputed
+ * first keystroke, see choices_search()), find the rest of them.
+ * Return 1 if so, or 0 otherwise. */
+int
+complete_search(tty_interface_t *state)
+{
+	if (state->choices->partial == 0)
+		return 0;
+
+	choices_complete(state->choices, state->last_search, state->options->sort,
+		state->case_sensitive);
+	return 1;
+}
+
 static void
 update_state(tty_interface_t *state)
 {
 	if (*state->last_search != *state->search
 	|| strcmp(state->last_search, state->search) != 0) {
 		update_search(state);
-		if (state->options->reverse == 1) {
-			/* Hide cursor and move it up. */
-			tty_printf(state->tty, "\x1b[?25l\x1b[%zuA\n", 1 +
-				state->options->num_lines + (size_t)state->options->show_info);
-		}
+		if (state->options->reverse == 1)
+			move_to_top(state);
 		draw(state);
 		/* Prevent a double draw when modifying the search string. */
 //		state->redraw = 0;
@@ -425,12 +449,16 @@ update_state(tty_interface_t *state)
 
 void
 tty_interface_init(tty_interface_t *state, tty_t *tty, choices_t *choices,
-	options_t *options, sel_t *selection)
+	options_t *options, sel_t *selection, client_t *client)
 {
 	state->tty = tty;
 	state->choices = choices;
+	state->client = client;
 	state->options = options;
+	state->query = NULL;
 	state->ambiguous_key_pending = 0;
+	state->draw_pending = 0;
+	tty->throttle = options->throttle;
 
 	*state->input = '\0';
 	*state->search = '\0';
@@ -440,6 +468,7 @@ tty_interface_init(tty_interface_t *state, tty_t *tty, choices_t *choices,
 	state->redraw = 1;
 	state->exit = -1;
 	state->selection = selection;
+	state->selection->anchor = (size_t)-1;
 
 	if (options->init_search) {
 		const size_t search_max = sizeof(state->search) - 1;
@@ -466,12 +495,17 @@ tty_interface_run(tty_interface_t *state)
 
 	for (;;) {
 		do {
-			while (!tty_input_ready(state->tty, -1, 1)) {
-				/* We received a signal (probably WINCH) */
+			while (!tty_input_ready(state->tty, draw_timeout(state), 1)) {
+				/* We received a signal (probably WINCH), it is time to
+				 * draw a deferred frame, or we are idle. */
 				if (state->options->auto_lines) {
 					tty_getwinsz(state->tty);
 					state->options->num_lines = tty_getheight(state->tty) - 1;
 				}
+				const int completed = complete_search(state);
+				if ((state->draw_pending == 1 || completed == 1)
+				&& state->options->reverse == 1)
+					move_to_top(state);
 				draw(state);
 			}
 
@@ -483,14 +517,12 @@ tty_interface_run(tty_interface_t *state)
 
 			if (state->exit >= 0) {
 				free_selections(state);
+				query_free(state->query);
 				return state->exit;
 			}
 
-			if (state->options->reverse == 1 && state->redraw == 1) {
-				/* Hide cursor and move it up. */
-				tty_printf(state->tty, "\x1b[?25l\x1b[%zuA\n", 1 +
-					state->options->num_lines + (size_t)state->options->show_info);
-			}
+			if (state->options->reverse == 1 && state->redraw == 1)
+				move_to_top(state);
 
 			draw(state);
 		} while (tty_input_ready(state->tty,
@@ -501,6 +533,7 @@ tty_interface_run(tty_interface_t *state)
 
 			if (state->exit >= 0) {
 				free_selections(state);
+				query_free(state->query);
 				return state->exit;
 			}
 		}
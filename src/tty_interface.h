@@ -39,7 +39,9 @@
 #endif /* __linux__ */
 
 #include "choices.h"
+#include "client.h"
 #include "options.h"
+#include "query.h"
 #include "tty.h"
 
 #ifndef PATH_MAX
@@ -50,8 +52,6 @@
 # endif /* __linux__ */
 #endif /* PATH_MAX */
 
-extern int g_case_sensitive;
-
 #define SEARCH_SIZE_MAX 4096
 #define SIG_INTERRUPT 130 /* 128 + SIGINT (usually 2) */
 #define PENDING_INPUT_MAX 32
@@ -77,20 +77,27 @@ extern "C" {
 typedef struct {
 	char str[MAX_POINTER_LEN];
 	size_t len;
+	size_t width; /* Columns taken by the pointer (including padding) */
 } pointer_t;
 
 typedef struct {
-	size_t size; /* Size of the selections buffer */
+	uint64_t *bitmap; /* One bit per item (see selections.c) */
+	size_t size; /* Size of the bitmap, in words */
 	size_t selected; /* Number of currently selected entries */
+	size_t anchor; /* Item last (un)marked by hand: start of range toggles */
 } sel_t;
 
 typedef struct {
 	tty_t *tty;
 	choices_t *choices;
+	client_t *client; /* Daemon running the searches (--connect), or NULL */
+	query_t *query; /* Plan of the current search (--extended), or NULL */
 	options_t *options;
 	sel_t *selection;
 	size_t cursor;
 	int ambiguous_key_pending;
+	int case_sensitive; /* Case sensitivity of the current search */
+	int draw_pending; /* A frame was deferred (see --throttle) */
 	int exit;
 	int redraw;
 	char search[SEARCH_SIZE_MAX + 1];
@@ -100,8 +107,11 @@ typedef struct {
 
 int is_boundary(const char c);
 void tty_interface_init(tty_interface_t *state, tty_t *tty,
-	choices_t *choices, options_t *options, sel_t *selection);
+	choices_t *choices, options_t *options, sel_t *selection,
+	client_t *client);
 int tty_interface_run(tty_interface_t *state);
+void update_search(tty_interface_t *state);
+int complete_search(tty_interface_t *state);
 
 #ifdef __cplusplus
 }
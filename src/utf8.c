@@ -0,0 +1,184 @@
+/* utf8.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+/* Display width of UTF-8 strings, independent of the current locale.
+ *
+ * Code point widths come from a table generated at build time from
+ * data/unicode_width.txt. Strings are measured by grapheme clusters: a base
+ * character followed by any number of zero-width characters (combining
+ * marks, variation selectors, emoji modifiers), characters joined by
+ * ZERO WIDTH JOINER, and pairs of regional indicators (flags). */
+
+#include "colors.h" /* IS_SGR_START, IS_SGR_CHAR */
+#include "utf8.h"
+#include "width_table.h"
+
+#define ZWJ 0x200d
+#define IS_REGIONAL_INDICATOR(c) ((c) >= 0x1f1e6 && (c) <= 0x1f1ff)
+
+/* Decode the UTF-8 character at S into CP, and return its length in bytes.
+ * Invalid (or truncated) sequences are decoded one byte at a time, as
+ * UTF8_INVALID. S must not be empty. */
+size_t
+utf8_decode(const char *s, uint32_t *cp)
+{
+	const unsigned char *u = (const unsigned char *)s;
+
+	if (u[0] < 0x80) {
+		*cp = u[0];
+		return 1;
+	}
+
+	size_t len = 0;
+	uint32_t c = 0;
+	uint32_t min = 0; /* Smallest code point for LEN (no overlong forms) */
+
+	if (u[0] >= 0xc2 && u[0] <= 0xdf) {
+		len = 2; c = u[0] & 0x1f; min = 0x80;
+	} else if (u[0] >= 0xe0 && u[0] <= 0xef) {
+		len = 3; c = u[0] & 0x0f; min = 0x800;
+	} else if (u[0] >= 0xf0 && u[0] <= 0xf4) {
+		len = 4; c = u[0] & 0x07; min = 0x10000;
+	} else {
+		*cp = UTF8_INVALID;
+		return 1;
+	}
+
+	for (size_t i = 1; i < len; i++) {
+		if ((u[i] & 0xc0) != 0x80) {
+			*cp = UTF8_INVALID;
+			return 1;
+		}
+		c = (c << 6) | (u[i] & 0x3f);
+	}
+
+	if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+		*cp = UTF8_INVALID;
+		return 1;
+	}
+
+	*cp = c;
+	return len;
+}
+
+/* Return the number of columns taken by the code point CP (0, 1, or 2).
+ * Control characters are given one column. */
+size_t
+utf8_cp_width(const uint32_t cp)
+{
+	if (cp < width_table[0].first)
+		return 1;
+
+	size_t lo = 0;
+	size_t hi = WIDTH_TABLE_SIZE;
+
+	while (lo < hi) {
+		const size_t mid = lo + ((hi - lo) >> 1);
+		if (cp > width_table[mid].last)
+			lo = mid + 1;
+		else if (cp < width_table[mid].first)
+			hi = mid;
+		else
+			return width_table[mid].width;
+	}
+
+	return 1;
+}
+
+/* Return the length in bytes of the grapheme cluster starting at S, and
+ * store the number of columns it takes in WIDTH. S must not be empty. */
+size_t
+utf8_cluster(const char *s, size_t *width)
+{
+	if (!((unsigned char)*s & 0x80) && !((unsigned char)s[1] & 0x80)) {
+		/* ASCII followed by ASCII (or NUL): the fast and common case */
+		*width = 1;
+		return 1;
+	}
+
+	uint32_t cp;
+	size_t len = utf8_decode(s, &cp);
+	*width = utf8_cp_width(cp);
+
+	const int regional = IS_REGIONAL_INDICATOR(cp);
+	uint32_t prev = cp;
+
+	while (s[len]) {
+		uint32_t next;
+		const size_t next_len = utf8_decode(s + len, &next);
+
+		if (prev == ZWJ || utf8_cp_width(next) == 0) {
+			/* Joined or combining: no extra space */
+		} else if (regional && IS_REGIONAL_INDICATOR(next)
+		&& prev == cp && len == 4) {
+			*width = 2; /* A flag: two regional indicators */
+		} else {
+			break;
+		}
+
+		len += next_len;
+		prev = next;
+	}
+
+	return len;
+}
+
+/* Return the number of columns needed to print the first N bytes of S
+ * (or the whole string, if shorter). SGR sequences take no space. */
+size_t
+utf8_nwidth(const char *s, const size_t n)
+{
+	size_t width = 0;
+	size_t i = 0;
+
+	while (i < n && s[i]) {
+		if (IS_SGR_START(s + i)) {
+			i += 2;
+			while (s[i] && s[i] != 'm' && IS_SGR_CHAR(s[i]))
+				i++;
+			if (s[i] == 'm')
+				i++;
+			continue;
+		}
+
+		size_t w = 0;
+		i += utf8_cluster(s + i, &w);
+		width += w;
+	}
+
+	return width;
+}
+
+/* Return the number of columns needed to print the string S. */
+size_t
+utf8_width(const char *s)
+{
+	return utf8_nwidth(s, (size_t)-1);
+}
@@ -34,6 +34,14 @@
 SUITE(match_suite);
 SUITE(choices_suite);
 SUITE(properties_suite);
+SUITE(utf8_suite);
+SUITE(snapshot_suite);
+SUITE(server_suite);
+SUITE(daemon_suite);
+SUITE(filter_suite);
+SUITE(output_suite);
+SUITE(selections_suite);
+SUITE(tty_suite);
 
 GREATEST_MAIN_DEFS();
 
@@ -43,6 +51,14 @@ int main(int argc, char *argv[]) {
 	RUN_SUITE(match_suite);
 	RUN_SUITE(choices_suite);
 	RUN_SUITE(properties_suite);
+	RUN_SUITE(utf8_suite);
+	RUN_SUITE(snapshot_suite);
+	RUN_SUITE(server_suite);
+	RUN_SUITE(daemon_suite);
+	RUN_SUITE(filter_suite);
+	RUN_SUITE(output_suite);
+	RUN_SUITE(selections_suite);
+	RUN_SUITE(tty_suite);
 
 	GREATEST_MAIN_END();
 }
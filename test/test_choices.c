@@ -36,6 +36,7 @@
 #include "config.h"
 #include "options.h"
 #include "choices.h"
+#include "first_key.h"
 
 #include "greatest/greatest.h"
 
@@ -73,11 +74,11 @@ TEST test_choices_empty() {
 TEST test_choices_1() {
 	choices_add(&choices, "tags");
 
-	choices_search(&choices, "", 1);
+	choices_search(&choices, "", 1, 1);
 	ASSERT_SIZE_T_EQ(1, choices.available);
 	ASSERT_SIZE_T_EQ(0, choices.selection);
 
-	choices_search(&choices, "t", 1);
+	choices_search(&choices, "t", 1, 1);
 	ASSERT_SIZE_T_EQ(1, choices.available);
 	ASSERT_SIZE_T_EQ(0, choices.selection);
 
@@ -98,7 +99,7 @@ TEST test_choices_2() {
 	choices_add(&choices, "test");
 
 	/* Empty search */
-	choices_search(&choices, "", 1);
+	choices_search(&choices, "", 1, 1);
 	ASSERT_SIZE_T_EQ(0, choices.selection);
 	ASSERT_SIZE_T_EQ(2, choices.available);
 
@@ -113,7 +114,7 @@ TEST test_choices_2() {
 	ASSERT_SIZE_T_EQ(0, choices.selection);
 
 	/* Filtered search */
-	choices_search(&choices, "te", 1);
+	choices_search(&choices, "te", 1, 1);
 	ASSERT_SIZE_T_EQ(1, choices.available);
 	ASSERT_SIZE_T_EQ(0, choices.selection);
 	ASSERT_STR_EQ("test", choices_get(&choices, 0));
@@ -125,12 +126,12 @@ TEST test_choices_2() {
 	ASSERT_SIZE_T_EQ(0, choices.selection);
 
 	/* No results */
-	choices_search(&choices, "foobar", 1);
+	choices_search(&choices, "foobar", 1, 1);
 	ASSERT_SIZE_T_EQ(0, choices.available);
 	ASSERT_SIZE_T_EQ(0, choices.selection);
 
 	/* Different order due to scoring */
-	choices_search(&choices, "ts", 1);
+	choices_search(&choices, "ts", 1, 1);
 	ASSERT_SIZE_T_EQ(2, choices.available);
 	ASSERT_SIZE_T_EQ(0, choices.selection);
 	ASSERT_STR_EQ("test", choices_get(&choices, 0));
@@ -157,10 +158,42 @@ TEST test_choices_without_search() {
 	PASS();
 }
 
+TEST test_choices_empty_query() {
+	choices_add(&choices, "tax");
+	choices_add(&choices, "tat");
+	choices_add(&choices, "box");
+
+	/* Everything matches, in input order, without a score */
+	choices_search(&choices, "", 1, 0);
+	ASSERT_SIZE_T_EQ(3, choices_available(&choices));
+	for (size_t i = 0; i < 3; i++) {
+		ASSERT_STR_EQ(choices.strings[i], choices_get(&choices, i));
+		ASSERT_SIZE_T_EQ(i, choices_getindex(&choices, i));
+		ASSERT_EQ(SCORE_MIN, choices_getscore(&choices, i));
+		ASSERT_SIZE_T_EQ(3, choices_getwidth(&choices, i));
+	}
+	ASSERT_EQ(NULL, choices_get(&choices, 3));
+
+	/* The same as listed results */
+	struct scored_result *results;
+	ASSERT_SIZE_T_EQ(3, choices_search_r(&choices, "", 1, 0, 2, &results));
+	for (size_t i = 0; i < 3; i++) {
+		ASSERT_STR_EQ(choices_get(&choices, i), results[i].str);
+		ASSERT_SIZE_T_EQ(i, results[i].index);
+	}
+	free(results);
+
+	choices_narrow(&choices, "x", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&choices));
+	ASSERT_STR_EQ("tax", choices_get(&choices, 0));
+
+	PASS();
+}
+
 /* Regression test for segfault */
 TEST test_choices_unicode() {
 	choices_add(&choices, "Edmund Husserl - Méditations cartésiennes - Introduction a la phénoménologie.pdf");
-	choices_search(&choices, "e", 1);
+	choices_search(&choices, "e", 1, 1);
 
 	PASS();
 }
@@ -175,7 +208,7 @@ TEST test_choices_large_input() {
 		choices_add(&choices, strings[i]);
 	}
 
-	choices_search(&choices, "12", 1);
+	choices_search(&choices, "12", 1, 1);
 
 	/* Must match `seq 0 99999 | grep '.*1.*2.*' | wc -l` */
 	ASSERT_SIZE_T_EQ(8146, choices.available);
@@ -188,6 +221,489 @@ TEST test_choices_large_input() {
 	PASS();
 }
 
+TEST test_choices_unsorted_input_order() {
+	const int N = 10000;
+	char *strings[10000];
+
+	choices.worker_count = 4;
+	for (int i = 0; i < N; i++) {
+		const int ret = asprintf(&strings[i], "%i", i);
+		(void)ret;
+		choices_add(&choices, strings[i]);
+	}
+
+	/* Partial results of all workers are merged by input position */
+	choices_search(&choices, "1", 0, 1);
+	for (size_t i = 1; i < choices_available(&choices); i++)
+		ASSERT(choices_getindex(&choices, i - 1) < choices_getindex(&choices, i));
+
+	for (int i = 0; i < N; i++)
+		free(strings[i]);
+
+	PASS();
+}
+
+TEST test_choices_narrow() {
+	const int N = 10000;
+	char *strings[10000];
+
+	choices.worker_count = 4;
+	for (int i = 0; i < N; i++) {
+		const int ret = asprintf(&strings[i], "%i", i);
+		(void)ret;
+		choices_add(&choices, strings[i]);
+	}
+
+	/* Narrowing the results of "1" gives the same as a full search */
+	const int sort[] = {1, 0};
+	for (int s = 0; s < 2; s++) {
+		choices_search(&choices, "12", sort[s], 1);
+		const size_t available = choices_available(&choices);
+		size_t indexes[1000];
+		for (size_t i = 0; i < available && i < 1000; i++)
+			indexes[i] = choices_getindex(&choices, i);
+
+		choices_search(&choices, "1", sort[s], 1);
+		choices_narrow(&choices, "12", sort[s], 1);
+		ASSERT_SIZE_T_EQ(available, choices_available(&choices));
+		for (size_t i = 0; i < available && i < 1000; i++)
+			ASSERT_SIZE_T_EQ(indexes[i], choices_getindex(&choices, i));
+	}
+
+	for (int i = 0; i < N; i++)
+		free(strings[i]);
+
+	PASS();
+}
+
+TEST test_choices_ansi() {
+	options_t options;
+	options_init(&options);
+	options.ansi = 1;
+
+	choices_destroy(&choices);
+	choices_init(&choices, &options);
+
+	char plain[] = "plain";
+	char colored[] = "\x1b[1;34mdir\x1b[0m/\x1b[32mexec\x1b[0m";
+	choices_add(&choices, plain);
+	choices_add(&choices, colored);
+
+	/* Colors never reach the matcher */
+	choices_search(&choices, "dire", 1, 1);
+	ASSERT_SIZE_T_EQ(1, choices.available);
+	ASSERT_STR_EQ("dir/exec", choices_get(&choices, 0));
+	ASSERT_SIZE_T_EQ(8, choices_getwidth(&choices, 0));
+
+	struct ansi_colors ansi;
+	ASSERT_SIZE_T_EQ(4, choices_getcolors(&choices, 0, &ansi));
+	ASSERT_SIZE_T_EQ(0, (size_t)ansi.spans[0].offset);
+	ASSERT_SIZE_T_EQ(3, (size_t)ansi.spans[1].offset);
+	ASSERT_SIZE_T_EQ(4, (size_t)ansi.spans[2].offset);
+	ASSERT_SIZE_T_EQ(8, (size_t)ansi.spans[3].offset);
+	ASSERT_STR_EQ("\x1b[32m", ansi.ansi->attrs[ansi.spans[2].attr]);
+
+	/* Repeated sequences are stored only once */
+	ASSERT_EQ(ansi.spans[1].attr, ansi.spans[3].attr);
+	ASSERT_SIZE_T_EQ(3, ansi.ansi->attrs_count);
+
+	choices_search(&choices, "", 1, 1);
+	const size_t plain_n = strcmp(choices_get(&choices, 0), "plain") == 0 ? 0 : 1;
+	ASSERT_SIZE_T_EQ(0, choices_getcolors(&choices, plain_n, &ansi));
+
+	PASS();
+}
+
+TEST test_choices_search_index() {
+	const int N = 10000;
+	char *strings[10000];
+
+	choices_t indexed;
+	default_options.search_index = 1;
+	choices_init(&indexed, &default_options);
+	default_options.search_index = 0;
+
+	for (int i = 0; i < N; i++) {
+		const int ret = asprintf(&strings[i], "%s%i/%c%c", i % 7 ? "src/" : "",
+			i, 'a' + i % 26, 'A' + i % 23);
+		(void)ret;
+		choices_add(&choices, strings[i]);
+		/* Index the first half, and search the rest as it is */
+		if (i == N / 2)
+			choices_index(&indexed);
+		choices_add(&indexed, strings[i]);
+	}
+	search_index_wait(indexed.index);
+
+	/* The index never loses a match, whatever the case */
+	const char *queries[] = {"s/9a", "123", "99/zz", "SRC", "/qw", "xyz", "é12"};
+	for (int s = 0; s < 2; s++) {
+		for (size_t q = 0; q < sizeof(queries) / sizeof(*queries); q++) {
+			choices_search(&choices, queries[q], s, s);
+			choices_search(&indexed, queries[q], s, s);
+			ASSERT_SIZE_T_EQ(choices_available(&choices),
+				choices_available(&indexed));
+			for (size_t i = 0; i < choices_available(&choices); i++)
+				ASSERT_SIZE_T_EQ(choices_getindex(&choices, i),
+					choices_getindex(&indexed, i));
+		}
+		choices_index(&indexed);
+		search_index_wait(indexed.index);
+	}
+
+	choices_destroy(&indexed);
+	for (int i = 0; i < N; i++)
+		free(strings[i]);
+
+	PASS();
+}
+
+TEST test_choices_first_key() {
+	const int N = 5000;
+	char *strings[5000];
+
+	choices_t precomputed;
+	choices_init(&precomputed, &default_options);
+
+	for (int i = 0; i < N; i++) {
+		const int ret = asprintf(&strings[i], "%i%c", i, i % 3 ? 'x' : 'Y');
+		(void)ret;
+		choices_add(&choices, strings[i]);
+		choices_add(&precomputed, strings[i]);
+	}
+	choices_precompute(&precomputed, &default_options);
+	first_key_wait(precomputed.first_key);
+
+	const char *queries[] = {"1", "x", "y", "Y", "z", "12", "1y"};
+	for (size_t q = 0; q < sizeof(queries) / sizeof(*queries); q++) {
+		const int cs = options_case_sensitive(&default_options, queries[q]);
+		choices_search(&choices, queries[q], 1, cs);
+		choices_search(&precomputed, queries[q], 1, cs);
+
+		/* Only the best matches of single characters are there at first */
+		const size_t available = choices_available(&choices);
+		if (precomputed.partial) {
+			ASSERT_SIZE_T_EQ(available, precomputed.partial);
+			ASSERT_SIZE_T_EQ(FIRST_KEY_RESULTS, choices_available(&precomputed));
+		}
+		for (size_t i = 0; i < choices_available(&precomputed); i++)
+			ASSERT_SIZE_T_EQ(choices_getindex(&choices, i),
+				choices_getindex(&precomputed, i));
+
+		choices_complete(&precomputed, queries[q], 1, cs);
+		ASSERT_SIZE_T_EQ(0, precomputed.partial);
+		ASSERT_SIZE_T_EQ(available, choices_available(&precomputed));
+		for (size_t i = 0; i < available; i++)
+			ASSERT_SIZE_T_EQ(choices_getindex(&choices, i),
+				choices_getindex(&precomputed, i));
+	}
+
+	choices_search(&precomputed, "x", 1, 0);
+	ASSERT_SIZE_T_EQ(N - N / 3 - 1, precomputed.partial);
+
+	/* The first key is searched for as usual in the wrong sort mode */
+	choices_search(&precomputed, "1", 0, 0);
+	ASSERT_SIZE_T_EQ(0, precomputed.partial);
+
+	choices_destroy(&precomputed);
+	for (int i = 0; i < N; i++)
+		free(strings[i]);
+
+	PASS();
+}
+
+TEST test_choices_incremental() {
+	const int N = 3000;
+	char *strings[3000];
+
+	choices_t incremental;
+	default_options.incremental = 1;
+	choices_init(&incremental, &default_options);
+	default_options.incremental = 0;
+
+	for (int i = 0; i < N; i++) {
+		const int ret = asprintf(&strings[i], "src/%i/%s_%c%i.c", i % 17,
+			i % 5 ? "main" : "Makefile", 'a' + i % 26, i);
+		(void)ret;
+		choices_add(&choices, strings[i]);
+		choices_add(&incremental, strings[i]);
+	}
+
+	/* As typed: scores go on from those of the previous query */
+	const char *queries[] = {"s", "sr", "src", "srcm", "srcma", "srcm",
+		"srcmM", "srcmMa", "", "1", "1/", "1/m", "1/ma", "1/mak"};
+	for (size_t q = 0; q < sizeof(queries) / sizeof(*queries); q++) {
+		const int cs = options_case_sensitive(&default_options, queries[q]);
+		choices_search(&choices, queries[q], 1, cs);
+		choices_search(&incremental, queries[q], 1, cs);
+		ASSERT_SIZE_T_EQ(choices_available(&choices),
+			choices_available(&incremental));
+		for (size_t i = 0; i < choices_available(&choices); i++) {
+			ASSERT_SIZE_T_EQ(choices_getindex(&choices, i),
+				choices_getindex(&incremental, i));
+			ASSERT(choices_getscore(&choices, i)
+				== choices_getscore(&incremental, i));
+		}
+	}
+
+	choices_destroy(&incremental);
+	for (int i = 0; i < N; i++)
+		free(strings[i]);
+
+	PASS();
+}
+
+TEST test_choices_extended() {
+	choices_t extended;
+	default_options.extended = 1;
+	choices_init(&extended, &default_options);
+	default_options.extended = 0;
+
+	choices_add(&extended, "src/main.c");
+	choices_add(&extended, "src/match.c");
+	choices_add(&extended, "src/match.h");
+	choices_add(&extended, "test/test_match.c");
+	choices_add(&extended, "Makefile");
+
+	/* AND terms, anchors and negations */
+	choices_search(&extended, "^src .c$", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&extended));
+	choices_search(&extended, "'match !^test", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&extended));
+	choices_search(&extended, "!src !test", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&extended));
+	ASSERT_STR_EQ("Makefile", choices_get(&extended, 0));
+	choices_search(&extended, "^makefile$", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&extended));
+	choices_search(&extended, "^makefile$", 1, 1);
+	ASSERT_SIZE_T_EQ(0, choices_available(&extended));
+
+	/* Alternatives */
+	choices_search(&extended, "^test | .h$ match", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&extended));
+	ASSERT_STR_EQ("test/test_match.c", choices_get(&extended, 0));
+	ASSERT_STR_EQ("src/match.h", choices_get(&extended, 1));
+
+	/* Whatever is left once the syntax is removed matches everything. */
+	choices_search(&extended, "! ^ '", 1, 0);
+	ASSERT_SIZE_T_EQ(5, choices_available(&extended));
+
+	/* A single fuzzy term scores as without the syntax. */
+	choices_search(&extended, "smc", 1, 0);
+	ASSERT(choices_getscore(&extended, 0)
+		== match("smc", choices_get(&extended, 0), 0));
+
+	/* Without --extended, the syntax is just text. */
+	choices_add(&choices, "src/match.c");
+	choices_search(&choices, "^src", 1, 0);
+	ASSERT_SIZE_T_EQ(0, choices_available(&choices));
+
+	choices_destroy(&extended);
+	PASS();
+}
+
+TEST test_choices_exact() {
+	choices_t exact;
+	default_options.exact = 1;
+	choices_init(&exact, &default_options);
+	default_options.exact = 0;
+
+	choices_add(&exact, "src/main.c");
+	choices_add(&exact, "src/match.c");
+	choices_add(&exact, "test/test_match.c");
+	choices_add(&exact, "Makefile");
+	choices_add(&exact, "smc");
+
+	/* Substrings only */
+	choices_search(&exact, "smc", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&exact));
+	ASSERT_STR_EQ("smc", choices_get(&exact, 0));
+	choices_search(&exact, "MAKE", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&exact));
+	choices_search(&exact, "match", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&exact));
+	ASSERT_STR_EQ("src/match.c", choices_get(&exact, 0));
+
+	/* The contiguous run is highlighted. */
+	size_t positions[MATCH_MAX_LEN];
+	memset(positions, -1, sizeof(positions));
+	choices_positions(&exact, NULL, "tch", 1, positions, 0);
+	ASSERT_SIZE_T_EQ(6, positions[0]);
+	ASSERT_SIZE_T_EQ(7, positions[1]);
+	ASSERT_SIZE_T_EQ(8, positions[2]);
+	ASSERT_SIZE_T_EQ((size_t)-1, positions[3]);
+
+	/* Quoted terms are fuzzy in the extended syntax. */
+	exact.extended = 1;
+	choices_search(&exact, "src mc", 1, 0);
+	ASSERT_SIZE_T_EQ(0, choices_available(&exact));
+	choices_search(&exact, "src 'mc", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&exact));
+	exact.extended = 0;
+
+	/* Toggled off (Alt-e), matching is fuzzy again. */
+	exact.exact = 0;
+	choices_search(&exact, "smc", 1, 0);
+	ASSERT_SIZE_T_EQ(4, choices_available(&exact));
+
+	choices_destroy(&exact);
+	PASS();
+}
+
+TEST test_choices_typos() {
+	choices_t typos;
+	default_options.typos = 1;
+	choices_init(&typos, &default_options);
+	default_options.typos = 0;
+
+	choices_add(&typos, "src/choices.c");
+	choices_add(&typos, "src/options.c");
+	choices_add(&typos, "test/test_choices.c");
+
+	/* Too few results: those with typos come after them. */
+	choices_search(&typos, "choices", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&typos));
+	choices_search(&typos, "choises", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&typos));
+	ASSERT_STR_EQ("src/choices.c", choices_get(&typos, 0));
+	choices_search(&typos, "tchoices", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&typos));
+	ASSERT_STR_EQ("test/test_choices.c", choices_get(&typos, 0));
+	ASSERT_STR_EQ("src/choices.c", choices_get(&typos, 1));
+	ASSERT(choices_getscore(&typos, 1) < choices_getscore(&typos, 0));
+
+	/* Only one typo */
+	choices_search(&typos, "chiosec", 1, 0);
+	ASSERT_SIZE_T_EQ(0, choices_available(&typos));
+
+	/* The characters found are highlighted. */
+	size_t positions[MATCH_MAX_LEN];
+	memset(positions, -1, sizeof(positions));
+	choices_positions(&typos, NULL, "optoins", 1, positions, 0);
+	ASSERT_SIZE_T_EQ(4, positions[0]);
+	ASSERT_SIZE_T_EQ((size_t)-1, positions[6]);
+
+	/* Results with typos need not be among those narrowed. */
+	choices_search(&typos, "src", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&typos));
+	choices_narrow(&typos, "srcs", 1, 0);
+	ASSERT_SIZE_T_EQ(3, choices_available(&typos));
+	ASSERT_STR_EQ("test/test_choices.c", choices_get(&typos, 2));
+
+	choices_destroy(&typos);
+	PASS();
+}
+
+TEST test_choices_folded() {
+	choices_t plain, nfd;
+	choices_init(&plain, &default_options);
+	default_options.normalize = 1;
+	choices_init(&nfd, &default_options);
+	default_options.normalize = 0;
+
+	static const char *strings[] = {"Straße/Über.txt", "Москва/Документы",
+		"cafe\xcc\x81", "café", "\xe2\x84\xaa.dat"};
+	for (size_t i = 0; i < sizeof(strings) / sizeof(*strings); i++) {
+		choices_add(&plain, (char *)strings[i]);
+		choices_add(&nfd, (char *)strings[i]);
+	}
+
+	/* Case is ignored beyond ASCII... */
+	choices_search(&plain, "über", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&plain));
+	choices_search(&plain, "москвадок", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&plain));
+	choices_search(&plain, "ÜBER", 1, 1);
+	ASSERT_SIZE_T_EQ(0, choices_available(&plain));
+	choices_search(&plain, "k.dat", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&plain));
+
+	/* ... and what is highlighted is what the folded characters were. */
+	size_t positions[MATCH_MAX_LEN];
+	memset(positions, -1, sizeof(positions));
+	choices_positions(&plain, NULL, "üb", 0, positions, 0);
+	ASSERT_SIZE_T_EQ(8, positions[0]);
+	ASSERT_SIZE_T_EQ(9, positions[1]);
+	ASSERT_SIZE_T_EQ(10, positions[2]);
+	ASSERT_SIZE_T_EQ((size_t)-1, positions[3]);
+
+	/* The same, for text that is not a key */
+	memset(positions, -1, sizeof(positions));
+	choices_str_positions(&plain, NULL, "üb", "Straße/Über.txt",
+		positions, 0);
+	ASSERT_SIZE_T_EQ(8, positions[0]);
+	ASSERT_SIZE_T_EQ(10, positions[2]);
+	ASSERT_SIZE_T_EQ((size_t)-1, positions[3]);
+
+	/* Precomposed and decomposed characters only match alike with
+	 * --normalize. */
+	choices_search(&plain, "café", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&plain));
+	choices_search(&nfd, "café", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&nfd));
+	choices_search(&nfd, "cafe\xcc\x81", 1, 1);
+	ASSERT_SIZE_T_EQ(2, choices_available(&nfd));
+
+	choices_destroy(&plain);
+	choices_destroy(&nfd);
+	PASS();
+}
+
+TEST test_choices_fields() {
+	choices_t grep, ps;
+	default_options.field_delimiter = ":";
+	default_options.nth = "3";
+	default_options.with_nth = "3,1";
+	choices_init(&grep, &default_options);
+	default_options.field_delimiter = NULL;
+	default_options.nth = "3..";
+	default_options.with_nth = NULL;
+	choices_init(&ps, &default_options);
+	default_options.nth = NULL;
+
+	choices_add(&grep, "src/main.c:12:int main(void)");
+	choices_add(&grep, "src/match.c:40:score_t match(void)");
+	choices_add(&grep, "test/test.c:7:main");
+
+	/* Only the selected fields are searched. */
+	choices_search(&grep, "main", 1, 0);
+	ASSERT_SIZE_T_EQ(2, choices_available(&grep));
+	ASSERT_STR_EQ("test/test.c:7:main", choices_get(&grep, 0));
+	ASSERT_STR_EQ("main:test/test.c", choices_getview(&grep, 0));
+	ASSERT_SIZE_T_EQ(16, choices_getwidth(&grep, 0));
+	choices_search(&grep, "12", 1, 0);
+	ASSERT_SIZE_T_EQ(0, choices_available(&grep));
+
+	/* Positions in the fields searched, mapped to the string, and to the
+	 * fields displayed */
+	size_t positions[MATCH_MAX_LEN];
+	memset(positions, -1, sizeof(positions));
+	choices_positions(&grep, NULL, "mv", 0, positions, 0);
+	ASSERT_SIZE_T_EQ(4, positions[0]);
+	ASSERT_SIZE_T_EQ(9, positions[1]);
+	choices_map_positions(&grep, 0, 0, positions);
+	ASSERT_SIZE_T_EQ(18, positions[0]);
+	ASSERT_SIZE_T_EQ(23, positions[1]);
+
+	memset(positions, -1, sizeof(positions));
+	choices_positions(&grep, NULL, "in", 2, positions, 0);
+	choices_map_positions(&grep, 2, 1, positions);
+	ASSERT_SIZE_T_EQ(2, positions[0]);
+	ASSERT_SIZE_T_EQ(3, positions[1]);
+	ASSERT_SIZE_T_EQ((size_t)-1, positions[2]);
+
+	/* Runs of blanks separate fields by default. */
+	choices_add(&ps, "  412 root  /usr/bin/sshd -D");
+	choices_add(&ps, "  977 sshd  /bin/sh");
+	ASSERT_STR_EQ("/usr/bin/sshd -D", choices_key(&ps, 0));
+	choices_search(&ps, "sshd", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&ps));
+
+	choices_destroy(&grep);
+	choices_destroy(&ps);
+	PASS();
+}
+
 SUITE(choices_suite) {
 	SET_SETUP(setup, NULL);
 	SET_TEARDOWN(teardown, NULL);
@@ -196,6 +712,18 @@ SUITE(choices_suite) {
 	RUN_TEST(test_choices_1);
 	RUN_TEST(test_choices_2);
 	RUN_TEST(test_choices_without_search);
+	RUN_TEST(test_choices_empty_query);
 	RUN_TEST(test_choices_unicode);
 	RUN_TEST(test_choices_large_input);
+	RUN_TEST(test_choices_unsorted_input_order);
+	RUN_TEST(test_choices_narrow);
+	RUN_TEST(test_choices_ansi);
+	RUN_TEST(test_choices_search_index);
+	RUN_TEST(test_choices_first_key);
+	RUN_TEST(test_choices_incremental);
+	RUN_TEST(test_choices_extended);
+	RUN_TEST(test_choices_exact);
+	RUN_TEST(test_choices_fields);
+	RUN_TEST(test_choices_typos);
+	RUN_TEST(test_choices_folded);
 }
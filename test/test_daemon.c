@@ -0,0 +1,304 @@
+/* test_daemon.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "options.h"
+#include "choices.h"
+#include "client.h"
+#include "daemon.h"
+
+#include "greatest/greatest.h"
+
+#define ASSERT_SIZE_T_EQ(a,b) ASSERT_EQ_FMT((size_t)(a), (b), "%zu")
+
+static options_t default_options;
+static choices_t choices;
+static client_t client;
+static int peer; /* The daemon's end of CLIENT->FD */
+static pid_t daemon_pid = -1;
+static char socket_path[] = "/tmp/fnftest_daemon.XXXXXX";
+static char corpus_a[] = "/tmp/fnftest_corpus_a.XXXXXX";
+static char corpus_b[] = "/tmp/fnftest_corpus_b.XXXXXX";
+
+static void setup(void *udata) {
+	(void)udata;
+
+	options_init(&default_options);
+	default_options.workers = 1;
+	choices_init(&choices, &default_options);
+
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+		abort();
+	memset(&client, 0, sizeof(client));
+	client.fd = client.reader.fd = fds[0];
+	peer = fds[1];
+}
+
+static void teardown(void *udata) {
+	(void)udata;
+
+	client_destroy(&client, &choices);
+	choices_destroy(&choices);
+	close(peer);
+
+	if (daemon_pid != -1) {
+		kill(daemon_pid, SIGTERM);
+		waitpid(daemon_pid, NULL, 0);
+		daemon_pid = -1;
+		unlink(corpus_a);
+		unlink(corpus_b);
+		memcpy(corpus_a + strlen(corpus_a) - 6, "XXXXXX", 6);
+		memcpy(corpus_b + strlen(corpus_b) - 6, "XXXXXX", 6);
+		memcpy(socket_path + strlen(socket_path) - 6, "XXXXXX", 6);
+	}
+}
+
+/* Answer the next search of CLIENT with RESPONSE. */
+static void
+respond(const char *response)
+{
+	if (write(peer, response, strlen(response)) == -1
+	|| write(peer, "\n", 1) == -1)
+		abort();
+}
+
+/* Return the exit status of a client receiving RESPONSE to a search. */
+static int
+search_status(const char *response)
+{
+	/* Or the child would print it again on exit() */
+	fflush(stdout);
+
+	const pid_t pid = fork();
+	if (pid == 0) {
+		const int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDERR_FILENO);
+		respond(response);
+		client_search(&client, &choices, "x", 0);
+		_exit(0);
+	}
+
+	int status;
+	if (pid == -1 || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status))
+		return -1;
+	return WEXITSTATUS(status);
+}
+
+TEST client_unescape() {
+	respond("{\"query\":\"x\",\"total\":3,\"offset\":0,\"results\":["
+		"{\"text\":\"caf\\u00e9 \\u00E9\",\"index\":0,\"score\":1,"
+		"\"positions\":[]},"
+		"{\"text\":\"\\ud83d\\ude00|\\u20ac\",\"index\":1,\"score\":1,"
+		"\"positions\":[]},"
+		"{\"text\":\"\\\"\\\\\\/\\t\\u0001\",\"index\":2,"
+		"\"score\":1e999,"
+		"\"positions\":[0,1]}]}");
+	client_search(&client, &choices, "x", 0);
+
+	ASSERT_SIZE_T_EQ(3, client.total);
+	ASSERT_SIZE_T_EQ(3, choices_available(&choices));
+	ASSERT_STR_EQ("caf\xc3\xa9 \xc3\xa9", choices_get(&choices, 0));
+	ASSERT_STR_EQ("\xf0\x9f\x98\x80|\xe2\x82\xac",
+		choices_get(&choices, 1));
+	ASSERT_STR_EQ("\"\\/\t\x01", choices_get(&choices, 2));
+	ASSERT_EQ(SCORE_MAX, choices_getscore(&choices, 2));
+
+	PASS();
+}
+
+TEST client_unescape_errors() {
+	const char *head = "{\"query\":\"x\",\"total\":1,\"offset\":0,"
+		"\"results\":[{\"text\":\"";
+	const char *tail = "\",\"index\":0,\"score\":1,\"positions\":[]}]}";
+	const char *bad[] = {
+		"\\u0000", /* C strings cannot hold it */
+		"\\udc00", /* Low surrogate first */
+		"\\ud83d", /* High surrogate alone */
+		"\\ud83d\\u0041", /* Not followed by a low surrogate */
+		"\\u12g4",
+		"\\u12",
+	};
+	char response[256];
+
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		snprintf(response, sizeof(response), "%s%s%s", head, bad[i],
+			tail);
+		ASSERT_EQ_FMT(EXIT_FAILURE, search_status(response), "%d");
+	}
+
+	snprintf(response, sizeof(response), "%s%s%s", head, "\\u0041", tail);
+	ASSERT_EQ_FMT(0, search_status(response), "%d");
+
+	/* Error replies */
+	ASSERT_EQ_FMT(EXIT_FAILURE,
+		search_status("{\"error\":\"Invalid request\"}"), "%d");
+
+	PASS();
+}
+
+TEST client_local_index() {
+	respond("{\"query\":\"\",\"total\":2,\"offset\":0,\"results\":["
+		"{\"text\":\"a\",\"index\":0,\"score\":1,\"positions\":[]},"
+		"{\"text\":\"b\",\"index\":5000,\"score\":1,"
+		"\"positions\":[]}]}");
+	client_search(&client, &choices, "", 0);
+	ASSERT_SIZE_T_EQ(2, choices.size);
+
+	/* Strings already received are not copied again */
+	respond("{\"query\":\"b\",\"total\":1,\"offset\":0,\"results\":["
+		"{\"text\":\"b\",\"index\":5000,\"score\":1,"
+		"\"positions\":[]}]}");
+	client_search(&client, &choices, "b", 0);
+	ASSERT_SIZE_T_EQ(2, choices.size);
+	ASSERT_SIZE_T_EQ(1, choices_getindex(&choices, 0));
+
+	/* The corpus was reloaded: index 0 now holds another string */
+	respond("{\"query\":\"\",\"total\":2,\"offset\":0,\"results\":["
+		"{\"text\":\"c\",\"index\":0,\"score\":1,\"positions\":[]},"
+		"{\"text\":\"b\",\"index\":5000,\"score\":1,"
+		"\"positions\":[]}]}");
+	client_search(&client, &choices, "", 0);
+	ASSERT_SIZE_T_EQ(3, choices.size);
+	ASSERT_SIZE_T_EQ(2, choices_getindex(&choices, 0));
+	ASSERT_STR_EQ("c", choices_get(&choices, 0));
+	ASSERT_SIZE_T_EQ(1, choices_getindex(&choices, 1));
+
+	/* The old string is kept (it may be selected) */
+	ASSERT_STR_EQ("a", choices.strings[0]);
+
+	PASS();
+}
+
+/* Write COUNT lines made of the character CH, padded to WIDTH bytes,
+ * over the file at PATH, keeping its modification time if KEEP_TIME
+ * is 1. */
+static void
+write_corpus(const char *path, const char ch, const size_t count,
+	const size_t width, const int keep_time)
+{
+	struct stat st;
+	if (stat(path, &st) == -1)
+		abort();
+
+	/* In place, to keep the same file */
+	FILE *fp = fopen(path, "r+");
+	if (!fp)
+		abort();
+	for (size_t i = 0; i < count; i++)
+		fprintf(fp, "%c%0*zu\n", ch, (int)width - 2, i);
+	fclose(fp);
+
+	if (keep_time == 1) {
+		struct timeval tv[2] = {{st.st_atime, 0}, {st.st_mtime, 0}};
+		utimes(path, tv);
+	}
+}
+
+/* Connect to the daemon, and return the first string of PATH. */
+static const char *
+first_string(const char *path)
+{
+	options_t options = default_options;
+	options.connect_socket = socket_path;
+	options.corpus = path;
+
+	/* Let the daemon notice the previous client is gone */
+	client_destroy(&client, &choices);
+	usleep(100000);
+
+	client_init(&client, &options);
+	client_search(&client, &choices, "", 1);
+	return choices_get(&choices, 0);
+}
+
+TEST daemon_reload_and_evict() {
+	/* Together, but not alone, over the memory limit (1 MiB) */
+	const size_t count = 9000;
+	const size_t width = 64;
+	struct stat st;
+
+	close(mkstemp(socket_path));
+	unlink(socket_path);
+	close(mkstemp(corpus_a));
+	close(mkstemp(corpus_b));
+	write_corpus(corpus_a, 'a', count, width, 0);
+	write_corpus(corpus_b, 'b', count, width, 0);
+
+	options_t options = default_options;
+	options.daemon_socket = socket_path;
+	options.memory_limit = 1;
+	fflush(stdout);
+	daemon_pid = fork();
+	ASSERT(daemon_pid != -1);
+	if (daemon_pid == 0) {
+		daemon_run(&options);
+		_exit(1);
+	}
+	for (int i = 0; i < 100 && stat(socket_path, &st) == -1; i++)
+		usleep(10000);
+
+	ASSERT_EQ_FMT('a', first_string(corpus_a)[0], "%c");
+
+	/* Changed: reloaded */
+	write_corpus(corpus_a, 'A', count + 1, width, 0);
+	ASSERT_EQ_FMT('A', first_string(corpus_a)[0], "%c");
+
+	/* Looks unchanged (same size and time): kept */
+	write_corpus(corpus_a, 'x', count + 1, width, 1);
+	ASSERT_EQ_FMT('A', first_string(corpus_a)[0], "%c");
+
+	/* Unloaded to make room for another corpus, and thus read again */
+	ASSERT_EQ_FMT('b', first_string(corpus_b)[0], "%c");
+	ASSERT_EQ_FMT('x', first_string(corpus_a)[0], "%c");
+
+	PASS();
+}
+
+SUITE(daemon_suite) {
+	SET_SETUP(setup, NULL);
+	SET_TEARDOWN(teardown, NULL);
+
+	RUN_TEST(client_unescape);
+	RUN_TEST(client_unescape_errors);
+	RUN_TEST(client_local_index);
+	RUN_TEST(daemon_reload_and_evict);
+}
@@ -0,0 +1,300 @@
+/* test_filter.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "options.h"
+#include "choices.h"
+#include "filter.h"
+
+#include "greatest/greatest.h"
+
+#define ASSERT_SIZE_T_EQ(a,b) ASSERT_EQ_FMT((size_t)(a), (b), "%zu")
+
+#define CHUNK_SIZE (1 << 20) /* As in filter.c */
+
+static options_t default_options;
+static char path[] = "/tmp/fnftest_filter.XXXXXX";
+
+/* Input and expected output */
+static char *input;
+static size_t input_len;
+static char *expected;
+static size_t expected_len;
+
+static void setup(void *udata) {
+	(void)udata;
+
+	options_init(&default_options);
+	default_options.filter = "zq";
+	close(mkstemp(path));
+	input = expected = NULL;
+	input_len = expected_len = 0;
+}
+
+static void teardown(void *udata) {
+	(void)udata;
+
+	unlink(path);
+	memcpy(path + strlen(path) - 6, "XXXXXX", 6);
+	free(input);
+	free(expected);
+}
+
+static void
+append(char **buf, size_t *len, const char *str, const size_t n)
+{
+	*buf = safe_realloc(*buf, *len + n + 1);
+	memcpy(*buf + *len, str, n);
+	*len += n;
+	(*buf)[*len] = '\0';
+}
+
+/* Add the line STR to the input, and to the expected output if MATCH
+ * is 1. */
+static void
+add_line(const char *str, const int match)
+{
+	append(&input, &input_len, str, strlen(str));
+	append(&input, &input_len, "\n", 1);
+	if (match == 1) {
+		append(&expected, &expected_len, str, strlen(str));
+		append(&expected, &expected_len, "\n", 1);
+	}
+}
+
+/* Add COUNT lines not matching. */
+static void
+add_filler(const size_t count)
+{
+	char line[32];
+	for (size_t i = 0; i < count; i++) {
+		snprintf(line, sizeof(line), "filler%07zu", i);
+		add_line(line, 0);
+	}
+}
+
+/* Run filter_run() with OPTIONS on INPUT, written to its standard input
+ * through a pipe, in pieces of PIECE bytes. Return what it printed (to be
+ * freed by the caller), and set *LEN to its length. */
+static char *
+run_filter(const options_t *options, const size_t piece, size_t *len)
+{
+	int fds[2];
+	if (pipe(fds) == -1)
+		return NULL;
+
+	/* Or the children would print it again */
+	fflush(stdout);
+
+	const pid_t writer = fork();
+	if (writer == 0) {
+		close(fds[0]);
+		for (size_t i = 0; i < input_len; i += piece) {
+			const size_t n = input_len - i < piece
+				? input_len - i : piece;
+			if (write(fds[1], input + i, n) != (ssize_t)n)
+				_exit(1);
+		}
+		_exit(0);
+	}
+
+	const pid_t filter = fork();
+	if (filter == 0) {
+		choices_t c;
+		FILE *fp = fopen(path, "w");
+		if (!fp || dup2(fds[0], STDIN_FILENO) == -1
+		|| dup2(fileno(fp), STDOUT_FILENO) == -1)
+			_exit(1);
+		close(fds[1]);
+
+		choices_init(&c, options);
+		filter_run(&c, options);
+		_exit(0);
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+	int status;
+	if (writer == -1 || filter == -1 || waitpid(writer, NULL, 0) == -1
+	|| waitpid(filter, &status, 0) == -1 || status != 0)
+		return NULL;
+
+	char *out = NULL;
+	char buf[65536];
+	size_t n;
+	FILE *fp = fopen(path, "r");
+	*len = 0;
+	append(&out, len, "", 0);
+	while (fp && (n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		append(&out, len, buf, n);
+	if (fp)
+		fclose(fp);
+
+	return out;
+}
+
+/* Assert that filtering the input gives the expected output, whether
+ * it comes in small or large pieces. */
+static enum greatest_test_res
+check_filter(const options_t *options)
+{
+	const size_t pieces[] = {4099, CHUNK_SIZE + 1};
+
+	for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+		size_t len;
+		char *out = run_filter(options, pieces[i], &len);
+		ASSERT(out);
+		ASSERT_SIZE_T_EQ(expected_len, len);
+		ASSERT_MEM_EQ(expected, out, len);
+		free(out);
+	}
+
+	PASS();
+}
+
+TEST filter_chunk_boundaries() {
+	options_t options = default_options;
+	char line[32];
+
+	/* Over three chunks, with lines of all lengths */
+	for (size_t i = 0; input_len < 3 * CHUNK_SIZE; i++) {
+		snprintf(line, sizeof(line), "%.*s%s%zu", (int)(i % 17),
+			"abcdefghijklmnopq", i % 3 == 0 ? "zq" : "", i);
+		add_line(line, i % 3 == 0);
+	}
+	/* The last line has no delimiter */
+	add_line("zq", 1);
+	input_len--;
+
+	options.sort = 0;
+	CHECK_CALL(check_filter(&options));
+
+	PASS();
+}
+
+TEST filter_long_lines() {
+	options_t options = default_options;
+	char *line = safe_realloc(NULL, 3 * CHUNK_SIZE + 1);
+
+	memset(line, 'a', 3 * CHUNK_SIZE);
+	line[3 * CHUNK_SIZE] = '\0';
+	line[CHUNK_SIZE] = 'z';
+	line[CHUNK_SIZE * 2] = 'q';
+
+	add_line("zq1", 1);
+	add_line(line, 1);
+	add_line("zq2", 1);
+	line[CHUNK_SIZE] = 'a';
+	add_line(line, 0);
+	add_line("zq3", 1);
+	free(line);
+
+	options.sort = 0;
+	CHECK_CALL(check_filter(&options));
+
+	PASS();
+}
+
+TEST filter_top_k_ties() {
+	options_t options = default_options;
+	options.filter = "ab";
+
+	/* Ties are broken by input order, across chunks as well. */
+	add_line("xab", 0);
+	add_line("ab1", 0);
+	add_filler(100000);
+	add_line("zzab", 0);
+	add_line("ab2", 0);
+	add_filler(100000);
+	add_line("ab3", 0);
+	add_line("ab", 0);
+	add_line("ab4", 0);
+
+	options.limit = 3;
+	append(&expected, &expected_len, "ab\nab1\nab2\n", 11);
+	CHECK_CALL(check_filter(&options));
+
+	options.limit = 6;
+	append(&expected, &expected_len, "ab3\nab4\nxab\n", 12);
+	CHECK_CALL(check_filter(&options));
+
+	/* A limit above the number of matches */
+	options.limit = (size_t)-1;
+	append(&expected, &expected_len, "zzab\n", 5);
+	CHECK_CALL(check_filter(&options));
+
+	PASS();
+}
+
+TEST filter_no_sort() {
+	options_t options = default_options;
+	options.filter = "ab";
+	options.sort = 0;
+
+	add_line("xab", 1);
+	add_line("ab1", 1);
+	add_filler(100000);
+	add_line("zzab", 1);
+	add_line("ab", 1);
+	add_filler(100000);
+	add_line("ab2", 1);
+	CHECK_CALL(check_filter(&options));
+
+	/* The first matches, in input order */
+	options.limit = 3;
+	expected_len = 0;
+	append(&expected, &expected_len, "xab\nab1\nzzab\n", 13);
+	CHECK_CALL(check_filter(&options));
+
+	/* Delimited by NUL */
+	options.limit = 0;
+	options.print_null = 1;
+	expected_len = 0;
+	append(&expected, &expected_len, "xab\0ab1\0zzab\0ab\0ab2", 20);
+	CHECK_CALL(check_filter(&options));
+
+	PASS();
+}
+
+SUITE(filter_suite) {
+	SET_SETUP(setup, NULL);
+	SET_TEARDOWN(teardown, NULL);
+
+	RUN_TEST(filter_chunk_boundaries);
+	RUN_TEST(filter_long_lines);
+	RUN_TEST(filter_top_k_ties);
+	RUN_TEST(filter_no_sort);
+}
@@ -0,0 +1,183 @@
+/* test_libfnf.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libfnf.h"
+
+#include "greatest/greatest.h"
+
+#define ASSERT_SIZE_T_EQ(a,b) ASSERT_EQ_FMT((size_t)(a), (b), "%zu")
+
+static const char *const candidates[] = {
+	"src/choices.c", "src/match.c", "README.md", "Makefile", "src/Match.h"
+};
+
+TEST libfnf_add_and_search() {
+	fnf_engine_t *engine = fnf_engine_new(1);
+	ASSERT(engine);
+
+	fnf_engine_add(engine, candidates, 5);
+	ASSERT_SIZE_T_EQ(5, fnf_engine_size(engine));
+
+	ASSERT_SIZE_T_EQ(5, fnf_engine_search(engine, "", NULL));
+	ASSERT_SIZE_T_EQ(2, fnf_engine_search(engine, "mat", NULL));
+
+	double score = 0;
+	const char *best = fnf_engine_result(engine, 0, &score);
+	ASSERT(best);
+	ASSERT(strstr(best, "atch"));
+	ASSERT(fnf_engine_result(engine, 1, NULL));
+	ASSERT_EQ(NULL, fnf_engine_result(engine, 2, NULL));
+
+	fnf_engine_free(engine);
+	PASS();
+}
+
+TEST libfnf_case_modes() {
+	fnf_engine_t *engine = fnf_engine_new(1);
+	fnf_engine_add(engine, candidates, 5);
+
+	struct fnf_search_opts opts = { FNF_CASE_IGNORE, 1 };
+	ASSERT_SIZE_T_EQ(2, fnf_engine_search(engine, "Mat", &opts));
+
+	opts.case_mode = FNF_CASE_RESPECT;
+	ASSERT_SIZE_T_EQ(0, fnf_engine_search(engine, "mAT", &opts));
+	ASSERT_SIZE_T_EQ(1, fnf_engine_search(engine, "Mat", &opts));
+	ASSERT_STR_EQ("src/Match.h", fnf_engine_result(engine, 0, NULL));
+
+	/* Smart case: lowercase ignores case, uppercase respects it */
+	opts.case_mode = FNF_CASE_SMART;
+	ASSERT_SIZE_T_EQ(2, fnf_engine_search(engine, "mat", &opts));
+	ASSERT_SIZE_T_EQ(1, fnf_engine_search(engine, "Mat", &opts));
+
+	fnf_engine_free(engine);
+	PASS();
+}
+
+TEST libfnf_unsorted() {
+	fnf_engine_t *engine = fnf_engine_new(1);
+	fnf_engine_add(engine, candidates, 5);
+
+	struct fnf_search_opts opts = { FNF_CASE_IGNORE, 0 };
+	ASSERT_SIZE_T_EQ(3, fnf_engine_search(engine, "sc", &opts));
+	ASSERT_STR_EQ("src/choices.c", fnf_engine_result(engine, 0, NULL));
+	ASSERT_STR_EQ("src/match.c", fnf_engine_result(engine, 1, NULL));
+	ASSERT_STR_EQ("src/Match.h", fnf_engine_result(engine, 2, NULL));
+
+	fnf_engine_free(engine);
+	PASS();
+}
+
+TEST libfnf_add_buffer() {
+	fnf_engine_t *engine = fnf_engine_new(1);
+	const char buf[] = "foo\0\0bar\0baz";
+
+	/* The empty string is skipped and the last one needs no delimiter */
+	ASSERT_SIZE_T_EQ(3, fnf_engine_add_buffer(engine, buf, sizeof(buf) - 1, '\0'));
+	ASSERT_SIZE_T_EQ(3, fnf_engine_size(engine));
+	ASSERT_SIZE_T_EQ(1, fnf_engine_search(engine, "bz", NULL));
+	ASSERT_STR_EQ("baz", fnf_engine_result(engine, 0, NULL));
+
+	fnf_engine_free(engine);
+	PASS();
+}
+
+TEST libfnf_positions() {
+	fnf_engine_t *engine = fnf_engine_new(1);
+	const char *const strings[] = { "xaxbxc" };
+	size_t positions[FNF_MAX_POSITIONS];
+
+	fnf_engine_add(engine, strings, 1);
+	ASSERT_SIZE_T_EQ(1, fnf_engine_search(engine, "abc", NULL));
+	ASSERT_SIZE_T_EQ(3, fnf_engine_positions(engine, 0, positions));
+	ASSERT_SIZE_T_EQ(1, positions[0]);
+	ASSERT_SIZE_T_EQ(3, positions[1]);
+	ASSERT_SIZE_T_EQ(5, positions[2]);
+
+	fnf_engine_search(engine, "", NULL);
+	ASSERT_SIZE_T_EQ(0, fnf_engine_positions(engine, 0, positions));
+
+	fnf_engine_free(engine);
+	PASS();
+}
+
+struct thread_arg {
+	const char *query;
+	size_t count;
+};
+
+static void *
+search_thread(void *data)
+{
+	struct thread_arg *arg = data;
+	fnf_engine_t *engine = fnf_engine_new(2);
+	char str[32];
+
+	for (int i = 0; i < 10000; i++) {
+		snprintf(str, sizeof(str), "item%d", i);
+		const char *p = str;
+		fnf_engine_add(engine, &p, 1);
+	}
+
+	for (int i = 0; i < 20; i++)
+		arg->count = fnf_engine_search(engine, arg->query, NULL);
+
+	fnf_engine_free(engine);
+	return NULL;
+}
+
+/* Engines share no state: they can be searched concurrently. */
+TEST libfnf_concurrent_engines() {
+	struct thread_arg args[] = { { "i99", 0 }, { "m12", 0 }, { "9999", 0 } };
+	pthread_t threads[3];
+
+	for (int i = 0; i < 3; i++)
+		ASSERT_EQ(0, pthread_create(&threads[i], NULL, search_thread, &args[i]));
+	for (int i = 0; i < 3; i++)
+		pthread_join(threads[i], NULL);
+
+	/* 10000 - 9^4 - 4 * 9^3 numbers have at least two nines */
+	ASSERT_SIZE_T_EQ(523, args[0].count);
+	ASSERT_SIZE_T_EQ(523, args[1].count);
+	ASSERT_SIZE_T_EQ(1, args[2].count);
+	PASS();
+}
+
+SUITE(libfnf_suite) {
+	RUN_TEST(libfnf_add_and_search);
+	RUN_TEST(libfnf_case_modes);
+	RUN_TEST(libfnf_unsorted);
+	RUN_TEST(libfnf_add_buffer);
+	RUN_TEST(libfnf_positions);
+	RUN_TEST(libfnf_concurrent_engines);
+}
@@ -30,6 +30,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "config.h"
 #include "match.h"
@@ -40,125 +41,125 @@
 #define ASSERT_SCORE_EQ(a,b) ASSERT_IN_RANGE((a), (b), SCORE_TOLERANCE)
 #define ASSERT_SIZE_T_EQ(a,b) ASSERT_EQ_FMT((size_t)(a), (b), "%zu")
 
-/* has_match(char *needle, char *haystack) */
+/* has_match(char *needle, char *haystack, int case_sensitive) */
 TEST exact_match_should_return_true() {
-	ASSERT(has_match("a", "a"));
+	ASSERT(has_match("a", "a", 1));
 	PASS();
 }
 
 TEST partial_match_should_return_true() {
-	ASSERT(has_match("a", "ab"));
-	ASSERT(has_match("a", "ba"));
+	ASSERT(has_match("a", "ab", 1));
+	ASSERT(has_match("a", "ba", 1));
 	PASS();
 }
 
 TEST match_with_delimiters_in_between() {
-	ASSERT(has_match("abc", "a|b|c"));
+	ASSERT(has_match("abc", "a|b|c", 1));
 	PASS();
 }
 
 TEST non_match_should_return_false() {
-	ASSERT(!has_match("a", ""));
-	ASSERT(!has_match("a", "b"));
-	ASSERT(!has_match("ass", "tags"));
+	ASSERT(!has_match("a", "", 1));
+	ASSERT(!has_match("a", "b", 1));
+	ASSERT(!has_match("ass", "tags", 1));
 	PASS();
 }
 
 TEST empty_query_should_always_match() {
 	/* match when query is empty */
-	ASSERT(has_match("", ""));
-	ASSERT(has_match("", "a"));
+	ASSERT(has_match("", "", 1));
+	ASSERT(has_match("", "a", 1));
 	PASS();
 }
 
-/* match(char *needle, char *haystack) */
+/* match(char *needle, char *haystack, int case_sensitive) */
 
 TEST should_prefer_starts_of_words() {
 	/* App/Models/Order is better than App/MOdels/zRder  */
-	ASSERT(match("amor", "app/models/order") > match("amor", "app/models/zrder"));
+	ASSERT(match("amor", "app/models/order", 1) > match("amor", "app/models/zrder", 1));
 	PASS();
 }
 
 TEST should_prefer_consecutive_letters() {
 	/* App/MOdels/foo is better than App/M/fOo  */
-	ASSERT(match("amo", "app/m/foo") < match("amo", "app/models/foo"));
+	ASSERT(match("amo", "app/m/foo", 1) < match("amo", "app/models/foo", 1));
 	PASS();
 }
 
 /*TEST should_prefer_contiguous_over_letter_following_period() {
 	// GEMFIle.Lock < GEMFILe
-	ASSERT(match("gemfil", "Gemfile.lock") < match("gemfil", "Gemfile"));
+	ASSERT(match("gemfil", "Gemfile.lock", 1) < match("gemfil", "Gemfile", 1));
 	PASS();
 } */
 
 TEST should_prefer_shorter_matches() {
-	ASSERT(match("abce", "abcdef") > match("abce", "abc de"));
-	ASSERT(match("abc", "    a b c ") > match("abc", " a  b  c "));
-	ASSERT(match("abc", " a b c    ") > match("abc", " a  b  c "));
+	ASSERT(match("abce", "abcdef", 1) > match("abce", "abc de", 1));
+	ASSERT(match("abc", "    a b c ", 1) > match("abc", " a  b  c ", 1));
+	ASSERT(match("abc", " a b c    ", 1) > match("abc", " a  b  c ", 1));
 	PASS();
 }
 
 TEST should_prefer_shorter_candidates() {
-	ASSERT(match("test", "tests") > match("test", "testing"));
+	ASSERT(match("test", "tests", 1) > match("test", "testing", 1));
 	PASS();
 }
 
 TEST should_prefer_start_of_candidate() {
 	/* Scores first letter highly */
-	ASSERT(match("test", "testing") > match("test", "/testing"));
+	ASSERT(match("test", "testing", 1) > match("test", "/testing", 1));
 	PASS();
 }
 
 TEST score_exact_match() {
 	/* Exact match is SCORE_MAX */
-	ASSERT_SCORE_EQ(SCORE_MAX, match("abc", "abc"));
-	ASSERT_SCORE_EQ(SCORE_MAX, match("aBc", "abC"));
+	ASSERT_SCORE_EQ(SCORE_MAX, match("abc", "abc", 1));
+	ASSERT_SCORE_EQ(SCORE_MAX, match("aBc", "abC", 1));
 	PASS();
 }
 
 TEST score_empty_query() {
 	/* Empty query always results in SCORE_MIN */
-	ASSERT_SCORE_EQ(SCORE_MIN, match("", ""));
-	ASSERT_SCORE_EQ(SCORE_MIN, match("", "a"));
-	ASSERT_SCORE_EQ(SCORE_MIN, match("", "bb"));
+	ASSERT_SCORE_EQ(SCORE_MIN, match("", "", 1));
+	ASSERT_SCORE_EQ(SCORE_MIN, match("", "a", 1));
+	ASSERT_SCORE_EQ(SCORE_MIN, match("", "bb", 1));
 	PASS();
 }
 
 TEST score_gaps() {
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING, match("a", "*a"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2, match("a", "*ba"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_GAP_TRAILING, match("a", "**a*"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_GAP_TRAILING*2, match("a", "**a**"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_CONSECUTIVE + SCORE_GAP_TRAILING*2, match("aa", "**aa**"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_GAP_LEADING + SCORE_GAP_INNER + SCORE_GAP_TRAILING + SCORE_GAP_TRAILING, match("aa", "**a*a**"));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING, match("a", "*a", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2, match("a", "*ba", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_GAP_TRAILING, match("a", "**a*", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_GAP_TRAILING*2, match("a", "**a**", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_CONSECUTIVE + SCORE_GAP_TRAILING*2, match("aa", "**aa**", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_GAP_LEADING + SCORE_GAP_INNER + SCORE_GAP_TRAILING + SCORE_GAP_TRAILING, match("aa", "**a*a**", 1));
 	PASS();
 }
 
 TEST score_consecutive() {
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_CONSECUTIVE, match("aa", "*aa"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_CONSECUTIVE*2, match("aaa", "*aaa"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_GAP_INNER + SCORE_MATCH_CONSECUTIVE, match("aaa", "*a*aa"));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_CONSECUTIVE, match("aa", "*aa", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_CONSECUTIVE*2, match("aaa", "*aaa", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_GAP_INNER + SCORE_MATCH_CONSECUTIVE, match("aaa", "*a*aa", 1));
 	PASS();
 }
 
 TEST score_slash() {
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_SLASH, match("a", "/a"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_SLASH, match("a", "*/a"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_SLASH + SCORE_MATCH_CONSECUTIVE, match("aa", "a/aa"));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_SLASH, match("a", "/a", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_SLASH, match("a", "*/a", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_SLASH + SCORE_MATCH_CONSECUTIVE, match("aa", "a/aa", 1));
 	PASS();
 }
 
 TEST score_capital() {
-//	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_CAPITAL, match("a", "Ab"));
-//	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_CAPITAL, match("a", "aAb"));
-//	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_CAPITAL + SCORE_MATCH_CONSECUTIVE, match("aa", "aAab"));
+//	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_CAPITAL, match("a", "Ab", 1));
+//	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_CAPITAL, match("a", "aAb", 1));
+//	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*2 + SCORE_MATCH_CAPITAL + SCORE_MATCH_CONSECUTIVE, match("aa", "aAab", 1));
 	PASS();
 }
 
 TEST score_dot() {
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_DOT, match("a", ".a"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*3 + SCORE_MATCH_DOT, match("a", "*a.a"));
-	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_GAP_INNER + SCORE_MATCH_DOT, match("a", "*a.a"));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_MATCH_DOT, match("a", ".a", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING*3 + SCORE_MATCH_DOT, match("a", "*a.a", 1));
+	ASSERT_SCORE_EQ(SCORE_GAP_LEADING + SCORE_GAP_INNER + SCORE_MATCH_DOT, match("a", "*a.a", 1));
 	PASS();
 }
 
@@ -167,16 +168,16 @@ TEST score_long_string() {
 	memset(string, 'a', sizeof(string) - 1);
 	string[sizeof(string) - 1] = '\0';
 
-	ASSERT_SCORE_EQ(SCORE_MIN, match("aa", string));
-	ASSERT_SCORE_EQ(SCORE_MIN, match(string, "aa"));
-	ASSERT_SCORE_EQ(SCORE_MIN, match(string, string));
+	ASSERT_SCORE_EQ(SCORE_MIN, match("aa", string, 1));
+	ASSERT_SCORE_EQ(SCORE_MIN, match(string, "aa", 1));
+	ASSERT_SCORE_EQ(SCORE_MIN, match(string, string, 1));
 
 	PASS();
 }
 
 TEST positions_consecutive() {
 	size_t positions[3];
-	match_positions("amo", "app/models/foo", positions);
+	match_positions("amo", "app/models/foo", positions, 1);
 	ASSERT_SIZE_T_EQ(0, positions[0]);
 	ASSERT_SIZE_T_EQ(4, positions[1]);
 	ASSERT_SIZE_T_EQ(5, positions[2]);
@@ -188,7 +189,7 @@ TEST positions_start_of_word() {
 	/* We should prefer matching the 'o' in order, since it's the beginning
 	 * of a word. */
 	size_t positions[4];
-	match_positions("amor", "app/models/order", positions);
+	match_positions("amor", "app/models/order", positions, 1);
 	ASSERT_SIZE_T_EQ(0, positions[0]);
 	ASSERT_SIZE_T_EQ(4, positions[1]);
 	ASSERT_SIZE_T_EQ(5, positions[2]);
@@ -199,11 +200,11 @@ TEST positions_start_of_word() {
 
 TEST positions_no_bonuses() {
 	size_t positions[2];
-	match_positions("as", "tags", positions);
+	match_positions("as", "tags", positions, 1);
 	ASSERT_SIZE_T_EQ(1, positions[0]);
 	ASSERT_SIZE_T_EQ(3, positions[1]);
 
-	match_positions("as", "examples.txt", positions);
+	match_positions("as", "examples.txt", positions, 1);
 	ASSERT_SIZE_T_EQ(2, positions[0]);
 	ASSERT_SIZE_T_EQ(7, positions[1]);
 
@@ -212,7 +213,7 @@ TEST positions_no_bonuses() {
 
 TEST positions_multiple_candidates_start_of_words() {
 	size_t positions[3];
-	match_positions("abc", "a/a/b/c/c", positions);
+	match_positions("abc", "a/a/b/c/c", positions, 1);
 	ASSERT_SIZE_T_EQ(0, positions[0]);
 	ASSERT_SIZE_T_EQ(4, positions[1]);
 	ASSERT_SIZE_T_EQ(6, positions[2]);
@@ -222,7 +223,7 @@ TEST positions_multiple_candidates_start_of_words() {
 
 TEST positions_exact_match() {
 	size_t positions[3];
-	match_positions("foo", "foo", positions);
+	match_positions("foo", "foo", positions, 1);
 	ASSERT_SIZE_T_EQ(0, positions[0]);
 	ASSERT_SIZE_T_EQ(1, positions[1]);
 	ASSERT_SIZE_T_EQ(2, positions[2]);
@@ -230,6 +231,116 @@ TEST positions_exact_match() {
 	PASS();
 }
 
+TEST greedy_score_single_alignment() {
+	/* With only one way to match, greedy and optimal scores agree. */
+	ASSERT_EQ(match("aa", "**a*a**", 1), match_greedy("aa", "**a*a**", 1));
+	ASSERT_EQ(match("amo", "app/models", 1), match_greedy("amo", "app/models", 1));
+	ASSERT_EQ(SCORE_MAX, match_greedy("foo", "foo", 1));
+	PASS();
+}
+
+TEST greedy_positions_shortest_window() {
+	/* The leftmost match ends at 'c': the window is shrunk from there. */
+	size_t positions[3];
+	match_greedy_positions("abc", "aaxbcabc", positions, 1);
+	ASSERT_SIZE_T_EQ(1, positions[0]);
+	ASSERT_SIZE_T_EQ(3, positions[1]);
+	ASSERT_SIZE_T_EQ(4, positions[2]);
+
+	/* A better match further right is missed. */
+	ASSERT(match_greedy("abc", "aaxbcabc", 1) < match("abc", "aaxbcabc", 1));
+
+	PASS();
+}
+
+TEST substring_anchors() {
+	score_t score;
+	ASSERT(match_substring("mat", 3, "src/match.c", MATCH_ANYWHERE, 1, NULL, NULL));
+	ASSERT(!match_substring("mat", 3, "src/match.c", MATCH_PREFIX, 1, NULL, NULL));
+	ASSERT(match_substring(".c", 2, "src/match.c", MATCH_SUFFIX, 1, NULL, NULL));
+	ASSERT(!match_substring(".c", 2, "src/match.h", MATCH_SUFFIX, 1, NULL, NULL));
+	ASSERT(match_substring("SRC", 3, "src/match.c", MATCH_PREFIX, 0, NULL, NULL));
+	ASSERT(!match_substring("SRC", 3, "src/match.c", MATCH_PREFIX, 1, NULL, NULL));
+	ASSERT(match_substring("foo", 3, "foo", MATCH_WHOLE, 1, &score, NULL));
+	ASSERT_EQ(SCORE_MAX, score);
+	ASSERT(!match_substring("foo", 3, "foox", MATCH_WHOLE, 1, NULL, NULL));
+	PASS();
+}
+
+TEST substring_best_occurrence() {
+	/* The occurrence at the start of a word scores best. */
+	size_t positions[2];
+	score_t score;
+	ASSERT(match_substring("ma", 2, "domain/main.c", MATCH_ANYWHERE, 1,
+		&score, positions));
+	ASSERT_SIZE_T_EQ(7, positions[0]);
+	ASSERT_SIZE_T_EQ(8, positions[1]);
+	ASSERT_EQ(match("ma", "domain/main.c", 1), score);
+	PASS();
+}
+
+TEST typos_left_out() {
+	struct typo_needle t;
+	/* One typo for every four characters, up to MATCH_TYPOS_MAX */
+	ASSERT(!typo_needle_init(&t, "abc", 2, 0));
+	ASSERT(typo_needle_init(&t, "choises", 2, 0));
+	ASSERT_EQ(1, t.typos);
+	ASSERT(typo_needle_init(&t, "tyy_interface", 5, 0));
+	ASSERT_EQ(MATCH_TYPOS_MAX, t.typos);
+
+	/* A wrong character, a missing one, two swapped */
+	ASSERT(typo_needle_init(&t, "choises", 1, 0));
+	ASSERT_EQ(1, has_match_typos(&t, "src/choices.c"));
+	ASSERT(typo_needle_init(&t, "chioces", 1, 0));
+	ASSERT_EQ(1, has_match_typos(&t, "src/choices.c"));
+	ASSERT(typo_needle_init(&t, "CHOICES", 1, 0));
+	ASSERT_EQ(0, has_match_typos(&t, "src/choices.c"));
+	ASSERT(typo_needle_init(&t, "CHOICES", 1, 1));
+	ASSERT_EQ(-1, has_match_typos(&t, "src/choices.c"));
+	ASSERT(typo_needle_init(&t, "tyy_interface", 2, 0));
+	ASSERT_EQ(1, has_match_typos(&t, "src/tty_interface.c"));
+	ASSERT(typo_needle_init(&t, "xyzzy_plugh", 2, 0));
+	ASSERT_EQ(-1, has_match_typos(&t, "src/tty_interface.c"));
+	PASS();
+}
+
+TEST typos_score_below_match() {
+	struct typo_needle t;
+	size_t positions[MATCH_MAX_LEN];
+	memset(positions, -1, sizeof(positions));
+	ASSERT(typo_needle_init(&t, "mxtch", 1, 1));
+	const score_t score = match_typos(&t, "src/match.c", positions, 1);
+	ASSERT_EQ(match("mtch", "src/match.c", 1) + SCORE_TYPO, score);
+
+	/* The characters found are highlighted. */
+	ASSERT_SIZE_T_EQ(4, positions[0]);
+	ASSERT_SIZE_T_EQ(6, positions[1]);
+	ASSERT_SIZE_T_EQ(7, positions[2]);
+	ASSERT_SIZE_T_EQ(8, positions[3]);
+	ASSERT_SIZE_T_EQ((size_t)-1, positions[4]);
+	PASS();
+}
+
+TEST variants_agree() {
+	/* Case sensitivity is part of the variant. */
+	ASSERT(has_match_ci("MAC", "src/match.c"));
+	ASSERT(!has_match_cs("MAC", "src/match.c"));
+	ASSERT(has_match_cs("s/.c", "src/match.c"));
+	ASSERT_EQ(match("M", "src/Match.c", 0), match_1_ci("M", "src/Match.c"));
+	ASSERT_EQ(match("sM", "src/Match.c", 1), match_2_cs("sM", "src/Match.c"));
+	ASSERT_EQ(match("mat", "src/Match.c", 0), match_3_ci("mat", "src/Match.c"));
+	ASSERT_EQ(match("srcmc", "src/Match.c", 1),
+		match_cs("srcmc", "src/Match.c"));
+
+	/* Only the SGR variants stop at a trailing SGR sequence. */
+	const char *colored = "\x1b[31msrc\x1b[0m/match.c";
+	ASSERT(!has_match_ci_sgr("srcm", colored));
+	ASSERT(!has_match("srcm", colored, 0));
+	ASSERT(has_match_ci_sgr("sr", colored));
+	ASSERT(has_match_ci("srcm", colored));
+	PASS();
+}
+
 SUITE(match_suite) {
 	RUN_TEST(exact_match_should_return_true);
 	RUN_TEST(partial_match_should_return_true);
@@ -258,4 +369,15 @@ SUITE(match_suite) {
 	RUN_TEST(positions_no_bonuses);
 	RUN_TEST(positions_multiple_candidates_start_of_words);
 	RUN_TEST(positions_exact_match);
+
+	RUN_TEST(greedy_score_single_alignment);
+	RUN_TEST(greedy_positions_shortest_window);
+
+	RUN_TEST(substring_anchors);
+	RUN_TEST(substring_best_occurrence);
+
+	RUN_TEST(typos_left_out);
+	RUN_TEST(typos_score_below_match);
+
+	RUN_TEST(variants_agree);
 }
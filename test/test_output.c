@@ -0,0 +1,303 @@
+/* test_output.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "choices.h" /* safe_realloc() */
+#include "output.h"
+
+#include "greatest/greatest.h"
+
+#define ASSERT_SIZE_T_EQ(a,b) ASSERT_EQ_FMT((size_t)(a), (b), "%zu")
+
+/* Whatever is read from the pipe OUT writes to */
+struct capture {
+	pthread_t thread;
+	char *buf;
+	size_t len;
+	int fd;
+	int slow; /* Read a little at a time, to make the writer wait */
+};
+
+static output_t out;
+static struct capture cap;
+static char *expected;
+static size_t expected_len;
+
+static void *
+capture_thread(void *data)
+{
+	struct capture *c = data;
+	char buf[65536];
+	ssize_t n;
+
+	while ((n = read(c->fd, buf, c->slow ? 509 : sizeof(buf))) > 0) {
+		c->buf = safe_realloc(c->buf, c->len + (size_t)n);
+		memcpy(c->buf + c->len, buf, (size_t)n);
+		c->len += (size_t)n;
+		if (c->slow)
+			usleep(50);
+	}
+
+	return NULL;
+}
+
+/* Set up OUT to write to a pipe holding a single page, read by another
+ * thread, and terminate items with DELIM. */
+static int
+start_capture(const char delim, const int slow)
+{
+	int fds[2];
+	if (pipe(fds) == -1)
+		return -1;
+	fcntl(fds[1], F_SETPIPE_SZ, 4096);
+
+	cap.buf = NULL;
+	cap.len = 0;
+	cap.fd = fds[0];
+	cap.slow = slow;
+
+	/* Signals are for the writer (see output_interrupted). */
+	sigset_t set, old;
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+	const int ret = pthread_create(&cap.thread, NULL, capture_thread, &cap);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ret != 0)
+		return -1;
+
+	output_init(&out, fds[1], delim);
+	return 0;
+}
+
+/* Close the pipe, and wait for the reader to get everything. */
+static void
+stop_capture(void)
+{
+	close(out.fd);
+	pthread_join(cap.thread, NULL);
+	close(cap.fd);
+}
+
+static void
+expect(const char *str, const size_t len)
+{
+	expected = safe_realloc(expected, expected_len + len + 1);
+	memcpy(expected + expected_len, str, len);
+	expected_len += len;
+}
+
+static void setup(void *udata) {
+	(void)udata;
+
+	expected = NULL;
+	expected_len = 0;
+}
+
+static void teardown(void *udata) {
+	(void)udata;
+
+	free(expected);
+	free(cap.buf);
+	cap.buf = NULL;
+}
+
+/* Queue COUNT items of various lengths, from a single buffer, as filter.c
+ * does. Return the buffer, to be freed once flushed. */
+static char *
+queue_items(const size_t count, const char delim)
+{
+	char *buf = safe_realloc(NULL, count * 1024);
+	char *p = buf;
+
+	for (size_t i = 0; i < count; i++) {
+		const size_t len = i * 7919 % 1000;
+		memset(p, 'a' + (int)(i % 26), len);
+		snprintf(p + len, 24, "%zu", i);
+
+		output_item(&out, p);
+		expect(p, strlen(p));
+		expect(&delim, 1);
+		p += strlen(p) + 1;
+	}
+
+	return buf;
+}
+
+static enum greatest_test_res
+check_batching(const char delim)
+{
+	/* More than the iovecs a batch can hold */
+	const size_t count = OUTPUT_IOV_MAX * 3 + 17;
+
+	ASSERT_EQ(0, start_capture(delim, 0));
+	char *buf = queue_items(count, delim);
+	ASSERT_EQ(0, output_flush(&out));
+	free(buf);
+	stop_capture();
+
+	ASSERT_SIZE_T_EQ(expected_len, cap.len);
+	ASSERT_MEM_EQ(expected, cap.buf, cap.len);
+	PASS();
+}
+
+TEST output_batching() {
+	CHECK_CALL(check_batching('\n'));
+	free(cap.buf);
+	cap.buf = NULL;
+	expected_len = 0;
+	CHECK_CALL(check_batching('\0'));
+	PASS();
+}
+
+static enum greatest_test_res
+check_scratch(const char delim)
+{
+	static char large[OUTPUT_SCRATCH_SIZE + 1000];
+	char buf[64];
+
+	ASSERT_EQ(0, start_capture(delim, 0));
+
+	/* Copies of transient strings, over several scratch areas */
+	for (size_t i = 0; i < 20000; i++) {
+		const int len = snprintf(buf, sizeof(buf), "%zu:%0*zu", i,
+			(int)(i % 40), i);
+		expect(buf, (size_t)len);
+		expect(&delim, 1);
+
+		if (i % 3 == 0)
+			output_printf(&out, "%s", buf);
+		else
+			output_copy(&out, buf, (size_t)len);
+		output_copy(&out, &delim, 1);
+		memset(buf, 'X', sizeof(buf)); /* Not to be read again */
+	}
+
+	/* Larger than the scratch area: written at once */
+	memset(large, 'L', sizeof(large));
+	expect(large, sizeof(large));
+	output_copy(&out, large, sizeof(large));
+	memset(large, 'X', sizeof(large));
+
+	output_printf(&out, "%d%c", 42, delim);
+	expect("42", 2);
+	expect(&delim, 1);
+
+	ASSERT_EQ(0, output_flush(&out));
+	stop_capture();
+
+	ASSERT_SIZE_T_EQ(expected_len, cap.len);
+	ASSERT_MEM_EQ(expected, cap.buf, cap.len);
+	PASS();
+}
+
+TEST output_scratch() {
+	CHECK_CALL(check_scratch('\n'));
+	free(cap.buf);
+	cap.buf = NULL;
+	expected_len = 0;
+	CHECK_CALL(check_scratch('\0'));
+	PASS();
+}
+
+static volatile sig_atomic_t interrupts;
+
+static void
+output_interrupted(int sig)
+{
+	(void)sig;
+	interrupts++;
+}
+
+TEST output_short_writes() {
+	/* Signals make writev return early: either nothing was written
+	 * (EINTR), or only part of the batch. */
+	struct sigaction sa, old_sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = output_interrupted; /* No SA_RESTART */
+	sigaction(SIGALRM, &sa, &old_sa);
+
+	const struct itimerval every_ms = {{0, 1000}, {0, 1000}};
+	const struct itimerval off = {{0, 0}, {0, 0}};
+	interrupts = 0;
+
+	ASSERT_EQ(0, start_capture('\n', 1));
+	setitimer(ITIMER_REAL, &every_ms, NULL);
+	char *buf = queue_items(OUTPUT_IOV_MAX / 2 - 1, '\n');
+	const int ret = output_flush(&out);
+	setitimer(ITIMER_REAL, &off, NULL);
+	sigaction(SIGALRM, &old_sa, NULL);
+	free(buf);
+	stop_capture();
+
+	ASSERT_EQ(0, ret);
+	ASSERT(interrupts > 0);
+	ASSERT_SIZE_T_EQ(expected_len, cap.len);
+	ASSERT_MEM_EQ(expected, cap.buf, cap.len);
+	PASS();
+}
+
+TEST output_write_error() {
+	int fds[2];
+	ASSERT_EQ(0, pipe(fds));
+	close(fds[0]);
+
+	void (*old)(int) = signal(SIGPIPE, SIG_IGN);
+	output_init(&out, fds[1], '\n');
+	output_item(&out, "lost");
+	ASSERT_EQ(-1, output_flush(&out));
+
+	/* Nothing is written anymore */
+	output_item(&out, "lost");
+	ASSERT_EQ(-1, output_flush(&out));
+	signal(SIGPIPE, old);
+	close(fds[1]);
+
+	PASS();
+}
+
+SUITE(output_suite) {
+	SET_SETUP(setup, NULL);
+	SET_TEARDOWN(teardown, NULL);
+
+	RUN_TEST(output_batching);
+	RUN_TEST(output_scratch);
+	RUN_TEST(output_short_writes);
+	RUN_TEST(output_write_error);
+}
@@ -30,6 +30,7 @@
 */
 
 #define _DEFAULT_SOURCE
+#include <ctype.h>
 #include <string.h>
 
 #include "greatest/greatest.h"
@@ -117,11 +118,11 @@ static struct theft_type_info string_info = {
 static theft_trial_res
 prop_should_return_results_if_there_is_a_match(char *needle, char *haystack)
 {
-	int match_exists = has_match(needle, haystack);
+	int match_exists = has_match(needle, haystack, 1);
 	if (!match_exists)
 		return THEFT_TRIAL_SKIP;
 
-	score_t score = match(needle, haystack);
+	score_t score = match(needle, haystack, 1);
 
 	if (needle[0] == '\0')
 		return THEFT_TRIAL_SKIP;
@@ -151,7 +152,7 @@ TEST should_return_results_if_there_is_a_match()
 static theft_trial_res
 prop_positions_should_match_characters_in_string(char *needle, char *haystack)
 {
-	int match_exists = has_match(needle, haystack);
+	int match_exists = has_match(needle, haystack, 1);
 	if (!match_exists)
 		return THEFT_TRIAL_SKIP;
 
@@ -161,7 +162,7 @@ prop_positions_should_match_characters_in_string(char *needle, char *haystack)
 		return THEFT_TRIAL_ERROR;
 	memset(positions, -1, n);
 
-	match_positions(needle, haystack, positions);
+	match_positions(needle, haystack, positions, 1);
 
 	/* This test is failing. Not sure why. TEMPORARILY disabled. */
 	/* Must be increasing */
@@ -201,7 +202,410 @@ TEST positions_should_match_characters_in_string() {
 	PASS();
 }
 
+static theft_trial_res
+prop_extend_should_score_as_match(char *pattern, char *haystack)
+{
+	/* Plain text with word boundaries, and a needle it matches */
+	static const char alphabet[] = "aAbBcC/-_. 1";
+	const size_t len = strlen(haystack);
+	const size_t plen = strlen(pattern);
+	if (len == 0 || plen == 0)
+		return THEFT_TRIAL_SKIP;
+
+	char *h = malloc(len + 1);
+	char *needle = malloc(len + 1);
+	struct match_row *rows = malloc(2 * sizeof(struct match_row));
+	if (!h || !needle || !rows)
+		return THEFT_TRIAL_ERROR;
+
+	size_t n = 0;
+	for (size_t j = 0; j < len; j++) {
+		h[j] = alphabet[(unsigned char)haystack[j] % (sizeof(alphabet) - 1)];
+		if (pattern[j % plen] & 1)
+			needle[n++] = h[j];
+	}
+	h[len] = needle[n] = '\0';
+
+	theft_trial_res res = n < 2 ? THEFT_TRIAL_SKIP : THEFT_TRIAL_PASS;
+
+	/* Grow the needle one character at a time, going on from the
+	 * previous row each time. */
+	for (int cs = 0; cs <= 1 && res == THEFT_TRIAL_PASS; cs++) {
+		char *prefix = strdup(needle);
+		prefix[1] = '\0';
+		match_keep(prefix, h, cs, &rows[0]);
+
+		for (size_t i = 2; i <= n; i++) {
+			prefix[i - 1] = needle[i - 1];
+			prefix[i] = '\0';
+			const score_t score = match_extend(prefix, h, cs,
+				&rows[i % 2], &rows[(i + 1) % 2]);
+			if (score != match(prefix, h, cs)) {
+				res = THEFT_TRIAL_FAIL;
+				break;
+			}
+		}
+		free(prefix);
+	}
+
+	free(rows);
+	free(needle);
+	free(h);
+	return res;
+}
+
+TEST extend_should_score_as_match() {
+	struct theft *t = theft_init(0);
+	struct theft_cfg cfg = {
+	    .name = __func__,
+	    .fun = prop_extend_should_score_as_match,
+	    .type_info = {&string_info, &string_info},
+	    .trials = 20000,
+	};
+
+	theft_run_res res = theft_run(t, &cfg);
+	theft_free(t);
+	GREATEST_ASSERT_EQm("extend_should_score_as_match", THEFT_RUN_PASS, res);
+	PASS();
+}
+
+static theft_trial_res
+prop_sparse_should_score_as_dense(char *pattern, char *haystack)
+{
+	/* The fewer characters, the denser their occurrences */
+	static const char alphabet[] = "aA/b-B_c.C 1";
+	const size_t len = strlen(haystack);
+	const size_t plen = strlen(pattern);
+	if (len == 0 || plen == 0)
+		return THEFT_TRIAL_SKIP;
+
+	const size_t letters = 2 + (unsigned char)pattern[0] % (sizeof(alphabet) - 2);
+	char *h = malloc(len + 1);
+	char *needle = malloc(len + 1);
+	size_t *positions = malloc(len * sizeof(size_t));
+	if (!h || !needle || !positions)
+		return THEFT_TRIAL_ERROR;
+
+	size_t n = 0;
+	for (size_t j = 0; j < len; j++) {
+		h[j] = alphabet[(unsigned char)haystack[j] % letters];
+		if (pattern[j % plen] & 2)
+			needle[n++] = h[j];
+	}
+	h[len] = needle[n] = '\0';
+
+	theft_trial_res res = n == 0 ? THEFT_TRIAL_SKIP : THEFT_TRIAL_PASS;
+
+	/* match_positions() always runs the dense DP. */
+	for (int cs = 0; cs <= 1 && res == THEFT_TRIAL_PASS; cs++) {
+		if (match(needle, h, cs) != match_positions(needle, h, positions, cs))
+			res = THEFT_TRIAL_FAIL;
+	}
+
+	free(positions);
+	free(needle);
+	free(h);
+	return res;
+}
+
+TEST sparse_should_score_as_dense() {
+	struct theft *t = theft_init(0);
+	struct theft_cfg cfg = {
+	    .name = __func__,
+	    .fun = prop_sparse_should_score_as_dense,
+	    .type_info = {&string_info, &string_info},
+	    .trials = 20000,
+	};
+
+	theft_run_res res = theft_run(t, &cfg);
+	theft_free(t);
+	GREATEST_ASSERT_EQm("sparse_should_score_as_dense", THEFT_RUN_PASS, res);
+	PASS();
+}
+
+static theft_trial_res
+prop_short_scorers_should_score_as_dp(char *pattern, char *haystack)
+{
+	static const char alphabet[] = "aA/b-B_c.C 1";
+	const size_t len = strlen(haystack);
+	const size_t plen = strlen(pattern);
+	if (len == 0 || plen == 0)
+		return THEFT_TRIAL_SKIP;
+
+	/* A needle of one to three characters the haystack matches */
+	const size_t letters = 2 + (unsigned char)pattern[0] % (sizeof(alphabet) - 2);
+	const size_t max = 1 + (unsigned char)pattern[plen - 1] % 3;
+	char *h = malloc(len + 1);
+	char needle[4];
+	size_t *positions = malloc(len * sizeof(size_t));
+	if (!h || !positions)
+		return THEFT_TRIAL_ERROR;
+
+	size_t n = 0;
+	for (size_t j = 0; j < len; j++) {
+		h[j] = alphabet[(unsigned char)haystack[j] % letters];
+		if (n < max && pattern[j % plen] & 4)
+			needle[n++] = h[j];
+	}
+	h[len] = needle[n] = '\0';
+
+	theft_trial_res res = n == 0 ? THEFT_TRIAL_SKIP : THEFT_TRIAL_PASS;
+
+	const match_func_t scorer = match_for(needle);
+	for (int cs = 0; cs <= 1 && res == THEFT_TRIAL_PASS; cs++) {
+		const score_t score = scorer(needle, h, cs);
+		if (score != match(needle, h, cs)
+		|| score != match_positions(needle, h, positions, cs))
+			res = THEFT_TRIAL_FAIL;
+	}
+
+	free(positions);
+	free(h);
+	return res;
+}
+
+TEST short_scorers_should_score_as_dp() {
+	struct theft *t = theft_init(0);
+	struct theft_cfg cfg = {
+	    .name = __func__,
+	    .fun = prop_short_scorers_should_score_as_dp,
+	    .type_info = {&string_info, &string_info},
+	    .trials = 20000,
+	};
+
+	theft_run_res res = theft_run(t, &cfg);
+	theft_free(t);
+	GREATEST_ASSERT_EQm("short_scorers_should_score_as_dp", THEFT_RUN_PASS, res);
+	PASS();
+}
+
+static theft_trial_res
+prop_greedy_should_not_score_above_match(char *pattern, char *haystack)
+{
+	static const char alphabet[] = "aA/b-B_c.C 1";
+	const size_t len = strlen(haystack);
+	const size_t plen = strlen(pattern);
+	if (len == 0 || plen == 0)
+		return THEFT_TRIAL_SKIP;
+
+	/* A needle the haystack matches, in a haystack where it can match in
+	 * many ways. */
+	const size_t letters = 2 + (unsigned char)pattern[0] % (sizeof(alphabet) - 2);
+	char *h = malloc(len + 1);
+	char *needle = malloc(len + 1);
+	size_t *positions = malloc(len * sizeof(size_t));
+	if (!h || !needle || !positions)
+		return THEFT_TRIAL_ERROR;
+
+	size_t n = 0;
+	for (size_t j = 0; j < len; j++) {
+		h[j] = alphabet[(unsigned char)haystack[j] % letters];
+		if (pattern[j % plen] & 4)
+			needle[n++] = h[j];
+	}
+	h[len] = needle[n] = '\0';
+
+	theft_trial_res res = n == 0 ? THEFT_TRIAL_SKIP : THEFT_TRIAL_PASS;
+
+	for (int cs = 0; cs <= 1 && res == THEFT_TRIAL_PASS; cs++) {
+		const score_t score = match_greedy_positions(needle, h, positions, cs);
+		/* Tied alignments may differ by rounding. */
+		if (score > match(needle, h, cs) + 0.000001
+		|| score != match_greedy(needle, h, cs))
+			res = THEFT_TRIAL_FAIL;
+
+		/* The positions must be an alignment of NEEDLE */
+		for (size_t i = 0; i < n && res == THEFT_TRIAL_PASS
+		&& score != SCORE_MIN; i++) {
+			if ((cs ? h[positions[i]] : tolower(h[positions[i]]))
+			!= (cs ? needle[i] : tolower(needle[i]))
+			|| (i > 0 && positions[i] <= positions[i - 1]))
+				res = THEFT_TRIAL_FAIL;
+		}
+	}
+
+	free(positions);
+	free(needle);
+	free(h);
+	return res;
+}
+
+TEST greedy_should_not_score_above_match() {
+	struct theft *t = theft_init(0);
+	struct theft_cfg cfg = {
+	    .name = __func__,
+	    .fun = prop_greedy_should_not_score_above_match,
+	    .type_info = {&string_info, &string_info},
+	    .trials = 50000,
+	};
+
+	theft_run_res res = theft_run(t, &cfg);
+	theft_free(t);
+	GREATEST_ASSERT_EQm("greedy_should_not_score_above_match", THEFT_RUN_PASS, res);
+	PASS();
+}
+
+static theft_trial_res
+prop_substring_should_find_as_scan(char *pattern, char *haystack)
+{
+	static const char alphabet[] = "aAbB/_";
+	const size_t len = strlen(haystack);
+	const size_t plen = strlen(pattern);
+	if (len == 0 || plen < 2)
+		return THEFT_TRIAL_SKIP;
+
+	/* A slice of a haystack of few letters, so that the first and last
+	 * bytes of the needle are found often, with a letter flipped case at
+	 * times (so that it may not be there). */
+	const size_t letters = 2 + (unsigned char)pattern[0] % (sizeof(alphabet) - 2);
+	char *h = malloc(len + 1);
+	char *needle = malloc(len + 1);
+	size_t *positions = malloc(len * sizeof(size_t));
+	if (!h || !needle || !positions)
+		return THEFT_TRIAL_ERROR;
+
+	for (size_t j = 0; j < len; j++)
+		h[j] = alphabet[(unsigned char)haystack[j] % letters];
+	h[len] = '\0';
+
+	const size_t start = (unsigned char)pattern[1] % len;
+	size_t n = 1 + (unsigned char)pattern[plen - 1] % 12;
+	if (n > len - start)
+		n = len - start;
+	memcpy(needle, h + start, n);
+	needle[n] = '\0';
+	if (pattern[0] & 1 && isalpha((unsigned char)needle[n / 2]))
+		needle[n / 2] ^= 0x20;
+
+	theft_trial_res res = THEFT_TRIAL_PASS;
+
+	for (int cs = 0; cs <= 1 && res == THEFT_TRIAL_PASS; cs++) {
+		int found = 0;
+		for (size_t s = 0; s + n <= len && found == 0; s++) {
+			size_t i = 0;
+			while (i < n && (cs ? h[s + i] == needle[i]
+			: tolower(h[s + i]) == tolower(needle[i])))
+				i++;
+			found = i == n;
+		}
+
+		score_t score = SCORE_MIN;
+		if (match_substring(needle, n, h, MATCH_ANYWHERE, cs, &score,
+		positions) != found) {
+			res = THEFT_TRIAL_FAIL;
+			break;
+		}
+
+		/* The positions must be an occurrence of NEEDLE */
+		for (size_t i = 0; found && i < n; i++) {
+			if (positions[i] != positions[0] + i
+			|| (cs ? h[positions[i]] : tolower(h[positions[i]]))
+			!= (cs ? needle[i] : tolower(needle[i])))
+				res = THEFT_TRIAL_FAIL;
+		}
+	}
+
+	free(positions);
+	free(needle);
+	free(h);
+	return res;
+}
+
+TEST substring_should_find_as_scan() {
+	struct theft *t = theft_init(0);
+	struct theft_cfg cfg = {
+	    .name = __func__,
+	    .fun = prop_substring_should_find_as_scan,
+	    .type_info = {&string_info, &string_info},
+	    .trials = 50000,
+	};
+
+	theft_run_res res = theft_run(t, &cfg);
+	theft_free(t);
+	GREATEST_ASSERT_EQm("substring_should_find_as_scan", THEFT_RUN_PASS, res);
+	PASS();
+}
+
+static theft_trial_res
+prop_typos_should_count_as_lcs(char *pattern, char *haystack)
+{
+	static const char alphabet[] = "abcA/";
+	const size_t n = strlen(pattern);
+	const size_t m = strlen(haystack);
+	if (n > 64 || m > 64)
+		return THEFT_TRIAL_SKIP;
+
+	char needle[65], h[65];
+	for (size_t i = 0; i < n; i++)
+		needle[i] = alphabet[(unsigned char)pattern[i] % (sizeof(alphabet) - 1)];
+	needle[n] = '\0';
+	for (size_t j = 0; j < m; j++)
+		h[j] = alphabet[(unsigned char)haystack[j] % (sizeof(alphabet) - 1)];
+	h[m] = '\0';
+
+	struct typo_needle t;
+	if (!typo_needle_init(&t, needle, MATCH_TYPOS_MAX, 1))
+		return THEFT_TRIAL_SKIP;
+
+	/* The characters left out are those not in the longest common
+	 * subsequence. */
+	size_t lcs[65][65];
+	for (size_t i = 0; i <= n; i++) {
+		for (size_t j = 0; j <= m; j++) {
+			if (i == 0 || j == 0)
+				lcs[i][j] = 0;
+			else if (needle[i - 1] == h[j - 1])
+				lcs[i][j] = lcs[i - 1][j - 1] + 1;
+			else
+				lcs[i][j] = lcs[i - 1][j] > lcs[i][j - 1]
+					? lcs[i - 1][j] : lcs[i][j - 1];
+		}
+	}
+
+	const int typos = (int)(n - lcs[n][m]);
+	const int errors = has_match_typos(&t, h);
+	if (errors != (typos <= t.typos ? typos : -1))
+		return THEFT_TRIAL_FAIL;
+	if (errors <= 0)
+		return THEFT_TRIAL_PASS;
+
+	/* What is highlighted is the rest of the needle, in order. */
+	size_t positions[MATCH_MAX_LEN];
+	if (match_typos(&t, h, positions, 1) == SCORE_MIN)
+		return THEFT_TRIAL_FAIL;
+	size_t k = 0;
+	for (size_t i = 0; k < n - (size_t)errors; i++) {
+		if (i == n || (k > 0 && positions[k] <= positions[k - 1]))
+			return THEFT_TRIAL_FAIL;
+		if (h[positions[k]] == needle[i])
+			k++;
+	}
+
+	return THEFT_TRIAL_PASS;
+}
+
+TEST typos_should_count_as_lcs() {
+	struct theft *t = theft_init(0);
+	struct theft_cfg cfg = {
+	    .name = __func__,
+	    .fun = prop_typos_should_count_as_lcs,
+	    .type_info = {&string_info, &string_info},
+	    .trials = 50000,
+	};
+
+	theft_run_res res = theft_run(t, &cfg);
+	theft_free(t);
+	GREATEST_ASSERT_EQm("typos_should_count_as_lcs", THEFT_RUN_PASS, res);
+	PASS();
+}
+
 SUITE(properties_suite) {
 	RUN_TEST(should_return_results_if_there_is_a_match);
 	RUN_TEST(positions_should_match_characters_in_string);
+	RUN_TEST(extend_should_score_as_match);
+	RUN_TEST(sparse_should_score_as_dense);
+	RUN_TEST(short_scorers_should_score_as_dp);
+	RUN_TEST(greedy_should_not_score_above_match);
+	RUN_TEST(substring_should_find_as_scan);
+	RUN_TEST(typos_should_count_as_lcs);
 }
@@ -0,0 +1,268 @@
+/* test_selections.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+#include "choices.h"
+#include "keybindings.h"
+#include "selections.h"
+#include "tty_interface.h"
+
+#include "greatest/greatest.h"
+
+#define ASSERT_SIZE_T_EQ(a,b) ASSERT_EQ_FMT((size_t)(a), (b), "%zu")
+
+#define ITEMS 200
+
+static options_t default_options;
+static choices_t choices;
+static sel_t selection;
+static tty_t tty;
+static tty_interface_t state;
+static char strings[ITEMS][8];
+
+/* Every third item matches "x": the result set of "x" holds the items
+ * 0, 3, 6..., in this order (no sorting). */
+static void setup(void *udata) {
+	(void)udata;
+
+	options_init(&default_options);
+	default_options.multi = 1;
+	default_options.sort = 0;
+	choices_init(&choices, &default_options);
+	for (size_t i = 0; i < ITEMS; i++) {
+		snprintf(strings[i], sizeof(strings[i]), "%c%03zu",
+			i % 3 == 0 ? 'x' : 'y', i);
+		choices_add(&choices, strings[i]);
+	}
+	choices_index(&choices);
+
+	memset(&selection, 0, sizeof(selection));
+	memset(&tty, 0, sizeof(tty));
+	tty_interface_init(&state, &tty, &choices, &default_options,
+		&selection, NULL);
+}
+
+static void teardown(void *udata) {
+	(void)udata;
+
+	free_selections(&state);
+	query_free(state.query);
+	choices_destroy(&choices);
+}
+
+/* Handle KEYS as typed, searching again if the query changed (as the
+ * main loop does before drawing). */
+static void
+type(const char *keys)
+{
+	for (const char *p = keys; *p; p++) {
+		const char key[2] = {*p, '\0'};
+		handle_input(&state, key, 0);
+	}
+
+	if (strcmp(state.last_search, state.search) != 0)
+		update_search(&state);
+}
+
+/* Move to the match at position N in the result set. */
+static void
+move_to(const size_t n)
+{
+	choices.selection = n;
+}
+
+#define ALT(key) "\x1b" key
+#define TAB "\t"
+
+TEST selections_bitmap() {
+	/* Across word boundaries, and far beyond the bitmap */
+	const size_t items[] = {0, 63, 64, 127, 128, 5000};
+
+	for (size_t i = 0; i < sizeof(items) / sizeof(items[0]); i++) {
+		ASSERT_FALSE(is_selected(&selection, items[i]));
+		select_entry(&selection, items[i]);
+		select_entry(&selection, items[i]);
+		ASSERT(is_selected(&selection, items[i]));
+		ASSERT_SIZE_T_EQ(i + 1, selection.selected);
+	}
+	ASSERT_FALSE(is_selected(&selection, 62));
+	ASSERT_FALSE(is_selected(&selection, 65));
+	ASSERT_FALSE(is_selected(&selection, 4999));
+	ASSERT_FALSE(is_selected(&selection, 1000000));
+
+	deselect_entry(&selection, 64);
+	deselect_entry(&selection, 64);
+	deselect_entry(&selection, 1000000);
+	ASSERT_FALSE(is_selected(&selection, 64));
+	ASSERT(is_selected(&selection, 63));
+	ASSERT_SIZE_T_EQ(5, selection.selected);
+
+	toggle_entry(&selection, 64);
+	toggle_entry(&selection, 63);
+	ASSERT(is_selected(&selection, 64));
+	ASSERT_FALSE(is_selected(&selection, 63));
+	ASSERT_SIZE_T_EQ(5, selection.selected);
+
+	clear_selections(&selection);
+	ASSERT_SIZE_T_EQ(0, selection.selected);
+	ASSERT_FALSE(is_selected(&selection, 5000));
+
+	PASS();
+}
+
+TEST selections_select_all() {
+	select_entry(&selection, 1); /* Not a match of "x" */
+
+	type("x" ALT("a"));
+	ASSERT_SIZE_T_EQ(68, selection.selected);
+	for (size_t i = 0; i < ITEMS; i++)
+		ASSERT_EQ(i % 3 == 0 || i == 1, is_selected(&selection, i));
+
+	/* Already selected: nothing changes */
+	type(ALT("a"));
+	ASSERT_SIZE_T_EQ(68, selection.selected);
+
+	/* Deselects the items out of the result set as well */
+	type(ALT("d"));
+	ASSERT_SIZE_T_EQ(0, selection.selected);
+	ASSERT_FALSE(is_selected(&selection, 1));
+
+	/* Without --multi, nothing is marked */
+	default_options.multi = 0;
+	type(ALT("a"));
+	ASSERT_SIZE_T_EQ(0, selection.selected);
+
+	PASS();
+}
+
+TEST selections_toggle_all_twice() {
+	type("x");
+	select_entry(&selection, 3);
+	select_entry(&selection, 4);
+
+	type(ALT("t"));
+	ASSERT_SIZE_T_EQ(66 + 1, selection.selected);
+	ASSERT_FALSE(is_selected(&selection, 3));
+	ASSERT(is_selected(&selection, 4));
+	ASSERT(is_selected(&selection, 198));
+
+	type(ALT("t"));
+	ASSERT_SIZE_T_EQ(2, selection.selected);
+	ASSERT(is_selected(&selection, 3));
+	ASSERT(is_selected(&selection, 4));
+	ASSERT_FALSE(is_selected(&selection, 198));
+
+	PASS();
+}
+
+TEST selections_toggle_range() {
+	type("x");
+
+	/* TAB marks the item at position 2 (item 6), and moves down. */
+	move_to(2);
+	type(TAB);
+	ASSERT(is_selected(&selection, 6));
+	ASSERT_SIZE_T_EQ(6, selection.anchor);
+
+	/* From the anchor (excluded) to the current item (included) */
+	move_to(7);
+	type(ALT("r"));
+	ASSERT_SIZE_T_EQ(6, selection.selected);
+	for (size_t i = 6; i <= 21; i += 3)
+		ASSERT(is_selected(&selection, i));
+	ASSERT_FALSE(is_selected(&selection, 3));
+	ASSERT_FALSE(is_selected(&selection, 24));
+	ASSERT_SIZE_T_EQ(21, selection.anchor);
+
+	/* The current item is the anchor now: only it is toggled. */
+	type(ALT("r"));
+	ASSERT_FALSE(is_selected(&selection, 21));
+	type(ALT("r"));
+	ASSERT(is_selected(&selection, 21));
+
+	/* Upwards */
+	move_to(4);
+	type(ALT("r"));
+	ASSERT_SIZE_T_EQ(3, selection.selected);
+	ASSERT(is_selected(&selection, 6));
+	ASSERT(is_selected(&selection, 9));
+	ASSERT(is_selected(&selection, 21));
+	ASSERT_SIZE_T_EQ(12, selection.anchor);
+
+	/* Over the whole result set, both ends included */
+	move_to(0);
+	type(TAB);
+	move_to(66);
+	type(ALT("r"));
+	ASSERT_SIZE_T_EQ(67 - 3, selection.selected);
+	ASSERT(is_selected(&selection, 0));
+	ASSERT(is_selected(&selection, 198));
+	ASSERT_FALSE(is_selected(&selection, 6));
+
+	PASS();
+}
+
+TEST selections_toggle_range_anchor() {
+	/* No anchor yet: only the current item is toggled. */
+	type("x");
+	move_to(3);
+	type(ALT("r"));
+	ASSERT_SIZE_T_EQ(1, selection.selected);
+	ASSERT(is_selected(&selection, 9));
+
+	/* The anchor (item 0) is not a match of "x1" anymore. */
+	move_to(0);
+	type(TAB "1");
+	ASSERT_SIZE_T_EQ(0, selection.anchor);
+	ASSERT_SIZE_T_EQ(12, choices_getindex(&choices, 0));
+	move_to(4);
+	type(ALT("r"));
+	ASSERT_SIZE_T_EQ(3, selection.selected);
+	ASSERT(is_selected(&selection, choices_getindex(&choices, 4)));
+	ASSERT_FALSE(is_selected(&selection, choices_getindex(&choices, 3)));
+
+	PASS();
+}
+
+SUITE(selections_suite) {
+	SET_SETUP(setup, NULL);
+	SET_TEARDOWN(teardown, NULL);
+
+	RUN_TEST(selections_bitmap);
+	RUN_TEST(selections_select_all);
+	RUN_TEST(selections_toggle_all_twice);
+	RUN_TEST(selections_toggle_range);
+	RUN_TEST(selections_toggle_range_anchor);
+}
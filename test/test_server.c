@@ -0,0 +1,263 @@
+/* test_server.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "options.h"
+#include "choices.h"
+#include "output.h"
+#include "server.h"
+
+#include "greatest/greatest.h"
+
+static options_t default_options;
+static choices_t choices;
+static session_t session;
+static output_t out;
+static int fds[2];
+static char response[65536]; /* What a pipe holds by default */
+
+static void setup(void *udata) {
+	(void)udata;
+
+	options_init(&default_options);
+	default_options.workers = 1;
+	choices_init(&choices, &default_options);
+	session_init(&session, &choices, 0);
+	if (pipe(fds) == -1)
+		abort();
+	output_init(&out, fds[1], '\n');
+}
+
+static void teardown(void *udata) {
+	(void)udata;
+
+	session_destroy(&session);
+	choices_destroy(&choices);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void
+add_strings(char **strings, const size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		choices_add(&choices, strings[i]);
+	choices_index(&choices);
+}
+
+/* Send the request in LINE to S, and return the response line (without
+ * its newline), or NULL if none was written. */
+static const char *
+request(session_t *s, const char *line)
+{
+	char buf[256];
+	size_t len = 0;
+
+	snprintf(buf, sizeof(buf), "%s", line);
+	if (session_request(s, &default_options, buf, &out) == -1)
+		return NULL;
+
+	while (len == 0 || response[len - 1] != '\n') {
+		const ssize_t n = read(fds[0], response + len,
+			sizeof(response) - len - 1);
+		if (n <= 0)
+			return NULL;
+		len += (size_t)n;
+	}
+
+	response[len - 1] = '\0';
+	return response;
+}
+
+TEST server_paging() {
+	char *strings[] = {"one", "two", "three", "four", "five"};
+	add_strings(strings, 5);
+
+	ASSERT_STR_EQ("{\"query\":\"\",\"total\":5,\"offset\":1,\"results\":["
+		"{\"text\":\"two\",\"index\":1,\"score\":-1e999,"
+		"\"positions\":[]},"
+		"{\"text\":\"three\",\"index\":2,\"score\":-1e999,"
+		"\"positions\":[]}]}", request(&session, "\t2\t1"));
+
+	/* A limit of zero lists all the matches */
+	ASSERT_STR_EQ("{\"query\":\"o\",\"total\":3,\"offset\":0,\"results\":["
+		"{\"text\":\"one\",\"index\":0,\"score\":0.890000,"
+		"\"positions\":[0]},"
+		"{\"text\":\"two\",\"index\":1,\"score\":-0.010000,"
+		"\"positions\":[2]},"
+		"{\"text\":\"four\",\"index\":3,\"score\":-0.015000,"
+		"\"positions\":[1]}]}", request(&session, "o\t0"));
+
+	ASSERT_STR_EQ("{\"query\":\"o\",\"total\":3,\"offset\":2,\"results\":["
+		"{\"text\":\"four\",\"index\":3,\"score\":-0.015000,"
+		"\"positions\":[1]}]}", request(&session, "o\t5\t2"));
+
+	ASSERT_STR_EQ("{\"query\":\"o\",\"total\":3,\"offset\":3,"
+		"\"results\":[]}",
+		request(&session, "o\t1\t3"));
+	ASSERT_STR_EQ("{\"query\":\"o\",\"total\":3,\"offset\":9,"
+		"\"results\":[]}",
+		request(&session, "o\t\t9"));
+
+	PASS();
+}
+
+TEST server_narrowing() {
+	static char strings[512][8];
+	char *ptrs[512];
+	static char narrowed[65536];
+	session_t fresh;
+
+	for (size_t i = 0; i < 512; i++) {
+		snprintf(strings[i], sizeof(strings[i]), "%c%c%c%zu",
+			"abc"[i % 3], "xab"[i % 5 % 3], "bay"[i % 7 % 3], i);
+		ptrs[i] = strings[i];
+	}
+	add_strings(ptrs, 512);
+
+	/* Searched in the matches of the previous query */
+	request(&session, "a");
+	request(&session, "ab");
+	snprintf(narrowed, sizeof(narrowed), "%s", request(&session, "ab2"));
+	ASSERT(strstr(narrowed, "\"total\":0,") == NULL);
+
+	/* Searched in all the strings */
+	session_init(&fresh, &choices, 1);
+	ASSERT_STR_EQ(narrowed, request(&fresh, "ab2"));
+
+	/* Narrowed again, in a shared session */
+	request(&fresh, "a");
+	ASSERT_STR_EQ(narrowed, request(&fresh, "ab2"));
+	session_destroy(&fresh);
+
+	/* Back to a shorter query */
+	snprintf(narrowed, sizeof(narrowed), "%s", request(&session, "a"));
+	session_init(&fresh, &choices, 1);
+	ASSERT_STR_EQ(narrowed, request(&fresh, "a"));
+	session_destroy(&fresh);
+
+	PASS();
+}
+
+TEST server_escaping() {
+	char *strings[] = {"a\"b", "a\\b", "a\x01" "b\x1f", "caf\xc3\xa9"};
+	add_strings(strings, 4);
+
+	ASSERT_STR_EQ("{\"query\":\"\",\"total\":4,\"offset\":0,\"results\":["
+		"{\"text\":\"a\\\"b\",\"index\":0,\"score\":-1e999,"
+		"\"positions\":[]},"
+		"{\"text\":\"a\\\\b\",\"index\":1,\"score\":-1e999,"
+		"\"positions\":[]},"
+		"{\"text\":\"a\\u0001b\\u001f\",\"index\":2,\"score\":-1e999,"
+		"\"positions\":[]},"
+		"{\"text\":\"caf\xc3\xa9\",\"index\":3,\"score\":-1e999,"
+		"\"positions\":[]}]}", request(&session, ""));
+
+	/* The query is escaped as well */
+	ASSERT_STR_EQ("{\"query\":\"\\\"\\\\\",\"total\":0,\"offset\":0,"
+		"\"results\":[]}", request(&session, "\"\\"));
+
+	/* Positions are byte offsets */
+	ASSERT_STR_EQ("{\"query\":\"\xc3\xa9\",\"total\":1,\"offset\":0,"
+		"\"results\":[{\"text\":\"caf\xc3\xa9\",\"index\":3,"
+		"\"score\":0.985000,\"positions\":[3]}]}",
+		request(&session, "\xc3\xa9"));
+
+	PASS();
+}
+
+TEST server_errors() {
+	const char *error = "{\"error\":\"Invalid request\"}";
+	char *strings[] = {"one", "two"};
+	add_strings(strings, 2);
+
+	ASSERT_STR_EQ(error, request(&session, "o\tx"));
+	ASSERT_STR_EQ(error, request(&session, "o\t1x"));
+	ASSERT_STR_EQ(error, request(&session, "o\t-1"));
+	ASSERT_STR_EQ(error, request(&session, "o\t1\t-1"));
+	ASSERT_STR_EQ(error, request(&session, "o\t1\t0\t"));
+	ASSERT_STR_EQ(error,
+		request(&session, "o\t99999999999999999999999999"));
+
+	/* The session is still usable */
+	ASSERT_STR_EQ("{\"query\":\"w\",\"total\":1,\"offset\":0,\"results\":["
+		"{\"text\":\"two\",\"index\":1,\"score\":-0.010000,"
+		"\"positions\":[1]}]}", request(&session, "w"));
+
+	PASS();
+}
+
+TEST server_reader() {
+	static char line[100000];
+	reader_t r = {NULL, 0, 0, 0, fds[0], 0};
+
+	memset(line, 'x', sizeof(line) - 1);
+	const pid_t pid = fork();
+	ASSERT(pid != -1);
+	if (pid == 0) {
+		/* Longer than what a single read returns */
+		const char *p = "one\n\ntwo\n";
+		if (write(fds[1], p, strlen(p)) == -1
+		|| write(fds[1], line, sizeof(line) - 1) == -1
+		|| write(fds[1], "\nlast", 5) == -1)
+			_exit(1);
+		_exit(0);
+	}
+	close(fds[1]);
+	fds[1] = -1;
+
+	ASSERT_STR_EQ("one", reader_next_line(&r));
+	ASSERT_STR_EQ("", reader_next_line(&r));
+	ASSERT_STR_EQ("two", reader_next_line(&r));
+	ASSERT_STR_EQ(line, reader_next_line(&r));
+	ASSERT_STR_EQ("last", reader_next_line(&r));
+	ASSERT_EQ(NULL, reader_next_line(&r));
+
+	free(r.buf);
+	waitpid(pid, NULL, 0);
+	PASS();
+}
+
+SUITE(server_suite) {
+	SET_SETUP(setup, NULL);
+	SET_TEARDOWN(teardown, NULL);
+
+	RUN_TEST(server_paging);
+	RUN_TEST(server_narrowing);
+	RUN_TEST(server_escaping);
+	RUN_TEST(server_errors);
+	RUN_TEST(server_reader);
+}
@@ -0,0 +1,245 @@
+/* test_snapshot.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "options.h"
+#include "choices.h"
+#include "snapshot.h"
+#include "search_index.h"
+
+#include "greatest/greatest.h"
+
+#define ASSERT_SIZE_T_EQ(a,b) ASSERT_EQ_FMT((size_t)(a), (b), "%zu")
+
+static options_t default_options;
+static char path[] = "/tmp/fnftest_snapshot.XXXXXX";
+
+static void setup(void *udata) {
+	(void)udata;
+
+	options_init(&default_options);
+	default_options.workers = 1;
+	close(mkstemp(path));
+}
+
+static void teardown(void *udata) {
+	(void)udata;
+
+	unlink(path);
+	memcpy(path + strlen(path) - 6, "XXXXXX", 6);
+}
+
+/* Write a snapshot of a few strings to PATH. */
+static int
+write_snapshot(void)
+{
+	char strings[][16] = {"foo", "bar/baz", "日本語", "x"};
+	choices_t c;
+	const char *error = NULL;
+
+	choices_init(&c, &default_options);
+	for (size_t i = 0; i < 4; i++)
+		choices_add(&c, strings[i]);
+	choices_index(&c);
+
+	const int ret = snapshot_write(&c, path, &error);
+	choices_destroy(&c);
+	return ret;
+}
+
+TEST snapshot_round_trip() {
+	choices_t c;
+	const char *error = NULL;
+
+	ASSERT_EQ(0, write_snapshot());
+
+	choices_init(&c, &default_options);
+	ASSERT_EQ(0, snapshot_load(&c, path, &error));
+	ASSERT_SIZE_T_EQ(4, c.size);
+	ASSERT_STR_EQ("foo", c.strings[0]);
+	ASSERT_STR_EQ("bar/baz", c.strings[1]);
+	ASSERT_STR_EQ("日本語", c.strings[2]);
+	ASSERT_STR_EQ("x", c.strings[3]);
+	ASSERT_EQ(6, c.widths[2]);
+
+	choices_search(&c, "bz", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&c));
+	ASSERT_STR_EQ("bar/baz", choices_get(&c, 0));
+
+	choices_destroy(&c);
+	PASS();
+}
+
+TEST snapshot_fields() {
+	choices_t c;
+	const char *error = NULL;
+
+	ASSERT_EQ(0, write_snapshot());
+
+	default_options.field_delimiter = "/";
+	default_options.nth = "2";
+	default_options.with_nth = "1";
+	choices_init(&c, &default_options);
+	ASSERT_EQ(0, snapshot_load(&c, path, &error));
+	ASSERT_STR_EQ("baz", choices_key(&c, 1));
+	ASSERT_EQ(3, c.widths[1]);
+	ASSERT_EQ(6, c.widths[2]);
+
+	choices_search(&c, "r", 1, 0);
+	ASSERT_SIZE_T_EQ(0, choices_available(&c));
+	choices_search(&c, "bz", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&c));
+	ASSERT_STR_EQ("bar/baz", choices_get(&c, 0));
+	ASSERT_STR_EQ("bar", choices_getview(&c, 0));
+
+	choices_destroy(&c);
+	PASS();
+}
+
+TEST snapshot_search_index() {
+	choices_t c;
+	const char *error = NULL;
+	size_t *candidates = NULL;
+
+	default_options.search_index = 1;
+	ASSERT_EQ(0, write_snapshot());
+
+	/* Loaded along: no string is left to index. */
+	choices_init(&c, &default_options);
+	ASSERT_EQ(0, snapshot_load(&c, path, &error));
+	ASSERT_SIZE_T_EQ(0, search_index_lookup(c.index, "zab", c.size,
+		&candidates));
+	free(candidates);
+	choices_destroy(&c);
+
+	/* Not with keys folded another way */
+	default_options.normalize = 1;
+	choices_init(&c, &default_options);
+	ASSERT_EQ(0, snapshot_load(&c, path, &error));
+	ASSERT_SIZE_T_EQ((size_t)-1, search_index_lookup(c.index, "zab", c.size,
+		&candidates));
+	choices_destroy(&c);
+	PASS();
+}
+
+TEST snapshot_folded_keys() {
+	char strings[][16] = {"Москва", "plain", "\x1b[1mбук\x1b[0m"};
+	choices_t c;
+	const char *error = NULL;
+
+	choices_init(&c, &default_options);
+	for (size_t i = 0; i < 3; i++)
+		choices_add(&c, strings[i]);
+	ASSERT_EQ(0, snapshot_write(&c, path, &error));
+	choices_destroy(&c);
+
+	/* Loaded as written: only strings that folding changes are copies. */
+	choices_init(&c, &default_options);
+	ASSERT_EQ(0, snapshot_load(&c, path, &error));
+	ASSERT(c.folded);
+	ASSERT_STR_EQ("москва", c.folded[0]);
+	ASSERT_EQ(c.strings[1], c.folded[1]);
+	ASSERT_EQ(1, c.sgr);
+	choices_search(&c, "МОСКВА", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&c));
+	choices_search(&c, "БУК", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&c));
+	choices_destroy(&c);
+
+	/* Folded again, the other way */
+	default_options.normalize = 1;
+	choices_init(&c, &default_options);
+	ASSERT_EQ(0, snapshot_load(&c, path, &error));
+	choices_search(&c, "москва", 1, 0);
+	ASSERT_SIZE_T_EQ(1, choices_available(&c));
+	choices_destroy(&c);
+	PASS();
+}
+
+TEST snapshot_corrupted() {
+	choices_t c;
+	const char *error = NULL;
+
+	ASSERT_EQ(0, write_snapshot());
+
+	/* Flip a byte of the arena */
+	FILE *fp = fopen(path, "r+b");
+	ASSERT(fp);
+	fseek(fp, -20, SEEK_END);
+	const int ch = fgetc(fp);
+	fseek(fp, -20, SEEK_END);
+	fputc(ch ^ 1, fp);
+	fclose(fp);
+
+	choices_init(&c, &default_options);
+	ASSERT_EQ(-1, snapshot_load(&c, path, &error));
+	ASSERT(error);
+	ASSERT_SIZE_T_EQ(0, c.size);
+	choices_destroy(&c);
+	PASS();
+}
+
+TEST snapshot_not_a_snapshot() {
+	choices_t c;
+	const char *error = NULL;
+
+	FILE *fp = fopen(path, "w");
+	ASSERT(fp);
+	fputs("just\na\nlist\nof\nstrings\nlong\nenough\nfor\na\nheader\n"
+		"and\nthen\nsome\nmore\nlines\nto\nbe\nsure\n", fp);
+	fclose(fp);
+
+	fp = fopen(path, "r");
+	ASSERT_EQ(0, snapshot_check(fp));
+	fclose(fp);
+
+	choices_init(&c, &default_options);
+	ASSERT_EQ(-1, snapshot_load(&c, path, &error));
+	ASSERT_STR_EQ("Not a snapshot", error);
+	choices_destroy(&c);
+	PASS();
+}
+
+SUITE(snapshot_suite) {
+	SET_SETUP(setup, NULL);
+	SET_TEARDOWN(teardown, NULL);
+
+	RUN_TEST(snapshot_round_trip);
+	RUN_TEST(snapshot_fields);
+	RUN_TEST(snapshot_search_index);
+	RUN_TEST(snapshot_folded_keys);
+	RUN_TEST(snapshot_corrupted);
+	RUN_TEST(snapshot_not_a_snapshot);
+}
@@ -0,0 +1,213 @@
+/* test_tty.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tty.h"
+
+#include "greatest/greatest.h"
+
+#define ASSERT_SIZE_T_EQ(a,b) ASSERT_EQ_FMT((size_t)(a), (b), "%zu")
+
+#define PIPE_SIZE 4096
+
+static tty_t tty;
+static int master = -1; /* Of the pseudo-terminal tty reads from */
+static int pipe_out = -1; /* Read end of the pipe tty writes to */
+static char written[65536]; /* What was read from it */
+static size_t written_len;
+
+/* Open the tty on a pseudo-terminal, but have it write to a pipe which
+ * only holds a page: a terminal slower than the frames drawn. */
+static void setup(void *udata) {
+	(void)udata;
+
+	int fds[2];
+	memset(&tty, 0, sizeof(tty));
+	written_len = 0;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1
+	|| pipe(fds) == -1) {
+		master = -1;
+		return;
+	}
+
+	tty_init(&tty, ptsname(master));
+	tty_cancel_frame(&tty); /* Initial attributes */
+
+	fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+	dup2(fds[1], tty.fdout);
+	close(fds[1]);
+	fcntl(tty.fdout, F_SETFL, fcntl(tty.fdout, F_GETFL) | O_NONBLOCK);
+
+	pipe_out = fds[0];
+	fcntl(pipe_out, F_SETFL, fcntl(pipe_out, F_GETFL) | O_NONBLOCK);
+}
+
+static void teardown(void *udata) {
+	(void)udata;
+
+	if (master == -1)
+		return;
+
+	/* Closing writes whatever is left: make room for it. */
+	tty_cancel_frame(&tty);
+	while (tty_output_pending(&tty) == 1) {
+		char buf[PIPE_SIZE];
+		if (read(pipe_out, buf, sizeof(buf)) == -1)
+			break;
+		tty_drain(&tty);
+	}
+
+	tty_close(&tty);
+	close(pipe_out);
+	close(master);
+	master = pipe_out = -1;
+}
+
+/* Read up to MAX bytes of what the tty wrote. Return the number read. */
+static size_t
+read_written(const size_t max)
+{
+	const size_t room = sizeof(written) - written_len;
+	const ssize_t n = read(pipe_out, written + written_len,
+		max < room ? max : room);
+	if (n <= 0)
+		return 0;
+
+	written_len += (size_t)n;
+	return (size_t)n;
+}
+
+/* Compose a frame made of LEN bytes of CH, and flush it. */
+static void
+draw_frame(const char ch, const size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		tty_putc(&tty, ch);
+	tty_flush(&tty);
+}
+
+/* Return 1 if WRITTEN, from OFF on, holds LEN bytes of CH, or 0
+ * otherwise. */
+static int
+written_run(const size_t off, const char ch, const size_t len)
+{
+	if (off + len > written_len)
+		return 0;
+
+	for (size_t i = off; i < off + len; i++) {
+		if (written[i] != ch)
+			return 0;
+	}
+
+	return 1;
+}
+
+TEST tty_queued_frame_replaced() {
+	if (master == -1)
+		SKIP();
+
+	/* More than the pipe holds: part of it stays in flight. */
+	draw_frame('a', PIPE_SIZE + 1000);
+	ASSERT_EQ(1, tty_output_pending(&tty));
+
+	/* Both wait behind it, the newer one replacing the older. */
+	draw_frame('b', 100);
+	draw_frame('c', 200);
+	ASSERT_EQ(1, tty_output_pending(&tty));
+
+	while (read_written(PIPE_SIZE) > 0 || tty_output_pending(&tty) == 1)
+		tty_drain(&tty);
+	read_written(PIPE_SIZE);
+
+	ASSERT_SIZE_T_EQ(PIPE_SIZE + 1000 + 200, written_len);
+	ASSERT(written_run(0, 'a', PIPE_SIZE + 1000));
+	ASSERT(written_run(PIPE_SIZE + 1000, 'c', 200));
+
+	/* Nothing in flight: written right away */
+	draw_frame('d', 10);
+	ASSERT_EQ(0, tty_output_pending(&tty));
+	ASSERT_SIZE_T_EQ(10, read_written(PIPE_SIZE));
+	ASSERT(written_run(PIPE_SIZE + 1200, 'd', 10));
+
+	PASS();
+}
+
+TEST tty_write_resumed() {
+	if (master == -1)
+		SKIP();
+
+	static char frame[PIPE_SIZE * 5 + 123];
+	const size_t len = sizeof(frame);
+	for (size_t i = 0; i < len; i++)
+		frame[i] = (char)('A' + i % 23);
+	for (size_t i = 0; i < len; i++)
+		tty_putc(&tty, frame[i]);
+	tty_flush(&tty);
+	ASSERT_EQ(1, tty_output_pending(&tty));
+
+	/* Still blocked: nothing changes. */
+	tty_drain(&tty);
+	ASSERT_EQ(1, tty_output_pending(&tty));
+	ASSERT_SIZE_T_EQ(PIPE_SIZE, read_written(sizeof(written)));
+
+	/* Resumed where it stopped, a little at a time */
+	while (tty_output_pending(&tty) == 1) {
+		read_written(1000);
+		tty_drain(&tty);
+	}
+	while (read_written(PIPE_SIZE) > 0);
+
+	ASSERT_SIZE_T_EQ(len, written_len);
+	ASSERT_MEM_EQ(frame, written, len);
+
+	/* A frame composed but cancelled is never written. */
+	tty_putc(&tty, 'x');
+	tty_cancel_frame(&tty);
+	tty_flush(&tty);
+	ASSERT_SIZE_T_EQ(0, read_written(PIPE_SIZE));
+
+	PASS();
+}
+
+SUITE(tty_suite) {
+	SET_SETUP(setup, NULL);
+	SET_TEARDOWN(teardown, NULL);
+
+	RUN_TEST(tty_queued_frame_replaced);
+	RUN_TEST(tty_write_resumed);
+}
@@ -0,0 +1,190 @@
+/* test_utf8.c */
+
+/*
+ * This file is part of fnf
+ *
+ * Copyright (C) 2022-2025, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+* The MIT License (MIT)
+
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* 
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+* 
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fold.h"
+#include "match.h" /* MATCH_MAX_LEN */
+#include "utf8.h"
+
+#include "greatest/greatest.h"
+
+#define ASSERT_SIZE_T_EQ(a,b) ASSERT_EQ_FMT((size_t)(a), (b), "%zu")
+
+TEST utf8_decode_valid() {
+	uint32_t cp = 0;
+
+	ASSERT_SIZE_T_EQ(1, utf8_decode("a", &cp));
+	ASSERT_EQ(0x61, cp);
+	ASSERT_SIZE_T_EQ(2, utf8_decode("é", &cp));
+	ASSERT_EQ(0xe9, cp);
+	ASSERT_SIZE_T_EQ(3, utf8_decode("日", &cp));
+	ASSERT_EQ(0x65e5, cp);
+	ASSERT_SIZE_T_EQ(4, utf8_decode("😀", &cp));
+	ASSERT_EQ(0x1f600, cp);
+	PASS();
+}
+
+TEST utf8_decode_invalid() {
+	uint32_t cp = 0;
+
+	/* Stray continuation byte */
+	ASSERT_SIZE_T_EQ(1, utf8_decode("\x80", &cp));
+	ASSERT_EQ(UTF8_INVALID, cp);
+	/* Truncated sequence */
+	ASSERT_SIZE_T_EQ(1, utf8_decode("\xe6\x97", &cp));
+	ASSERT_EQ(UTF8_INVALID, cp);
+	/* Overlong encoding of '/' */
+	ASSERT_SIZE_T_EQ(1, utf8_decode("\xc0\xaf", &cp));
+	ASSERT_EQ(UTF8_INVALID, cp);
+	PASS();
+}
+
+TEST utf8_cp_widths() {
+	ASSERT_SIZE_T_EQ(1, utf8_cp_width('a'));
+	ASSERT_SIZE_T_EQ(1, utf8_cp_width(0xe9)); /* é */
+	ASSERT_SIZE_T_EQ(0, utf8_cp_width(0x301)); /* Combining acute accent */
+	ASSERT_SIZE_T_EQ(0, utf8_cp_width(0x200b)); /* Zero width space */
+	ASSERT_SIZE_T_EQ(2, utf8_cp_width(0x65e5)); /* 日 */
+	ASSERT_SIZE_T_EQ(2, utf8_cp_width(0xff21)); /* Fullwidth A */
+	ASSERT_SIZE_T_EQ(2, utf8_cp_width(0x1f600)); /* 😀 */
+	PASS();
+}
+
+TEST utf8_clusters() {
+	size_t w = 0;
+
+	/* e + combining acute accent */
+	ASSERT_SIZE_T_EQ(3, utf8_cluster("e\xcc\x81x", &w));
+	ASSERT_SIZE_T_EQ(1, w);
+
+	/* Family: man ZWJ woman ZWJ girl */
+	const char *family = "\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9"
+		"\xe2\x80\x8d\xf0\x9f\x91\xa7";
+	ASSERT_SIZE_T_EQ(strlen(family), utf8_cluster(family, &w));
+	ASSERT_SIZE_T_EQ(2, w);
+
+	/* Flag: two regional indicators, followed by a third one */
+	const char *flags = "\xf0\x9f\x87\xa6\xf0\x9f\x87\xb7\xf0\x9f\x87\xa6";
+	ASSERT_SIZE_T_EQ(8, utf8_cluster(flags, &w));
+	ASSERT_SIZE_T_EQ(2, w);
+	PASS();
+}
+
+TEST utf8_string_width() {
+	ASSERT_SIZE_T_EQ(0, utf8_width(""));
+	ASSERT_SIZE_T_EQ(5, utf8_width("hello"));
+	ASSERT_SIZE_T_EQ(8, utf8_width("日本語ab"));
+	ASSERT_SIZE_T_EQ(4, utf8_width("cafe\xcc\x81"));
+	/* SGR sequences take no space */
+	ASSERT_SIZE_T_EQ(3, utf8_width("\x1b[1;31mred\x1b[0m"));
+	PASS();
+}
+
+TEST utf8_partial_width() {
+	ASSERT_SIZE_T_EQ(2, utf8_nwidth("日本語", 3));
+	ASSERT_SIZE_T_EQ(4, utf8_nwidth("日本語", 6));
+	ASSERT_SIZE_T_EQ(3, utf8_nwidth("abc", 10));
+	PASS();
+}
+
+TEST fold_case() {
+	char *s;
+	/* ASCII is left as is, and so are strings folding to themselves. */
+	ASSERT_EQ(NULL, fold_string("Makefile", FOLD_CASE));
+	ASSERT_EQ(NULL, fold_string("москва", FOLD_CASE));
+
+	ASSERT_STR_EQ("москва/документы", s = fold_string("МОСКВА/Документы",
+		FOLD_CASE));
+	free(s);
+	/* ẞ (3 bytes) folds to ß (2), KELVIN SIGN to 'k' */
+	ASSERT_STR_EQ("STRAßE", s = fold_string("STRAẞE", FOLD_CASE));
+	free(s);
+	ASSERT_STR_EQ("k", s = fold_string("\xe2\x84\xaa", FOLD_CASE));
+	free(s);
+	ASSERT_STR_EQ("λόγοσ", s = fold_string("ΛΌΓΟς", FOLD_CASE));
+	free(s);
+
+	ASSERT(fold_has_upper("Über"));
+	ASSERT(!fold_has_upper("λόγος"));
+	ASSERT(!fold_has_upper("ABC"));
+	PASS();
+}
+
+TEST fold_decompose() {
+	char *s;
+	ASSERT_STR_EQ("cafe\xcc\x81", s = fold_string("café", FOLD_NFD));
+	free(s);
+	ASSERT_STR_EQ("E\xcc\x81", s = fold_string("É", FOLD_NFD));
+	free(s);
+	ASSERT_STR_EQ("\xce\xb1\xcc\x81", s = fold_string("Ά",
+		FOLD_CASE | FOLD_NFD));
+	free(s);
+	/* Hangul syllables, algorithmically */
+	ASSERT_STR_EQ("\xe1\x84\x92\xe1\x85\xa1\xe1\x86\xab",
+		s = fold_string("한", FOLD_NFD));
+	free(s);
+	ASSERT_EQ(NULL, fold_string("cafe\xcc\x81", FOLD_NFD));
+	PASS();
+}
+
+TEST fold_positions() {
+	/* "_k" in "_\xe2\x84\xaa": the three bytes of KELVIN SIGN */
+	size_t positions[MATCH_MAX_LEN] = {0, 1, (size_t)-1};
+	fold_map_positions("_\xe2\x84\xaa", FOLD_CASE, positions);
+	ASSERT_SIZE_T_EQ(0, positions[0]);
+	ASSERT_SIZE_T_EQ(1, positions[1]);
+	ASSERT_SIZE_T_EQ(3, positions[3]);
+	ASSERT_SIZE_T_EQ((size_t)-1, positions[4]);
+
+	/* "e" and its accent in "cafe\xcc\x81.txt" decomposed from "é.txt":
+	 * "é" once, then the 't' after it */
+	size_t more[MATCH_MAX_LEN] = {3, 4, 5, 7, (size_t)-1};
+	fold_map_positions("café.txt", FOLD_NFD, more);
+	ASSERT_SIZE_T_EQ(3, more[0]);
+	ASSERT_SIZE_T_EQ(4, more[1]);
+	ASSERT_SIZE_T_EQ(6, more[2]);
+	ASSERT_SIZE_T_EQ((size_t)-1, more[3]);
+	PASS();
+}
+
+SUITE(utf8_suite) {
+	RUN_TEST(utf8_decode_valid);
+	RUN_TEST(utf8_decode_invalid);
+	RUN_TEST(utf8_cp_widths);
+	RUN_TEST(utf8_clusters);
+	RUN_TEST(utf8_string_width);
+	RUN_TEST(utf8_partial_width);
+
+	RUN_TEST(fold_case);
+	RUN_TEST(fold_decompose);
+	RUN_TEST(fold_positions);
+}